@@ -17,10 +17,15 @@ classdef AMDWindow
     % WindowEnd - End Time of the window. (s)
     % ZScore - Calculated AMD z-scores.
     % AMD - Calculated AMD table.
+    % PValue - Empirical p-values of the AMD against surrogate data.
+    % Percentile - Percentiles of the AMD within the surrogate data.
     %
     % AMDWINDOW Methods:
     % array2table - Converts an AMDWindow array to a table.
     % table2array - Converts a AMDWindow table into an array.
+    % saveresults - Saves an AMDWindow array to a compact result file.
+    % loadresults - Loads an AMDWindow array from a result file.
+    % savematresults - Saves an AMDWindow array to a result file beside a .mat file.
     
     %% Public Properties
     properties
@@ -52,6 +57,13 @@ classdef AMDWindow
         
         % Calculated AMD table.
         AMD = []        
+        
+        % Empirical p-values of the AMD table against jittered or shuffled
+        % surrogate data.  Empty unless surrogates were requested.
+        PValue = []
+        
+        % Percentile of each AMD within its surrogate AMDs.
+        Percentile = []
     end
     
     properties (Dependent = true)
@@ -110,5 +122,8 @@ classdef AMDWindow
     methods (Static = true)
         windowTable = array2table(windowArray)
         windowArray = table2array(windowTable)
+        saveresults(fileName, windowArray, precision)
+        windowArray = loadresults(fileName, indices)
+        [amdResultsFile, windowArray] = savematresults(matFileName, windowArray)
     end
 end
@@ -31,7 +31,7 @@ nWindows = length(windowArray);
 
 % List of AMDWindow variables we want to stick in the table.
 variableList = {'WindowStart', 'WindowEnd', 'TimeMin', 'TimeMax', ...
-    'TimeDiff', 'Stats', 'ZScore', 'AMD'};
+    'TimeDiff', 'Stats', 'ZScore', 'AMD', 'PValue', 'Percentile'};
 nVariables = length(variableList);
 
 % For every variable we listed above, create a column for all windows in
@@ -0,0 +1,83 @@
+function windowArray = loadresults(fileName, indices)
+% LOADRESULTS  Loads an AMDWindow array from a result file.
+%
+% Syntax:
+% windowArray = LOADRESULTS(fileName)
+% windowArray = LOADRESULTS(fileName, indices)
+%
+% Description:
+% Rebuilds AMDWindows written by SAVERESULTS.  The file is memory mapped
+% by the engine and only the requested windows are read from it.  A .mat
+% file saved by dynamical or dynamical_cli can also be given, in which case
+% its amdWindows are returned, or the windows of the result file it points
+% to if they were saved to one.
+%
+% Input:
+% fileName (string) - Name of the .amdr result file or .mat file.
+% indices (integer vector) - Which windows to load.  Default: all
+%
+% Output:
+% windowArray (AMDWindow array) - The windows, in the order of indices.
+%
+% See also AMDWINDOW SAVERESULTS
+
+narginchk(1, 2);
+
+validateattributes(fileName, {'char' 'string'}, {'nonempty'}, mfilename, 'fileName', 1);
+fileName = char(fileName);
+
+[p, ~, ext] = fileparts(fileName);
+if strcmpi(ext, '.mat')
+    data = load(fileName);
+    if isfield(data, 'amdResultsFile') && ~isempty(data.amdResultsFile)
+        % The result file is saved next to the .mat file.
+        [~, f, e] = fileparts(data.amdResultsFile);
+        fileName = fullfile(p, [f e]);
+    else
+        assert(isfield(data, 'amdWindows'), 'loadresults:noWindows', ...
+            '%s does not contain any AMD windows.', fileName);
+        windowArray = data.amdWindows;
+        if nargin == 2
+            windowArray = windowArray(indices);
+        end
+        return;
+    end
+end
+
+store = dynamical_inputs.nex.ResultStore(fileName);
+if nargin < 2
+    indices = 1:store.NumWindows;
+end
+rawWindows = store.read(indices);
+windowInfo = store.WindowInfo(indices,:);
+allNames = store.NeuronNames;
+allIDs = store.CellIDs;
+store.close();
+
+nWindows = length(rawWindows);
+matrixNames = {'AMD' 'ZScore' 'PValue' 'Percentile'};
+windowArray = repmat(dynamical.math.AMDWindow, 1, nWindows);
+for i = 1:nWindows
+    r = rawWindows(i);
+    names = allNames(r.Neurons);
+    
+    w = dynamical.math.AMDWindow;
+    w.WindowStart = windowInfo(i,1);
+    w.WindowEnd = windowInfo(i,2);
+    w.TimeMin = windowInfo(i,3);
+    w.TimeMax = windowInfo(i,4);
+    w.TimeDiff = windowInfo(i,5);
+    w.MinSpikeCount = windowInfo(i,6);
+    w.Stats = array2table([allIDs(r.Neurons) r.Stats], ...
+        'VariableNames', {'CellID' 'nSpikes' 'ISImean' 'ISIstd' 'Poisson'}, ...
+        'RowNames', names);
+    
+    for j = 1:length(matrixNames)
+        if ~isempty(r.(matrixNames{j}))
+            w.(matrixNames{j}) = array2table(r.(matrixNames{j}), ...
+                'VariableNames', names, 'RowNames', names);
+        end
+    end
+    
+    windowArray(i) = w;
+end
@@ -0,0 +1,37 @@
+function [amdResultsFile, windowArray] = savematresults(matFileName, windowArray)
+% SAVEMATRESULTS  Saves an AMDWindow array to a result file beside a .mat file.
+%
+% Syntax:
+% [amdResultsFile, windowArray] = SAVEMATRESULTS(matFileName, windowArray)
+%
+% Description:
+% With the NEX engine, the windows go to a result file next to the .mat
+% file, which is a fraction of the size of their tables and can be loaded
+% back a window at a time with LOADRESULTS.  The windows are then returned
+% empty so only the result file's name needs saving in the .mat file.
+% Without the engine, or with no windows, nothing is written and the
+% windows are returned as they are.
+%
+% Input:
+% matFileName (string) - Name of the .mat file the results belong to.
+% windowArray (AMDWindow array) - Windows processed by dynamical.math.amd.
+%
+% Output:
+% amdResultsFile (string) - Name of the result file relative to the folder
+%     of the .mat file, or '' if none was written.
+% windowArray (AMDWindow array) - Windows left to save in the .mat file.
+%
+% See also AMDWINDOW SAVERESULTS LOADRESULTS
+
+narginchk(2, 2);
+
+amdResultsFile = '';
+if isempty(windowArray) || ~dynamical_inputs.nex.isengineavailable
+    return;
+end
+
+[p, f] = fileparts(matFileName);
+amdResultsFile = [f '.amdr'];
+dynamical.math.AMDWindow.saveresults(fullfile(p, amdResultsFile), windowArray);
+windowArray = [];
+end
@@ -0,0 +1,64 @@
+function saveresults(fileName, windowArray, precision)
+% SAVERESULTS  Saves an AMDWindow array to a compact result file.
+%
+% Syntax:
+% SAVERESULTS(fileName, windowArray)
+% SAVERESULTS(fileName, windowArray, precision)
+%
+% Description:
+% Writes the windows with dynamical_inputs.nex.writeresultstore rather than
+% as MATLAB tables.  The neuron names are stored once for the whole file
+% and each window keeps only the indices of its neurons, its stats and its
+% matrices, followed by an index of the windows so any one of them can be
+% read back on its own with LOADRESULTS.  Requires the NEX engine.
+%
+% Input:
+% fileName (string) - Name of the result file, normally ending in .amdr.
+% windowArray (AMDWindow array) - Windows processed by dynamical.math.amd.
+% precision (string) - 'single' or 'double' storage of the matrices.
+%     Default: the class of the first window's AMD values
+%
+% See also AMDWINDOW LOADRESULTS
+
+narginchk(2, 3);
+
+validateattributes(windowArray, {'dynamical.math.AMDWindow'}, ...
+    {'nonempty' 'vector'}, mfilename, 'windowArray', 2);
+
+if nargin < 3
+    precision = class(windowArray(1).AMD{:,:});
+end
+
+nWindows = length(windowArray);
+
+% Build the neuron dictionary.  The cell IDs index the neurons of the NEX
+% file, so each one keeps the same name in every window.
+windowIDs = arrayfun(@(x) x.Stats.CellID, windowArray, 'UniformOutput', false);
+windowNames = arrayfun(@(x) x.Stats.Properties.RowNames, windowArray, 'UniformOutput', false);
+[cellIDs, iFirst] = unique(vertcat(windowIDs{:}));
+allNames = vertcat(windowNames{:});
+neuronNames = allNames(iFirst);
+
+neurons = cell(nWindows, 1);
+stats = cell(nWindows, 1);
+matrices = cell(nWindows, 4);
+matrixNames = {'AMD' 'ZScore' 'PValue' 'Percentile'};
+for i = 1:nWindows
+    w = windowArray(i);
+    [~, neurons{i}] = ismember(windowIDs{i}, cellIDs);
+    stats{i} = w.Stats{:, {'nSpikes' 'ISImean' 'ISIstd' 'Poisson'}};
+    
+    % PValue and Percentile are only tables if surrogates were requested.
+    for j = 1:length(matrixNames)
+        if istable(w.(matrixNames{j}))
+            matrices{i,j} = w.(matrixNames{j}){:,:};
+        end
+    end
+end
+
+windowInfo = [[windowArray.WindowStart]' [windowArray.WindowEnd]' ...
+    [windowArray.TimeMin]' [windowArray.TimeMax]' [windowArray.TimeDiff]' ...
+    [windowArray.MinSpikeCount]'];
+
+dynamical_inputs.nex.writeresultstore(fileName, neuronNames, cellIDs, windowInfo, ...
+    neurons, stats, matrices, precision);
@@ -26,9 +26,29 @@ function amdWindows = amd(input1, varargin)
 %     Default: 6
 % 'MinValidNeurons' (scalar) - Minimum number of valid neurons in a
 %     time window for it to be considered for analysis.  Default: 3
+% 'OutputFormat' (string) - 'array' to return an AMDWindow array, 'table'
+%     to return it as a table, or 'stability' to only return the neighbor
+%     stability of the windows.  Default: 'array'
 % 'Parallel' (logical) - If true, then MATLAB's parallel toolbox will be
 %     used to process the data.  Default: true
+% 'Precision' (string) - Class used to store the AMD and ZScore tables,
+%     either 'double' or 'single'.  Use 'single' to halve the memory used
+%     by recordings with a large number of units.  Default: 'double'
+% 'Seed' (scalar) - Seed of the random numbers used for the surrogates.
+%     Default: 0
 % 'StartTime' (scalar) - Start time of the analysis. (s)  Default: 0
+% 'SurrogateMethod' (string) - How the surrogates are made, either
+%     'jitter' or 'shuffle'.  See dynamical_inputs.nex.surrogateamd.
+%     Default: 'jitter'
+% 'Surrogates' (scalar) - If non-zero, the number of surrogate versions
+%     of each window used to fill in the PValue and Percentile tables of
+%     the windows.  Requires the NEX engine and can't be used with the
+%     'stability' output format.  Default: 0
+% 'JitterWidth' (scalar) - Largest amount a spike is moved by in a jitter
+%     surrogate. (s)  Default: 0.005
+% 'UseEngine' (logical) - If false, the MATLAB implementation is used even
+%     when the NEX engine is built, e.g. to check the engine's results
+%     against it.  Default: true if the engine is built
 % 'WindowSize' (scalar) - The size of a single analysis window. (s)
 %     Default: 60
 % 'WindowStep' (scalar) - The amount to increment the analysis from the
@@ -36,7 +56,9 @@ function amdWindows = amd(input1, varargin)
 %
 % Output:
 % amdWindows (dynamical.math.AMDWindow array) - The results for each
-%     window of data.
+%     window of data.  For the 'stability' output format, a struct with
+%     the fields 'data' and 'times' holding the neighbor stability values
+%     and times, as returned by dynamical.math.stability.
 %
 % Examples:
 % % Process a file and pass some options.
@@ -60,12 +82,18 @@ defaults.minPersistence = 0;
 defaults.minValidNeurons = 3;
 defaults.outputFormat = 'array';
 defaults.parallel = true;
+defaults.precision = 'double';
 defaults.showWaitbar = false;
 defaults.windowSize = 60;
 defaults.windowStep = 60;
 defaults.startTime = 0;
 defaults.endTime = Inf;
 defaults.intervals = [];
+defaults.surrogates = 0;
+defaults.surrogateMethod = 'jitter';
+defaults.jitterWidth = 0.005;
+defaults.seed = 0;
+defaults.useEngine = dynamical_inputs.nex.isengineavailable;
 
 % Filename/FileID
 validator = @(x) validateattributes(x, {'char' 'string' 'numeric'}, ...
@@ -117,16 +145,54 @@ addParameter(p, 'OutputFormat', defaults.outputFormat, validator);
 validator = @(x) validateattributes(x, {'logical'}, {'scalar' 'nonempty'});
 addParameter(p, 'Parallel', defaults.parallel, validator);
 
+% Precision of the AMD and ZScore tables.
+validator = @(x) any(validatestring(x, {'double' 'single'}));
+addParameter(p, 'Precision', defaults.precision, validator);
+
 % Waitbar toggle
 validator = @(x) validateattributes(x, {'logical' 'matlab.ui.Figure'}, ...
     ParserAttribute.ScalarNotEmpty.toCell);
 addParameter(p, 'ShowWaitbar', defaults.showWaitbar, validator);
 
+% Number of surrogates for the empirical null distributions.
+validator = @(x) validateattributes(x, {'numeric'}, ...
+    ParserAttribute.ScalarNotEmpty.toCell('integer', '>=', 0));
+addParameter(p, 'Surrogates', defaults.surrogates, validator);
+
+% Surrogate method
+validator = @(x) any(validatestring(x, {'jitter' 'shuffle'}));
+addParameter(p, 'SurrogateMethod', defaults.surrogateMethod, validator);
+
+% Jitter width
+validator = @(x) validateattributes(x, {'numeric'}, ...
+    ParserAttribute.ScalarNotEmpty.toCell('>=', 0));
+addParameter(p, 'JitterWidth', defaults.jitterWidth, validator);
+
+% Surrogate random number seed
+validator = @(x) validateattributes(x, {'numeric'}, ...
+    ParserAttribute.ScalarNotEmpty.toCell('integer', '>=', 0));
+addParameter(p, 'Seed', defaults.seed, validator);
+
+% NEX engine toggle
+validator = @(x) validateattributes(x, {'logical'}, {'scalar' 'nonempty'});
+addParameter(p, 'UseEngine', defaults.useEngine, validator);
+
 parse(p, input1, varargin{:});
 
-assert(ismember(lower(p.Results.OutputFormat), {'array' 'table'}), ...
+assert(ismember(lower(p.Results.OutputFormat), {'array' 'table' 'stability'}), ...
     'amd:inputError', 'Invalid output format: %s', p.Results.OutputFormat);
 
+% The stability output doesn't keep the windows, so there's nowhere to put
+% the surrogate p-values and percentiles.
+assert(p.Results.Surrogates == 0 || ~strcmpi(p.Results.OutputFormat, 'stability'), ...
+    'amd:inputError', 'Surrogates can''t be used with the ''stability'' output format.');
+
+% If the NEX engine has been built, the spike selection and the AMDs are
+% done natively.  Otherwise, we fall back to the MATLAB implementation.
+useEngine = p.Results.UseEngine;
+assert(~useEngine || dynamical_inputs.nex.isengineavailable, ...
+    'amd:inputError', 'The NEX engine is not built.');
+
 %% Setup
 
 if islogical(p.Results.ShowWaitbar)
@@ -152,7 +218,7 @@ end
 % If an end time wasn't specified, then we'll set it to be the maximum file
 % duration found in the NEX file's file header.
 if p.Results.EndTime == Inf
-    fileHeader = dynamical_inputs.readfileheader(fid);
+    fileHeader = dynamical_inputs.readfileheader(input1);
     endTime = fileHeader.tend;
 else
     endTime = p.Results.EndTime;
@@ -171,9 +237,18 @@ nWindows = length(endTimes);
 
 if isempty(p.Results.Intervals)
     intervalTimes = [];
+elseif useEngine && (ischar(input1) || isstring(input1)) && ...
+        strcmp(dynamical_inputs.determine_input_type(input1), 'NEX')
+    % Read the intervals in the engine and sort them by start time, the same
+    % as below.  The engine commands merge overlapping intervals themselves
+    % and keep zero length ones, which select a spike at exactly that time.
+    % intervalset('union') would drop those.
+    intervalSets = dynamical_inputs.nex.getintervalsets(input1, p.Results.Intervals, true);
+    intervalTimes = sortrows(vertcat(intervalSets{:}), 1);
+    intervalTimes = array2table(intervalTimes, 'VariableNames', {'Start' 'End'});
 else
     % Get the time boundaries for all intervals specified.
-    intervalTimes = cellfun(@(x) {dynamical_inputs.getintervaltimes(fid, x, true)}, ...
+    intervalTimes = cellfun(@(x) {dynamical_inputs.getintervaltimes(input1, x, true)}, ...
         cellstr(p.Results.Intervals));
     
     % Concatenate all the returned interval times and sort them by the
@@ -186,24 +261,34 @@ end
 % parfor loop in the AMD section.
 timestamps = neuronData.timestamps;
 minSpikeCount = p.Results.MinSpikeCount;
+precision = validatestring(p.Results.Precision, {'double' 'single'});
 
 %% Filter Neurons
 % Filter our neurons we don't want to analyze.  We only want neurons that
 % meet our minimum spike count threshold and exist across all windows.
 
-% Loop over all windows and create a running list of spike counts for each
-% neuron in each window.
-spikeCounts = zeros(nNeurons, nWindows);
-for iWindow = 1:nWindows
-    % Create a logical index of valid spike times for each neuron given the
-    % time window.
-    iValid = cellfun(@(x) filterspikes(x, intervalTimes, startTimes(iWindow), endTimes(iWindow)), ...
-         timestamps, 'UniformOutput', false);
-    assert(length(iValid) == nNeurons);
-    
-    % Calculate the spike counts for each neuron and add it to our running
-    % list of spike counts.
-    spikeCounts(:, iWindow) = cellfun(@sum, iValid);
+% With the NEX engine, the spike selection is done natively by merging each
+% spike train against the sorted intervals.  Otherwise, we fall back to
+% building logical masks in MATLAB.
+if useEngine
+    % Get the spike counts for each neuron in each window in one go.
+    spikeCounts = dynamical_inputs.nex.selectspikes(timestamps, intervalTimes, ...
+        [startTimes(:) endTimes(:)]);
+else
+    % Loop over all windows and create a running list of spike counts for
+    % each neuron in each window.
+    spikeCounts = zeros(nNeurons, nWindows);
+    for iWindow = 1:nWindows
+        % Create a logical index of valid spike times for each neuron given
+        % the time window.
+        iValid = cellfun(@(x) filterspikes(x, intervalTimes, startTimes(iWindow), endTimes(iWindow)), ...
+             timestamps, 'UniformOutput', false);
+        assert(length(iValid) == nNeurons);
+        
+        % Calculate the spike counts for each neuron and add it to our
+        % running list of spike counts.
+        spikeCounts(:, iWindow) = cellfun(@sum, iValid);
+    end
 end
 
 % Each row of our running list contains the number of spikes for each
@@ -225,6 +310,28 @@ assert(nValidWindows > 0, ...
 % neuron names.
 validNeuronNames = cellstr(neuronData.name(fValidNeurons));
 
+%% Streaming Stability
+% When only the neighbor stability is wanted and the engine is available,
+% the windows are streamed through the engine.  Each window is compared
+% with the next one as soon as both exist and is then dropped, so the AMD
+% windows are never all held in memory.
+
+if strcmpi(p.Results.OutputFormat, 'stability') && useEngine
+    dynamical.dprintf(1, '%% AMD - Streaming neighbor stability for %d windows...', nValidWindows);
+    t0 = tic;
+    
+    windowTimes = [startTimes(fValidWindows)' endTimes(fValidWindows)'];
+    stabilityValues = dynamical_inputs.nex.streamstability(timestamps(fValidNeurons), ...
+        intervalTimes, windowTimes, iSpikes(fValidNeurons, fValidWindows));
+    
+    % Same stability times as dynamical.math.stability.
+    stabilityTimes = mean([windowTimes(1:end-1,2) windowTimes(2:end,1)], 2)';
+    amdWindows = struct('data', stabilityValues, 'times', stabilityTimes);
+    
+    dynamical.dprintf(1, 'Done: %g (s)\n', toc(t0));
+    return;
+end
+
 %% AMD
 
 dynamical.dprintf(1, '%% AMD - Allocating memory for %d windows...', nValidWindows);
@@ -264,7 +371,7 @@ for iWindow = 1:nValidWindows
     w.Stats = array2table([fValidNeurons(iN) zeros(nValidNeurons, 4)], ...
         'VariableNames', {'CellID' 'nSpikes' 'ISImean' 'ISIstd' 'Poisson'}, ...
         'RowNames', validNeuronNames(iN));
-    w.AMD = array2table(zeros(nValidNeurons), ...
+    w.AMD = array2table(zeros(nValidNeurons, precision), ...
       'VariableNames', validNeuronNames(iN), ...
       'RowNames', validNeuronNames(iN));
     w.ZScore = w.AMD;
@@ -292,7 +399,50 @@ dynamical.dprintf(1, 'Done: %g (s)\n', t);
 dynamical.dprintf(1, '%% AMD - Calculating AMDs...\n'); 
 t0AMD = tic;
 
-if p.Results.Parallel
+if useEngine && (p.Results.Parallel || p.Results.WindowStep < p.Results.WindowSize)
+    %% AMD Engine
+    % The engine processes a batch of windows per call on its own threads,
+    % which share the spike data rather than each getting a copy.  The
+    % matrices come back in the table precision and each batch is limited
+    % to about 2^25 matrix values, so only one batch of matrices is held
+    % alongside the tables at a time.
+    if showWaitbar
+        waitbar(0, hWaitbar, 'AMD - Processing Windows');
+    end
+    
+    windowTimes = [[amdWindows.WindowStart]' [amdWindows.WindowEnd]'];
+    neuronMask = iSpikes(fValidNeurons, fValidWindows);
+    batches = windowbatches(sum(neuronMask, 1).^2, 2^25);
+    
+    for b = 1:size(batches, 1)
+        iBatch = batches(b,1):batches(b,2);
+        
+        if p.Results.WindowStep < p.Results.WindowSize
+            % The windows overlap, so most spikes of a window were already
+            % in the previous one.  Slide a single window across the batch
+            % and only process the spikes that enter and leave it at each
+            % step.
+            [amdMatrices, zScores, stats] = dynamical_inputs.nex.slidingamd(timestamps(fValidNeurons), ...
+                intervalTimes, windowTimes(iBatch,:), neuronMask(:,iBatch), 'Precision', precision);
+        else
+            % Split every window into tiles of neuron pairs and balance the
+            % tiles of all windows across the threads, so a few windows
+            % with many neurons don't hold up the rest.
+            [amdMatrices, zScores, stats] = dynamical_inputs.nex.multiwindowamd(timestamps(fValidNeurons), ...
+                intervalTimes, windowTimes(iBatch,:), neuronMask(:,iBatch), 'Precision', precision);
+        end
+        
+        for i = 1:length(iBatch)
+            amdWindows(iBatch(i)) = storewindowresults(amdWindows(iBatch(i)), amdMatrices{i}, ...
+                stats{i}, minSpikeCount, zScores{i});
+        end
+        clear amdMatrices zScores;
+        
+        if showWaitbar
+            waitbar(batches(b,2) / nValidWindows, hWaitbar);
+        end
+    end
+elseif p.Results.Parallel
     %% AMD Parallel
     
     % Preallocate the array which will hold our parallel.FevalFuture
@@ -307,7 +457,7 @@ if p.Results.Parallel
         for i = 1:nValidWindows
             futures(i) = parfeval(@amdtask, 1, ...
                 amdWindows(i), intervalTimes, timestamps, i, ...
-                nValidWindows, minSpikeCount);
+                nValidWindows, minSpikeCount, useEngine, precision);
         end
     catch e
         cancel(futures);
@@ -347,7 +497,7 @@ else
         end
         
         amdWindows(i) = amdtask(amdWindows(i), intervalTimes, timestamps, ...
-            i, nValidWindows, minSpikeCount);
+            i, nValidWindows, minSpikeCount, useEngine, precision);
         
         % Update the waitbar if toggled.
         if showWaitbar
@@ -360,67 +510,131 @@ end
 tAMD = toc(t0AMD);
 dynamical.dprintf(1, '%% AMD - Calculating AMDs Finished: %g (s)\n', tAMD); 
 
+%% Surrogates
+% Empirical null distributions of each window's AMD.  The engine generates
+% the surrogates itself, on its own threads, so the windows are simply
+% handed over one at a time.
+
+if p.Results.Surrogates > 0
+    assert(useEngine, 'amd:inputError', 'Surrogate null distributions require the NEX engine.');
+    dynamical.dprintf(1, '%% AMD - Comparing against %d surrogates...', p.Results.Surrogates);
+    t0 = tic;
+    
+    surrogateOptions = {'Method', p.Results.SurrogateMethod, ...
+        'JitterWidth', p.Results.JitterWidth, ...
+        'Surrogates', p.Results.Surrogates, ...
+        'Seed', p.Results.Seed};
+    for iWindow = 1:nValidWindows
+        % The stream is the window's index among all the windows, so a
+        % window gets the same surrogates regardless of which other windows
+        % were valid.
+        trains = windowtrains(amdWindows(iWindow), intervalTimes, timestamps, useEngine);
+        [pValues, percentiles] = dynamical_inputs.nex.surrogateamd(trains, ...
+            surrogateOptions{:}, 'Stream', fValidWindows(iWindow), ...
+            'Intervals', intervalTimes);
+        
+        amdWindows(iWindow).PValue = amdWindows(iWindow).AMD;
+        amdWindows(iWindow).PValue{:,:} = pValues;
+        amdWindows(iWindow).Percentile = amdWindows(iWindow).AMD;
+        amdWindows(iWindow).Percentile{:,:} = percentiles;
+    end
+    
+    dynamical.dprintf(1, 'Done: %g (s)\n', toc(t0));
+end
+
 % Convert the array of AMDwindow into a table for easier viewing.
 if strcmpi(p.Results.OutputFormat, 'table')
     amdWindows = dynamical.math.AMDWindow.array2table(amdWindows);
+elseif strcmpi(p.Results.OutputFormat, 'stability')
+    [stabilityValues, stabilityTimes] = dynamical.math.stability(amdWindows, ...
+        'Method', 'neighbor', 'Parallel', p.Results.Parallel);
+    amdWindows = struct('data', stabilityValues, 'times', stabilityTimes);
 end
 
 
-function amdWindow = amdtask(amdWindow, intervalTimes, timestamps, iWindow, nValidWindows, minSpikeCount)
+function amdWindow = amdtask(amdWindow, intervalTimes, timestamps, iWindow, nValidWindows, minSpikeCount, useEngine, precision)
 dynamical.dprintf(2, '%% AMD Window - %d of %d...', iWindow, nValidWindows);
 
 t0 = tic;
 
-iCurrentNeurons = amdWindow.Stats.CellID;
-nCurrentNeurons = length(iCurrentNeurons);
-
-% Get a list of indices of spikes that fit within the time window
-% [startTime, endTime).
-s = amdWindow.WindowStart;
-e = amdWindow.WindowEnd;
-%dynamical.dprintf(2, '%% AMD Window - Time Bounds: (%g,%g)\n', s, e);
-fValid = cellfun(@(x) find(filterspikes(x, intervalTimes, s, e)), ...
-    timestamps(iCurrentNeurons), 'UniformOutput', false);
-
 % Make sure things look properly formatted in the analysis tables.
 assert(isequal(amdWindow.Stats.Row, ...
     amdWindow.AMD.Row, ...
     amdWindow.AMD.Properties.VariableNames'), ...
     'amd:internalError', 'Rows/Columns of the Stats and AMD tables are not the same.');
 
-% Find the min and max spike times across the valid neurons for this
-% time window.
-minMax = nan(nCurrentNeurons, 2);
-for i = 1:nCurrentNeurons
-    ic = iCurrentNeurons(i);
-    n = timestamps{ic}(fValid{i});
-    minMax(i,:) = [min(n) max(n)];
+% Pull out the spike trains of the neurons we're analyzing.
+trains = windowtrains(amdWindow, intervalTimes, timestamps, useEngine);
+
+% Calculate the neuron stats and the AMD of every neuron pair.  The engine
+% does this natively on a thread pool, walking both directions of each pair
+% in a single merge of the two spike trains, and fills in the z-scores in
+% the same pass.  For single precision the tiled large window kernel is
+% used, which writes single precision results directly.
+if useEngine && strcmp(precision, 'single')
+    [amdMatrix, stats, zScore] = dynamical_inputs.nex.tiledamd(trains, 'Precision', precision);
+    amdWindow = storewindowresults(amdWindow, amdMatrix, stats, minSpikeCount, zScore);
+elseif useEngine
+    [amdMatrix, stats, zScore] = dynamical_inputs.nex.windowamd(trains);
+    amdWindow = storewindowresults(amdWindow, amdMatrix, stats, minSpikeCount, zScore);
+else
+    [amdMatrix, stats] = windowamd(trains);
+    amdWindow = storewindowresults(amdWindow, amdMatrix, stats, minSpikeCount);
 end
-timeMin = min(minMax(:,1));
-timeMax = max(minMax(:,2));
-timeDiff = timeMax - timeMin;
-assert(timeDiff > 0 || isnan(timeDiff), 'amd:poissonError', 'Invalid time diff: %g', timeDiff);
 
-% Calculate the Poisson value for each neuron.  Any Inf values are
-% reset to 0.
-amdWindow.Stats.Poisson = 0.5 * timeDiff ./ amdWindow.Stats.nSpikes;
+t1 = toc(t0);
+dynamical.dprintf(2, '%g (s)\n', t1);
 
-% Calculate the ISIs.  I'm blindly following the method implemented by
-% Dan in the AMDv4 function.  This has been looked over by the PI
-% (Michal Zochowski) and confirmed to be correct.
-ISImean = nan(nCurrentNeurons, 1);
-ISIwidth = nan(nCurrentNeurons, 1);
-for i = 1:nCurrentNeurons
-    I = iCurrentNeurons(i);
-    ISI = timestamps{I}(fValid{i});
-    c1 = ISI(1) - timeMin;
-    c2 = timeMax - ISI(end);
-    dISI = diff(ISI);
-    ISImean(i) = 1/2/timeDiff * (c1^2 + c2^2) + sum(1/4/timeDiff*dISI.^2);
-    ISIwidth(i) = 1/3/timeDiff * (c1^3 + c2^3) + sum(1/12/timeDiff*dISI.^3);
+
+function trains = windowtrains(amdWindow, intervalTimes, timestamps, useEngine)
+% WINDOWTRAINS
+%
+% Syntax:
+% trains = WINDOWTRAINS(amdWindow, intervalTimes, timestamps, useEngine)
+%
+% Pulls out the spike trains of the window's neurons that fit within the
+% time window [startTime, endTime) and the intervals.
+
+iCurrentNeurons = amdWindow.Stats.CellID;
+
+s = amdWindow.WindowStart;
+e = amdWindow.WindowEnd;
+%dynamical.dprintf(2, '%% AMD Window - Time Bounds: (%g,%g)\n', s, e);
+if useEngine
+    [~, spikeRanges] = dynamical_inputs.nex.selectspikes(timestamps(iCurrentNeurons), ...
+        intervalTimes, [s e]);
+    fValid = cellfun(@rangestoindices, spikeRanges, 'UniformOutput', false);
+else
+    fValid = cellfun(@(x) find(filterspikes(x, intervalTimes, s, e)), ...
+        timestamps(iCurrentNeurons), 'UniformOutput', false);
 end
-amdWindow.Stats.ISImean = ISImean;
-amdWindow.Stats.ISIstd = sqrt(ISIwidth - ISImean.^2);
+
+trains = cellfun(@(x,i) x(i), timestamps(iCurrentNeurons), fValid, ...
+    'UniformOutput', false);
+
+
+function amdWindow = storewindowresults(amdWindow, amdMatrix, stats, minSpikeCount, zScore)
+% STOREWINDOWRESULTS
+%
+% Syntax:
+% amdWindow = STOREWINDOWRESULTS(amdWindow, amdMatrix, stats, minSpikeCount)
+% amdWindow = STOREWINDOWRESULTS(___, zScore)
+%
+% Fills in the AMD, stats and z-scores of an AMD window from the results of
+% windowamd or the NEX engine.  If the engine already calculated the
+% z-scores they're stored as is, otherwise they're calculated here.
+
+nCurrentNeurons = height(amdWindow.Stats);
+
+timeMin = stats.TimeMin;
+timeMax = stats.TimeMax;
+timeDiff = stats.TimeDiff;
+assert(timeDiff > 0 || isnan(timeDiff), 'amd:poissonError', 'Invalid time diff: %g', timeDiff);
+
+amdWindow.Stats.Poisson = stats.Poisson;
+amdWindow.Stats.ISImean = stats.ISImean;
+amdWindow.Stats.ISIstd = stats.ISIstd;
+amdWindow.AMD{:,:} = amdMatrix;
 
 % Store some of the parameters used in the data calculations.
 amdWindow.MinSpikeCount = minSpikeCount;
@@ -435,38 +649,9 @@ amdWindow.Stats.ISImean(iJunk) = 0;
 amdWindow.Stats.ISIstd(iJunk) = 0;
 amdWindow.Stats.Poisson(iJunk) = 0;
 
-% Create a set of all unique neuron pair combinations.  If we have 3
-% available neurons we'll get a set of pairs that look like
-% 1,2
-% 1,3
-% 2,3
-% We use these pairs as indices into the iValidNeurons variable we
-% calculated above that represents the reduced set of neurons we are
-% analyzing after we've excluded neurons that don't meet our minimum
-% qualifications.
-neuronCombos = nchoosek(1:nCurrentNeurons, 2);
-nCombos = size(neuronCombos, 1);
-
-% For each combination we want to calculate the average minimum
-% distance (AMD) in both directions.  For instance, if we're are
-% looking at the combination (1,3), we also calculate the the
-% combinations (3,1) as the calculation isn't symetric.
-for iCombo = 1:nCombos
-    % For convenience pull out the indices for our combo.
-    i1 = neuronCombos(iCombo, 1);
-    i2 = neuronCombos(iCombo, 2);
-
-    % Now get the neuron indices.
-    iS1 = iCurrentNeurons(i1);
-    iS2 = iCurrentNeurons(i2);
-
-    % Pull out the two spike trains we are going to analyze.
-    S1 = timestamps{iS1}(fValid{i1});
-    S2 = timestamps{iS2}(fValid{i2});
-
-    % Calculate the average minimum distance (AMD) in both directions.
-    amdWindow.AMD{i1, i2} = finddistance(S1, S2);
-    amdWindow.AMD{i2, i1} = finddistance(S2, S1);
+if nargin > 4
+    amdWindow.ZScore{:,:} = zScore;
+    return;
 end
 
 % This could probably be put in its own function, but we'll go ahead
@@ -479,9 +664,6 @@ Iw = repmat(amdWindow.Stats.ISIstd', nCurrentNeurons, 1);
 Ivals = (Im - amdWindow.AMD{:,:}) ./ Iw;
 amdWindow.ZScore{:,:} = Ivals .* C;
 
-t1 = toc(t0);
-dynamical.dprintf(2, '%g (s)\n', t1);
-
 
 function iFilter = filterspikes(x, intervalTimes, startTime, endTime)
 % FILTERSPIKES
@@ -507,6 +689,114 @@ if ~isempty(intervalTimes)
 end
 
 
+function batches = windowbatches(windowValues, maxValues)
+% WINDOWBATCHES
+%
+% Syntax:
+% batches = WINDOWBATCHES(windowValues, maxValues)
+%
+% Splits the windows into Bx2 [first last] runs of consecutive windows
+% whose matrices hold at most maxValues values in total.  A window larger
+% than that gets a batch of its own.
+
+nWindows = length(windowValues);
+batches = zeros(0, 2);
+first = 1;
+total = 0;
+for i = 1:nWindows
+    if i > first && total + windowValues(i) > maxValues
+        batches(end+1,:) = [first i-1]; %#ok<AGROW>
+        first = i;
+        total = 0;
+    end
+    total = total + windowValues(i);
+end
+batches(end+1,:) = [first nWindows];
+
+
+function indices = rangestoindices(ranges)
+% RANGESTOINDICES
+%
+% Syntax:
+% indices = RANGESTOINDICES(ranges)
+%
+% Expands an Rx2 [first last] matrix of index ranges, as returned by
+% dynamical_inputs.nex.selectspikes, into a column of indices.
+
+indices = arrayfun(@(a,b) {(a:b)'}, ranges(:,1), ranges(:,2));
+indices = vertcat(indices{:}, zeros(0,1));
+
+
+function [amdMatrix, stats] = windowamd(trains)
+% WINDOWAMD
+%
+% Syntax:
+% [amdMatrix, stats] = WINDOWAMD(trains)
+%
+% MATLAB implementation of dynamical_inputs.nex.windowamd used when the
+% NEX engine isn't available.
+
+nCurrentNeurons = length(trains);
+
+% Find the min and max spike times across the valid neurons for this
+% time window.
+minMax = nan(nCurrentNeurons, 2);
+for i = 1:nCurrentNeurons
+    n = trains{i};
+    minMax(i,:) = [min(n) max(n)];
+end
+timeMin = min(minMax(:,1));
+timeMax = max(minMax(:,2));
+timeDiff = timeMax - timeMin;
+
+stats.nSpikes = cellfun(@numel, trains(:));
+stats.TimeMin = timeMin;
+stats.TimeMax = timeMax;
+stats.TimeDiff = timeDiff;
+
+% Calculate the Poisson value for each neuron.
+stats.Poisson = 0.5 * timeDiff ./ stats.nSpikes;
+
+% Calculate the ISIs.  I'm blindly following the method implemented by
+% Dan in the AMDv4 function.  This has been looked over by the PI
+% (Michal Zochowski) and confirmed to be correct.
+ISImean = nan(nCurrentNeurons, 1);
+ISIwidth = nan(nCurrentNeurons, 1);
+for i = 1:nCurrentNeurons
+    ISI = trains{i};
+    c1 = ISI(1) - timeMin;
+    c2 = timeMax - ISI(end);
+    dISI = diff(ISI);
+    ISImean(i) = 1/2/timeDiff * (c1^2 + c2^2) + sum(1/4/timeDiff*dISI.^2);
+    ISIwidth(i) = 1/3/timeDiff * (c1^3 + c2^3) + sum(1/12/timeDiff*dISI.^3);
+end
+stats.ISImean = ISImean;
+stats.ISIstd = sqrt(ISIwidth - ISImean.^2);
+
+% Create a set of all unique neuron pair combinations.  If we have 3
+% available neurons we'll get a set of pairs that look like
+% 1,2
+% 1,3
+% 2,3
+neuronCombos = nchoosek(1:nCurrentNeurons, 2);
+nCombos = size(neuronCombos, 1);
+
+% For each combination we want to calculate the average minimum
+% distance (AMD) in both directions.  For instance, if we're are
+% looking at the combination (1,3), we also calculate the the
+% combinations (3,1) as the calculation isn't symetric.
+amdMatrix = zeros(nCurrentNeurons);
+for iCombo = 1:nCombos
+    % For convenience pull out the indices for our combo.
+    i1 = neuronCombos(iCombo, 1);
+    i2 = neuronCombos(iCombo, 2);
+
+    % Calculate the average minimum distance (AMD) in both directions.
+    amdMatrix(i1, i2) = finddistance(trains{i1}, trains{i2});
+    amdMatrix(i2, i1) = finddistance(trains{i2}, trains{i1});
+end
+
+
 function meanDist = finddistance(S1, S2)
 % FINDDISTANCE
 %
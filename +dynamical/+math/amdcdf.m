@@ -1,4 +1,4 @@
-function [F, X, flatData] = amdcdf(A, xlsFilename, overwrite)
+function [F, X, flatData] = amdcdf(A, xlsFilename, overwrite, epsilon)
 % AMDCDF  Calculates the empirical CDF for an aggregate set of AMD values.
 %
 % Syntax:
@@ -10,6 +10,9 @@ function [F, X, flatData] = amdcdf(A, xlsFilename, overwrite)
 % [___] = AMDCDF(___, xlsFilename)
 % [___] = AMDCDF(___, xlsFilename, overwrite)
 %
+% % Approximate CDF
+% [___] = AMDCDF(___, xlsFilename, overwrite, epsilon)
+%
 % Description:
 % Calculates the empirical cumulative distribution function of the AMD data
 % in a set of AMD windows.  All AMD calculations in all specified AMD
@@ -17,13 +20,20 @@ function [F, X, flatData] = amdcdf(A, xlsFilename, overwrite)
 % processed using the 'ecdf' function from the Statistics and Machine
 % Learning toolbox.
 %
+% If the NEX engine is available, the CDFs are calculated natively with
+% dynamical_inputs.nex.ECDFAccumulator, which is handed the window
+% matrices one at a time rather than flattening them, and the flattened
+% data is only put together if it's asked for.
+%
 % Input:
 % amdWindows (dynamical.math.AMDWindow array) - Array of AMDWindows to
 %     process.  The AMDWindows should have already been processed by the
 %     dynamical.math.amd function.
 % amdMATfile (string) - Name of the .mat file containing the amdWindows
 %     array.  This file is generated by any of the dynamical top level
-%     processing functions, e.g. dynamical or dynamical_cli.
+%     processing functions, e.g. dynamical or dynamical_cli.  The .amdr
+%     result file they write the windows to with the NEX engine can also be
+%     given directly.
 % xlsFilename (string) - The name of the .xlsx output file that will
 %     contain the ECDF output data.  If not specified, then no data is
 %     saved to disk.
@@ -32,6 +42,9 @@ function [F, X, flatData] = amdcdf(A, xlsFilename, overwrite)
 %     deleted, but the old 'CDF' sheet is still removed and created again
 %     with the newly calculated data, i.e. all other sheets are untouched.
 %     Default: false
+% epsilon (scalar) - If non-zero, the CDFs are approximated from a quantile
+%     sketch with an error of about epsilon, which is much lighter on memory
+%     for very large runs.  Requires the NEX engine.  Default: 0
 %
 % Output:
 % F (array) - The ECDF evaluated at the points in X using AMD window data.
@@ -41,7 +54,7 @@ function [F, X, flatData] = amdcdf(A, xlsFilename, overwrite)
 %     across all specified AMD windows (diagonals excluded) and flattened
 %     to a single array.  The values are NOT sorted.
 
-narginchk(1, 3);
+narginchk(1, 4);
 
 % Process the input variable and handle it differently depending on its
 % type.  If it's a string, we assume it's a .mat filename.  If it's a type
@@ -49,9 +62,9 @@ narginchk(1, 3);
 % to process.
 if isa(A, 'dynamical.math.AMDWindow')
     amdWindows = A;
-elseif ischar(A)
-    % Attempt to load the .mat file, specifically the amdWindows variable.
-    load(A, 'amdWindows');
+elseif ischar(A) || isstring(A)
+    % Load the windows from the .mat file, or the result file it points to.
+    amdWindows = dynamical.math.AMDWindow.loadresults(A);
 else
     error('Unhandled input type %s', class(A));
 end
@@ -64,46 +77,84 @@ if nargin < 3
     overwrite = false;
 end
 
+if nargin < 4
+    epsilon = 0;
+end
+
+useEngine = dynamical_inputs.nex.isengineavailable;
+assert(epsilon == 0 || useEngine, 'The approximate CDF requires the NEX engine.');
+
 % The number of AMDWindows
 nWindows = length(amdWindows);
 
-% We'll store the flattened AMD matrices for each AMD window here.
-flatAMDs = cell(1, nWindows);
-flatZScores = cell(1, nWindows);
+F = cell(1, 2);
+X = cell(1, 2);
+flatData = {};
 
-for i = 1:nWindows
-    % Pull out the window's AMD data into a matrix.
-    rawAMD = amdWindows(i).AMD{:,:};
-    rawZScore = amdWindows(i).ZScore{:,:};
-    
-    % Find all the indices of the diagonal.
-    iDiag = 1:size(rawAMD,2)+1:numel(rawAMD);
+if useEngine
+    % The engine skips the diagonals itself.  Each window's matrix is handed
+    % over as soon as it's pulled out of its table, so only one window's
+    % matrix is held in memory alongside the windows, and the AMD and
+    % z-scores are done one after the other.
+    nNeurons = arrayfun(@(x) width(x.AMD), amdWindows);
+    nValues = sum(nNeurons .* (nNeurons - 1));
     
-    % Set all the diagonal entries to empty.  This has the side effect of
-    % collapsing the 2D matrix into an array (without the diagonal values).
-    rawAMD(iDiag) = [];
-    rawZScore(iDiag) = [];
+    cdf = dynamical_inputs.nex.ECDFAccumulator(nValues, 'Epsilon', epsilon);
+    for i = 1:nWindows
+        cdf.add(amdWindows(i).AMD{:,:});
+    end
+    [F{1}, X{1}, nNaN] = cdf.finish();
+    assert(nNaN == 0, 'Unexpected NaN values found in the flattened amd data.');
     
-    % Store the flattened data for later processing.
-    flatAMDs{i} = rawAMD;
-    flatZScores{i} = rawZScore;
+    cdf = dynamical_inputs.nex.ECDFAccumulator(nValues, 'Epsilon', epsilon);
+    for i = 1:nWindows
+        cdf.add(amdWindows(i).ZScore{:,:});
+    end
+    [F{2}, X{2}, nNaN] = cdf.finish();
+    assert(nNaN == 0, 'Unexpected NaN values found in the flattened zscore data.');
 end
 
-% Convert all the cells into a single flattened array.
-flatAMD = cell2mat(flatAMDs);
-flatZScores = cell2mat(flatZScores);
-
-% We might need to remove NaNs, but for now throw an error as I don't think
-% they should ever be in the amd data.
-assert(~any(isnan(flatAMD)), 'Unexpected NaN values found in the flattened amd data.');
-assert(~any(isnan(flatZScores)), 'Unexpected NaN values found in the flattened zscore data.');
-
-% Run the ECDF calculations.
-F = cell(1, 2);
-X = cell(1, 2);
-[F{1}, X{1}] = ecdf(flatAMD);
-[F{2}, X{2}] = ecdf(flatZScores);
-flatData = {flatAMD, flatZScores};
+% The flattened data is only needed without the engine or if the caller
+% wants it.
+if ~useEngine || nargout > 2
+    % We'll store the flattened AMD matrices for each AMD window here.
+    flatAMDs = cell(1, nWindows);
+    flatZScores = cell(1, nWindows);
+    
+    for i = 1:nWindows
+        % Pull out the window's AMD data into a matrix.
+        rawAMD = amdWindows(i).AMD{:,:};
+        rawZScore = amdWindows(i).ZScore{:,:};
+        
+        % Find all the indices of the diagonal.
+        iDiag = 1:size(rawAMD,2)+1:numel(rawAMD);
+        
+        % Set all the diagonal entries to empty.  This has the side effect of
+        % collapsing the 2D matrix into an array (without the diagonal values).
+        rawAMD(iDiag) = [];
+        rawZScore(iDiag) = [];
+        
+        % Store the flattened data for later processing.
+        flatAMDs{i} = rawAMD;
+        flatZScores{i} = rawZScore;
+    end
+    
+    % Convert all the cells into a single flattened array.
+    flatAMD = cell2mat(flatAMDs);
+    flatZScores = cell2mat(flatZScores);
+    
+    % We might need to remove NaNs, but for now throw an error as I don't think
+    % they should ever be in the amd data.
+    assert(~any(isnan(flatAMD)), 'Unexpected NaN values found in the flattened amd data.');
+    assert(~any(isnan(flatZScores)), 'Unexpected NaN values found in the flattened zscore data.');
+    
+    % Run the ECDF calculations.
+    if ~useEngine
+        [F{1}, X{1}] = ecdf(flatAMD);
+        [F{2}, X{2}] = ecdf(flatZScores);
+    end
+    flatData = {flatAMD, flatZScores};
+end
 
 % If the xls filename is specified, then we'll attempt to save the results
 % to the specified Excel file.
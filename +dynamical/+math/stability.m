@@ -10,7 +10,9 @@ function [stabilityValues, stabilityTimes] = stability(amdWindows, varargin)
 % Input:
 % amdWindows (dynamical.math.AMDWindow array) - Array of AMDWindows to
 %     process.  The AMDWindows should have already been processed by the
-%     dynamical.math.amd function.
+%     dynamical.math.amd function.  May also be the name of a .amdr result
+%     file or .mat file to load them from with
+%     dynamical.math.AMDWindow.loadresults.
 %
 % Output:
 % S
@@ -49,6 +51,10 @@ validatestring(p.Results.Method, s);
 
 assert(~istable(amdWindows));
 
+if ischar(amdWindows) || isstring(amdWindows)
+    amdWindows = dynamical.math.AMDWindow.loadresults(amdWindows);
+end
+
 if islogical(p.Results.ShowWaitbar)
     showWaitbar = p.Results.ShowWaitbar;
     hWaitbar = [];
@@ -122,7 +128,34 @@ end
 
  dynamical.dprintf(1, '%% Stability - Num Window Pairs: %d\n', nPairs);
 
-if p.Results.Parallel
+% If the NEX engine has been built, the window pairs are compared natively.
+% The neurons of all windows are mapped into one global index space once
+% and the pairs are spread over the engine's threads, so no tables are
+% built per pair.
+useEngine = dynamical_inputs.nex.isengineavailable;
+
+if useEngine
+    %% Engine Processing
+    if showWaitbar
+        waitbar(0, hWaitbar, 'Stability - Comparing Windows');
+    end
+    
+    zScores = arrayfun(@(x) x.ZScore{:,:}, amdWindows, 'UniformOutput', false);
+    cellIDs = arrayfun(@(x) x.Stats.CellID, amdWindows, 'UniformOutput', false);
+    stabilityValues = dynamical_inputs.nex.windowstability(zScores, cellIDs, ...
+        lower(p.Results.Method));
+    
+    % Same stability times as the MATLAB implementation below.
+    if strcmpi(p.Results.Method, 'neighbor')
+        a = windowPairs(:,1);
+        b = windowPairs(:,2);
+        stabilityTimes = mean([[amdWindows(a).WindowEnd]' [amdWindows(b).WindowStart]'], 2)';
+    end
+    
+    if showWaitbar
+        waitbar(1, hWaitbar);
+    end
+elseif p.Results.Parallel
     %% Parallel Processing
     
     % Determine how many window pairs we want to analyze per parallel job.
@@ -0,0 +1,140 @@
+function tests = test_amd()
+tests = functiontests(localfunctions);
+end
+
+function setupOnce(testCase)
+testCase.assumeTrue(dynamical_inputs.nex.isengineavailable, ...
+    'The NEX engine is not built.');
+
+% Six neurons firing at different rates over 100 s, and two interval
+% variables that overlap each other.  The zero length 'rest' interval at
+% 62 s sits exactly on a spike of the first three neurons, so it only
+% selects anything if intervals are treated as closed.
+frequency = 40000;
+rng(3);
+spikeTicks = cell(6, 1);
+for i = 1:numel(spikeTicks)
+    ticks = randi([0 100 * frequency - 1], 150 + 60 * i, 1);
+    if i <= 3
+        ticks(end+1) = 62 * frequency; %#ok<AGROW>
+    end
+    spikeTicks{i} = unique(ticks);
+end
+intervals.rest = [5 15; 30 30.5; 62 62];
+intervals.run = [12 25; 40 55; 70 95];
+
+fileName = [tempname '.nex'];
+writenexfile(fileName, frequency, spikeTicks, intervals);
+
+testCase.TestData.fileName = fileName;
+end
+
+function teardownOnce(testCase)
+if isfield(testCase.TestData, 'fileName') && exist(testCase.TestData.fileName, 'file') == 2
+    delete(testCase.TestData.fileName);
+end
+end
+
+function testWithoutIntervals(testCase)
+verifyEngineMatches(testCase, {});
+end
+
+function testWithIntervals(testCase)
+verifyEngineMatches(testCase, {'Intervals', {'rest' 'run'}});
+end
+
+function testOverlappingWindowsWithoutIntervals(testCase)
+verifyEngineMatches(testCase, {'WindowStep', 10});
+end
+
+function testOverlappingWindowsWithIntervals(testCase)
+verifyEngineMatches(testCase, {'WindowStep', 10, 'Intervals', {'rest' 'run'}});
+end
+
+function verifyEngineMatches(testCase, options)
+% Runs the MATLAB implementation and every engine path amd takes for the
+% options: the per window engine kernel, the batched multi window kernel
+% and, for overlapping windows, the sliding window kernel.
+import dynamical.math.amd;
+
+options = [{'WindowSize', 20, 'WindowStep', 20, 'EndTime', 100, ...
+    'MinSpikeCount', 6, 'MinValidNeurons', 3} options];
+fileName = testCase.TestData.fileName;
+
+expected = amd(fileName, options{:}, 'UseEngine', false, 'Parallel', false);
+
+for parallel = [false true]
+    actual = amd(fileName, options{:}, 'UseEngine', true, 'Parallel', parallel);
+    verifyWindowsEqual(testCase, actual, expected);
+end
+end
+
+function verifyWindowsEqual(testCase, actual, expected)
+testCase.assertEqual(numel(actual), numel(expected));
+testCase.verifyEqual([actual.WindowStart], [expected.WindowStart]);
+testCase.verifyEqual([actual.WindowEnd], [expected.WindowEnd]);
+
+tolerance = {'AbsTol', 1e-9, 'RelTol', 1e-9};
+for i = 1:numel(expected)
+    testCase.verifyEqual(actual(i).Stats.Properties.RowNames, ...
+        expected(i).Stats.Properties.RowNames);
+    testCase.verifyEqual(actual(i).Stats{:,:}, expected(i).Stats{:,:}, tolerance{:});
+    testCase.verifyEqual(actual(i).AMD{:,:}, expected(i).AMD{:,:}, tolerance{:});
+    testCase.verifyEqual(actual(i).ZScore{:,:}, expected(i).ZScore{:,:}, tolerance{:});
+    testCase.verifyEqual([actual(i).TimeMin actual(i).TimeMax actual(i).TimeDiff], ...
+        [expected(i).TimeMin expected(i).TimeMax expected(i).TimeDiff], tolerance{:});
+end
+end
+
+function writenexfile(fileName, frequency, spikeTicks, intervals)
+% Writes a NEX file with a neuron per cell of spikeTicks and an interval
+% variable per field of intervals.
+fileHeaderSize = 544;
+varHeaderSize = 208;
+intervalNames = fieldnames(intervals);
+nNeurons = numel(spikeTicks);
+nVars = nNeurons + numel(intervalNames);
+
+fid = fopen(fileName, 'w', 'ieee-le');
+cleanup = onCleanup(@() fclose(fid));
+
+fwrite(fid, [827868494 106], 'int32');
+fwrite(fid, zeros(1, 256), 'uint8');
+fwrite(fid, frequency, 'double');
+fwrite(fid, [0 100 * frequency nVars 0], 'int32');
+fwrite(fid, zeros(1, 256), 'uint8');
+
+dataOffset = fileHeaderSize + nVars * varHeaderSize;
+for i = 1:nNeurons
+    name = sprintf('sig%03d', i);
+    writevarheader(fid, 0, name, dataOffset, numel(spikeTicks{i}));
+    dataOffset = dataOffset + 4 * numel(spikeTicks{i});
+end
+for i = 1:numel(intervalNames)
+    nIntervals = size(intervals.(intervalNames{i}), 1);
+    writevarheader(fid, 2, intervalNames{i}, dataOffset, nIntervals);
+    dataOffset = dataOffset + 8 * nIntervals;
+end
+
+for i = 1:nNeurons
+    fwrite(fid, spikeTicks{i}, 'int32');
+end
+for i = 1:numel(intervalNames)
+    ticks = round(intervals.(intervalNames{i}) * frequency);
+    fwrite(fid, ticks(:,1), 'int32');
+    fwrite(fid, ticks(:,2), 'int32');
+end
+end
+
+function writevarheader(fid, type, name, dataOffset, count)
+nameField = zeros(1, 64);
+nameField(1:numel(name)) = double(name);
+
+fwrite(fid, [type 100], 'int32');
+fwrite(fid, nameField, 'uint8');
+fwrite(fid, [dataOffset count 0 0 0 0], 'int32');
+fwrite(fid, [0 0 0 0], 'double');
+fwrite(fid, [0 0 0], 'int32');
+fwrite(fid, [0 0], 'double');
+fwrite(fid, zeros(1, 52), 'uint8');
+end
@@ -0,0 +1,110 @@
+function tests = test_spiketriggeredaverage()
+tests = functiontests(localfunctions);
+end
+
+function setupOnce(testCase)
+testCase.assumeTrue(dynamical_inputs.nex.isengineavailable, ...
+    'The NEX engine is not built.');
+
+% One neuron and one continuous channel of a single fragment, with spikes
+% at both ends of the recording so offset windows fall outside it.  The
+% spikes are kept off the midpoints between samples so the nearest sample
+% is never a tie.
+sampleFrequency = 1000;
+adToMV = 0.01;
+rng(7);
+samples = int16(randi([-3000 3000], 5000, 1));
+spikeSamples = [1; 4; 4990; 4998; randi([0 4900], 200, 1)];
+spikeTimes = sort(spikeSamples + 0.25) / sampleFrequency;
+
+fileName = [tempname '.nex'];
+writenexfile(fileName, spikeTimes, samples, sampleFrequency, adToMV);
+
+testCase.TestData.fileName = fileName;
+testCase.TestData.sampleFrequency = sampleFrequency;
+testCase.TestData.adToMV = adToMV;
+testCase.TestData.samples = samples;
+testCase.TestData.spikeTimes = spikeTimes;
+end
+
+function teardownOnce(testCase)
+if isfield(testCase.TestData, 'fileName') && exist(testCase.TestData.fileName, 'file') == 2
+    delete(testCase.TestData.fileName);
+end
+end
+
+function testWindowAroundSpike(testCase)
+verifyWindow(testCase, [0.01 0.02]);
+end
+
+function testWindowStartingAfterSpike(testCase)
+verifyWindow(testCase, [-0.01 0.02]);
+end
+
+function testWindowEndingBeforeSpike(testCase)
+verifyWindow(testCase, [0.02 -0.005]);
+end
+
+function verifyWindow(testCase, window)
+import dynamical_inputs.nex.spiketriggeredaverage;
+
+data = testCase.TestData;
+sta = spiketriggeredaverage(data.fileName, 1, 1, window);
+
+firstLag = -round(window(1) * data.sampleFrequency);
+lastLag = round(window(2) * data.sampleFrequency);
+lags = (firstLag:lastLag)';
+
+% Every lag of every spike that stays inside the recording.
+nSamples = numel(data.samples);
+sampleIndices = round(data.spikeTimes * data.sampleFrequency) + lags' + 1;
+isInside = sampleIndices >= 1 & sampleIndices <= nSamples;
+values = zeros(size(sampleIndices));
+values(isInside) = double(data.samples(sampleIndices(isInside))) * data.adToMV;
+
+expectedCount = sum(isInside, 1)';
+expectedMean = sum(values, 1)' ./ expectedCount;
+
+testCase.verifyEqual(sta.lags, lags / data.sampleFrequency, 'AbsTol', 1e-12);
+testCase.verifyEqual(sta.count, expectedCount);
+testCase.verifyEqual(sta.mean, expectedMean, 'AbsTol', 1e-9);
+end
+
+function writenexfile(fileName, spikeTimes, samples, sampleFrequency, adToMV)
+% Writes a NEX file with one neuron and one continuous variable.
+frequency = 40000;
+fileHeaderSize = 544;
+varHeaderSize = 208;
+spikeTicks = int32(round(spikeTimes * frequency));
+neuronOffset = fileHeaderSize + 2 * varHeaderSize;
+continuousOffset = neuronOffset + 4 * numel(spikeTicks);
+
+fid = fopen(fileName, 'w', 'ieee-le');
+cleanup = onCleanup(@() fclose(fid));
+
+fwrite(fid, [827868494 106], 'int32');
+fwrite(fid, zeros(1, 256), 'uint8');
+fwrite(fid, frequency, 'double');
+fwrite(fid, [0 numel(samples) * frequency / sampleFrequency 2 0], 'int32');
+fwrite(fid, zeros(1, 256), 'uint8');
+
+writevarheader(fid, 0, 'neuron', neuronOffset, numel(spikeTicks), 0, 0, 0);
+writevarheader(fid, 5, 'channel', continuousOffset, 1, sampleFrequency, adToMV, numel(samples));
+
+fwrite(fid, spikeTicks, 'int32');
+fwrite(fid, [0 0], 'int32');
+fwrite(fid, samples, 'int16');
+end
+
+function writevarheader(fid, type, name, dataOffset, count, wFrequency, adToMV, nPoints)
+nameField = zeros(1, 64);
+nameField(1:numel(name)) = double(name);
+
+fwrite(fid, [type 100], 'int32');
+fwrite(fid, nameField, 'uint8');
+fwrite(fid, [dataOffset count 0 0 0 0], 'int32');
+fwrite(fid, [0 0 wFrequency adToMV], 'double');
+fwrite(fid, [nPoints 0 0], 'int32');
+fwrite(fid, [0 0], 'double');
+fwrite(fid, zeros(1, 52), 'uint8');
+end
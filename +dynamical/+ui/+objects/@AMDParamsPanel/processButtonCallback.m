@@ -125,7 +125,9 @@ amdStruct2.ShowWaitbar = true;
 [p, f] = fileparts(fileData.path);
 matFileName = fullfile(p, [f dateSuffix '.mat']);
 metaData = struct('date', datestr(now), 'params', amdStruct2); %#ok<NASGU>
-save(matFileName, 'metaData', 'amdWindows', 'stability');
+
+[amdResultsFile, amdWindows] = dynamical.math.AMDWindow.savematresults(matFileName, amdWindows);
+save(matFileName, 'metaData', 'amdWindows', 'amdResultsFile', 'stability');
 
 % Excel output only implemented for the 'neighbor' stability method right
 % now.
@@ -56,6 +56,40 @@ expected = expectedSeq(1, 1, 1);
 testCase.verifyEqual(actual, expected);
 end
 
+function testThreeOutputsMatchStructFields(testCase)
+import dynamical.util.averagesequentialbouts;
+
+time = [1 2 4 5 6 8];
+data = [1 2 3 4 5 6];
+boutLength = 1;
+
+averaged = averagesequentialbouts(time, data, boutLength);
+[seqStart, seqStop, seqAverage] = averagesequentialbouts(time, data, boutLength);
+
+testCase.verifyEqual(seqStart, [averaged.seqStart]');
+testCase.verifyEqual(seqStop, [averaged.seqStop]');
+testCase.verifyEqual(seqAverage, [averaged.seqAverage]');
+end
+
+function testRowAndColumnInputsGiveColumnStruct(testCase)
+import dynamical.util.averagesequentialbouts;
+
+time = [1 2 4 5 6 8];
+data = [1 2 3 4 5 6];
+boutLength = 1;
+
+fromRows = averagesequentialbouts(time, data, boutLength);
+fromColumns = averagesequentialbouts(time', data', boutLength);
+expected = [
+    expectedSeq(1, 2, 1.5);
+    expectedSeq(4, 6, 4);
+    expectedSeq(8, 8, 6)];
+
+testCase.verifySize(fromRows, [3 1]);
+testCase.verifyEqual(fromRows, expected);
+testCase.verifyEqual(fromColumns, expected);
+end
+
 function testErrorOnDifferentNumElements(testCase)
 import dynamical.util.averagesequentialbouts;
 
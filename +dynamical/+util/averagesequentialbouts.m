@@ -1,4 +1,4 @@
-function averaged = averagesequentialbouts(time, data, boutLength)
+function [averaged, seqStop, seqAverage] = averagesequentialbouts(time, data, boutLength)
 %AVERAGESEQUENTIALBOUTS Average temporally sequential data points together
 %
 %   In
@@ -13,8 +13,16 @@ function averaged = averagesequentialbouts(time, data, boutLength)
 %   averaged(1-N).seqStop = end time
 %   averaged(1-N).seqAverage = average data in [start time, end time]
 %   
+%   With three outputs the same values come back as columns instead, which
+%   skips building the struct array:
+%   [seqStart, seqStop, seqAverage] = AVERAGESEQUENTIALBOUTS(...)
+%   
+%   The runs are found by the NEX engine if it's available, otherwise with
+%   vectorized MATLAB.
+%   
 %   Usage
 %   averaged = AVERAGESEQUENTIALBOUTS(time, data, boutLength)
+%   [seqStart, seqStop, seqAverage] = AVERAGESEQUENTIALBOUTS(time, data, boutLength)
 
 narginchk(3, 3);
 
@@ -25,46 +33,30 @@ validateattributes(boutLength, {'numeric'}, {'scalar', 'nonnegative', 'nonzero'}
 assert(length(time) == length(data),...
     'time and data must have same the number of elements');
 
-nElements = length(time);
-
-% find difference between current time and previous time
-timeDiffs = zeros(nElements, 1);
-for t = 1:nElements
-    if t == 1
-        timeDiffs(t) = Inf;
-    else
-        timeDiffs(t) = time(t) - time(t-1);
-    end
+if dynamical_inputs.nex.isengineavailable
+    [seqStart, seqStop, seqAverage] = dynamical_inputs.nex.sequentialbouts(time, data, boutLength);
+else
+    [seqStart, seqStop, seqAverage] = labelbouts(double(time(:)), double(data(:)), double(boutLength));
 end
 
-% label each element as belonging to a specific sequential group
-seqLabel = 0;
-labels = zeros(nElements, 1);
-for l = 1:nElements
-    diffSameAsBoutLength = fpequal(timeDiffs(l), boutLength);
-    
-    if l == 1 || ~diffSameAsBoutLength
-        seqLabel = seqLabel + 1;
-        labels(l) = seqLabel;
-    else
-        labels(l) = labels(l-1);
-    end
+if nargout > 1
+    averaged = seqStart;
+else
+    averaged = struct('seqStart', num2cell(seqStart), 'seqStop', num2cell(seqStop), ...
+        'seqAverage', num2cell(seqAverage));
+end
 end
 
-% average elements that are part of same sequence together
-averagedBout = @(start, stop, avg)...
-    struct('seqStart', start, 'seqStop', stop, 'seqAverage', avg);
-
-averaged = averagedBout({}, {}, {});
+function [seqStart, seqStop, seqAverage] = labelbouts(time, data, boutLength)
+% a new sequence starts wherever the time difference isn't the bout length,
+% and the running count of those starts labels the sequences
+timeDiffs = [Inf; diff(time)];
+isStart = ~fpequal(timeDiffs, boutLength);
+labels = cumsum(isStart);
 
-for s = 1:seqLabel
-    sequence = (labels == s);
-    seqTime = time(sequence);
-    seqData = data(sequence);
-    
-    averaged = [averaged;...
-        averagedBout(seqTime(1), seqTime(end), mean(seqData))];
-end
+seqStart = time(isStart);
+seqStop = time([find(isStart(2:end)); numel(time)]);
+seqAverage = accumarray(labels, data) ./ accumarray(labels, 1);
 end
 
 function equal = fpequal(a, b)
@@ -72,4 +64,3 @@ function equal = fpequal(a, b)
     tolerance = eps(largest);
     equal = abs(a - b) <= tolerance;
 end
-
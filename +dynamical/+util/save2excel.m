@@ -50,13 +50,14 @@ switch lower(stabilityMethod)
         end
         
         % Mean Sequential Stability
-        seqBouts = averagesequentialbouts(stabilityData.times, stabilityData.data, amdStruct.WindowStep);
+        [seqStart, seqStop, seqAverage] = averagesequentialbouts(stabilityData.times, ...
+            stabilityData.data, amdStruct.WindowStep);
         
-        nSeqBouts = length(seqBouts);
+        nSeqBouts = length(seqStart);
         
-        toRangeStr = @(sb) sprintf('%.2f-%.2f', sb.seqStart, sb.seqStop);
-        seqTimeRanges = arrayfun(toRangeStr, seqBouts, 'UniformOutput', false);
-        seqAverages = num2cell([seqBouts.seqAverage]');
+        toRangeStr = @(start, stop) sprintf('%.2f-%.2f', start, stop);
+        seqTimeRanges = arrayfun(toRangeStr, seqStart, seqStop, 'UniformOutput', false);
+        seqAverages = num2cell(seqAverage);
         
         feval(excelFcn, xlsFileName, {'Sequential Time Range', 'Mean Sequential Stability'}, 'Stability', 'D1:E1');
         r = sprintf('%s%d:%s%d', 'D', 2, 'E', nSeqBouts + 1);
@@ -10,7 +10,9 @@ function dynamical_cli(input1, varargin)
 % Description:
 % Command line interface (CLI) for Dynamical.  Has all the processing
 % options as the GUI, though not graphs are generated.  The same data files
-% are saved.
+% are saved.  If the NEX engine is available, the AMD windows are saved to
+% a .amdr result file next to the .mat file rather than in it, see
+% dynamical.math.AMDWindow.loadresults.
 %
 % Input:
 % nexFileName (string) - The name of the NEX file to read.
@@ -36,6 +38,10 @@ function dynamical_cli(input1, varargin)
 %     all windows meeting the minimum spike count to be considered valid.
 % 'MinValidNeurons' (scalar) - Minimum number of valid neurons in a
 %     time window for it to be considered for analysis.  Default: 3
+% 'Streaming' (logical) - If true and the stability method is 'neighbor',
+%     the stability is calculated while the AMD windows are produced and
+%     the windows themselves are not kept, which keeps memory use flat for
+%     long recordings.  The AMD windows are not saved.  Default: false
 
 %% Imports
 import dynamical.util.validateattributes
@@ -51,6 +57,7 @@ defaults.minPersistence = 0;
 defaults.minValidNeurons = 3;
 defaults.outputFormat = 'array';
 defaults.parallel = true;
+defaults.streaming = false;
 methodList = {'neighbor' 'all'};
 defaults.Method = methodList{1};
 
@@ -104,6 +111,10 @@ validator = @(x) validateattributes(x, {'string' 'char'}, ...
     {'nonempty' 'scalartext'});
 addParameter(ip, 'Method', defaults.Method, validator);
 
+% Streaming toggle
+validator = @(x) validateattributes(x, {'logical'}, {'scalar' 'nonempty'});
+addParameter(ip, 'Streaming', defaults.streaming, validator);
+
 parse(ip, input1, varargin{:});
 
 %% Setup
@@ -133,9 +144,18 @@ end
 
 %% AMD
 
+% In streaming mode the neighbor stability comes straight out of the AMD
+% calculations.
+isStreaming = ip.Results.Streaming && strcmpi(ip.Results.Method, 'neighbor');
+if isStreaming
+    outputFormat = 'stability';
+else
+    outputFormat = 'array';
+end
+
 dynamical.dprintf(1, '%% AMD - Processing Data...\n');
 t0 = tic;
-amdWindows = dynamical.math.amd(input1, 'StartTime', ip.Results.StartTime, ...
+amdOutput = dynamical.math.amd(input1, 'StartTime', ip.Results.StartTime, ...
                            'EndTime', ip.Results.EndTime, ...
                            'WindowSize', ip.Results.WindowSize, ...
                            'WindowStep', ip.Results.WindowStep, ...
@@ -144,21 +164,30 @@ amdWindows = dynamical.math.amd(input1, 'StartTime', ip.Results.StartTime, ...
                            'MinPersistence', ip.Results.MinPersistence, ...
                            'MinValidNeurons', ip.Results.MinValidNeurons, ...
                            'Parallel', ip.Results.Parallel, ...
+                           'OutputFormat', outputFormat, ...
                            'ShowWaitbar', false);
 t = toc(t0);
 dynamical.dprintf(1, '%% AMD - Processing Finished: %g (s)\n', t);
 
 %% Stability
 
-dynamical.dprintf(1, '%% Stability - Processing Data...\n');
-
-t0 = tic;
-[S, T] = dynamical.math.stability(amdWindows, 'Method', ip.Results.Method, ...
-    'ShowWaitBar', false, 'Parallel', ip.Results.Parallel);
-t = toc(t0);
-dynamical.dprintf(1, '%% Stability - Processing Finished: %g (s)\n', t);
-stability.data = S;
-stability.times = T;
+if isStreaming
+    amdWindows = [];
+    stability.data = amdOutput.data;
+    stability.times = amdOutput.times;
+else
+    amdWindows = amdOutput;
+    
+    dynamical.dprintf(1, '%% Stability - Processing Data...\n');
+    
+    t0 = tic;
+    [S, T] = dynamical.math.stability(amdWindows, 'Method', ip.Results.Method, ...
+        'ShowWaitBar', false, 'Parallel', ip.Results.Parallel);
+    t = toc(t0);
+    dynamical.dprintf(1, '%% Stability - Processing Finished: %g (s)\n', t);
+    stability.data = S;
+    stability.times = T;
+end
 
 %% Save Data
 
@@ -199,7 +228,9 @@ amdStruct2.ShowWaitbar = false;
 [p, f] = fileparts(input1);
 matFileName = fullfile(p, [f dateSuffix '.mat']);
 metaData = struct('date', datestr(now), 'params', amdStruct2);
-save(matFileName, 'metaData', 'amdWindows', 'stability');
+
+[amdResultsFile, amdWindows] = dynamical.math.AMDWindow.savematresults(matFileName, amdWindows);
+save(matFileName, 'metaData', 'amdWindows', 'amdResultsFile', 'stability');
 
 % Excel output only implemented for the 'neighbor' stability method right
 % now.
@@ -0,0 +1,144 @@
+classdef AMDStream < handle
+    % AMDSTREAM  Calculates AMD windows from spike data as it's recorded.
+    %
+    % Syntax:
+    % obj = AMDSTREAM(nNeurons)
+    % obj = AMDSTREAM(nNeurons, options)
+    %
+    % Description:
+    % Online counterpart of dynamical.math.amd for recordings that are
+    % still being written, or for replaying a file in pieces.  Spikes are
+    % handed over in chunks with the time up to which the data is
+    % complete, and every window that ends by then is calculated right
+    % away, along with its neighbor stability.  The engine only keeps the
+    % spikes that future windows still need, in a ring buffer per neuron,
+    % so a stream can run for as long as the recording does.
+    %
+    % Windows follow the same rules as dynamical.math.amd: a neuron is
+    % included if it has at least 'MinSpikeCount' spikes in the window and
+    % a window is only produced if it has at least 'MinValidNeurons'
+    % neurons.  'MinPersistence' needs the whole recording and isn't
+    % supported.
+    %
+    % Input:
+    % nNeurons (scalar) - Number of neurons in the recording.
+    %
+    % Options (key,value):
+    % 'MinSpikeCount' (scalar) - Default: 6
+    % 'MinValidNeurons' (scalar) - Default: 3
+    % 'StartTime' (scalar) - Start time of the first window. (s)  Default: 0
+    % 'WindowSize' (scalar) - Size of a window. (s)  Default: 60
+    % 'WindowStep' (scalar) - Time between window starts. (s)  Default: 60
+    %
+    % AMDSTREAM Methods:
+    % append - Adds a chunk of spikes and returns the completed windows.
+    % close - Releases the engine's stream.
+    %
+    % Examples:
+    % % Replay a file 10 seconds at a time.
+    % neuronData = dynamical_inputs.getneurondata('C:\datafile.nex');
+    % stream = dynamical_inputs.nex.AMDStream(height(neuronData));
+    % for t = 10:10:600
+    %     chunks = cellfun(@(x) x(x >= t-10 & x < t), neuronData.timestamps, ...
+    %         'UniformOutput', false);
+    %     [windows, stability] = stream.append(chunks, t);
+    % end
+    %
+    % See Also: dynamical.math.amd, dynamical.math.stability
+    
+    properties (SetAccess = private)
+        % Number of neurons in the recording.
+        NumNeurons = 0
+        
+        % Time up to which spikes have been appended. (s)
+        CompleteTime = -Inf
+    end
+    
+    properties (Access = private)
+        % Handle of the stream in the engine.
+        Handle = []
+    end
+    
+    methods
+        function obj = AMDStream(nNeurons, varargin)
+            p = inputParser;
+            
+            validator = @(x) validateattributes(x, {'numeric'}, ...
+                {'scalar' 'nonempty' 'integer' '>=' 0});
+            addRequired(p, 'nNeurons', validator);
+            
+            validator = @(x) validateattributes(x, {'numeric'}, ...
+                {'scalar' 'nonempty' 'integer' '>=' 0});
+            addParameter(p, 'MinSpikeCount', 6, validator);
+            addParameter(p, 'MinValidNeurons', 3, validator);
+            
+            validator = @(x) validateattributes(x, {'numeric'}, {'scalar' 'nonempty'});
+            addParameter(p, 'StartTime', 0, validator);
+            
+            validator = @(x) validateattributes(x, {'numeric'}, {'scalar' 'nonempty' 'positive'});
+            addParameter(p, 'WindowSize', 60, validator);
+            addParameter(p, 'WindowStep', 60, validator);
+            
+            parse(p, nNeurons, varargin{:});
+            
+            obj.NumNeurons = nNeurons;
+            obj.Handle = dynamical_inputs.nex.nexengine( ...
+                dynamical_inputs.nex.NexEngineOpcodes.StreamOpen, ...
+                double(nNeurons), double(p.Results.WindowSize), ...
+                double(p.Results.WindowStep), double(p.Results.StartTime), ...
+                double(p.Results.MinSpikeCount), double(p.Results.MinValidNeurons));
+        end
+        
+        function [windows, stability] = append(obj, chunks, completeTime)
+            % APPEND  Adds a chunk of spikes to the stream.
+            %
+            % Syntax:
+            % [windows, stability] = obj.APPEND(chunks, completeTime)
+            %
+            % Input:
+            % chunks (cell) - The new sorted spike timestamps of each
+            %     neuron, empty for neurons without new spikes.  They must
+            %     come after the neuron's previous spikes and the previous
+            %     complete time. (s)
+            % completeTime (scalar) - Time up to which all spikes have now
+            %     been appended.  It must be finite, so at the end of the
+            %     recording pass the time it ends. (s)
+            %
+            % Output:
+            % windows (struct array) - The windows completed by this chunk,
+            %     with the fields WindowStart, WindowEnd, Neurons (indices
+            %     into chunks), AMD, ZScore and Stats, as returned by
+            %     dynamical_inputs.nex.windowamd.
+            % stability (struct) - Neighbor stability of the new windows
+            %     with the window before each of them, with the same 'data'
+            %     and 'times' fields as the stability output of
+            %     dynamical_cli.
+            
+            assert(~isempty(obj.Handle), 'AMDStream:closed', 'The stream has been closed.');
+            validateattributes(chunks, {'cell'}, {'numel' obj.NumNeurons}, 'append', 'chunks', 1);
+            validateattributes(completeTime, {'numeric'}, {'scalar' 'real' 'finite'}, ...
+                'append', 'completeTime', 2);
+            
+            chunks = cellfun(@double, chunks, 'UniformOutput', false);
+            
+            [windows, stability] = dynamical_inputs.nex.nexengine( ...
+                dynamical_inputs.nex.NexEngineOpcodes.StreamAppend, ...
+                obj.Handle, chunks, double(completeTime));
+            obj.CompleteTime = max(obj.CompleteTime, completeTime);
+        end
+        
+        function close(obj)
+            % CLOSE  Releases the engine's stream.  Windows that haven't
+            % been completed are dropped.
+            if ~isempty(obj.Handle)
+                dynamical_inputs.nex.nexengine( ...
+                    dynamical_inputs.nex.NexEngineOpcodes.StreamClose, obj.Handle);
+                obj.Handle = [];
+            end
+        end
+        
+        function delete(obj)
+            obj.close();
+        end
+    end
+end
@@ -0,0 +1,159 @@
+classdef ContinuousReader < handle
+    % CONTINUOUSREADER  Reads a continuous channel a chunk at a time.
+    %
+    % Syntax:
+    % obj = CONTINUOUSREADER(nexFileName, index)
+    % obj = CONTINUOUSREADER(nexFileName, index, 'ChunkSize', chunkSize)
+    %
+    % Description:
+    % Walks a continuous channel from start to end in chunks of at most
+    % 'ChunkSize' samples, so filters and feature extraction can run over
+    % recordings too long to load with getcontinuousdata.  A chunk never
+    % spans a gap between the channel's recorded fragments; the chunk
+    % after a gap starts the next fragment.  While one chunk is being
+    % processed the engine reads the next one in the background.  Only a
+    % few chunks are held at a time, so memory use is set by the chunk
+    % size rather than the length of the recording.
+    %
+    % Input:
+    % nexFileName (string) - The name of the NEX file to read.
+    % index (integer) - Which continuous variable, in the same order as
+    %     dynamical_inputs.nex.getcontinuousdata.
+    %
+    % Options (key,value):
+    % 'ChunkSize' (scalar) - Largest number of samples per chunk.
+    %     Default: 1048576
+    %
+    % CONTINUOUSREADER Methods:
+    % next - Gets the next chunk.
+    % close - Releases the engine's reader.
+    %
+    % Examples:
+    % % Find the peak of a channel without loading it.
+    % reader = dynamical_inputs.nex.ContinuousReader('C:\datafile.nex', 1);
+    % peak = 0;
+    % while ~reader.IsDone
+    %     peak = max([peak; abs(reader.next())]);
+    % end
+    %
+    % See Also: dynamical_inputs.nex.getcontinuousdata,
+    %     dynamical_inputs.nex.continuousenvelope
+    
+    properties (SetAccess = private)
+        % Sampling rate. (Hz)
+        SampleFrequency = NaN
+        
+        % Scale from raw A/D values to mV.
+        ADtoMV = NaN
+        
+        % Total number of samples in the channel.
+        NumSamples = 0
+        
+        % Index of the first sample of each fragment.
+        FragmentStarts = zeros(0, 1)
+        
+        % Time of the first sample of each fragment. (s)
+        FragmentTimes = zeros(0, 1)
+        
+        % True once next has returned the last chunk.
+        IsDone = false
+    end
+    
+    properties (Access = private)
+        % Handle of the reader in the engine.
+        Handle = []
+        
+        % The chunk read ahead of the caller, so IsDone is known before
+        % next is called again.
+        Pending = []
+    end
+    
+    methods
+        function obj = ContinuousReader(nexFileName, index, varargin)
+            p = inputParser;
+            addRequired(p, 'nexFileName', @(x) ischar(x) || isstring(x));
+            addRequired(p, 'index', @(x) validateattributes(x, {'numeric'}, ...
+                {'scalar' 'integer' 'positive'}));
+            addParameter(p, 'ChunkSize', 2^20, @(x) validateattributes(x, {'numeric'}, ...
+                {'scalar' 'integer' 'positive'}));
+            parse(p, nexFileName, index, varargin{:});
+            
+            [obj.Handle, layout] = dynamical_inputs.nex.nexengine( ...
+                dynamical_inputs.nex.NexEngineOpcodes.ContinuousOpen, ...
+                char(nexFileName), double(index), double(p.Results.ChunkSize));
+            
+            obj.SampleFrequency = layout.SampleFrequency;
+            obj.ADtoMV = layout.ADtoMV;
+            obj.NumSamples = layout.NumSamples;
+            obj.FragmentStarts = layout.FragmentStarts;
+            obj.FragmentTimes = layout.FragmentTimes;
+            
+            obj.readAhead();
+        end
+        
+        function [data, startTime, fragment, firstSample] = next(obj, varargin)
+            % NEXT  Gets the next chunk of samples.
+            %
+            % Syntax:
+            % [data, startTime, fragment, firstSample] = obj.NEXT()
+            % [___] = obj.NEXT('Raw', true)
+            %
+            % Options (key,value):
+            % 'Raw' (logical) - Return the int16 A/D values rather than
+            %     mV.  Default: false
+            %
+            % Output:
+            % data (vector) - The samples of the chunk, empty once the
+            %     channel is done. (mV)
+            % startTime (scalar) - Time of the first sample. (s)
+            % fragment (scalar) - Fragment the chunk is in.
+            % firstSample (scalar) - Index of the first sample within the
+            %     whole channel.
+            
+            p = inputParser;
+            p.FunctionName = 'next';
+            addParameter(p, 'Raw', false, @(x) isscalar(x) && islogical(x));
+            parse(p, varargin{:});
+            
+            assert(~isempty(obj.Handle), 'ContinuousReader:closed', 'The reader has been closed.');
+            
+            chunk = obj.Pending;
+            if ~obj.IsDone
+                obj.readAhead();
+            end
+            
+            data = chunk.data;
+            if ~p.Results.Raw
+                data = double(data) * obj.ADtoMV;
+            end
+            startTime = chunk.startTime;
+            fragment = chunk.fragment;
+            firstSample = chunk.firstSample;
+        end
+        
+        function close(obj)
+            % CLOSE  Releases the engine's reader and closes the file.
+            if ~isempty(obj.Handle)
+                dynamical_inputs.nex.nexengine( ...
+                    dynamical_inputs.nex.NexEngineOpcodes.ContinuousClose, obj.Handle);
+                obj.Handle = [];
+            end
+            obj.IsDone = true;
+        end
+        
+        function delete(obj)
+            obj.close();
+        end
+    end
+    
+    methods (Access = private)
+        function readAhead(obj)
+            chunk = struct;
+            [chunk.data, chunk.startTime, chunk.fragment, chunk.firstSample] = ...
+                dynamical_inputs.nex.nexengine( ...
+                dynamical_inputs.nex.NexEngineOpcodes.ContinuousNext, obj.Handle);
+            obj.Pending = chunk;
+            obj.IsDone = isempty(chunk.data);
+        end
+    end
+end
@@ -0,0 +1,93 @@
+classdef ECDFAccumulator < handle
+    % ECDFACCUMULATOR  Builds the empirical CDF of window matrices one at a
+    % time.
+    %
+    % Syntax:
+    % obj = ECDFACCUMULATOR(nValues)
+    % obj = ECDFACCUMULATOR(nValues, 'Epsilon', epsilon)
+    %
+    % Description:
+    % Gives the same CDF as dynamical_inputs.nex.windowecdf, but the
+    % matrices are handed to the engine one at a time with add rather than
+    % all together in a cell array, so the caller only ever needs to hold
+    % one of them.  Single precision matrices are read as they are.  The
+    % exact CDF keeps the off diagonal values added so far in the engine,
+    % the approximate CDF only a sketch of them.
+    %
+    % Input:
+    % nValues (scalar) - Expected total number of off diagonal values, which
+    %     sizes the sketch of the approximate CDF.
+    %
+    % Options (key,value):
+    % 'Epsilon' (scalar) - Target error of the approximate CDF, as a
+    %     fraction of the number of values.  Set to 0 for the exact CDF.
+    %     An epsilon below about log2(nValues)/nValues keeps every value
+    %     and is exact as well.  Default: 0
+    %
+    % ECDFACCUMULATOR Methods:
+    % add - Adds the off diagonal values of a square matrix.
+    % finish - Returns the CDF and releases the engine's copy.
+    %
+    % Examples:
+    % n = arrayfun(@(x) width(x.AMD), amdWindows);
+    % cdf = dynamical_inputs.nex.ECDFAccumulator(sum(n .* (n - 1)));
+    % for i = 1:length(amdWindows)
+    %     cdf.add(amdWindows(i).AMD{:,:});
+    % end
+    % [F, X] = cdf.finish();
+    %
+    % See Also: dynamical_inputs.nex.windowecdf, dynamical.math.amdcdf
+    
+    properties (Access = private)
+        % Handle of the CDF in the engine.
+        Handle = []
+    end
+    
+    methods
+        function obj = ECDFAccumulator(nValues, varargin)
+            p = inputParser;
+            p.FunctionName = mfilename;
+            addRequired(p, 'nValues', @(x) validateattributes(x, {'numeric'}, ...
+                {'scalar' 'integer' '>=' 0}));
+            addParameter(p, 'Epsilon', 0, @(x) validateattributes(x, {'numeric'}, ...
+                {'scalar' 'nonempty' 'real' '>=' 0 '<' 1}));
+            parse(p, nValues, varargin{:});
+            
+            obj.Handle = dynamical_inputs.nex.nexengine( ...
+                dynamical_inputs.nex.NexEngineOpcodes.ECDFOpen, ...
+                double(p.Results.Epsilon), double(nValues));
+        end
+        
+        function add(obj, matrix)
+            % ADD  Adds the off diagonal values of a square matrix.
+            assert(~isempty(obj.Handle), 'ECDFAccumulator:finished', 'The CDF has been finished.');
+            
+            if ~isa(matrix, 'single')
+                matrix = double(matrix);
+            end
+            dynamical_inputs.nex.nexengine( ...
+                dynamical_inputs.nex.NexEngineOpcodes.ECDFAppend, obj.Handle, matrix);
+        end
+        
+        function [F, X, nIgnored, errorBound] = finish(obj)
+            % FINISH  Returns the CDF and releases the engine's copy.
+            %
+            % Output:
+            % F, X, nIgnored, errorBound - As returned by
+            %     dynamical_inputs.nex.windowecdf.
+            assert(~isempty(obj.Handle), 'ECDFAccumulator:finished', 'The CDF has been finished.');
+            
+            [F, X, nIgnored, errorBound] = dynamical_inputs.nex.nexengine( ...
+                dynamical_inputs.nex.NexEngineOpcodes.ECDFClose, obj.Handle);
+            obj.Handle = [];
+        end
+        
+        function delete(obj)
+            if ~isempty(obj.Handle)
+                dynamical_inputs.nex.nexengine( ...
+                    dynamical_inputs.nex.NexEngineOpcodes.ECDFClose, obj.Handle);
+                obj.Handle = [];
+            end
+        end
+    end
+end
@@ -5,5 +5,42 @@ classdef NexEngineOpcodes
         GetMarkers = 3;
         GetContinuous = 4;
         GetVariableHeaders = 5;
+        SelectSpikes = 6;
+        WindowAMD = 7;
+        SlidingWindowAMD = 8;
+        TiledWindowAMD = 9;
+        MultiWindowAMD = 10;
+        WindowStability = 11;
+        StreamStability = 12;
+        WindowECDF = 13;
+        SurrogateAMD = 14;
+        StreamOpen = 15;
+        StreamAppend = 16;
+        StreamClose = 17;
+        PairMetric = 18;
+        Correlograms = 19;
+        PSTH = 20;
+        BinCounts = 21;
+        BuildEnvelope = 22;
+        QueryEnvelope = 23;
+        ContinuousOpen = 24;
+        ContinuousNext = 25;
+        ContinuousClose = 26;
+        FilterContinuous = 27;
+        DetectSpikes = 28;
+        WaveformFeatures = 29;
+        SpikeTriggeredAverage = 30;
+        WelchPSD = 31;
+        Spectrogram = 32;
+        ReadIntervals = 33;
+        IntervalAlgebra = 34;
+        SequentialBouts = 35;
+        ResultStoreWrite = 36;
+        ResultStoreOpen = 37;
+        ResultStoreRead = 38;
+        ResultStoreClose = 39;
+        ECDFOpen = 40;
+        ECDFAppend = 41;
+        ECDFClose = 42;
     end
 end
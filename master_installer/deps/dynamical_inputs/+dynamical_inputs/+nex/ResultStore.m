@@ -0,0 +1,117 @@
+classdef ResultStore < handle
+    % RESULTSTORE  Random access to the windows of an AMD result file.
+    %
+    % Syntax:
+    % obj = RESULTSTORE(fileName)
+    %
+    % Description:
+    % Opens a file written by dynamical_inputs.nex.writeresultstore.  The
+    % engine memory maps the file and reads only its dictionary and window
+    % index, so the window times and neuron names are known straight away
+    % and each window is only read from disk when it's asked for.
+    %
+    % Input:
+    % fileName (string) - The AMD result file to open.
+    %
+    % RESULTSTORE Methods:
+    % read - Reads windows.
+    % close - Releases the engine's mapping of the file.
+    %
+    % Examples:
+    % store = dynamical_inputs.nex.ResultStore('C:\datafile.amdr');
+    % w = store.read(store.NumWindows);
+    % imagesc(w.AMD);
+    %
+    % See Also: dynamical_inputs.nex.writeresultstore,
+    %     dynamical.math.AMDWindow.loadresults
+    
+    properties (SetAccess = private)
+        % The file that's open.
+        FileName = ''
+        
+        % Storage class of the matrices, 'single' or 'double'.
+        Precision = 'double'
+        
+        % Name and cell ID of each neuron of the dictionary.
+        NeuronNames = cell(0, 1)
+        CellIDs = zeros(0, 1)
+        
+        % nWindows x 6 [WindowStart WindowEnd TimeMin TimeMax TimeDiff
+        % MinSpikeCount] of each window.
+        WindowInfo = zeros(0, 6)
+        
+        % Number of neurons in each window.
+        NumNeurons = zeros(0, 1)
+    end
+    
+    properties (Dependent = true)
+        NumWindows
+    end
+    
+    properties (Access = private)
+        % Handle of the file in the engine.
+        Handle = []
+    end
+    
+    methods
+        function obj = ResultStore(fileName)
+            validateattributes(fileName, {'char' 'string'}, {'nonempty'}, mfilename, 'fileName', 1);
+            
+            [obj.Handle, info] = dynamical_inputs.nex.nexengine( ...
+                dynamical_inputs.nex.NexEngineOpcodes.ResultStoreOpen, char(fileName));
+            
+            obj.FileName = char(fileName);
+            obj.Precision = info.Precision;
+            obj.NeuronNames = info.NeuronNames;
+            obj.CellIDs = info.CellIDs;
+            obj.WindowInfo = info.Windows;
+            obj.NumNeurons = info.NumNeurons;
+        end
+        
+        function n = get.NumWindows(obj)
+            n = size(obj.WindowInfo, 1);
+        end
+        
+        function windows = read(obj, indices)
+            % READ  Reads windows from the file.
+            %
+            % Syntax:
+            % windows = obj.READ()
+            % windows = obj.READ(indices)
+            %
+            % Input:
+            % indices (integer vector) - Which windows.  Default: all
+            %
+            % Output:
+            % windows (struct) - One element per index with fields
+            %     Neurons (dictionary indices), Stats (nNeurons x 4
+            %     [nSpikes ISImean ISIstd Poisson]), and the AMD, ZScore,
+            %     PValue and Percentile matrices, empty for those the
+            %     window doesn't have.
+            
+            assert(~isempty(obj.Handle), 'ResultStore:closed', 'The result file has been closed.');
+            
+            if nargin < 2
+                indices = 1:obj.NumWindows;
+            end
+            validateattributes(indices, {'numeric'}, {'integer' 'positive' '<=' obj.NumWindows}, ...
+                'read', 'indices', 1);
+            
+            windows = dynamical_inputs.nex.nexengine( ...
+                dynamical_inputs.nex.NexEngineOpcodes.ResultStoreRead, obj.Handle, double(indices(:)));
+        end
+        
+        function close(obj)
+            % CLOSE  Releases the engine's mapping of the file.
+            if ~isempty(obj.Handle)
+                dynamical_inputs.nex.nexengine( ...
+                    dynamical_inputs.nex.NexEngineOpcodes.ResultStoreClose, obj.Handle);
+                obj.Handle = [];
+            end
+        end
+        
+        function delete(obj)
+            obj.close();
+        end
+    end
+end
@@ -0,0 +1,81 @@
+function counts = bincounts(source, intervalTimes, timeRange, binWidth, varargin)
+% BINCOUNTS  Bins the spikes of every neuron into a count matrix.
+%
+% Syntax:
+% counts = BINCOUNTS(nexFileName, intervalTimes, timeRange, binWidth)
+% counts = BINCOUNTS(timestamps, intervalTimes, timeRange, binWidth)
+% counts = BINCOUNTS(___, 'Format', format, 'Precision', precision, 'Indices', indices)
+%
+% Description:
+% Builds the neurons x bins spike count matrix of a whole session without
+% going through a loop in MATLAB.  Given a NEX file name, the neuron
+% timestamps are read and binned as the integer ticks stored in the file,
+% so no seconds copy of the spikes is ever made.  The bin width must then
+% be a whole number of ticks.  Given timestamps, they are binned in
+% seconds.
+%
+% Bin b covers timeRange(1) + (b-1)*binWidth <= s < timeRange(1) + b*binWidth,
+% with the last bin cut short at timeRange(2) if needed.  Only spikes in
+% one of the intervals are counted.  Counts too large for the precision
+% are saturated.
+%
+% With the 'csr' format only the bins with spikes are stored, in
+% compressed sparse row form.  The counts of neuron i are in
+% Values(RowOffsets(i)+1:RowOffsets(i+1)), for the zero based bins in the
+% same elements of Columns.
+%
+% Input:
+% nexFileName (string) - The name of the NEX file to read.
+% timestamps (cell) - Sorted spike timestamps for each neuron. (s)
+% intervalTimes (table|matrix) - Intervals to restrict the spikes to,
+%     either a table with 'Start' and 'End' variables or an Nx2
+%     [start end] matrix.  Leave empty to use all spikes.
+% timeRange (vector) - [start end] time span to bin. (s)
+% binWidth (scalar) - Width of the bins. (s)
+%
+% Options:
+% Format (char) - 'dense' or 'csr'. (default: 'dense')
+% Precision (char) - 'uint16' or 'uint32'. (default: 'uint16')
+% Indices (vector) - Neuron variables to read from the file, in the same
+%     order as dynamical_inputs.nex.getneurondata.  All if empty.
+%     (default: [])
+%
+% Output:
+% counts (matrix|struct) - The nNeurons x nBins count matrix, or for the
+%     'csr' format a struct with RowOffsets, Columns, Values and Size.
+%
+% See Also: dynamical_inputs.nex.selectspikes
+
+narginchk(4, inf);
+
+p = inputParser;
+p.FunctionName = mfilename;
+addParameter(p, 'Format', 'dense', @(x) any(strcmp(x, {'dense' 'csr'})));
+addParameter(p, 'Precision', 'uint16', @(x) any(strcmp(x, {'uint16' 'uint32'})));
+addParameter(p, 'Indices', [], @(x) isempty(x) || isvector(x));
+parse(p, varargin{:});
+
+validateattributes(timeRange, {'numeric'}, {'numel', 2, 'increasing'}, mfilename, 'timeRange', 3);
+validateattributes(binWidth, {'numeric'}, {'scalar' 'positive'}, mfilename, 'binWidth', 4);
+
+if isstring(source)
+    source = char(source);
+end
+
+if istable(intervalTimes)
+    intervalTimes = [intervalTimes.Start intervalTimes.End];
+elseif isempty(intervalTimes)
+    intervalTimes = [];
+end
+
+opcode = dynamical_inputs.nex.NexEngineOpcodes.BinCounts;
+args = {source, double(intervalTimes), double(timeRange(:)), double(binWidth), ...
+    p.Results.Format, p.Results.Precision, double(p.Results.Indices(:))};
+
+if strcmp(p.Results.Format, 'dense')
+    counts = dynamical_inputs.nex.nexengine(opcode, args{:});
+else
+    [offsets, columns, values] = dynamical_inputs.nex.nexengine(opcode, args{:});
+    counts = struct('RowOffsets', offsets, 'Columns', columns, 'Values', values, ...
+        'Size', [numel(offsets) - 1, ceil(diff(timeRange) / binWidth - 1e-9)]);
+end
@@ -0,0 +1,69 @@
+function [times, minimum, maximum, samplesPerPoint] = continuousenvelope(nexFileName, index, timeSpan, nPixels, varargin)
+% CONTINUOUSENVELOPE  Gets the min/max envelope of a continuous channel for display.
+%
+% Syntax:
+% [times, minimum, maximum] = CONTINUOUSENVELOPE(nexFileName, index, timeSpan, nPixels)
+% [times, minimum, maximum, samplesPerPoint] = CONTINUOUSENVELOPE(___)
+% CONTINUOUSENVELOPE(___, 'CacheFile', cacheFile, 'Rebuild', rebuild)
+%
+% Description:
+% Plotting the min and max of each point's samples as a band draws the
+% channel the same as plotting every sample, at any zoom.  The first call
+% on a channel builds a pyramid of min/max envelopes at power of two
+% decimations, streaming the samples through once, and caches it on disk.
+% After that each call reads only about nPixels envelope points from the
+% cache, however long the span, so zooming through a day long recording
+% doesn't read the samples at all.  Spans short enough to need only a few
+% samples per pixel come back as the raw samples.
+%
+% No envelope point spans a gap between the channel's recorded fragments.
+% The cache is rebuilt if the NEX file changes size.
+%
+% Input:
+% nexFileName (string) - The name of the NEX file to read.
+% index (integer) - Which continuous variable, in the same order as
+%     dynamical_inputs.nex.getcontinuousdata.
+% timeSpan (vector) - [start end] time span to show. (s)
+% nPixels (integer) - Width of the plot, the result has at least this many
+%     points when the span has enough samples.
+%
+% Options:
+% CacheFile (string) - Where to keep the pyramid.  (default: the NEX file
+%     name with '.cont<index>.env' added)
+% Rebuild (logical) - Rebuild the cache even if it's up to date.
+%     (default: false)
+%
+% Output:
+% times (vector) - Start time of each point. (s)
+% minimum, maximum (vector) - Envelope of each point. (mV)
+% samplesPerPoint (scalar) - Samples covered by each point, 1 for raw
+%     samples.
+%
+% See Also: dynamical_inputs.nex.getcontinuousdata
+
+narginchk(4, inf);
+
+p = inputParser;
+p.FunctionName = mfilename;
+addParameter(p, 'CacheFile', '', @(x) ischar(x) || isstring(x));
+addParameter(p, 'Rebuild', false, @(x) isscalar(x) && islogical(x));
+parse(p, varargin{:});
+
+validateattributes(index, {'numeric'}, {'scalar' 'integer' 'positive'}, mfilename, 'index', 2);
+validateattributes(timeSpan, {'numeric'}, {'numel', 2, 'increasing'}, mfilename, 'timeSpan', 3);
+validateattributes(nPixels, {'numeric'}, {'scalar' 'integer' 'positive'}, mfilename, 'nPixels', 4);
+
+nexFileName = char(nexFileName);
+cacheFile = char(p.Results.CacheFile);
+if isempty(cacheFile)
+    cacheFile = sprintf('%s.cont%d.env', nexFileName, index);
+end
+
+if p.Results.Rebuild
+    dynamical_inputs.nex.nexengine(dynamical_inputs.nex.NexEngineOpcodes.BuildEnvelope, ...
+        nexFileName, double(index), cacheFile);
+end
+
+[times, minimum, maximum, samplesPerPoint] = dynamical_inputs.nex.nexengine( ...
+    dynamical_inputs.nex.NexEngineOpcodes.QueryEnvelope, nexFileName, double(index), ...
+    cacheFile, double(timeSpan(:)), double(nPixels));
@@ -0,0 +1,51 @@
+function [counts, lags] = correlograms(timestamps, intervalTimes, maxLag, binWidth)
+% CORRELOGRAMS  Calculates the cross and auto-correlograms of all neuron pairs.
+%
+% Syntax:
+% counts = CORRELOGRAMS(timestamps, intervalTimes, maxLag, binWidth)
+% [counts, lags] = CORRELOGRAMS(___)
+%
+% Description:
+% Counts the lags between the spikes of every pair of neurons, within
+% +/- maxLag, on the engine's thread pool.  Each pair is a single sweep
+% through both spike trains, so hundreds of neurons take seconds rather
+% than the minutes of a MATLAB loop over pairs.
+%
+% Only spikes inside the intervals are used.  A spike near the edge of an
+% interval can still be paired with a spike just inside a neighbouring
+% interval.  The auto-correlograms leave out each spike paired with itself.
+%
+% Input:
+% timestamps (cell) - Sorted spike timestamps for each neuron. (s)
+% intervalTimes (table|matrix) - Intervals to restrict the spikes to,
+%     either a table with 'Start' and 'End' variables or an Nx2
+%     [start end] matrix.  Leave empty to use all spikes.
+% maxLag (scalar) - Largest lag to count, rounded up to a whole number of
+%     bins. (s)
+% binWidth (scalar) - Width of the lag bins. (s)
+%
+% Output:
+% counts (uint32) - nBins x nNeurons x nNeurons array, where
+%     counts(:, i, j) is the correlogram of neuron j's spikes relative to
+%     neuron i's spikes, so positive lags are neuron j firing after neuron i.
+% lags (vector) - Center of each lag bin. (s)
+%
+% See Also: dynamical_inputs.nex.getneurondata
+
+narginchk(4, 4);
+
+validateattributes(timestamps, {'cell'}, {}, mfilename, 'timestamps', 1);
+validateattributes(maxLag, {'numeric'}, {'scalar' 'positive'}, mfilename, 'maxLag', 3);
+validateattributes(binWidth, {'numeric'}, {'scalar' 'positive' '<=', maxLag}, ...
+    mfilename, 'binWidth', 4);
+
+if istable(intervalTimes)
+    intervalTimes = [intervalTimes.Start intervalTimes.End];
+elseif isempty(intervalTimes)
+    intervalTimes = [];
+end
+
+opcode = dynamical_inputs.nex.NexEngineOpcodes.Correlograms;
+
+[counts, lags] = dynamical_inputs.nex.nexengine(opcode, timestamps, ...
+    double(intervalTimes), double(maxLag), double(binWidth));
@@ -0,0 +1,93 @@
+function [neuronTable, waveforms, thresholds] = detectspikes(nexFileName, indices, varargin)
+% DETECTSPIKES  Finds spikes on continuous channels by thresholding.
+%
+% Syntax:
+% neuronTable = DETECTSPIKES(nexFileName, indices)
+% [neuronTable, waveforms, thresholds] = DETECTSPIKES(___)
+% ___ = DETECTSPIKES(___, 'SOS', sos, 'Gain', g)
+% ___ = DETECTSPIKES(___, 'Threshold', k, 'Polarity', polarity, 'Refractory', r)
+% ___ = DETECTSPIKES(___, 'Snippet', [pre post], 'OutputFile', outputFile)
+%
+% Description:
+% Gives recordings with only raw continuous channels neuron variables for
+% the AMD pipeline.  Each channel is streamed from disk through an
+% optional high pass filter twice, in constant memory: once to estimate
+% the noise as median(|x|)/0.6745 from a subsample, and once to mark a
+% spike at the peak of each excursion past k times that.  No spike is
+% marked within the refractory period after another.  Channels are
+% searched in parallel by the engine.
+%
+% The filter runs forward only, starting each fragment settled on its
+% first sample.
+%
+% Input:
+% nexFileName (string) - The name of the NEX file to read.
+% indices (integer vector) - Which continuous variables, in the same order
+%     as dynamical_inputs.nex.getcontinuousdata.
+%
+% Options:
+% SOS (matrix) - Kx6 second order sections of the filter to detect on, in
+%     the layout of zp2sos.  (default: none)
+% Gain (scalar) - Gain to apply with the sections. (default: 1)
+% Threshold (scalar) - Threshold in noise standard deviations.
+%     (default: 4.5)
+% Polarity (string) - 'negative', 'positive' or 'both'.
+%     (default: 'negative')
+% Refractory (scalar) - Shortest time between spikes. (s) (default: 0.001)
+% Snippet (vector) - [pre post] samples of filtered signal to keep around
+%     each peak. (default: [0 0])
+% OutputFile (string) - NEX file to write the spikes to, as a neuron
+%     variable per channel named after it with '_spk' added, plus a
+%     waveform variable with '_wf' added after that if there are
+%     snippets.  (default: none)
+%
+% Output:
+% neuronTable (table) - One row per index with the 'name' of the channel
+%     and the 'timestamps' of its spikes (s), as getneurondata returns.
+% waveforms (cell) - The nSpikes x (pre+post) snippets of each channel.
+%     (mV)
+% thresholds (vector) - Threshold used on each channel. (mV)
+%
+% Examples:
+% % 300 Hz high pass on a 30 kHz channel, snippets of 0.3 + 0.6 ms.
+% [z, p, k] = butter(2, 300 / 15000, 'high');
+% [sos, g] = zp2sos(z, p, k);
+% neurons = dynamical_inputs.nex.detectspikes('C:\datafile.nex', 1:16, ...
+%     'SOS', sos, 'Gain', g, 'Snippet', [9 18]);
+%
+% See Also: dynamical_inputs.nex.getneurondata,
+%     dynamical_inputs.nex.filtercontinuous
+
+narginchk(2, inf);
+
+validateattributes(indices, {'numeric'}, {'vector' 'integer' 'positive'}, mfilename, 'indices', 2);
+
+p = inputParser;
+p.FunctionName = mfilename;
+addParameter(p, 'SOS', zeros(0, 6), @(x) isnumeric(x) && (isempty(x) || size(x, 2) == 6));
+addParameter(p, 'Gain', 1, @(x) isscalar(x) && isnumeric(x));
+addParameter(p, 'Threshold', 4.5, @(x) isscalar(x) && x > 0);
+addParameter(p, 'Polarity', 'negative', @(x) ischar(x) || isstring(x));
+addParameter(p, 'Refractory', 0.001, @(x) isscalar(x) && x >= 0);
+addParameter(p, 'Snippet', [0 0], @(x) isnumeric(x) && numel(x) == 2 && all(x >= 0 & x == round(x)));
+addParameter(p, 'OutputFile', '', @(x) ischar(x) || isstring(x));
+parse(p, varargin{:});
+
+polarity = validatestring(p.Results.Polarity, {'negative' 'positive' 'both'}, mfilename, 'Polarity');
+polarity = find(strcmp(polarity, {'negative' 'both' 'positive'})) - 2;
+
+sos = double(p.Results.SOS);
+if ~isempty(sos)
+    sos(1, 1:3) = sos(1, 1:3) * p.Results.Gain;
+end
+
+opcode = dynamical_inputs.nex.NexEngineOpcodes.DetectSpikes;
+
+spikes = dynamical_inputs.nex.nexengine(opcode, char(nexFileName), double(indices(:)), ...
+    reshape(sos, [], 6), double(p.Results.Threshold), polarity, double(p.Results.Refractory), ...
+    double(p.Results.Snippet(:)), char(p.Results.OutputFile));
+spikes = spikes(:);
+
+neuronTable = struct2table(rmfield(spikes, {'threshold' 'waveforms'}), 'AsArray', true);
+waveforms = {spikes.waveforms}';
+thresholds = [spikes.threshold]';
@@ -0,0 +1,94 @@
+function continuousTable = filtercontinuous(nexFileName, indices, varargin)
+% FILTERCONTINUOUS  Filters and decimates continuous channels as they're read.
+%
+% Syntax:
+% continuousTable = FILTERCONTINUOUS(nexFileName, indices)
+% continuousTable = FILTERCONTINUOUS(___, 'SOS', sos, 'Gain', g)
+% continuousTable = FILTERCONTINUOUS(___, 'Decimate', r, 'FIR', taps)
+% continuousTable = FILTERCONTINUOUS(___, 'ZeroPhase', zeroPhase)
+%
+% Description:
+% Does what getcontinuousdata followed by decimate and filtfilt would, but
+% in the engine while the samples stream off disk, so the full rate
+% channels are never loaded.  Each fragment is first run through the FIR
+% and cut down to every r'th sample, then through the IIR sections at the
+% lower rate.  Fragments are filtered separately so nothing is smeared
+% across the gaps between them, with each end padded by reflection.
+%
+% Channels recorded together are filtered together and the channels are
+% spread over the engine's threads.
+%
+% Input:
+% nexFileName (string) - The name of the NEX file to read.
+% indices (integer vector) - Which continuous variables, in the same order
+%     as dynamical_inputs.nex.getcontinuousdata.
+%
+% Options:
+% SOS (matrix) - Kx6 second order sections in the [b0 b1 b2 a0 a1 a2]
+%     layout of butter, zp2sos and friends.  (default: none)
+% Gain (scalar) - Gain to apply with the sections. (default: 1)
+% ZeroPhase (logical) - Run the sections forward and backward like
+%     filtfilt, rather than forward only like sosfilt. (default: true)
+% Decimate (integer) - Keep every r'th sample. (default: 1)
+% FIR (vector) - Anti-aliasing filter to run before decimating.  It's
+%     centered on each kept sample, so odd length symmetric taps add no
+%     delay.  (default: a Hamming windowed sinc of 20r+1 taps with its
+%     cutoff at 0.8 of the new Nyquist rate when decimating, none
+%     otherwise)
+%
+% Output:
+% continuousTable (table) - One row per index with the ADFrequency,
+%     timestamps, fragmentStarts and data of the filtered channel, the
+%     same as getcontinuousdata's.  data is in mV.
+%
+% Examples:
+% % LFP band from a 40 kHz channel, at 1 kHz.
+% [z, p, k] = butter(3, [1 300] / 500);
+% [sos, g] = zp2sos(z, p, k);
+% lfp = dynamical_inputs.nex.filtercontinuous('C:\datafile.nex', 1:4, ...
+%     'Decimate', 40, 'SOS', sos, 'Gain', g);
+%
+% See Also: dynamical_inputs.nex.getcontinuousdata,
+%     dynamical_inputs.nex.ContinuousReader
+
+narginchk(2, inf);
+
+validateattributes(indices, {'numeric'}, {'vector' 'integer' 'positive'}, mfilename, 'indices', 2);
+
+p = inputParser;
+p.FunctionName = mfilename;
+addParameter(p, 'SOS', zeros(0, 6), @(x) isnumeric(x) && (isempty(x) || size(x, 2) == 6));
+addParameter(p, 'Gain', 1, @(x) isscalar(x) && isnumeric(x));
+addParameter(p, 'ZeroPhase', true, @(x) isscalar(x) && islogical(x));
+addParameter(p, 'Decimate', 1, @(x) isscalar(x) && x >= 1 && x == round(x));
+addParameter(p, 'FIR', [], @(x) isnumeric(x) && (isempty(x) || isvector(x)));
+parse(p, varargin{:});
+
+sos = double(p.Results.SOS);
+if ~isempty(sos)
+    sos(1, 1:3) = sos(1, 1:3) * p.Results.Gain;
+end
+
+r = double(p.Results.Decimate);
+taps = double(p.Results.FIR(:));
+if isempty(taps) && r > 1
+    taps = antialias(r);
+end
+
+opcode = dynamical_inputs.nex.NexEngineOpcodes.FilterContinuous;
+
+filtered = dynamical_inputs.nex.nexengine(opcode, char(nexFileName), double(indices(:)), ...
+    taps, r, reshape(sos, [], 6), p.Results.ZeroPhase);
+
+continuousTable = struct2table(filtered(:), 'AsArray', true);
+
+
+function taps = antialias(r)
+% Hamming windowed sinc low pass for decimating by r.
+n = (-10*r:10*r)';
+cutoff = 0.8 / r;
+x = pi * cutoff * n;
+taps = sin(x) ./ x;
+taps(n == 0) = 1;
+taps = taps .* (0.54 + 0.46*cos(pi * n / (10*r)));
+taps = taps / sum(taps);
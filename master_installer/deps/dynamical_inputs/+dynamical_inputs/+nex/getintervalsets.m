@@ -0,0 +1,47 @@
+function [intervalSets, fileSpan] = getintervalsets(nexFileName, intervalNames, isCaseSensitive)
+% GETINTERVALSETS  Reads NEX interval variables as sorted, disjoint interval sets.
+%
+% Syntax:
+% intervalSets = GETINTERVALSETS(nexFileName, intervalNames)
+% [intervalSets, fileSpan] = GETINTERVALSETS(___, isCaseSensitive)
+%
+% Description:
+% Reads the named interval variables in the engine, rather than reading
+% every variable of the file and building a table per name the way
+% getintervaltimes does.  Each set comes back sorted with its overlapping
+% and touching intervals merged, the form dynamical_inputs.nex.intervalset
+% and the engine's spike selection commands take.
+%
+% Input:
+% nexFileName (string) - The name of the NEX file to read.
+% intervalNames (string array) - Names of the interval variables.
+% isCaseSensitive (logical) - If true, we do a case sensitive search for
+%     the interval names.  Default: false
+%
+% Output:
+% intervalSets (cell) - An Nx2 [start end] matrix per name. (s)
+% fileSpan (vector) - [tbeg tend] of the file. (s)
+%
+% Examples:
+% % All REM and slow wave sleep.
+% sets = dynamical_inputs.nex.getintervalsets('C:\datafile.nex', {'REM' 'SWS'});
+% sleep = dynamical_inputs.nex.intervalset('union', sets{:});
+%
+% See Also: dynamical_inputs.nex.intervalset,
+%     dynamical_inputs.nex.getintervaltimes
+
+narginchk(2, 3);
+
+if nargin < 3
+    isCaseSensitive = false;
+end
+
+validateattributes(isCaseSensitive, {'logical'}, {'scalar' 'nonempty'}, ...
+    mfilename, 'isCaseSensitive', 3);
+
+intervalNames = cellstr(intervalNames);
+
+opcode = dynamical_inputs.nex.NexEngineOpcodes.ReadIntervals;
+
+[intervalSets, fileSpan] = dynamical_inputs.nex.nexengine(opcode, char(nexFileName), ...
+    intervalNames(:)', isCaseSensitive);
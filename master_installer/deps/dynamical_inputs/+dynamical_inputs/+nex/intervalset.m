@@ -0,0 +1,87 @@
+function intervals = intervalset(operation, varargin)
+% INTERVALSET  Set operations on sorted, disjoint interval lists.
+%
+% Syntax:
+% intervals = INTERVALSET('union', A, B, ...)
+% intervals = INTERVALSET('intersect', A, B, ...)
+% intervals = INTERVALSET('setdiff', A, B)
+% intervals = INTERVALSET('complement', A, [tbeg tend])
+% intervals = INTERVALSET('minduration', A, minDuration)
+% intervals = INTERVALSET('mergegaps', A, maxGap)
+%
+% Description:
+% Interval algebra for selecting phases and bouts, done in the engine in
+% O(n log n) instead of by concatenating tables, calling sortrows and
+% scanning for overlaps.  Inputs are sorted and merged first, so they can
+% be in any order and overlap.  Outputs are sorted and disjoint, ready for
+% selectspikes, bincounts and the other commands that take intervalTimes.
+%
+% A set is treated as the time it covers, ignoring endpoints, so results
+% have no zero length intervals: intervals that only touch don't
+% intersect, and removing an interval doesn't leave its endpoints behind.
+% union and intersect take any number of sets.
+%
+% Input:
+% A, B (matrix or table) - Nx2 [start end] matrices, or tables with Start
+%     and End columns as returned by getintervaltimes. (s)
+% [tbeg tend] (vector) - Span to complement within, e.g. the fileSpan
+%     from getintervalsets. (s)
+% minDuration (scalar) - Intervals shorter than this are dropped. (s)
+% maxGap (scalar) - Intervals separated by at most this much are joined.
+%     (s)
+%
+% Output:
+% intervals (matrix) - Nx2 [start end] matrix. (s)
+%
+% Examples:
+% % Sleep bouts of at least 30 s outside of artifacts, bridging gaps of
+% % up to 5 s.
+% [sets, span] = dynamical_inputs.nex.getintervalsets('C:\datafile.nex', ...
+%     {'REM' 'SWS' 'Artifact'});
+% sleep = dynamical_inputs.nex.intervalset('union', sets{1:2});
+% sleep = dynamical_inputs.nex.intervalset('setdiff', sleep, sets{3});
+% sleep = dynamical_inputs.nex.intervalset('mergegaps', sleep, 5);
+% sleep = dynamical_inputs.nex.intervalset('minduration', sleep, 30);
+% awake = dynamical_inputs.nex.intervalset('complement', sleep, span);
+%
+% See Also: dynamical_inputs.nex.getintervalsets,
+%     dynamical_inputs.nex.selectspikes
+
+narginchk(2, inf);
+
+operations = {'union' 'intersect' 'setdiff' 'complement' 'minduration' 'mergegaps'};
+operation = validatestring(operation, operations, mfilename, 'operation', 1);
+code = find(strcmp(operation, operations)) - 1;
+
+opcode = dynamical_inputs.nex.NexEngineOpcodes.IntervalAlgebra;
+
+sets = cellfun(@tomatrix, varargin, 'UniformOutput', false);
+
+switch operation
+    case {'union' 'intersect'}
+        % A union with nothing just sorts and merges the first set.
+        intervals = dynamical_inputs.nex.nexengine(opcode, 0, sets{1}, zeros(0, 2), 0);
+        for i = 2:numel(sets)
+            intervals = dynamical_inputs.nex.nexengine(opcode, code, intervals, sets{i}, 0);
+        end
+        
+    case 'setdiff'
+        narginchk(3, 3);
+        intervals = dynamical_inputs.nex.nexengine(opcode, code, sets{1}, sets{2}, 0);
+        
+    otherwise
+        narginchk(3, 3);
+        parameter = double(varargin{2});
+        validateattributes(parameter, {'numeric'}, {'vector' 'real' 'nonnan'}, mfilename, 'parameter', 3);
+        intervals = dynamical_inputs.nex.nexengine(opcode, code, sets{1}, zeros(0, 2), parameter(:)');
+end
+
+
+function x = tomatrix(x)
+% Nx2 double matrix of an interval table or matrix.
+if istable(x)
+    x = [x.Start x.End];
+elseif isempty(x)
+    x = zeros(0, 2);
+end
+x = double(x);
@@ -0,0 +1,24 @@
+function tf = isengineavailable
+% ISENGINEAVAILABLE  Checks if the compiled NEX engine can be used.
+%
+% Syntax:
+% tf = ISENGINEAVAILABLE
+%
+% Description:
+% The NEX engine is a mex file that has to be built for the current system
+% via makeengine.  Code that has a native fast path can use this to decide
+% whether to call into the engine or fall back to its MATLAB
+% implementation.
+%
+% Output:
+% tf (logical) - True if the nexengine mex file was found.
+%
+% See also MAKEENGINE
+
+persistent isAvailable
+
+if isempty(isAvailable)
+    isAvailable = ~isempty(which('dynamical_inputs.nex.nexengine'));
+end
+
+tf = isAvailable;
@@ -16,12 +16,21 @@ srcPath = fullfile(w.path, 'src');
 % Path to the local header files.
 includePath = sprintf('-I%s', srcPath);
 
-% Name of the primary .cpp file.
-mainCPP = fullfile(srcPath, 'nexengine.cpp');
+% Source files that make up the engine.  nexengine.cpp holds the mex
+% gateway, the rest are the kernels it dispatches to.
+srcFiles = fullfile(srcPath, {'nexengine.cpp', 'spiketrains.cpp', 'amdkernel.cpp', ...
+    'threadpool.cpp', 'slidingamd.cpp', 'tiledamd.cpp', 'stabilitykernel.cpp', ...
+    'streamstability.cpp', 'ecdfkernel.cpp', 'surrogateamd.cpp', ...
+    'streamingamd.cpp', 'pairmetrics.cpp', 'correlogram.cpp', ...
+    'psthkernel.cpp', 'bincounts.cpp', 'continuousfile.cpp', 'envelope.cpp', ...
+    'continuousreader.cpp', 'continuousfilter.cpp', 'spikedetect.cpp', ...
+    'waveformfeatures.cpp', 'stakernel.cpp', 'fftkernel.cpp', ...
+    'spectralkernel.cpp', 'intervalset.cpp', 'sequentialbouts.cpp', ...
+    'resultstore.cpp'});
 
 % Output directory of the mex binary, i.e. the compiled engine.
 outputDir = sprintf('-outdir %s', w.path);
 
 % f = sprintf('mex -v %s -largeArrayDims %s %s', outputDir, includePath, mainCPP);
 % eval(f);
-feval(@mex, '-largearraydims', '-v', includePath, '-outdir', outputDir, mainCPP);
+feval(@mex, '-largearraydims', '-v', includePath, '-outdir', outputDir, srcFiles{:});
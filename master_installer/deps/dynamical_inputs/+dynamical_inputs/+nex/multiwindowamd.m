@@ -0,0 +1,65 @@
+function [amdMatrices, zScores, stats] = multiwindowamd(timestamps, intervalTimes, windowTimes, neuronMask, varargin)
+% MULTIWINDOWAMD  Calculates the AMD of a set of time windows in one go.
+%
+% Syntax:
+% amdMatrices = MULTIWINDOWAMD(timestamps, intervalTimes, windowTimes, neuronMask)
+% [amdMatrices, zScores, stats] = MULTIWINDOWAMD(___)
+% ___ = MULTIWINDOWAMD(___, 'Precision', precision)
+%
+% Description:
+% Gives the same results as calling dynamical_inputs.nex.windowamd on each
+% window, but all the windows are processed together on the engine's
+% thread pool.  Each window's neuron pairs are split into tiles and the
+% tiles of every window are handed out to the threads as tasks, with idle
+% threads stealing tasks from busy ones.  Windows with many active neurons
+% are therefore spread over all the threads instead of holding up one of
+% them, and the spike data is shared rather than copied to each worker.
+%
+% Input:
+% timestamps (cell) - Sorted spike timestamps for each neuron. (s)
+% intervalTimes (table|matrix) - Intervals to restrict the spikes to,
+%     either a table with 'Start' and 'End' variables or an Nx2
+%     [start end] matrix.  Leave empty to use all spikes.
+% windowTimes (matrix) - Wx2 [start end] matrix of time windows.  Each
+%     window covers start <= s < end. (s)
+% neuronMask (logical) - nNeurons x W mask of the neurons to include in
+%     the results of each window.
+%
+% Options (key,value):
+% 'Precision' (string) - Class of the AMD and z-score matrices, either
+%     'double' or 'single'.  Calculations are always done in double.
+%     Default: 'double'
+%
+% Output:
+% amdMatrices (cell) - Wx1 cell array of AMD matrices, one per window, for
+%     the neurons selected by the window's column of neuronMask.
+% zScores (cell) - Wx1 cell array of the matching z-score matrices.
+% stats (cell) - Wx1 cell array of stats structs, with the same fields as
+%     the stats returned by dynamical_inputs.nex.windowamd.
+%
+% See Also: dynamical_inputs.nex.windowamd, dynamical_inputs.nex.slidingamd
+
+narginchk(4, inf);
+
+validateattributes(timestamps, {'cell'}, {}, mfilename, 'timestamps', 1);
+validateattributes(windowTimes, {'numeric'}, {'2d'}, mfilename, 'windowTimes', 3);
+validateattributes(neuronMask, {'logical' 'numeric'}, ...
+    {'size', [numel(timestamps) size(windowTimes, 1)]}, mfilename, 'neuronMask', 4);
+
+p = inputParser;
+p.FunctionName = mfilename;
+addParameter(p, 'Precision', 'double', @(x) any(validatestring(x, {'double' 'single'})));
+parse(p, varargin{:});
+
+precision = validatestring(p.Results.Precision, {'double' 'single'});
+
+if istable(intervalTimes)
+    intervalTimes = [intervalTimes.Start intervalTimes.End];
+elseif isempty(intervalTimes)
+    intervalTimes = [];
+end
+
+opcode = dynamical_inputs.nex.NexEngineOpcodes.MultiWindowAMD;
+
+[amdMatrices, zScores, stats] = dynamical_inputs.nex.nexengine(opcode, ...
+    timestamps, double(intervalTimes), double(windowTimes), logical(neuronMask), precision);
@@ -0,0 +1,70 @@
+function values = pairmetric(timestamps, intervalTimes, windowTimes, neuronMask, metric, varargin)
+% PAIRMETRIC  Calculates a pairwise spike train metric for a set of time windows.
+%
+% Syntax:
+% values = PAIRMETRIC(timestamps, intervalTimes, windowTimes, neuronMask, metric)
+% values = PAIRMETRIC(___, 'Dt', dt)
+%
+% Description:
+% Runs any of the engine's pair metrics with the same window slicing, tiling
+% and threading as dynamical_inputs.nex.multiwindowamd.  Each metric has its
+% own compiled pair loop, so choosing one costs nothing per spike.
+%
+% The metrics are:
+%     'amd' - Average minimum distance from each neuron to each other one,
+%         the same as the AMD matrices of multiwindowamd.
+%     'sttc' - Spike time tiling coefficient (Cutts and Eglen, 2014), from
+%         -1 to 1, using a coincidence window of +/- Dt.
+%     'isi' - ISI-distance (Kreuz et al., 2007), from 0 to 1.
+%     'spike' - SPIKE-distance (Kreuz et al., 2013), from 0 to 1.
+% All but 'amd' are symmetric.  'sttc', 'isi' and 'spike' average over time,
+% and only the parts of the window covered by intervalTimes count as time.
+% 'isi' and 'spike' treat the edges of each covered part as spikes of every
+% neuron.  Pairs where either neuron has no spikes in the window are NaN,
+% and so is the diagonal of such a neuron for every metric but 'amd', whose
+% diagonal is always zero.
+%
+% Input:
+% timestamps (cell) - Sorted spike timestamps for each neuron. (s)
+% intervalTimes (table|matrix) - Intervals to restrict the spikes to,
+%     either a table with 'Start' and 'End' variables or an Nx2
+%     [start end] matrix.  Leave empty to use all spikes.
+% windowTimes (matrix) - Wx2 [start end] matrix of time windows.  Each
+%     window covers start <= s < end. (s)
+% neuronMask (logical) - nNeurons x W mask of the neurons to include in
+%     the results of each window.
+% metric (char) - One of 'amd', 'sttc', 'isi' or 'spike'.
+%
+% Options:
+% Dt (scalar) - Coincidence window of 'sttc'. (s) (default: 0.005)
+%
+% Output:
+% values (cell) - Wx1 cell array of metric matrices, one per window, for
+%     the neurons selected by the window's column of neuronMask.  Element
+%     (i,j) is the metric from neuron i to neuron j.
+%
+% See Also: dynamical_inputs.nex.multiwindowamd
+
+narginchk(5, inf);
+
+validateattributes(timestamps, {'cell'}, {}, mfilename, 'timestamps', 1);
+validateattributes(windowTimes, {'numeric'}, {'2d'}, mfilename, 'windowTimes', 3);
+validateattributes(neuronMask, {'logical' 'numeric'}, ...
+    {'size', [numel(timestamps) size(windowTimes, 1)]}, mfilename, 'neuronMask', 4);
+metric = validatestring(metric, {'amd' 'sttc' 'isi' 'spike'}, mfilename, 'metric', 5);
+
+p = inputParser;
+p.FunctionName = mfilename;
+addParameter(p, 'Dt', 0.005, @(x) isscalar(x) && x > 0);
+parse(p, varargin{:});
+
+if istable(intervalTimes)
+    intervalTimes = [intervalTimes.Start intervalTimes.End];
+elseif isempty(intervalTimes)
+    intervalTimes = [];
+end
+
+opcode = dynamical_inputs.nex.NexEngineOpcodes.PairMetric;
+
+values = dynamical_inputs.nex.nexengine(opcode, timestamps, double(intervalTimes), ...
+    double(windowTimes), logical(neuronMask), metric, double(p.Results.Dt));
@@ -0,0 +1,99 @@
+function [counts, binCenters, offsets, spikeTimes] = psth(timestamps, triggers, trialWindow, binWidth, varargin)
+% PSTH  Aligns spikes to triggers, giving PSTHs and per trial rasters.
+%
+% Syntax:
+% counts = PSTH(timestamps, triggers, trialWindow, binWidth)
+% counts = PSTH(timestamps, markerData, trialWindow, binWidth, 'Field', field, 'Value', value)
+% [counts, binCenters, offsets, spikeTimes] = PSTH(___)
+%
+% Description:
+% Each trigger starts a trial covering trigger - pre <= s < trigger + post.
+% The spikes of every neuron in every trial are found with binary searches
+% on the engine's thread pool, so 10k triggers and hundreds of neurons
+% don't need a loop in MATLAB.
+%
+% The triggers can be given as times, as an event read by
+% dynamical_inputs.nex.readvariabledata, or as a marker read the same way.
+% For a marker, only the timestamps whose value of the 'Field' marker field
+% matches 'Value' are used.
+%
+% The rasters come back in compressed sparse row form.  Row
+% r = trial + nTrials*(neuron - 1) holds the spikes of one neuron in one
+% trial, which are spikeTimes(offsets(r)+1:offsets(r+1)).
+%
+% Input:
+% timestamps (cell) - Sorted spike timestamps for each neuron. (s)
+% triggers (vector) - Trigger times, one per trial. (s)
+% markerData (struct) - An event or marker variable struct.
+% trialWindow (vector) - [pre post] time to include before and after each
+%     trigger. (s)
+% binWidth (scalar) - Width of the PSTH bins. (s)
+%
+% Options:
+% Field (char) - Name of the marker field to filter on.
+% Value (char|scalar) - Marker value to keep.  A number is compared
+%     against the numeric value of the marker strings.
+%
+% Output:
+% counts (matrix) - nBins x nNeurons spike counts, summed over trials.
+%     Divide by nTrials*binWidth for the firing rate.
+% binCenters (vector) - Center of each bin relative to the trigger. (s)
+% offsets (uint64) - nTrials*nNeurons + 1 row offsets into spikeTimes.
+% spikeTimes (vector) - Spike times relative to their row's trigger. (s)
+%
+% See Also: dynamical_inputs.nex.readvariabledata
+
+narginchk(4, inf);
+
+p = inputParser;
+p.FunctionName = mfilename;
+addParameter(p, 'Field', '', @(x) ischar(x) || isstring(x));
+addParameter(p, 'Value', []);
+parse(p, varargin{:});
+
+validateattributes(timestamps, {'cell'}, {}, mfilename, 'timestamps', 1);
+validateattributes(trialWindow, {'numeric'}, {'numel', 2}, mfilename, 'trialWindow', 3);
+validateattributes(binWidth, {'numeric'}, {'scalar' 'positive'}, mfilename, 'binWidth', 4);
+
+if isstruct(triggers)
+    triggers = triggertimes(triggers, char(p.Results.Field), p.Results.Value);
+end
+validateattributes(triggers, {'numeric'}, {}, mfilename, 'triggers', 2);
+
+opcode = dynamical_inputs.nex.NexEngineOpcodes.PSTH;
+
+if nargout > 2
+    [counts, offsets, spikeTimes] = dynamical_inputs.nex.nexengine(opcode, timestamps, ...
+        double(triggers(:)), double(trialWindow(:)), double(binWidth));
+else
+    counts = dynamical_inputs.nex.nexengine(opcode, timestamps, ...
+        double(triggers(:)), double(trialWindow(:)), double(binWidth));
+end
+
+edges = -trialWindow(1) + (0:size(counts, 1)) * binWidth;
+edges(end) = min(edges(end), trialWindow(2));
+binCenters = (edges(1:end-1) + edges(2:end))' / 2;
+
+
+function t = triggertimes(variable, field, value)
+% Picks the trigger times out of an event or marker variable.
+
+t = variable.timestamps;
+if isempty(field)
+    return;
+end
+
+names = cellfun(@(v) v.name, variable.values, 'UniformOutput', false);
+iField = find(strcmp(names, field), 1);
+if isempty(iField)
+    error('nex:psth:unknownField', ...
+        'The marker has no field named ''%s''.', field);
+end
+
+strings = variable.values{iField}.strings;
+if isnumeric(value)
+    isKept = str2double(strings) == value;
+else
+    isKept = strcmp(strings, char(value));
+end
+t = t(isKept);
@@ -0,0 +1,86 @@
+function [psd, frequencies, nSegments] = pwelchcontinuous(nexFileName, indices, varargin)
+% PWELCHCONTINUOUS  Welch power spectral density of continuous channels.
+%
+% Syntax:
+% [psd, frequencies] = PWELCHCONTINUOUS(nexFileName, indices)
+% [psd, frequencies, nSegments] = PWELCHCONTINUOUS(___)
+% ___ = PWELCHCONTINUOUS(___, 'Window', window, 'Overlap', overlap, 'NFFT', nfft)
+%
+% Description:
+% Does what getcontinuousdata followed by pwelch would, but in the engine
+% while the samples stream off disk, so the channels are never loaded as
+% double.  Segments never span a gap between fragments; the end of a
+% fragment too short for another segment is left out.  The result is
+% scaled as pwelch's is when given the sample rate, i.e. one sided in
+% mV^2/Hz.  Channels are done in parallel by the engine.
+%
+% Input:
+% nexFileName (string) - The name of the NEX file to read.
+% indices (integer vector) - Which continuous variables, in the same order
+%     as dynamical_inputs.nex.getcontinuousdata.  They must share a sample
+%     rate.
+%
+% Options:
+% Window (vector or integer) - Window applied to each segment, or the
+%     length of a Hamming window. (default: 1024)
+% Overlap (integer) - Samples shared by consecutive segments.
+%     (default: half the window)
+% NFFT (integer) - FFT length, at least the window length.  Lengths made
+%     of small factors are fastest. (default: the window length)
+%
+% Output:
+% psd (single) - nFrequencies x numel(indices) power spectral densities.
+%     (mV^2/Hz)
+% frequencies (vector) - Frequency of each row. (Hz)
+% nSegments (vector) - Number of segments averaged for each channel.
+%
+% Examples:
+% [psd, f] = dynamical_inputs.nex.pwelchcontinuous('C:\datafile.nex', 1:4, 'Window', 2048);
+% semilogy(f, psd);
+%
+% See Also: dynamical_inputs.nex.spectrogramcontinuous,
+%     dynamical_inputs.nex.getcontinuousdata
+
+narginchk(2, inf);
+
+validateattributes(indices, {'numeric'}, {'vector' 'integer' 'positive'}, mfilename, 'indices', 2);
+
+[window, overlap, nfft] = parseoptions(varargin);
+
+opcode = dynamical_inputs.nex.NexEngineOpcodes.WelchPSD;
+
+spectra = dynamical_inputs.nex.nexengine(opcode, char(nexFileName), double(indices(:)), ...
+    window, overlap, nfft);
+
+frequencies = spectra(1).frequencies;
+if any(arrayfun(@(s) ~isequal(s.frequencies, frequencies), spectra))
+    error('nex:pwelchcontinuous:sampleRate', 'The channels must share a sample rate.');
+end
+psd = [spectra.power];
+nSegments = [spectra.nSegments]';
+
+
+function [window, overlap, nfft] = parseoptions(options)
+% Shared option parsing with spectrogramcontinuous.
+p = inputParser;
+p.FunctionName = 'pwelchcontinuous';
+addParameter(p, 'Window', 1024, @(x) isnumeric(x) && isvector(x) && ~isempty(x));
+addParameter(p, 'Overlap', [], @(x) isempty(x) || (isscalar(x) && x >= 0 && x == round(x)));
+addParameter(p, 'NFFT', [], @(x) isempty(x) || (isscalar(x) && x >= 1 && x == round(x)));
+parse(p, options{:});
+
+window = double(p.Results.Window(:));
+if isscalar(window)
+    n = (0:window-1)';
+    window = 0.54 - 0.46*cos(2*pi*n / max(window - 1, 1));
+end
+
+overlap = double(p.Results.Overlap);
+if isempty(overlap)
+    overlap = floor(numel(window) / 2);
+end
+
+nfft = double(p.Results.NFFT);
+if isempty(nfft)
+    nfft = numel(window);
+end
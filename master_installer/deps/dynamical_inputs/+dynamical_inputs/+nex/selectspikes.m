@@ -0,0 +1,49 @@
+function [spikeCounts, spikeRanges] = selectspikes(timestamps, intervalTimes, windowTimes)
+% SELECTSPIKES  Finds the spikes within a set of time windows and intervals.
+%
+% Syntax:
+% spikeCounts = SELECTSPIKES(timestamps, intervalTimes, windowTimes)
+% [spikeCounts, spikeRanges] = SELECTSPIKES(___)
+%
+% Description:
+% Native replacement for building a logical spike mask per interval.  For
+% every neuron and time window, the spikes s with start <= s < end that
+% also fall within one of the (closed) intervals are selected.  The
+% intervals are sorted and merged once, then each spike train is walked
+% alongside them in a single pass.
+%
+% Input:
+% timestamps (cell) - Sorted spike timestamps for each neuron, e.g. the
+%     timestamps column of the table returned by getneurondata. (s)
+% intervalTimes (table|matrix) - Intervals to restrict the selection to,
+%     either a table with 'Start' and 'End' variables as returned by
+%     getintervaltimes or an Nx2 [start end] matrix.  Leave empty to only
+%     filter by the time windows.
+% windowTimes (matrix) - Wx2 [start end] matrix of time windows. (s)
+%
+% Output:
+% spikeCounts (matrix) - nNeurons x W matrix of selected spike counts.
+% spikeRanges (cell) - nNeurons x W cell array.  Each cell contains an Rx2
+%     matrix of [first last] spike indices (1 based, inclusive) into the
+%     neuron's timestamps.
+
+narginchk(3, 3);
+
+validateattributes(timestamps, {'cell'}, {}, mfilename, 'timestamps', 1);
+validateattributes(windowTimes, {'numeric'}, {'2d'}, mfilename, 'windowTimes', 3);
+
+if istable(intervalTimes)
+    intervalTimes = [intervalTimes.Start intervalTimes.End];
+elseif isempty(intervalTimes)
+    intervalTimes = [];
+end
+
+opcode = dynamical_inputs.nex.NexEngineOpcodes.SelectSpikes;
+
+if nargout > 1
+    [spikeCounts, spikeRanges] = dynamical_inputs.nex.nexengine(opcode, ...
+        timestamps, double(intervalTimes), double(windowTimes));
+else
+    spikeCounts = dynamical_inputs.nex.nexengine(opcode, ...
+        timestamps, double(intervalTimes), double(windowTimes));
+end
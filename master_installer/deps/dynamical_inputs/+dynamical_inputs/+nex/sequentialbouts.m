@@ -0,0 +1,30 @@
+function [seqStart, seqStop, seqAverage] = sequentialbouts(time, data, boutLength)
+% SEQUENTIALBOUTS  Averages the runs of equally spaced samples in the engine.
+%
+% Syntax:
+% [seqStart, seqStop, seqAverage] = SEQUENTIALBOUTS(time, data, boutLength)
+%
+% Description:
+% The native version of dynamical.util.averagesequentialbouts.  A sample
+% continues the run of the one before it if the time between them equals
+% boutLength to within eps.  The runs are found and averaged in two linear
+% passes, and come back as columns rather than a struct array.
+%
+% Input:
+% time (vector) - Ascending sample times.
+% data (vector) - Value of each sample.
+% boutLength (scalar) - Time between the samples of a run.
+%
+% Output:
+% seqStart (vector) - Time of the first sample of each run.
+% seqStop (vector) - Time of the last sample of each run.
+% seqAverage (vector) - Mean of the data of each run.
+%
+% See Also: dynamical.util.averagesequentialbouts
+
+narginchk(3, 3);
+
+opcode = dynamical_inputs.nex.NexEngineOpcodes.SequentialBouts;
+
+[seqStart, seqStop, seqAverage] = dynamical_inputs.nex.nexengine(opcode, double(time(:)), ...
+    double(data(:)), double(boutLength));
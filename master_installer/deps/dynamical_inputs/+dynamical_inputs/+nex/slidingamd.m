@@ -0,0 +1,63 @@
+function [amdMatrices, zScores, stats] = slidingamd(timestamps, intervalTimes, windowTimes, neuronMask, varargin)
+% SLIDINGAMD  Calculates the AMD of a sequence of overlapping time windows.
+%
+% Syntax:
+% amdMatrices = SLIDINGAMD(timestamps, intervalTimes, windowTimes, neuronMask)
+% [amdMatrices, zScores, stats] = SLIDINGAMD(___)
+% ___ = SLIDINGAMD(___, 'Precision', precision)
+%
+% Description:
+% Gives the same results as calling dynamical_inputs.nex.windowamd on each
+% window, but is much faster when the windows overlap, i.e. the window step
+% is smaller than the window size.  A single window is slid across the
+% windows in order and running sums are kept for every neuron pair, so only
+% the spikes entering and leaving the window are visited at each step.
+%
+% Input:
+% timestamps (cell) - Sorted spike timestamps for each neuron. (s)
+% intervalTimes (table|matrix) - Intervals to restrict the spikes to,
+%     either a table with 'Start' and 'End' variables or an Nx2
+%     [start end] matrix.  Leave empty to use all spikes.
+% windowTimes (matrix) - Wx2 [start end] matrix of time windows, sorted by
+%     start time.  Each window covers start <= s < end. (s)
+% neuronMask (logical) - nNeurons x W mask of the neurons to include in
+%     the results of each window.
+%
+% Options (key,value):
+% 'Precision' (string) - Class of the AMD and z-score matrices, either
+%     'double' or 'single'.  Calculations are always done in double.
+%     Default: 'double'
+%
+% Output:
+% amdMatrices (cell) - Wx1 cell array of AMD matrices, one per window, for
+%     the neurons selected by the window's column of neuronMask.
+% zScores (cell) - Wx1 cell array of the matching z-score matrices.
+% stats (cell) - Wx1 cell array of stats structs, with the same fields as
+%     the stats returned by dynamical_inputs.nex.windowamd.
+%
+% See Also: dynamical_inputs.nex.windowamd
+
+narginchk(4, inf);
+
+validateattributes(timestamps, {'cell'}, {}, mfilename, 'timestamps', 1);
+validateattributes(windowTimes, {'numeric'}, {'2d'}, mfilename, 'windowTimes', 3);
+validateattributes(neuronMask, {'logical' 'numeric'}, ...
+    {'size', [numel(timestamps) size(windowTimes, 1)]}, mfilename, 'neuronMask', 4);
+
+p = inputParser;
+p.FunctionName = mfilename;
+addParameter(p, 'Precision', 'double', @(x) any(validatestring(x, {'double' 'single'})));
+parse(p, varargin{:});
+
+precision = validatestring(p.Results.Precision, {'double' 'single'});
+
+if istable(intervalTimes)
+    intervalTimes = [intervalTimes.Start intervalTimes.End];
+elseif isempty(intervalTimes)
+    intervalTimes = [];
+end
+
+opcode = dynamical_inputs.nex.NexEngineOpcodes.SlidingWindowAMD;
+
+[amdMatrices, zScores, stats] = dynamical_inputs.nex.nexengine(opcode, ...
+    timestamps, double(intervalTimes), double(windowTimes), logical(neuronMask), precision);
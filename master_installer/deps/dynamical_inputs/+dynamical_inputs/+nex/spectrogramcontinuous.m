@@ -0,0 +1,82 @@
+function spectra = spectrogramcontinuous(nexFileName, indices, varargin)
+% SPECTROGRAMCONTINUOUS  Short time power spectra of continuous channels.
+%
+% Syntax:
+% spectra = SPECTROGRAMCONTINUOUS(nexFileName, indices)
+% spectra = SPECTROGRAMCONTINUOUS(___, 'Window', window, 'Overlap', overlap, 'NFFT', nfft)
+%
+% Description:
+% The power spectral density of each segment, as spectrogram's fourth
+% output when given the sample rate, computed in the engine while the
+% samples stream off disk.  The spectra are single precision, which keeps
+% spectrograms of day long recordings to half the size.  Segments never
+% span a gap between fragments, so the times of the columns jump across
+% gaps.  Channels are done in parallel by the engine.
+%
+% Input:
+% nexFileName (string) - The name of the NEX file to read.
+% indices (integer vector) - Which continuous variables, in the same order
+%     as dynamical_inputs.nex.getcontinuousdata.
+%
+% Options:
+% Window (vector or integer) - Window applied to each segment, or the
+%     length of a Hamming window. (default: 1024)
+% Overlap (integer) - Samples shared by consecutive segments.
+%     (default: half the window)
+% NFFT (integer) - FFT length, at least the window length.  Lengths made
+%     of small factors are fastest. (default: the window length)
+%
+% Output:
+% spectra (struct) - One element per channel with fields:
+%     name - Name of the channel.
+%     frequencies - nFrequencies x 1 frequency of each row. (Hz)
+%     power - nFrequencies x nSegments single power spectral densities.
+%         (mV^2/Hz)
+%     times - nSegments x 1 time of the centre of each segment. (s)
+%     nSegments - Number of segments.
+%
+% Examples:
+% s = dynamical_inputs.nex.spectrogramcontinuous('C:\datafile.nex', 1, ...
+%     'Window', 4096, 'Overlap', 2048);
+% imagesc(s.times, s.frequencies, 10*log10(s.power)); axis xy;
+%
+% See Also: dynamical_inputs.nex.pwelchcontinuous,
+%     dynamical_inputs.nex.getcontinuousdata
+
+narginchk(2, inf);
+
+validateattributes(indices, {'numeric'}, {'vector' 'integer' 'positive'}, mfilename, 'indices', 2);
+
+[window, overlap, nfft] = parseoptions(varargin);
+
+opcode = dynamical_inputs.nex.NexEngineOpcodes.Spectrogram;
+
+spectra = dynamical_inputs.nex.nexengine(opcode, char(nexFileName), double(indices(:)), ...
+    window, overlap, nfft);
+spectra = spectra(:);
+
+
+function [window, overlap, nfft] = parseoptions(options)
+% Same options as pwelchcontinuous.
+p = inputParser;
+p.FunctionName = 'spectrogramcontinuous';
+addParameter(p, 'Window', 1024, @(x) isnumeric(x) && isvector(x) && ~isempty(x));
+addParameter(p, 'Overlap', [], @(x) isempty(x) || (isscalar(x) && x >= 0 && x == round(x)));
+addParameter(p, 'NFFT', [], @(x) isempty(x) || (isscalar(x) && x >= 1 && x == round(x)));
+parse(p, options{:});
+
+window = double(p.Results.Window(:));
+if isscalar(window)
+    n = (0:window-1)';
+    window = 0.54 - 0.46*cos(2*pi*n / max(window - 1, 1));
+end
+
+overlap = double(p.Results.Overlap);
+if isempty(overlap)
+    overlap = floor(numel(window) / 2);
+end
+
+nfft = double(p.Results.NFFT);
+if isempty(nfft)
+    nfft = numel(window);
+end
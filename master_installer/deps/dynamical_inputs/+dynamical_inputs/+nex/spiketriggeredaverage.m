@@ -0,0 +1,52 @@
+function sta = spiketriggeredaverage(nexFileName, neuronIndices, channelIndices, window)
+% SPIKETRIGGEREDAVERAGE  Averages continuous channels around spikes.
+%
+% Syntax:
+% sta = SPIKETRIGGEREDAVERAGE(nexFileName, neuronIndices, channelIndices, window)
+%
+% Description:
+% Computes the spike triggered average of each continuous channel for each
+% neuron, e.g. the spike triggered LFP, without loading the channels.  Each
+% spike is put on the nearest sample of the fragment it falls in and only
+% the samples around the spikes are read, as raw int16.  Spikes in gaps
+% between fragments are skipped, and spikes near the ends of a fragment
+% only count at the lags that stay inside it.  Channels are averaged in
+% parallel by the engine.
+%
+% Input:
+% nexFileName (string) - The name of the NEX file to read.
+% neuronIndices (integer vector) - Which neuron variables, in the same
+%     order as dynamical_inputs.nex.getneurondata.
+% channelIndices (integer vector) - Which continuous variables, in the same
+%     order as dynamical_inputs.nex.getcontinuousdata.
+% window (vector) - [pre post] time before and after each spike, rounded
+%     to whole samples of each channel.  Either can be negative for a
+%     window that starts after the spike or ends before it. (s)
+%
+% Output:
+% sta (struct) - One element per channel with fields:
+%     name - Name of the channel.
+%     lags - nLags x 1 lag of each row from the spike. (s)
+%     mean - nLags x nNeurons average. (mV)
+%     sd - nLags x nNeurons standard deviation. (mV)
+%     count - nLags x nNeurons number of spikes at each lag.
+%
+% Examples:
+% % LFP from 100 ms before to 200 ms after the spikes of neurons 1 to 5.
+% sta = dynamical_inputs.nex.spiketriggeredaverage('C:\datafile.nex', 1:5, 1, [0.1 0.2]);
+% plot(sta(1).lags, sta(1).mean);
+%
+% See Also: dynamical_inputs.nex.getneurondata,
+%     dynamical_inputs.nex.getcontinuousdata
+
+narginchk(4, 4);
+
+validateattributes(neuronIndices, {'numeric'}, {'vector' 'integer' 'positive'}, mfilename, 'neuronIndices', 2);
+validateattributes(channelIndices, {'numeric'}, {'vector' 'integer' 'positive'}, mfilename, 'channelIndices', 3);
+validateattributes(window, {'numeric'}, {'numel' 2 'real' 'finite'}, mfilename, 'window', 4);
+
+opcode = dynamical_inputs.nex.NexEngineOpcodes.SpikeTriggeredAverage;
+
+sta = dynamical_inputs.nex.nexengine(opcode, char(nexFileName), double(neuronIndices(:)), ...
+    double(channelIndices(:)), double(window(:)));
+sta = sta(:);
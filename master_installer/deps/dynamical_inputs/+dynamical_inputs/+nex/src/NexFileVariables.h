@@ -13,6 +13,8 @@ public:
         : m_Name( name ), m_TimestampFrequency( timestampFrequency )
         , m_DataOffset( 0 ) {}
 
+    virtual ~NexFileVariable() {}
+
     virtual void WriteVariableHeader( FILE* fp, int& dataOffset ) = 0;
     virtual void WriteData( FILE* fp ) = 0;
 
@@ -31,6 +33,14 @@ public:
         m_Timestamps.push_back( ( int )( tsInSeconds * m_TimestampFrequency ) );
     }
 
+    void AddTimestamp( int ticks ) {
+        m_Timestamps.push_back( ticks );
+    }
+
+    int LastTimestamp() const {
+        return m_Timestamps.empty() ? 0 : m_Timestamps.back();
+    }
+
     virtual void WriteVariableHeader( FILE* fp, int& dataOffset ) {
         // store data offset for our data
         m_DataOffset = dataOffset;
@@ -50,11 +60,96 @@ public:
     }
 
     virtual void WriteData( FILE* fp ) {
-        fwrite( &m_Timestamps[0], m_Timestamps.size() * sizeof( int ), 1, fp );
+        if ( !m_Timestamps.empty() ) {
+            fwrite( &m_Timestamps[0], m_Timestamps.size() * sizeof( int ), 1, fp );
+        }
     }
 
 protected:
     std::vector<int> m_Timestamps;
 };
 
+// waveform variable: a timestamp and nPointsWave A/D values per waveform
+class Waveform : public Neuron
+{
+public:
+    Waveform( const char* name, double timestampFrequency, double waveformFrequency,
+              int nPointsWave, double adToMV, double prethresholdTimeInSeconds )
+        : Neuron( name, timestampFrequency ), m_WaveformFrequency( waveformFrequency )
+        , m_NPointsWave( nPointsWave ), m_ADtoMV( adToMV )
+        , m_PrethresholdTime( prethresholdTimeInSeconds ) {}
+
+    // values are nPointsWave raw A/D values
+    void AddWaveform( int ticks, const short* values ) {
+        AddTimestamp( ticks );
+        m_Values.insert( m_Values.end(), values, values + m_NPointsWave );
+    }
+
+    virtual void WriteVariableHeader( FILE* fp, int& dataOffset ) {
+        m_DataOffset = dataOffset;
+
+        NexVarHeader varheader;
+        memset( &varheader, 0, sizeof( NexVarHeader ) );
+        varheader.Type = NEX_VARIABLE_TYPE_WAVEFORM;
+        varheader.Version = 102; // PrethresholdTimeInSeconds is valid
+        strcpy( varheader.Name, m_Name.c_str() );
+        varheader.DataOffset = dataOffset;
+        varheader.Count = ( int )m_Timestamps.size();
+        varheader.WFrequency = m_WaveformFrequency;
+        varheader.ADtoMV = m_ADtoMV;
+        varheader.NPointsWave = m_NPointsWave;
+        varheader.PrethresholdTimeInSeconds = m_PrethresholdTime;
+        fwrite( &varheader, sizeof( NexVarHeader ), 1, fp );
+
+        // timestamps, then the values of all the waveforms
+        dataOffset += varheader.Count * ( sizeof( int ) + m_NPointsWave * sizeof( short ) );
+    }
+
+    virtual void WriteData( FILE* fp ) {
+        Neuron::WriteData( fp );
+        if ( !m_Values.empty() ) {
+            fwrite( &m_Values[0], m_Values.size() * sizeof( short ), 1, fp );
+        }
+    }
+
+protected:
+    double m_WaveformFrequency;
+    int m_NPointsWave;
+    double m_ADtoMV;
+    double m_PrethresholdTime;
+    std::vector<short> m_Values;
+};
+
+// writes a .nex file holding fileVariables, returns false if the file
+// couldn't be written
+inline bool SaveNexFile( const char* filePath, double timestampFrequency, int endTicks,
+                         const std::vector<NexFileVariable*>& fileVariables )
+{
+    FILE* fp = fopen( filePath, "wb" );
+    if ( fp == 0 ) return false;
+
+    NexFileHeader fh;
+    memset( &fh, 0, sizeof( NexFileHeader ) );
+    char magic[] = "NEX1";
+    memcpy( &fh.MagicNumber, magic, 4 );
+    fh.NexFileVersion = 100;
+    fh.Frequency = timestampFrequency;
+    fh.Beg = 0;
+    fh.End = endTicks;
+    fh.NumVars = ( int )fileVariables.size();
+    fwrite( &fh, sizeof( NexFileHeader ), 1, fp );
+
+    // data starts right after all the headers
+    int dataOffset = sizeof( NexFileHeader ) + fh.NumVars * sizeof( NexVarHeader );
+    for ( size_t i = 0; i < fileVariables.size(); ++i ) {
+        fileVariables[i]->WriteVariableHeader( fp, dataOffset );
+    }
+    for ( size_t i = 0; i < fileVariables.size(); ++i ) {
+        fileVariables[i]->WriteData( fp );
+    }
+
+    bool isWritten = ferror( fp ) == 0;
+    return fclose( fp ) == 0 && isWritten;
+}
+
 #endif
@@ -0,0 +1,124 @@
+#include "amdkernel.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+void pairAMD(SpikeTrain a, SpikeTrain b, double *amdAB, double *amdBA)
+{
+    const double nan = std::numeric_limits<double>::quiet_NaN();
+
+    if (a.n == 0 || b.n == 0) {
+        *amdAB = nan;
+        *amdBA = nan;
+        return;
+    }
+
+    double sumAB = 0.0;
+    double sumBA = 0.0;
+    size_t i = 0;
+    size_t j = 0;
+
+    // Merge the two trains.  When we're at a[i], b[j-1] is the last spike of
+    // b at or before it and b[j] the first one after it, so the nearest
+    // spike in b is one of the two.  The same goes for b[j] against a.
+    while (i < a.n || j < b.n) {
+        if (j == b.n || (i < a.n && a.t[i] <= b.t[j])) {
+            double t = a.t[i];
+            double d = (j < b.n) ? b.t[j] - t : std::numeric_limits<double>::infinity();
+            if (j > 0) {
+                d = std::min(d, t - b.t[j-1]);
+            }
+            sumAB += d;
+            i++;
+        }
+        else {
+            double t = b.t[j];
+            double d = (i < a.n) ? a.t[i] - t : std::numeric_limits<double>::infinity();
+            if (i > 0) {
+                d = std::min(d, t - a.t[i-1]);
+            }
+            sumBA += d;
+            j++;
+        }
+    }
+
+    *amdAB = sumAB / (double)a.n;
+    *amdBA = sumBA / (double)b.n;
+}
+
+
+void finishNeuronStats(size_t nSpikes, double c1, double c2, double sum2, double sum3,
+                       double timeDiff, NeuronStats &stats)
+{
+    double T = timeDiff;
+
+    stats.nSpikes = (double)nSpikes;
+
+    // Neurons without spikes don't contribute anything.
+    if (nSpikes == 0) {
+        stats.isiMean = 0.0;
+        stats.isiStd = 0.0;
+        stats.poisson = 0.0;
+        return;
+    }
+
+    stats.poisson = 0.5 * T / stats.nSpikes;
+
+    double isiMean = (c1*c1 + c2*c2) / (2.0 * T) + sum2 / (4.0 * T);
+    double isiWidth = (c1*c1*c1 + c2*c2*c2) / (3.0 * T) + sum3 / (12.0 * T);
+    stats.isiMean = isiMean;
+    stats.isiStd = std::sqrt(isiWidth - isiMean * isiMean);
+}
+
+
+void computeWindowStats(const std::vector<SpikeTrain> &trains, WindowStats &window,
+                        std::vector<NeuronStats> &stats)
+{
+    const double nan = std::numeric_limits<double>::quiet_NaN();
+    size_t nTrains = trains.size();
+
+    // Find the min and max spike times across all neurons.
+    window.timeMin = nan;
+    window.timeMax = nan;
+    for (size_t i = 0; i < nTrains; i++) {
+        if (trains[i].n == 0) {
+            continue;
+        }
+        double first = trains[i].t[0];
+        double last = trains[i].t[trains[i].n - 1];
+        if (!(first >= window.timeMin)) {
+            window.timeMin = first;
+        }
+        if (!(last <= window.timeMax)) {
+            window.timeMax = last;
+        }
+    }
+    window.timeDiff = window.timeMax - window.timeMin;
+
+    double T = window.timeDiff;
+
+    stats.resize(nTrains);
+    for (size_t i = 0; i < nTrains; i++) {
+        const SpikeTrain &s = trains[i];
+        NeuronStats &ns = stats[i];
+
+        if (s.n == 0) {
+            finishNeuronStats(0, 0.0, 0.0, 0.0, 0.0, T, ns);
+            continue;
+        }
+
+        double c1 = s.t[0] - window.timeMin;
+        double c2 = window.timeMax - s.t[s.n - 1];
+        double sum2 = 0.0;
+        double sum3 = 0.0;
+        for (size_t k = 1; k < s.n; k++) {
+            double d = s.t[k] - s.t[k-1];
+            double d2 = d * d;
+            sum2 += d2;
+            sum3 += d2 * d;
+        }
+
+        finishNeuronStats(s.n, c1, c2, sum2, sum3, T, ns);
+    }
+}
@@ -0,0 +1,117 @@
+#ifndef AMDKERNEL_H
+#define AMDKERNEL_H
+
+#include <cmath>
+#include <cstddef>
+#include <vector>
+#include "spiketrains.h"
+
+// Per neuron statistics for a single AMD window.  These mirror the columns of
+// the AMDWindow Stats table.
+struct NeuronStats
+{
+    double nSpikes;
+    double isiMean;
+    double isiStd;
+    double poisson;
+};
+
+// Time span covered by the spikes of a single AMD window.
+struct WindowStats
+{
+    double timeMin;
+    double timeMax;
+    double timeDiff;
+};
+
+
+/*******************************************************************************
+ finishNeuronStats - Fills in a neuron's stats from its ISI moment sums.
+
+ Syntax:
+ finishNeuronStats(size_t nSpikes, double c1, double c2, double sum2, double sum3,
+                   double timeDiff, NeuronStats &stats)
+
+ Description:
+ The ISI moments follow Dan's AMDv4 implementation.  The gaps between the
+ window's time span and the neuron's first/last spike are counted alongside
+ the ISIs themselves.  Neurons without spikes get zeros.
+
+ Input:
+ nSpikes - Number of spikes of the neuron in the window.
+ c1 - Time from the window's first spike to the neuron's first spike.
+ c2 - Time from the neuron's last spike to the window's last spike.
+ sum2, sum3 - Sums of the squared and cubed ISIs.
+ timeDiff - Time span of the window's spikes.
+
+ Output:
+ stats - The neuron's stats.
+*******************************************************************************/
+void finishNeuronStats(size_t nSpikes, double c1, double c2, double sum2, double sum3,
+                       double timeDiff, NeuronStats &stats);
+
+
+/*******************************************************************************
+ computeZScore - Z-score of a single AMD value.
+
+ Syntax:
+ double computeZScore(double amd, const NeuronStats &from, const NeuronStats &to)
+
+ Description:
+ Compares the AMD from neuron "from" to neuron "to" against the ISI
+ distribution of "to", scaled by the number of spikes of "from".  This is
+ the z-score calculation the Zochowski lab gave us.
+*******************************************************************************/
+inline double computeZScore(double amd, const NeuronStats &from, const NeuronStats &to)
+{
+    return (to.isiMean - amd) / to.isiStd * std::sqrt(from.nSpikes);
+}
+
+
+/*******************************************************************************
+ pairAMD - Average minimum distance between two spike trains, both directions.
+
+ Syntax:
+ pairAMD(SpikeTrain a, SpikeTrain b, double *amdAB, double *amdBA)
+
+ Description:
+ For every spike in a, finds the distance to the nearest spike in b and
+ averages them (amdAB), and vice versa (amdBA).  Both trains are walked
+ together in a single merge: each spike's nearest neighbour in the other
+ train is either the last spike of the other train seen so far or the next
+ one, so no search is needed.  If either train is empty the corresponding
+ distances are NaN.
+
+ Input:
+ a, b - Sorted spike trains.
+
+ Output:
+ amdAB - Mean distance from the spikes of a to their nearest spike in b.
+ amdBA - Mean distance from the spikes of b to their nearest spike in a.
+*******************************************************************************/
+void pairAMD(SpikeTrain a, SpikeTrain b, double *amdAB, double *amdBA);
+
+
+/*******************************************************************************
+ computeWindowStats - Computes the AMD window time span and neuron stats.
+
+ Syntax:
+ computeWindowStats(const std::vector<SpikeTrain> &trains, WindowStats &window,
+                    std::vector<NeuronStats> &stats)
+
+ Description:
+ Calculates the spike counts, Poisson expectation and the ISI mean/std of
+ every neuron in a window the same way the AMDv4 reference implementation
+ does.  Neurons without spikes get zeros.
+
+ Input:
+ trains - The window's spike trains, one per neuron.
+
+ Output:
+ window - Smallest/largest spike time across all trains and their difference.
+ stats - Resized to the number of trains and filled in.
+*******************************************************************************/
+void computeWindowStats(const std::vector<SpikeTrain> &trains, WindowStats &window,
+                        std::vector<NeuronStats> &stats);
+
+#endif
@@ -0,0 +1,179 @@
+#include "bincounts.h"
+
+#include <algorithm>
+#include <limits>
+
+// Bins per dense block.  Each block is one task for the thread pool.
+static const size_t BIN_BLOCK = 256;
+
+
+// Bin of time t, which must be inside the grid.
+template <typename T>
+static inline size_t binOf(T t, const BinGrid<T> &grid)
+{
+    return std::min((size_t)((t - grid.start) / grid.width), grid.nBins - 1);
+}
+
+
+template <typename C>
+static inline void saturatingIncrement(C &c)
+{
+    if (c < std::numeric_limits<C>::max()) {
+        c++;
+    }
+}
+
+
+// Calls fn(bin) for each spike of train in [from, to) that is inside the
+// intervals, in time order.
+template <typename T, typename Fn>
+static void forEachSpike(TimedTrain<T> train, const std::vector<TimeSpan<T> > &intervals,
+                         const BinGrid<T> &grid, T from, T to, Fn fn)
+{
+    const T *t = std::lower_bound(train.t, train.t + train.n, from);
+    const T *end = train.t + train.n;
+
+    if (intervals.empty()) {
+        for (; t < end && *t < to; t++) {
+            fn(binOf(*t, grid));
+        }
+        return;
+    }
+
+    // First interval that doesn't end before the first spike.
+    size_t k = 0;
+    if (t < end) {
+        k = std::lower_bound(intervals.begin(), intervals.end(), *t,
+            [](const TimeSpan<T> &span, T value) { return span.end < value; }) - intervals.begin();
+    }
+
+    for (; t < end && *t < to && k < intervals.size(); t++) {
+        while (k < intervals.size() && intervals[k].end < *t) {
+            k++;
+        }
+        if (k < intervals.size() && intervals[k].start <= *t) {
+            fn(binOf(*t, grid));
+        }
+    }
+}
+
+
+// Start of a bin, or the end of the grid for the bin after the last.
+template <typename T>
+static T gridTime(const BinGrid<T> &grid, size_t bin)
+{
+    return bin >= grid.nBins ? grid.end : grid.start + (T)bin * grid.width;
+}
+
+
+template <typename T, typename C>
+void binCountsDense(const std::vector<TimedTrain<T> > &trains,
+                    const std::vector<TimeSpan<T> > &intervals, const BinGrid<T> &grid,
+                    C *counts, ThreadPool &pool)
+{
+    size_t nNeurons = trains.size();
+    size_t nBlocks = (grid.nBins + BIN_BLOCK - 1) / BIN_BLOCK;
+
+    pool.parallelFor(nBlocks, 1, [&](size_t begin, size_t end) {
+        for (size_t block = begin; block < end; block++) {
+            size_t b0 = block * BIN_BLOCK;
+            size_t b1 = std::min(b0 + BIN_BLOCK, grid.nBins);
+            std::fill(counts + b0*nNeurons, counts + b1*nNeurons, 0);
+
+            for (size_t i = 0; i < nNeurons; i++) {
+                // Rounding can put a seconds spike on the wrong side of a
+                // block edge, and the block must stay within its columns.
+                forEachSpike(trains[i], intervals, grid, gridTime(grid, b0), gridTime(grid, b1),
+                             [&](size_t bin) {
+                    bin = std::min(std::max(bin, b0), b1 - 1);
+                    saturatingIncrement(counts[i + bin*nNeurons]);
+                });
+            }
+        }
+    });
+}
+
+
+template <typename T>
+void countNonzeroBins(const std::vector<TimedTrain<T> > &trains,
+                      const std::vector<TimeSpan<T> > &intervals, const BinGrid<T> &grid,
+                      uint64_t *offsets, ThreadPool &pool)
+{
+    size_t nNeurons = trains.size();
+
+    offsets[0] = 0;
+    pool.parallelFor(nNeurons, 1, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) {
+            // The spikes are sorted, so each new bin starts a new run.
+            uint64_t nNonzero = 0;
+            size_t last = grid.nBins;
+            forEachSpike(trains[i], intervals, grid, grid.start, grid.end, [&](size_t bin) {
+                if (bin != last) {
+                    nNonzero++;
+                    last = bin;
+                }
+            });
+            offsets[i + 1] = nNonzero;
+        }
+    });
+
+    for (size_t i = 1; i <= nNeurons; i++) {
+        offsets[i] += offsets[i - 1];
+    }
+}
+
+
+template <typename T, typename C>
+void binCountsCSR(const std::vector<TimedTrain<T> > &trains,
+                  const std::vector<TimeSpan<T> > &intervals, const BinGrid<T> &grid,
+                  const uint64_t *offsets, uint32_t *columns, C *values, ThreadPool &pool)
+{
+    size_t nNeurons = trains.size();
+
+    pool.parallelFor(nNeurons, 1, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) {
+            uint32_t *column = columns + offsets[i];
+            C *value = values + offsets[i];
+            size_t k = 0;
+            size_t last = grid.nBins;
+
+            forEachSpike(trains[i], intervals, grid, grid.start, grid.end, [&](size_t bin) {
+                if (bin != last) {
+                    column[k] = (uint32_t)bin;
+                    value[k] = 0;
+                    k++;
+                    last = bin;
+                }
+                saturatingIncrement(value[k - 1]);
+            });
+        }
+    });
+}
+
+
+template void binCountsDense<int64_t, uint16_t>(const std::vector<TimedTrain<int64_t> > &,
+    const std::vector<TimeSpan<int64_t> > &, const BinGrid<int64_t> &, uint16_t *, ThreadPool &);
+template void binCountsDense<int64_t, uint32_t>(const std::vector<TimedTrain<int64_t> > &,
+    const std::vector<TimeSpan<int64_t> > &, const BinGrid<int64_t> &, uint32_t *, ThreadPool &);
+template void binCountsDense<double, uint16_t>(const std::vector<TimedTrain<double> > &,
+    const std::vector<TimeSpan<double> > &, const BinGrid<double> &, uint16_t *, ThreadPool &);
+template void binCountsDense<double, uint32_t>(const std::vector<TimedTrain<double> > &,
+    const std::vector<TimeSpan<double> > &, const BinGrid<double> &, uint32_t *, ThreadPool &);
+
+template void countNonzeroBins<int64_t>(const std::vector<TimedTrain<int64_t> > &,
+    const std::vector<TimeSpan<int64_t> > &, const BinGrid<int64_t> &, uint64_t *, ThreadPool &);
+template void countNonzeroBins<double>(const std::vector<TimedTrain<double> > &,
+    const std::vector<TimeSpan<double> > &, const BinGrid<double> &, uint64_t *, ThreadPool &);
+
+template void binCountsCSR<int64_t, uint16_t>(const std::vector<TimedTrain<int64_t> > &,
+    const std::vector<TimeSpan<int64_t> > &, const BinGrid<int64_t> &, const uint64_t *,
+    uint32_t *, uint16_t *, ThreadPool &);
+template void binCountsCSR<int64_t, uint32_t>(const std::vector<TimedTrain<int64_t> > &,
+    const std::vector<TimeSpan<int64_t> > &, const BinGrid<int64_t> &, const uint64_t *,
+    uint32_t *, uint32_t *, ThreadPool &);
+template void binCountsCSR<double, uint16_t>(const std::vector<TimedTrain<double> > &,
+    const std::vector<TimeSpan<double> > &, const BinGrid<double> &, const uint64_t *,
+    uint32_t *, uint16_t *, ThreadPool &);
+template void binCountsCSR<double, uint32_t>(const std::vector<TimedTrain<double> > &,
+    const std::vector<TimeSpan<double> > &, const BinGrid<double> &, const uint64_t *,
+    uint32_t *, uint32_t *, ThreadPool &);
@@ -0,0 +1,113 @@
+#ifndef BINCOUNTS_H
+#define BINCOUNTS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "threadpool.h"
+
+// A read only view of a sorted spike train in either seconds (double) or
+// NEX timestamp ticks (int64_t, so the bin edges of long recordings can't
+// overflow).
+template <typename T>
+struct TimedTrain
+{
+    const T *t;
+    size_t n;
+};
+
+// A closed time interval [start, end], in the same units as the trains.
+template <typename T>
+struct TimeSpan
+{
+    T start;
+    T end;
+};
+
+// Bin b covers start + b*width <= t < start + (b+1)*width, with the last
+// bin cut short at end.  For ticks this is all integer arithmetic.
+template <typename T>
+struct BinGrid
+{
+    T start;
+    T width;
+    size_t nBins;
+    T end;
+};
+
+
+/*******************************************************************************
+ binCountsDense - Bins the spikes of every neuron into a dense count matrix.
+
+ Syntax:
+ binCountsDense(const std::vector<TimedTrain<T> > &trains,
+                const std::vector<TimeSpan<T> > &intervals, const BinGrid<T> &grid,
+                C *counts, ThreadPool &pool)
+
+ Description:
+ Only spikes inside one of the intervals are counted, or all of them if
+ there are none.  The bins are split into blocks that run on the thread
+ pool.  Each block finds its first spike in each train with a binary search
+ and writes a contiguous run of the column major output, so no two threads
+ write to the same cache lines.  Counts that don't fit in C are saturated.
+
+ Input:
+ trains - Sorted spike trains.
+ intervals - Sorted, disjoint intervals.
+ grid - Bin layout.
+ pool - Thread pool to run on.
+
+ Output:
+ counts - Preallocated nNeurons x nBins matrix, column major.
+*******************************************************************************/
+template <typename T, typename C>
+void binCountsDense(const std::vector<TimedTrain<T> > &trains,
+                    const std::vector<TimeSpan<T> > &intervals, const BinGrid<T> &grid,
+                    C *counts, ThreadPool &pool);
+
+
+/*******************************************************************************
+ countNonzeroBins - Counts the bins with spikes in each neuron's row.
+
+ Syntax:
+ countNonzeroBins(const std::vector<TimedTrain<T> > &trains,
+                  const std::vector<TimeSpan<T> > &intervals, const BinGrid<T> &grid,
+                  uint64_t *offsets, ThreadPool &pool)
+
+ Description:
+ First of the two passes that build the count matrix in compressed sparse
+ row form, one row per neuron.  Only bins with spikes are stored, which
+ for short bins is a small fraction of the dense matrix.
+
+ Output:
+ offsets - Preallocated nNeurons + 1 row offsets.  The bins of row i are
+     columns[offsets[i]] to columns[offsets[i+1] - 1].
+*******************************************************************************/
+template <typename T>
+void countNonzeroBins(const std::vector<TimedTrain<T> > &trains,
+                      const std::vector<TimeSpan<T> > &intervals, const BinGrid<T> &grid,
+                      uint64_t *offsets, ThreadPool &pool);
+
+
+/*******************************************************************************
+ binCountsCSR - Fills in a compressed sparse row count matrix.
+
+ Syntax:
+ binCountsCSR(const std::vector<TimedTrain<T> > &trains,
+              const std::vector<TimeSpan<T> > &intervals, const BinGrid<T> &grid,
+              const uint64_t *offsets, uint32_t *columns, C *values, ThreadPool &pool)
+
+ Description:
+ Second pass, once the caller has allocated the columns and values to the
+ size given by countNonzeroBins.
+
+ Output:
+ columns - Zero based bin index of each stored count, ascending in a row.
+ values - The counts, saturated if they don't fit in C.
+*******************************************************************************/
+template <typename T, typename C>
+void binCountsCSR(const std::vector<TimedTrain<T> > &trains,
+                  const std::vector<TimeSpan<T> > &intervals, const BinGrid<T> &grid,
+                  const uint64_t *offsets, uint32_t *columns, C *values, ThreadPool &pool);
+
+#endif
@@ -0,0 +1,119 @@
+#include "continuousfile.h"
+
+#include <cstring>
+
+
+bool seekFile(FILE *fp, int64_t offset)
+{
+#ifdef _WIN32
+    return _fseeki64(fp, offset, SEEK_SET) == 0;
+#else
+    return fseeko(fp, (off_t)offset, SEEK_SET) == 0;
+#endif
+}
+
+
+int64_t getFileSize(FILE *fp)
+{
+#ifdef _WIN32
+    if (_fseeki64(fp, 0, SEEK_END) != 0) {
+        return -1;
+    }
+    return _ftelli64(fp);
+#else
+    if (fseeko(fp, 0, SEEK_END) != 0) {
+        return -1;
+    }
+    return (int64_t)ftello(fp);
+#endif
+}
+
+
+const char *readVariableHeader(FILE *fp, int type, int index, NexFileHeader &fileHeader,
+                               NexVarHeader &varHeader)
+{
+    std::vector<NexVarHeader> allHeaders;
+
+    if (!seekFile(fp, 0) || fread(&fileHeader, sizeof(NexFileHeader), 1, fp) != 1) {
+        return "Failed to read the file header.";
+    }
+    if (fileHeader.NumVars < 0) {
+        return "Invalid file header.";
+    }
+    allHeaders.resize(fileHeader.NumVars);
+    if (fileHeader.NumVars > 0 &&
+        fread(&allHeaders[0], sizeof(NexVarHeader) * fileHeader.NumVars, 1, fp) != 1) {
+        return "Failed to read the variable headers.";
+    }
+
+    int nFound = 0;
+    for (size_t i = 0; i < allHeaders.size(); i++) {
+        if (allHeaders[i].Type == type && nFound++ == index) {
+            varHeader = allHeaders[i];
+            return NULL;
+        }
+    }
+
+    return "Variable index out of range.";
+}
+
+
+const char *readContinuousLayout(FILE *fp, int channel, ContinuousLayout &layout)
+{
+    NexFileHeader fileHeader;
+    NexVarHeader varHeader;
+
+    const char *error = readVariableHeader(fp, NEX_VARIABLE_TYPE_CONTINUOUS, channel,
+                                           fileHeader, varHeader);
+    if (error != NULL) {
+        return error;
+    }
+    const NexVarHeader *header = &varHeader;
+
+    if (header->Count < 1 || header->NPointsWave < 0 || !(header->WFrequency > 0)) {
+        return "The continuous variable has no data.";
+    }
+
+    // The fragment timestamps (ticks) come first, then the index of the
+    // first sample of each fragment, then the samples.
+    size_t nFragments = (size_t)header->Count;
+    std::vector<int> ticks(nFragments);
+    std::vector<int> starts(nFragments);
+    if (!seekFile(fp, (int64_t)(unsigned int)header->DataOffset) ||
+        fread(&ticks[0], nFragments * 4, 1, fp) != 1 ||
+        fread(&starts[0], nFragments * 4, 1, fp) != 1) {
+        return "Failed to read the fragment tables.";
+    }
+
+    layout.name.assign(header->Name, strnlen(header->Name, sizeof(header->Name)));
+    layout.timestampFrequency = fileHeader.Frequency;
+    layout.sampleFrequency = header->WFrequency;
+    layout.adToMV = header->ADtoMV;
+    layout.dataOffset = (int64_t)(unsigned int)header->DataOffset + 8 * (int64_t)nFragments;
+    layout.nSamples = (uint64_t)(unsigned int)header->NPointsWave;
+    layout.fragmentStarts.resize(nFragments);
+    layout.fragmentTimes.resize(nFragments);
+    for (size_t f = 0; f < nFragments; f++) {
+        layout.fragmentStarts[f] = (uint64_t)(unsigned int)starts[f];
+        layout.fragmentTimes[f] = (double)ticks[f] / fileHeader.Frequency;
+        if (layout.fragmentStarts[f] > layout.nSamples ||
+            (f > 0 && layout.fragmentStarts[f] < layout.fragmentStarts[f - 1])) {
+            return "Invalid fragment table.";
+        }
+    }
+
+    return NULL;
+}
+
+
+bool readSamples(FILE *fp, const ContinuousLayout &layout, uint64_t first, size_t n,
+                 int16_t *samples)
+{
+    if (n == 0) {
+        return true;
+    }
+    if (first + n > layout.nSamples || !seekFile(fp, layout.dataOffset + 2 * (int64_t)first)) {
+        return false;
+    }
+    return fread(samples, 2, n, fp) == n;
+}
@@ -0,0 +1,114 @@
+#ifndef CONTINUOUSFILE_H
+#define CONTINUOUSFILE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include "NexFile.h"
+
+// Where the samples of a continuous variable are in a NEX file and how they
+// map to time.  A variable is recorded in fragments, each a run of equally
+// spaced samples that starts at its own timestamp.
+struct ContinuousLayout
+{
+    // Name of the variable and the file's timestamp rate. (Hz)
+    std::string name;
+    double timestampFrequency;
+
+    // Sampling rate of the variable and the A/D to mV factor.
+    double sampleFrequency;
+    double adToMV;
+
+    // File offset of the first int16 sample and the total sample count.
+    int64_t dataOffset;
+    uint64_t nSamples;
+
+    // First sample index and start time (s) of each fragment.
+    std::vector<uint64_t> fragmentStarts;
+    std::vector<double> fragmentTimes;
+
+    size_t numFragments() const { return fragmentStarts.size(); }
+
+    uint64_t fragmentEnd(size_t f) const
+    {
+        return f + 1 < fragmentStarts.size() ? fragmentStarts[f + 1] : nSamples;
+    }
+
+    // Time of sample k of fragment f. (s)
+    double sampleTime(size_t f, uint64_t k) const
+    {
+        return fragmentTimes[f] + (double)(k - fragmentStarts[f]) / sampleFrequency;
+    }
+};
+
+
+/*******************************************************************************
+ readVariableHeader - Finds the header of a variable of a NEX file.
+
+ Syntax:
+ const char *readVariableHeader(FILE *fp, int type, int index, NexFileHeader &fileHeader,
+                                NexVarHeader &varHeader)
+
+ Input:
+ fp - Open NEX file.
+ type - One of the NEX_VARIABLE_TYPE values.
+ index - 0 based index among the file's variables of that type.
+
+ Output:
+ const char * - NULL on success, otherwise a description of the problem.
+ fileHeader - The file header.
+ varHeader - The variable's header.
+*******************************************************************************/
+const char *readVariableHeader(FILE *fp, int type, int index, NexFileHeader &fileHeader,
+                               NexVarHeader &varHeader);
+
+
+/*******************************************************************************
+ readContinuousLayout - Reads the fragment layout of a continuous variable.
+
+ Syntax:
+ const char *readContinuousLayout(FILE *fp, int channel, ContinuousLayout &layout)
+
+ Description:
+ Reads the file and variable headers and the fragment tables, but none of
+ the samples.
+
+ Input:
+ fp - Open NEX file.
+ channel - 0 based index among the file's continuous variables.
+
+ Output:
+ const char * - NULL on success, otherwise a description of the problem.
+ layout - The variable's layout.
+*******************************************************************************/
+const char *readContinuousLayout(FILE *fp, int channel, ContinuousLayout &layout);
+
+
+/*******************************************************************************
+ readSamples - Reads a run of raw samples of a continuous variable.
+
+ Syntax:
+ bool readSamples(FILE *fp, const ContinuousLayout &layout, uint64_t first,
+                  size_t n, int16_t *samples)
+
+ Description:
+ Seeks with 64 bit offsets, so it works past 2 GB.  Returns false if the
+ samples couldn't all be read.
+*******************************************************************************/
+bool readSamples(FILE *fp, const ContinuousLayout &layout, uint64_t first, size_t n,
+                 int16_t *samples);
+
+
+/*******************************************************************************
+ seekFile - fseek with a 64 bit offset from the start of the file.
+*******************************************************************************/
+bool seekFile(FILE *fp, int64_t offset);
+
+/*******************************************************************************
+ getFileSize - Size of an open file in bytes, or -1 on failure.
+*******************************************************************************/
+int64_t getFileSize(FILE *fp);
+
+#endif
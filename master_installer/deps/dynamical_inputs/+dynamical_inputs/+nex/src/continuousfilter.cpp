@@ -0,0 +1,366 @@
+#include "continuousfilter.h"
+
+#include <algorithm>
+#include <memory>
+#include "continuousreader.h"
+
+// Samples per read.  Every channel being filtered has two chunks in memory.
+static const size_t FILTER_CHUNK_SAMPLES = 1 << 16;
+
+// Most channels filtered together in one interleaved group.  Eight doubles
+// fill two AVX registers.
+static const size_t MAX_GROUP_CHANNELS = 8;
+
+
+// Decimating FIR over the interleaved samples of nLanes channels.  Samples
+// of a fragment are pushed in as they're read, and each output is worked
+// out as soon as the samples it needs are in, so only about one filter
+// length of samples is kept.
+class FIRDecimator
+{
+public:
+    FIRDecimator(const std::vector<double> &taps, size_t factor, size_t nLanes)
+        : m_Taps(taps), m_Factor(factor), m_Lanes(nLanes), m_Sum(nLanes)
+    {
+        if (m_Taps.empty()) {
+            m_Taps.push_back(1.0);
+        }
+        m_Delay = (int64_t)(m_Taps.size() - 1) / 2;
+        reset();
+    }
+
+    // Starts a new fragment.
+    void reset()
+    {
+        m_Buffer.clear();
+        m_BufferStart = 0;
+        m_Count = 0;
+        m_Next = 0;
+    }
+
+    // Adds n samples per lane, appending the outputs they complete to out.
+    void push(const double *x, size_t n, std::vector<double> &out)
+    {
+        m_Buffer.insert(m_Buffer.end(), x, x + n*m_Lanes);
+        m_Count += (int64_t)n;
+
+        while (m_Next*(int64_t)m_Factor + m_Delay < m_Count) {
+            computeOutput(out);
+        }
+
+        // Drop the samples no output still needs.  While outputs still
+        // reach before the fragment start nothing is dropped, so the
+        // reflection always has the samples it needs.
+        int64_t first = std::min(firstNeeded(), m_Count);
+        if (first > m_BufferStart) {
+            m_Buffer.erase(m_Buffer.begin(), m_Buffer.begin() + (size_t)(first - m_BufferStart)*m_Lanes);
+            m_BufferStart = first;
+        }
+    }
+
+    // Ends the fragment, appending its remaining outputs.
+    void finish(std::vector<double> &out)
+    {
+        while (m_Next*(int64_t)m_Factor < m_Count) {
+            computeOutput(out);
+        }
+    }
+
+private:
+    int64_t firstNeeded() const
+    {
+        return m_Next*(int64_t)m_Factor + m_Delay - (int64_t)(m_Taps.size() - 1);
+    }
+
+    double sample(int64_t i, size_t l) const
+    {
+        return m_Buffer[(size_t)(i - m_BufferStart)*m_Lanes + l];
+    }
+
+    // Sample i of lane l, reflected about the end samples past either end
+    // of the fragment.  Samples past the end are only asked for once the
+    // fragment is finished.
+    double extended(int64_t i, size_t l) const
+    {
+        if (i < 0) {
+            return 2.0*sample(0, l) - sample(std::min(-i, m_Count - 1), l);
+        }
+        if (i >= m_Count) {
+            return 2.0*sample(m_Count - 1, l) - sample(std::max(2*(m_Count - 1) - i, (int64_t)0), l);
+        }
+        return sample(i, l);
+    }
+
+    void computeOutput(std::vector<double> &out)
+    {
+        int64_t last = m_Next*(int64_t)m_Factor + m_Delay;
+        size_t nTaps = m_Taps.size();
+        std::fill(m_Sum.begin(), m_Sum.end(), 0.0);
+
+        if (firstNeeded() >= 0 && last < m_Count) {
+            const double *x = &m_Buffer[(size_t)(last - m_BufferStart)*m_Lanes];
+            for (size_t j = 0; j < nTaps; j++, x -= m_Lanes) {
+                double h = m_Taps[j];
+                for (size_t l = 0; l < m_Lanes; l++) {
+                    m_Sum[l] += h * x[l];
+                }
+            }
+        }
+        else {
+            for (size_t j = 0; j < nTaps; j++) {
+                for (size_t l = 0; l < m_Lanes; l++) {
+                    m_Sum[l] += m_Taps[j] * extended(last - (int64_t)j, l);
+                }
+            }
+        }
+
+        out.insert(out.end(), m_Sum.begin(), m_Sum.end());
+        m_Next++;
+    }
+
+    std::vector<double> m_Taps;
+    size_t m_Factor;
+    size_t m_Lanes;
+    int64_t m_Delay;
+
+    // Samples of the fragment from m_BufferStart on, and how many have
+    // been pushed.
+    std::vector<double> m_Buffer;
+    int64_t m_BufferStart;
+    int64_t m_Count;
+
+    // Index of the next output within the fragment.
+    int64_t m_Next;
+    std::vector<double> m_Sum;
+};
+
+
+BiquadCascade::BiquadCascade(const std::vector<Biquad> &sections, size_t nLanes)
+    : m_Sections(sections), m_Lanes(nLanes), m_State(2*sections.size()*nLanes, 0.0)
+{
+}
+
+
+void BiquadCascade::reset()
+{
+    std::fill(m_State.begin(), m_State.end(), 0.0);
+}
+
+
+void BiquadCascade::settle(const double *v)
+{
+    for (size_t l = 0; l < m_Lanes; l++) {
+        double in = v[l];
+
+        for (size_t s = 0; s < m_Sections.size(); s++) {
+            const Biquad &q = m_Sections[s];
+            double *z1 = &m_State[2*s*m_Lanes];
+            double *z2 = z1 + m_Lanes;
+
+            double den = 1.0 + q.a1 + q.a2;
+            double out = den != 0.0 ? in*(q.b0 + q.b1 + q.b2)/den : 0.0;
+            z2[l] = q.b2*in - q.a2*out;
+            z1[l] = q.b1*in - q.a1*out + z2[l];
+            in = out;
+        }
+    }
+}
+
+
+void BiquadCascade::run(double *x, size_t n, bool isBackward)
+{
+    for (size_t k = 0; k < n; k++) {
+        double *v = x + (isBackward ? n - 1 - k : k)*m_Lanes;
+
+        for (size_t s = 0; s < m_Sections.size(); s++) {
+            const Biquad q = m_Sections[s];
+            double *z1 = &m_State[2*s*m_Lanes];
+            double *z2 = z1 + m_Lanes;
+
+            for (size_t l = 0; l < m_Lanes; l++) {
+                double in = v[l];
+                double out = q.b0*in + z1[l];
+                z1[l] = q.b1*in - q.a1*out + z2[l];
+                z2[l] = q.b2*in - q.a2*out;
+                v[l] = out;
+            }
+        }
+    }
+}
+
+
+// Runs the IIR cascade over the decimated samples of one fragment.
+static void runIIR(const ContinuousFilterOptions &options, double *x, size_t n, size_t nLanes)
+{
+    BiquadCascade cascade(options.sections, nLanes);
+    if (cascade.empty() || n == 0) {
+        return;
+    }
+
+    if (!options.zeroPhase) {
+        cascade.run(x, n);
+        return;
+    }
+
+    // Pad both ends by reflection, the same length filtfilt uses, and
+    // start each pass settled on its first sample.
+    size_t nSections = options.sections.size();
+    size_t pad = std::min(6*nSections, n - 1);
+    std::vector<double> ext((n + 2*pad)*nLanes);
+    for (size_t p = 0; p < pad; p++) {
+        for (size_t l = 0; l < nLanes; l++) {
+            ext[p*nLanes + l] = 2.0*x[l] - x[(pad - p)*nLanes + l];
+            ext[(pad + n + p)*nLanes + l] = 2.0*x[(n - 1)*nLanes + l] - x[(n - 2 - p)*nLanes + l];
+        }
+    }
+    std::copy(x, x + n*nLanes, ext.begin() + pad*nLanes);
+
+    size_t nExt = n + 2*pad;
+    cascade.settle(ext.data());
+    cascade.run(ext.data(), nExt);
+    cascade.settle(ext.data() + (nExt - 1)*nLanes);
+    cascade.run(ext.data(), nExt, true);
+
+    std::copy(ext.begin() + pad*nLanes, ext.begin() + (pad + n)*nLanes, x);
+}
+
+
+static bool isSameLayout(const ContinuousLayout &a, const ContinuousLayout &b)
+{
+    return a.sampleFrequency == b.sampleFrequency && a.nSamples == b.nSamples &&
+           a.fragmentStarts == b.fragmentStarts && a.fragmentTimes == b.fragmentTimes;
+}
+
+
+// Filters the channels of one group, whose readers all share a layout.
+static const char *filterGroup(const std::vector<ContinuousReader*> &readers,
+                               const ContinuousFilterOptions &options,
+                               const std::vector<FilteredChannel*> &results)
+{
+    size_t nLanes = readers.size();
+    const ContinuousLayout &layout = readers[0]->layout();
+
+    FIRDecimator decimator(options.taps, options.decimation, nLanes);
+    std::vector<ContinuousChunk> chunks(nLanes);
+    std::vector<double> block;
+    std::vector<double> out;
+    size_t fragment = layout.numFragments();
+
+    for (size_t l = 0; l < nLanes; l++) {
+        results[l]->sampleFrequency = layout.sampleFrequency / (double)options.decimation;
+    }
+
+    for (;;) {
+        bool isChunk = readers[0]->next(chunks[0]);
+        for (size_t l = 1; l < nLanes; l++) {
+            if (readers[l]->next(chunks[l]) != isChunk ||
+                (isChunk && chunks[l].firstSample != chunks[0].firstSample)) {
+                return "Channels with the same layout were read out of step.";
+            }
+        }
+
+        // Filter and hand out each fragment once all of it is in.
+        if (!isChunk || chunks[0].fragment != fragment) {
+            if (fragment < layout.numFragments()) {
+                decimator.finish(out);
+                size_t nOut = out.size() / nLanes;
+                runIIR(options, out.data(), nOut, nLanes);
+
+                for (size_t l = 0; l < nLanes; l++) {
+                    FilteredChannel &result = *results[l];
+                    result.fragmentStarts.push_back(result.data.size());
+                    result.fragmentTimes.push_back(layout.fragmentTimes[fragment]);
+                    for (size_t k = 0; k < nOut; k++) {
+                        result.data.push_back(out[k*nLanes + l]);
+                    }
+                }
+            }
+            if (!isChunk) {
+                break;
+            }
+
+            fragment = chunks[0].fragment;
+            decimator.reset();
+            out.clear();
+        }
+
+        size_t n = chunks[0].samples.size();
+        block.resize(n*nLanes);
+        for (size_t l = 0; l < nLanes; l++) {
+            const int16_t *s = chunks[l].samples.data();
+            double scale = readers[l]->layout().adToMV;
+            for (size_t k = 0; k < n; k++) {
+                block[k*nLanes + l] = (double)s[k] * scale;
+            }
+        }
+        decimator.push(block.data(), n, out);
+    }
+
+    for (size_t l = 0; l < nLanes; l++) {
+        if (readers[l]->error() != NULL) {
+            return readers[l]->error();
+        }
+    }
+
+    return NULL;
+}
+
+
+const char *filterContinuous(const char *fileName, const std::vector<int> &channels,
+                             const ContinuousFilterOptions &options,
+                             std::vector<FilteredChannel> &results, ThreadPool &pool)
+{
+    if (options.decimation == 0) {
+        return "The decimation factor must be positive.";
+    }
+
+    size_t nChannels = channels.size();
+    std::vector<std::unique_ptr<ContinuousReader> > readers(nChannels);
+    for (size_t i = 0; i < nChannels; i++) {
+        readers[i].reset(new ContinuousReader());
+        const char *error = readers[i]->open(fileName, channels[i], FILTER_CHUNK_SAMPLES);
+        if (error != NULL) {
+            return error;
+        }
+    }
+
+    // Group the channels that share a layout.
+    std::vector<std::vector<size_t> > groups;
+    std::vector<bool> isGrouped(nChannels, false);
+    for (size_t i = 0; i < nChannels; i++) {
+        if (isGrouped[i]) {
+            continue;
+        }
+        groups.push_back(std::vector<size_t>(1, i));
+        for (size_t j = i + 1; j < nChannels; j++) {
+            if (!isGrouped[j] && isSameLayout(readers[i]->layout(), readers[j]->layout())) {
+                if (groups.back().size() == MAX_GROUP_CHANNELS) {
+                    groups.push_back(std::vector<size_t>());
+                }
+                groups.back().push_back(j);
+                isGrouped[j] = true;
+            }
+        }
+    }
+
+    results.assign(nChannels, FilteredChannel());
+    std::vector<const char*> errors(groups.size(), NULL);
+
+    pool.runTasks(groups.size(), [&](size_t g) {
+        std::vector<ContinuousReader*> groupReaders;
+        std::vector<FilteredChannel*> groupResults;
+        for (size_t k = 0; k < groups[g].size(); k++) {
+            groupReaders.push_back(readers[groups[g][k]].get());
+            groupResults.push_back(&results[groups[g][k]]);
+        }
+        errors[g] = filterGroup(groupReaders, options, groupResults);
+    });
+
+    for (size_t g = 0; g < groups.size(); g++) {
+        if (errors[g] != NULL) {
+            return errors[g];
+        }
+    }
+
+    return NULL;
+}
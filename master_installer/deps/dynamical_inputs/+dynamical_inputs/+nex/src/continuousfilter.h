@@ -0,0 +1,110 @@
+#ifndef CONTINUOUSFILTER_H
+#define CONTINUOUSFILTER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "threadpool.h"
+
+// One second order section, normalized so a0 is 1.
+//     y[n] = b0 x[n] + b1 x[n-1] + b2 x[n-2] - a1 y[n-1] - a2 y[n-2]
+struct Biquad
+{
+    double b0, b1, b2;
+    double a1, a2;
+};
+
+// An IIR cascade and its state for nLanes interleaved channels, run a block
+// at a time in transposed direct form II.
+class BiquadCascade
+{
+public:
+    BiquadCascade(const std::vector<Biquad> &sections, size_t nLanes);
+
+    bool empty() const { return m_Sections.empty(); }
+
+    // Clears the state, as at the start of a recording.
+    void reset();
+
+    // Sets the state to where it settles with v (one value per lane) held
+    // on the input, so the cascade starts without a step transient.
+    void settle(const double *v);
+
+    // Filters n interleaved samples in place, last sample first if asked.
+    void run(double *x, size_t n, bool isBackward = false);
+
+private:
+    std::vector<Biquad> m_Sections;
+    size_t m_Lanes;
+
+    // Two states per section and lane.
+    std::vector<double> m_State;
+};
+
+struct ContinuousFilterOptions
+{
+    // FIR run before decimating, centered on each kept sample so that a
+    // symmetric odd length filter adds no delay.  Empty for none.
+    std::vector<double> taps;
+
+    // Keep every decimation'th sample of each fragment, 1 to keep them all.
+    size_t decimation;
+
+    // IIR cascade run on the decimated samples.  Empty for none.
+    std::vector<Biquad> sections;
+
+    // Run the cascade forward and backward, as MATLAB's filtfilt does,
+    // rather than forward only.
+    bool zeroPhase;
+};
+
+// A filtered continuous variable.  Fragments are filtered separately, so
+// nothing leaks across the gaps between them.
+struct FilteredChannel
+{
+    // Rate of the filtered samples. (Hz)
+    double sampleFrequency;
+
+    // First sample index and start time (s) of each fragment.
+    std::vector<uint64_t> fragmentStarts;
+    std::vector<double> fragmentTimes;
+
+    // The filtered samples. (mV)
+    std::vector<double> data;
+};
+
+
+/*******************************************************************************
+ filterContinuous - Filters and decimates continuous variables of a NEX file.
+
+ Syntax:
+ const char *filterContinuous(const char *fileName, const std::vector<int> &channels,
+                              const ContinuousFilterOptions &options,
+                              std::vector<FilteredChannel> &results, ThreadPool &pool)
+
+ Description:
+ Streams each variable through ContinuousReader, so only the decimated
+ output is ever held at full length.  The FIR is only evaluated at the
+ samples that are kept, which is the same work as a polyphase decimator,
+ and the IIR cascade then runs at the lower rate.  Both extend each
+ fragment past its ends by odd reflection about the end samples.
+
+ Variables with the same fragment layout, as channels recorded together
+ have, are filtered together with their samples interleaved, so the
+ inner loops run across channels and vectorize.  Groups of them run in
+ parallel on the pool.
+
+ Input:
+ fileName - NEX file to read.
+ channels - 0 based indices among the file's continuous variables.
+ options - The filters to run.
+
+ Output:
+ const char * - NULL on success, otherwise a description of the problem.
+ results - One entry per channel.
+*******************************************************************************/
+const char *filterContinuous(const char *fileName, const std::vector<int> &channels,
+                             const ContinuousFilterOptions &options,
+                             std::vector<FilteredChannel> &results, ThreadPool &pool);
+
+#endif
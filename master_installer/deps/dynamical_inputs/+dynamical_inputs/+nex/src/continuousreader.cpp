@@ -0,0 +1,149 @@
+#include "continuousreader.h"
+
+#include <algorithm>
+
+
+ContinuousReader::ContinuousReader()
+    : m_File(NULL), m_ChunkSize(0), m_Error(NULL), m_Fragment(0), m_Next(0), m_IsPending(false),
+      m_HasRequest(false), m_HasResult(false), m_ReadSucceeded(false), m_Stop(false)
+{
+}
+
+
+ContinuousReader::~ContinuousReader()
+{
+    close();
+}
+
+
+void ContinuousReader::close()
+{
+    // The background thread has to finish with the file first.  A read
+    // that's in progress is finished, one that hasn't started is dropped.
+    if (m_Thread.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(m_Mutex);
+            m_Stop = true;
+        }
+        m_Condition.notify_all();
+        m_Thread.join();
+    }
+    m_IsPending = false;
+    m_HasRequest = false;
+    m_HasResult = false;
+    m_Stop = false;
+
+    if (m_File != NULL) {
+        fclose(m_File);
+        m_File = NULL;
+    }
+}
+
+
+const char *ContinuousReader::open(const char *fileName, int channel, size_t chunkSize)
+{
+    close();
+
+    if (chunkSize == 0) {
+        return "The chunk size must be positive.";
+    }
+
+    m_File = fopen(fileName, "rb");
+    if (m_File == NULL) {
+        return "Failed to open file.";
+    }
+
+    const char *error = readContinuousLayout(m_File, channel, m_Layout);
+    if (error != NULL) {
+        close();
+        return error;
+    }
+
+    m_ChunkSize = chunkSize;
+    m_Error = NULL;
+    m_Fragment = 0;
+    m_Next = m_Layout.numFragments() > 0 ? m_Layout.fragmentStarts[0] : 0;
+    m_Thread = std::thread(&ContinuousReader::readLoop, this);
+    startRead();
+
+    return NULL;
+}
+
+
+void ContinuousReader::startRead()
+{
+    // Skip empty fragments.
+    while (m_Fragment < m_Layout.numFragments() && m_Next >= m_Layout.fragmentEnd(m_Fragment)) {
+        m_Fragment++;
+        if (m_Fragment < m_Layout.numFragments()) {
+            m_Next = m_Layout.fragmentStarts[m_Fragment];
+        }
+    }
+    if (m_Fragment >= m_Layout.numFragments()) {
+        return;
+    }
+
+    size_t n = (size_t)std::min<uint64_t>(m_ChunkSize, m_Layout.fragmentEnd(m_Fragment) - m_Next);
+    m_Buffer.fragment = m_Fragment;
+    m_Buffer.firstSample = m_Next;
+    m_Buffer.startTime = m_Layout.sampleTime(m_Fragment, m_Next);
+    m_Buffer.samples.resize(n);
+    m_Next += n;
+
+    m_IsPending = true;
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        m_HasRequest = true;
+        m_HasResult = false;
+    }
+    m_Condition.notify_all();
+}
+
+
+void ContinuousReader::readLoop()
+{
+    std::unique_lock<std::mutex> lock(m_Mutex);
+    for (;;) {
+        m_Condition.wait(lock, [this]() { return m_HasRequest || m_Stop; });
+        if (m_Stop) {
+            return;
+        }
+
+        lock.unlock();
+        bool isRead = readSamples(m_File, m_Layout, m_Buffer.firstSample, m_Buffer.samples.size(),
+                                  m_Buffer.samples.data());
+        lock.lock();
+
+        m_ReadSucceeded = isRead;
+        m_HasRequest = false;
+        m_HasResult = true;
+        m_Condition.notify_all();
+    }
+}
+
+
+bool ContinuousReader::next(ContinuousChunk &chunk)
+{
+    if (!m_IsPending || m_Error != NULL) {
+        return false;
+    }
+
+    bool isRead;
+    {
+        std::unique_lock<std::mutex> lock(m_Mutex);
+        m_Condition.wait(lock, [this]() { return m_HasResult; });
+        m_HasResult = false;
+        isRead = m_ReadSucceeded;
+    }
+    m_IsPending = false;
+
+    if (!isRead) {
+        m_Error = "Failed to read the samples.";
+        return false;
+    }
+
+    std::swap(chunk, m_Buffer);
+    startRead();
+
+    return true;
+}
@@ -0,0 +1,120 @@
+#ifndef CONTINUOUSREADER_H
+#define CONTINUOUSREADER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <condition_variable>
+#include <cstdio>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "continuousfile.h"
+
+// A run of samples handed out by ContinuousReader.  A chunk never spans two
+// fragments.
+struct ContinuousChunk
+{
+    // Raw A/D values, multiply by the layout's adToMV for mV.
+    std::vector<int16_t> samples;
+
+    // Fragment the chunk is in and the index of its first sample.
+    size_t fragment;
+    uint64_t firstSample;
+
+    // Time of the first sample. (s)
+    double startTime;
+};
+
+
+/*******************************************************************************
+ ContinuousReader - Reads a continuous variable a chunk at a time.
+
+ Description:
+ Walks a continuous variable of a NEX file from start to end in chunks of
+ at most chunkSize samples, starting a new chunk at every fragment.  Only
+ two chunks are ever held: the one handed to the caller and the next one,
+ which is read on a background thread while the caller works on the
+ current one.  Memory use is therefore fixed by the chunk size, however
+ long the recording is.  Each reader has a single background thread for
+ its whole life, which is handed one read at a time.
+
+ The caller's chunk is swapped with the read buffer by next(), so passing
+ the same chunk back every time reuses its storage.
+
+ Usage:
+ ContinuousReader reader;
+ if (reader.open(fileName, channel, chunkSize) == NULL) {
+     ContinuousChunk chunk;
+     while (reader.next(chunk)) {
+         process chunk
+     }
+     if (reader.error()) ...
+ }
+*******************************************************************************/
+class ContinuousReader
+{
+public:
+    ContinuousReader();
+    ~ContinuousReader();
+
+    /***************************************************************************
+     open - Opens a continuous variable and starts reading its first chunk.
+
+     Input:
+     fileName - NEX file to read.
+     channel - 0 based index among the file's continuous variables.
+     chunkSize - Largest number of samples per chunk.
+
+     Output:
+     const char * - NULL on success, otherwise a description of the problem.
+    ***************************************************************************/
+    const char *open(const char *fileName, int channel, size_t chunkSize);
+
+    const ContinuousLayout &layout() const { return m_Layout; }
+
+    // Gets the next chunk.  Returns false at the end of the data or if a
+    // read failed, in which case error() says why.
+    bool next(ContinuousChunk &chunk);
+
+    const char *error() const { return m_Error; }
+
+private:
+    ContinuousReader(const ContinuousReader &);
+    ContinuousReader &operator=(const ContinuousReader &);
+
+    // Starts reading the chunk at the current position into m_Buffer.
+    void startRead();
+
+    // Body of the background thread, which runs the reads handed to it by
+    // startRead until close.
+    void readLoop();
+
+    void close();
+
+    FILE *m_File;
+    ContinuousLayout m_Layout;
+    size_t m_ChunkSize;
+    const char *m_Error;
+
+    // Position of the next chunk to read.
+    size_t m_Fragment;
+    uint64_t m_Next;
+
+    // The chunk being read in the background, if any.  m_Buffer is only
+    // touched by the background thread while m_IsPending is set.
+    ContinuousChunk m_Buffer;
+    bool m_IsPending;
+
+    // The background thread and its handshake, guarded by m_Mutex.
+    // m_HasRequest is set by startRead, cleared by the thread along with
+    // setting m_HasResult once the read is done.
+    std::thread m_Thread;
+    std::mutex m_Mutex;
+    std::condition_variable m_Condition;
+    bool m_HasRequest;
+    bool m_HasResult;
+    bool m_ReadSucceeded;
+    bool m_Stop;
+};
+
+#endif
@@ -0,0 +1,89 @@
+#include "correlogram.h"
+
+#include <algorithm>
+#include <cmath>
+#include <utility>
+#include <vector>
+#include "tiledamd.h"
+
+// Number of lags binned at a time.  Small enough for the bin indices to stay
+// in L1.
+static const size_t LAG_BATCH = 64;
+
+
+// Adds the lags from each spike of a to the spikes of b to ab, and from b
+// to a to ba.  If a and b are the same train, ba is NULL and each spike's
+// lag to itself is skipped.
+static void sweepPair(SpikeTrain a, SpikeTrain b, const CorrelogramOptions &options,
+                      uint32_t *ab, uint32_t *ba)
+{
+    const double width = options.binWidth;
+    const double span = (double)options.halfBins * width;
+    const long nBins = (long)options.numBins();
+    bool isAuto = ba == NULL;
+
+    long abBins[LAG_BATCH];
+    long baBins[LAG_BATCH];
+    size_t lo = 0;
+
+    for (size_t i = 0; i < a.n; i++) {
+        double t = a.t[i];
+
+        // Lags from b to a run over (-span, span], so everything from
+        // t - span to t + span is needed.
+        while (lo < b.n && b.t[lo] < t - span) {
+            lo++;
+        }
+
+        for (size_t k0 = lo; k0 < b.n && b.t[k0] <= t + span; k0 += LAG_BATCH) {
+            size_t m = std::min(LAG_BATCH, b.n - k0);
+
+            for (size_t k = 0; k < m; k++) {
+                double d = b.t[k0 + k] - t;
+                abBins[k] = (long)std::floor((d + span) / width);
+                baBins[k] = (long)std::floor((span - d) / width);
+            }
+
+            for (size_t k = 0; k < m; k++) {
+                if (b.t[k0 + k] > t + span) {
+                    break;
+                }
+                if ((unsigned long)abBins[k] < (unsigned long)nBins && !(isAuto && k0 + k == i)) {
+                    ab[abBins[k]]++;
+                }
+                if (!isAuto && (unsigned long)baBins[k] < (unsigned long)nBins) {
+                    ba[baBins[k]]++;
+                }
+            }
+        }
+    }
+}
+
+
+void computeCorrelograms(const PackedTrains &trains, const CorrelogramOptions &options,
+                         uint32_t *counts, ThreadPool &pool)
+{
+    size_t n = trains.size();
+    size_t nBins = options.numBins();
+
+    std::fill(counts, counts + nBins * n * n, 0);
+
+    size_t tileSize = chooseTileSize(trains);
+    std::vector<std::pair<size_t, size_t> > tiles;
+    listTiles(n, tileSize, tiles);
+
+    pool.runTasks(tiles.size(), [&](size_t t) {
+        size_t i0 = tiles[t].first;
+        size_t j0 = tiles[t].second;
+        size_t i1 = std::min(i0 + tileSize, n);
+        size_t j1 = std::min(j0 + tileSize, n);
+
+        for (size_t i = i0; i < i1; i++) {
+            for (size_t j = (i0 == j0) ? i : j0; j < j1; j++) {
+                uint32_t *ij = counts + nBins * (i + n*j);
+                uint32_t *ji = (i == j) ? NULL : counts + nBins * (j + n*i);
+                sweepPair(trains[i], trains[j], options, ij, ji);
+            }
+        }
+    });
+}
@@ -0,0 +1,54 @@
+#ifndef CORRELOGRAM_H
+#define CORRELOGRAM_H
+
+#include <cstddef>
+#include <cstdint>
+#include "spiketrains.h"
+#include "threadpool.h"
+
+struct CorrelogramOptions
+{
+    // Bin width. (s)
+    double binWidth;
+
+    // Number of bins on each side of zero lag, so the lags covered are
+    // [-halfBins*binWidth, halfBins*binWidth).
+    size_t halfBins;
+
+    size_t numBins() const { return 2 * halfBins; }
+};
+
+
+/*******************************************************************************
+ computeCorrelograms - Cross and auto-correlograms of every pair of trains.
+
+ Syntax:
+ computeCorrelograms(const PackedTrains &trains, const CorrelogramOptions &options,
+                     uint32_t *counts, ThreadPool &pool)
+
+ Description:
+ For each spike of train i, the spikes of train j within the lag range are
+ found with a sliding pointer that only ever moves forward, so a pair costs
+ O(spikes + counted lags) rather than one search per spike.  The lags of a
+ run of spikes are turned into bin indices in a tight loop with no branches,
+ which the compiler vectorizes, before they're added to the histograms.
+ Each ordered pair (i, j) and (j, i) is filled in by the same sweep, and
+ the pairs are split into tiles that run on the thread pool.
+
+ Lag d = t_j - t_i goes in bin floor(d / binWidth) + halfBins.  The auto-
+ correlograms on the diagonal leave out each spike paired with itself.
+
+ Input:
+ trains - The spike trains, already restricted to any intervals.
+ options - Bin width and number of bins.
+ pool - Thread pool to run the tiles on.
+
+ Output:
+ counts - Preallocated nBins x n x n array, with element
+     [b + nBins*(i + n*j)] the count of lags from train i to train j in
+     bin b.
+*******************************************************************************/
+void computeCorrelograms(const PackedTrains &trains, const CorrelogramOptions &options,
+                         uint32_t *counts, ThreadPool &pool);
+
+#endif
@@ -0,0 +1,442 @@
+#include "ecdfkernel.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <utility>
+
+// 11 bit digits sort 64 bit keys in 6 passes with count tables that still
+// fit in L1.
+static const unsigned RADIX_BITS = 11;
+static const size_t RADIX_SIZE = (size_t)1 << RADIX_BITS;
+
+// Below this many keys the passes over the count tables cost more than
+// they save.
+static const size_t SERIAL_SORT_SIZE = (size_t)1 << 16;
+
+// Smallest block of keys handed to a task.
+static const size_t MIN_BLOCK_SIZE = (size_t)1 << 15;
+
+
+void radixSort(std::vector<uint64_t> &keys, ThreadPool &pool)
+{
+    size_t n = keys.size();
+    if (n < SERIAL_SORT_SIZE) {
+        std::sort(keys.begin(), keys.end());
+        return;
+    }
+
+    // A few blocks per thread so that the work stealing can even things out.
+    size_t nBlocks = std::max<size_t>(1, std::min(pool.size() * 4, n / MIN_BLOCK_SIZE));
+    std::vector<size_t> offsets(nBlocks * RADIX_SIZE);
+    std::vector<uint64_t> buffer(n);
+    uint64_t *src = keys.data();
+    uint64_t *dst = buffer.data();
+
+    for (unsigned shift = 0; shift < 64; shift += RADIX_BITS) {
+        std::fill(offsets.begin(), offsets.end(), 0);
+
+        pool.runTasks(nBlocks, [&](size_t b) {
+            size_t *counts = &offsets[b * RADIX_SIZE];
+            for (size_t i = n * b / nBlocks; i < n * (b + 1) / nBlocks; i++) {
+                counts[(src[i] >> shift) & (RADIX_SIZE - 1)]++;
+            }
+        });
+
+        // Turn the counts into write offsets, digit major and block minor,
+        // which keeps the sort stable.
+        size_t total = 0;
+        bool isSingleDigit = false;
+        for (size_t d = 0; d < RADIX_SIZE; d++) {
+            size_t digitCount = 0;
+            for (size_t b = 0; b < nBlocks; b++) {
+                size_t c = offsets[b * RADIX_SIZE + d];
+                offsets[b * RADIX_SIZE + d] = total;
+                total += c;
+                digitCount += c;
+            }
+            if (digitCount == n) {
+                isSingleDigit = true;
+            }
+        }
+
+        // Every key has the same digit, so the pass wouldn't move anything.
+        if (isSingleDigit) {
+            continue;
+        }
+
+        pool.runTasks(nBlocks, [&](size_t b) {
+            size_t *next = &offsets[b * RADIX_SIZE];
+            for (size_t i = n * b / nBlocks; i < n * (b + 1) / nBlocks; i++) {
+                dst[next[(src[i] >> shift) & (RADIX_SIZE - 1)]++] = src[i];
+            }
+        });
+
+        std::swap(src, dst);
+    }
+
+    if (src != keys.data()) {
+        keys.swap(buffer);
+    }
+}
+
+
+ExactECDF::ExactECDF(const std::vector<SquareMatrix> &matrices, ThreadPool &pool)
+    : m_NumValues(0), m_NumDistinct(0), m_NumIgnored(0)
+{
+    size_t nMatrices = matrices.size();
+
+    // Where each matrix's off diagonal values go in the key buffer.
+    std::vector<size_t> start(nMatrices + 1, 0);
+    for (size_t w = 0; w < nMatrices; w++) {
+        size_t n = matrices[w].n;
+        start[w + 1] = start[w] + n * (n > 0 ? n - 1 : 0);
+    }
+    m_Keys.resize(start[nMatrices]);
+
+    pool.parallelFor(nMatrices, 1, [&](size_t wBegin, size_t wEnd) {
+        for (size_t w = wBegin; w < wEnd; w++) {
+            const double *data = matrices[w].data;
+            size_t n = matrices[w].n;
+            uint64_t *out = &m_Keys[start[w]];
+            for (size_t j = 0; j < n; j++) {
+                for (size_t i = 0; i < n; i++) {
+                    if (i != j) {
+                        *out++ = doubleToKey(data[i + j*n]);
+                    }
+                }
+            }
+        }
+    });
+
+    finish(pool);
+}
+
+
+ExactECDF::ExactECDF(std::vector<uint64_t> &keys, ThreadPool &pool)
+    : m_NumValues(0), m_NumDistinct(0), m_NumIgnored(0)
+{
+    m_Keys.swap(keys);
+    finish(pool);
+}
+
+
+void ExactECDF::finish(ThreadPool &pool)
+{
+    radixSort(m_Keys, pool);
+
+    // The NaNs all sort to the end.
+    size_t nKeys = m_Keys.size();
+    while (m_NumIgnored < nKeys && m_Keys[nKeys - m_NumIgnored - 1] == NAN_KEY) {
+        m_NumIgnored++;
+    }
+    m_NumValues = nKeys - m_NumIgnored;
+
+    // -0 and 0 have different keys but count as one value.
+    for (size_t i = 0; i < m_NumValues; i++) {
+        if (i == 0 || keyToDouble(m_Keys[i]) != keyToDouble(m_Keys[i-1])) {
+            m_NumDistinct++;
+        }
+    }
+}
+
+
+size_t ExactECDF::numPoints() const
+{
+    return m_NumValues > 0 ? m_NumDistinct + 1 : 0;
+}
+
+
+void ExactECDF::write(double *F, double *X) const
+{
+    if (m_NumValues == 0) {
+        return;
+    }
+
+    double n = (double)m_NumValues;
+
+    X[0] = keyToDouble(m_Keys[0]);
+    F[0] = 0.0;
+
+    // Each distinct value gets the fraction of values up to the end of its
+    // run.
+    size_t k = 1;
+    for (size_t i = 0; i < m_NumValues; i++) {
+        double x = keyToDouble(m_Keys[i]);
+        if (i + 1 == m_NumValues || keyToDouble(m_Keys[i+1]) != x) {
+            X[k] = x;
+            F[k] = (double)(i + 1) / n;
+            k++;
+        }
+    }
+}
+
+
+QuantileSketch::QuantileSketch(size_t capacity)
+    : m_Capacity(std::max<size_t>(capacity, 2)), m_Count(0), m_NumIgnored(0), m_RankError(0.0),
+      m_Min(std::numeric_limits<double>::quiet_NaN())
+{
+    m_Levels.resize(1);
+    m_Levels[0].reserve(m_Capacity);
+    m_OddOffset.resize(1, false);
+}
+
+
+size_t QuantileSketch::capacityForError(double epsilon, size_t n)
+{
+    // Level h can't be compacted more than n / (capacity * 2^h) times and
+    // each compaction is off by at most 2^h, so every level adds at most
+    // n / capacity to the rank error.  There are at most log2(n) + 1
+    // levels.
+    double nLevels = std::log2((double)std::max<size_t>(n, 2)) + 1.0;
+    double capacity = std::ceil(nLevels / epsilon);
+
+    // A level compacts once it is full, so a sketch with room for one more
+    // than all n values never compacts and is exact.  A tiny epsilon gets
+    // that rather than a buffer far larger than the data.
+    size_t exact = std::max<size_t>(n, 1) + 1;
+    return capacity < (double)exact ? (size_t)capacity : exact;
+}
+
+
+void QuantileSketch::add(double x)
+{
+    if (x != x) {
+        m_NumIgnored++;
+        return;
+    }
+
+    if (!(x >= m_Min)) {
+        m_Min = x;
+    }
+    m_Count++;
+
+    m_Levels[0].push_back(x);
+    if (m_Levels[0].size() >= m_Capacity) {
+        compact(0);
+    }
+}
+
+
+void QuantileSketch::merge(const QuantileSketch &other)
+{
+    if (other.m_Levels.size() > m_Levels.size()) {
+        m_Levels.resize(other.m_Levels.size());
+        m_OddOffset.resize(other.m_Levels.size(), false);
+    }
+
+    for (size_t h = 0; h < other.m_Levels.size(); h++) {
+        m_Levels[h].insert(m_Levels[h].end(), other.m_Levels[h].begin(), other.m_Levels[h].end());
+    }
+
+    m_Count += other.m_Count;
+    m_NumIgnored += other.m_NumIgnored;
+    m_RankError += other.m_RankError;
+    if (!(other.m_Min >= m_Min)) {
+        m_Min = other.m_Min;
+    }
+
+    // Compacting a level only ever adds to the next one, so a single pass
+    // from the bottom catches everything.
+    for (size_t h = 0; h < m_Levels.size(); h++) {
+        if (m_Levels[h].size() >= m_Capacity) {
+            compact(h);
+        }
+    }
+}
+
+
+void QuantileSketch::compact(size_t level)
+{
+    if (level + 1 == m_Levels.size()) {
+        m_Levels.resize(level + 2);
+        m_OddOffset.resize(level + 2, false);
+    }
+
+    std::vector<double> &items = m_Levels[level];
+    std::vector<double> &above = m_Levels[level + 1];
+    std::sort(items.begin(), items.end());
+
+    // An odd item out stays behind.
+    size_t nPaired = items.size() & ~(size_t)1;
+    size_t offset = m_OddOffset[level] ? 1 : 0;
+    for (size_t i = offset; i < nPaired; i += 2) {
+        above.push_back(items[i]);
+    }
+    m_OddOffset[level] = !m_OddOffset[level];
+
+    if (nPaired < items.size()) {
+        items[0] = items.back();
+        items.resize(1);
+    }
+    else {
+        items.clear();
+    }
+
+    m_RankError += std::ldexp(1.0, (int)level);
+
+    if (above.size() >= m_Capacity) {
+        compact(level + 1);
+    }
+}
+
+
+void QuantileSketch::cdf(std::vector<double> &F, std::vector<double> &X) const
+{
+    F.clear();
+    X.clear();
+    if (m_Count == 0) {
+        return;
+    }
+
+    std::vector<std::pair<double, double> > items;
+    for (size_t h = 0; h < m_Levels.size(); h++) {
+        double weight = std::ldexp(1.0, (int)h);
+        for (size_t i = 0; i < m_Levels[h].size(); i++) {
+            items.push_back(std::make_pair(m_Levels[h][i], weight));
+        }
+    }
+    std::sort(items.begin(), items.end());
+
+    double n = (double)m_Count;
+    double total = 0.0;
+
+    X.push_back(m_Min);
+    F.push_back(0.0);
+    for (size_t i = 0; i < items.size(); i++) {
+        total += items[i].second;
+        if (i + 1 == items.size() || items[i+1].first != items[i].first) {
+            X.push_back(items[i].first);
+            F.push_back(total / n);
+        }
+    }
+}
+
+
+QuantileSketch sketchECDF(const std::vector<SquareMatrix> &matrices, double epsilon,
+                          ThreadPool &pool)
+{
+    size_t nMatrices = matrices.size();
+
+    std::vector<size_t> start(nMatrices + 1, 0);
+    for (size_t w = 0; w < nMatrices; w++) {
+        size_t n = matrices[w].n;
+        start[w + 1] = start[w] + n * (n > 0 ? n - 1 : 0);
+    }
+    size_t total = start[nMatrices];
+    size_t capacity = QuantileSketch::capacityForError(epsilon, total);
+
+    // Each group takes the matrices that start in its share of the values.
+    size_t nGroups = std::max<size_t>(1, std::min(pool.size() * 2, nMatrices));
+    std::vector<size_t> groupStart(nGroups + 1, nMatrices);
+    for (size_t g = 0, w = 0; g < nGroups; g++) {
+        while (w < nMatrices && start[w] < total * g / nGroups) {
+            w++;
+        }
+        groupStart[g] = w;
+    }
+
+    std::vector<QuantileSketch> sketches(nGroups, QuantileSketch(capacity));
+    pool.runTasks(nGroups, [&](size_t g) {
+        QuantileSketch &sketch = sketches[g];
+        for (size_t w = groupStart[g]; w < groupStart[g + 1]; w++) {
+            const double *data = matrices[w].data;
+            size_t n = matrices[w].n;
+            for (size_t j = 0; j < n; j++) {
+                for (size_t i = 0; i < n; i++) {
+                    if (i != j) {
+                        sketch.add(data[i + j*n]);
+                    }
+                }
+            }
+        }
+    });
+
+    for (size_t g = 1; g < nGroups; g++) {
+        sketches[0].merge(sketches[g]);
+    }
+
+    return sketches[0];
+}
+
+
+ECDFAccumulator::ECDFAccumulator(double epsilon, size_t nValues)
+    : m_Epsilon(epsilon),
+      m_Capacity(epsilon > 0.0 ? QuantileSketch::capacityForError(epsilon, nValues) : 2),
+      m_Sketch(m_Capacity)
+{
+    if (epsilon == 0.0) {
+        m_Keys.reserve(nValues);
+    }
+}
+
+
+template <typename T>
+void ECDFAccumulator::add(const T *data, size_t n, ThreadPool &pool)
+{
+    if (n < 2) {
+        return;
+    }
+
+    if (m_Epsilon == 0.0) {
+        // Column j has n - 1 off diagonal values.
+        size_t start = m_Keys.size();
+        m_Keys.resize(start + n * (n - 1));
+        pool.parallelFor(n, 1, [&](size_t jBegin, size_t jEnd) {
+            for (size_t j = jBegin; j < jEnd; j++) {
+                uint64_t *out = &m_Keys[start + j * (n - 1)];
+                for (size_t i = 0; i < n; i++) {
+                    if (i != j) {
+                        *out++ = doubleToKey((double)data[i + j*n]);
+                    }
+                }
+            }
+        });
+        return;
+    }
+
+    // Each group of columns goes through its own sketch, which are then
+    // merged in, as in sketchECDF.
+    size_t nGroups = std::max<size_t>(1, std::min(pool.size() * 2, n));
+    std::vector<QuantileSketch> sketches(nGroups, QuantileSketch(m_Capacity));
+    pool.runTasks(nGroups, [&](size_t g) {
+        QuantileSketch &sketch = sketches[g];
+        for (size_t j = n * g / nGroups; j < n * (g + 1) / nGroups; j++) {
+            for (size_t i = 0; i < n; i++) {
+                if (i != j) {
+                    sketch.add((double)data[i + j*n]);
+                }
+            }
+        }
+    });
+
+    for (size_t g = 0; g < nGroups; g++) {
+        m_Sketch.merge(sketches[g]);
+    }
+}
+
+
+void ECDFAccumulator::finish(std::vector<double> &F, std::vector<double> &X, size_t &nIgnored,
+                             double &errorBound, ThreadPool &pool)
+{
+    if (m_Epsilon == 0.0) {
+        ExactECDF cdf(m_Keys, pool);
+        F.resize(cdf.numPoints());
+        X.resize(cdf.numPoints());
+        if (!F.empty()) {
+            cdf.write(&F[0], &X[0]);
+        }
+        nIgnored = cdf.numIgnored();
+        errorBound = 0.0;
+    }
+    else {
+        m_Sketch.cdf(F, X);
+        nIgnored = m_Sketch.numIgnored();
+        errorBound = m_Sketch.count() > 0 ? m_Sketch.rankError() / (double)m_Sketch.count() : 0.0;
+        m_Sketch = QuantileSketch(m_Capacity);
+    }
+}
+
+
+template void ECDFAccumulator::add<double>(const double *, size_t, ThreadPool &);
+template void ECDFAccumulator::add<float>(const float *, size_t, ThreadPool &);
@@ -0,0 +1,232 @@
+#ifndef ECDFKERNEL_H
+#define ECDFKERNEL_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include "threadpool.h"
+
+// A square matrix of window results, e.g. a window's AMD or z-scores.  Not
+// owned.
+struct SquareMatrix
+{
+    const double *data;
+    size_t n;
+};
+
+
+/*******************************************************************************
+ doubleToKey, keyToDouble - Maps doubles to unsigned integers with the same
+                            order.
+
+ Description:
+ Positive doubles get their sign bit set and negative doubles get all of
+ their bits flipped, after which the integer order of the keys is the
+ numeric order of the doubles.  Every NaN is mapped to NAN_KEY, which sorts
+ after +Inf.
+*******************************************************************************/
+static const uint64_t NAN_KEY = ~(uint64_t)0;
+
+inline uint64_t doubleToKey(double x)
+{
+    if (x != x) {
+        return NAN_KEY;
+    }
+
+    uint64_t u;
+    std::memcpy(&u, &x, sizeof(u));
+    return (u & ((uint64_t)1 << 63)) ? ~u : (u | ((uint64_t)1 << 63));
+}
+
+inline double keyToDouble(uint64_t key)
+{
+    uint64_t u = (key & ((uint64_t)1 << 63)) ? (key & ~((uint64_t)1 << 63)) : ~key;
+    double x;
+    std::memcpy(&x, &u, sizeof(x));
+    return x;
+}
+
+
+/*******************************************************************************
+ radixSort - Sorts unsigned 64-bit keys on the thread pool.
+
+ Syntax:
+ radixSort(std::vector<uint64_t> &keys, ThreadPool &pool)
+
+ Description:
+ LSD radix sort, 11 bits per pass.  The keys are split into blocks, each
+ block is counted by one task, and the counts are turned into one write
+ offset per digit per block so that every block scatters into its own part
+ of the output.  Passes where every key has the same digit are skipped,
+ which for doubles of similar magnitude is most of the exponent passes.
+ Small inputs are handed to std::sort.
+*******************************************************************************/
+void radixSort(std::vector<uint64_t> &keys, ThreadPool &pool);
+
+
+/*******************************************************************************
+ ExactECDF - Empirical CDF of the off diagonal values of a set of matrices.
+
+ Description:
+ The off diagonal values of every matrix are written straight into one key
+ buffer, skipping the diagonals, and radix sorted.  The result matches the
+ MATLAB ecdf function: X holds the smallest value followed by every distinct
+ value, and F holds 0 followed by the fraction of values at or below each
+ distinct value.  NaNs are ignored, like ecdf does, and counted.
+
+ Usage:
+ ExactECDF cdf(matrices, pool);
+ allocate numPoints() sized F and X
+ cdf.write(F, X);
+*******************************************************************************/
+class ExactECDF
+{
+public:
+    ExactECDF(const std::vector<SquareMatrix> &matrices, ThreadPool &pool);
+
+    // Takes over a buffer of keys that were already written, leaving keys
+    // empty.
+    ExactECDF(std::vector<uint64_t> &keys, ThreadPool &pool);
+
+    // Length of F and X, zero if there are no values.
+    size_t numPoints() const;
+
+    // Number of NaNs that were left out.
+    size_t numIgnored() const { return m_NumIgnored; }
+
+    void write(double *F, double *X) const;
+
+private:
+    // Sorts the keys and counts the values.
+    void finish(ThreadPool &pool);
+
+    std::vector<uint64_t> m_Keys;
+    size_t m_NumValues;
+    size_t m_NumDistinct;
+    size_t m_NumIgnored;
+};
+
+
+/*******************************************************************************
+ QuantileSketch - Mergeable summary of a stream of values for approximate
+                  CDFs.
+
+ Description:
+ A stack of compactors in the style of Manku, Rajagopalan and Lindsay.
+ Values go into level 0.  Whenever a level holds capacity values it is
+ sorted and every other value is promoted to the next level with twice the
+ weight, alternating between the odd and even values so the errors tend to
+ cancel.  Each compaction at level h shifts the rank of any value by at most
+ 2^h, and the sketch keeps a running total of these, so rankError() is a
+ guaranteed bound on the rank error of the CDF rather than an estimate.
+
+ Sketches built on different threads are combined with merge(), which
+ appends the levels of the other sketch and compacts whatever overflows.
+ The rank error of a merge is the sum of the two plus that of the new
+ compactions.
+
+ capacityForError gives the capacity that keeps the rank error of n values
+ under epsilon * n.  It is never more than n + 1, where the sketch holds
+ every value without compacting and is exact.
+*******************************************************************************/
+class QuantileSketch
+{
+public:
+    explicit QuantileSketch(size_t capacity);
+
+    static size_t capacityForError(double epsilon, size_t n);
+
+    void add(double x);
+    void merge(const QuantileSketch &other);
+
+    // Number of values added, NaNs excluded.
+    size_t count() const { return m_Count; }
+
+    // Number of NaNs that were left out.
+    size_t numIgnored() const { return m_NumIgnored; }
+
+    // Bound on the difference between the number of values at or below any
+    // x and what the sketch says it is.
+    double rankError() const { return m_RankError; }
+
+    // Same layout as ExactECDF: the smallest value and 0, then the values
+    // retained by the sketch and their cumulative fractions.
+    void cdf(std::vector<double> &F, std::vector<double> &X) const;
+
+private:
+    void compact(size_t level);
+
+    size_t m_Capacity;
+    std::vector<std::vector<double> > m_Levels;
+    std::vector<bool> m_OddOffset;
+    size_t m_Count;
+    size_t m_NumIgnored;
+    double m_RankError;
+    double m_Min;
+};
+
+
+/*******************************************************************************
+ sketchECDF - Approximate CDF of the off diagonal values of a set of matrices.
+
+ Syntax:
+ QuantileSketch sketchECDF(const std::vector<SquareMatrix> &matrices,
+                           double epsilon, ThreadPool &pool)
+
+ Description:
+ The matrices are dealt out to the thread pool in contiguous groups of
+ roughly equal numbers of values.  Each group is run through its own sketch
+ and the sketches are merged at the end.  Nothing but the sketches is held
+ in memory.
+
+ Input:
+ matrices - The matrices to summarize.
+ epsilon - Target rank error as a fraction of the number of values.
+ pool - Thread pool to run on.
+*******************************************************************************/
+QuantileSketch sketchECDF(const std::vector<SquareMatrix> &matrices, double epsilon,
+                          ThreadPool &pool);
+
+
+/*******************************************************************************
+ ECDFAccumulator - Builds the CDF of ExactECDF or sketchECDF one matrix at a
+                   time.
+
+ Description:
+ For callers that can't hand over every matrix at once, e.g. AMD windows
+ whose tables are turned into matrices one window at a time.  The exact CDF
+ only keeps the keys of the values added so far, the approximate CDF only a
+ sketch sized for the expected number of values.  Each matrix is split
+ over the thread pool by columns.
+
+ Usage:
+ ECDFAccumulator cdf(epsilon, nValues);
+ for each matrix:
+     cdf.add(data, n, pool);
+ cdf.finish(F, X, nIgnored, errorBound, pool);
+*******************************************************************************/
+class ECDFAccumulator
+{
+public:
+    // epsilon is 0 for the exact CDF.  nValues is the expected total number
+    // of off diagonal values, which sizes the sketch.
+    ECDFAccumulator(double epsilon, size_t nValues);
+
+    // Adds the off diagonal values of a column major n x n matrix.  T is
+    // double or float.
+    template <typename T>
+    void add(const T *data, size_t n, ThreadPool &pool);
+
+    // Same outputs as ExactECDF or sketchECDF.  The values are released.
+    void finish(std::vector<double> &F, std::vector<double> &X, size_t &nIgnored,
+                double &errorBound, ThreadPool &pool);
+
+private:
+    double m_Epsilon;
+    size_t m_Capacity;
+    std::vector<uint64_t> m_Keys;
+    QuantileSketch m_Sketch;
+};
+
+#endif
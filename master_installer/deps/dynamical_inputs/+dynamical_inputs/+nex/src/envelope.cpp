@@ -0,0 +1,262 @@
+#include "envelope.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <string>
+
+// Samples per bucket of the finest level is 2^BASE_SHIFT.  Finer spans are
+// read raw, which is never more than this many samples per pixel.
+static const uint32_t BASE_SHIFT = 6;
+
+// Levels are added until the coarsest one has no more than this many
+// buckets.
+static const uint64_t TOP_BUCKETS = 1024;
+
+// Samples read from the NEX file at a time while building.  A multiple of
+// 2^BASE_SHIFT so the chunks split on bucket boundaries.
+static const size_t CHUNK_SAMPLES = (size_t)1 << 20;
+
+static const char ENVELOPE_MAGIC[8] = {'N', 'E', 'X', 'E', 'N', 'V', '0', '1'};
+
+// Fixed size header at the start of the cache file.
+struct EnvelopeHeader
+{
+    char magic[8];
+    uint32_t baseShift;
+    uint32_t nLevels;
+    int64_t fileSize;
+    int64_t dataOffset;
+    uint64_t nSamples;
+    uint64_t nFragments;
+};
+
+
+static uint64_t levelBuckets(const ContinuousLayout &layout, uint32_t shift)
+{
+    uint64_t n = 0;
+    for (size_t f = 0; f < layout.numFragments(); f++) {
+        n += EnvelopeIndex::numBuckets(layout, f, shift);
+    }
+    return n;
+}
+
+
+static void setLevelOffsets(const ContinuousLayout &layout, EnvelopeIndex &index)
+{
+    int64_t offset = (int64_t)sizeof(EnvelopeHeader);
+    index.levelOffsets.resize(index.nLevels);
+    for (uint32_t l = 0; l < index.nLevels; l++) {
+        index.levelOffsets[l] = offset;
+        offset += 4 * (int64_t)levelBuckets(layout, index.baseShift + l);
+    }
+}
+
+
+const char *buildEnvelope(FILE *fp, const ContinuousLayout &layout, int64_t fileSize,
+                          const char *cachePath, ThreadPool &pool)
+{
+    EnvelopeHeader header;
+    memcpy(header.magic, ENVELOPE_MAGIC, 8);
+    header.baseShift = BASE_SHIFT;
+    header.nLevels = 1;
+    header.fileSize = fileSize;
+    header.dataOffset = layout.dataOffset;
+    header.nSamples = layout.nSamples;
+    header.nFragments = layout.numFragments();
+    while (header.nLevels < 48 - BASE_SHIFT &&
+           levelBuckets(layout, BASE_SHIFT + header.nLevels - 1) > TOP_BUCKETS) {
+        header.nLevels++;
+    }
+
+    // The finest level, streamed from the file.
+    const size_t baseSize = (size_t)1 << BASE_SHIFT;
+    std::vector<int16_t> level(2 * levelBuckets(layout, BASE_SHIFT));
+    std::vector<int16_t> chunk(CHUNK_SAMPLES);
+    size_t bucket = 0;
+
+    for (size_t f = 0; f < layout.numFragments(); f++) {
+        for (uint64_t k = layout.fragmentStarts[f]; k < layout.fragmentEnd(f); k += CHUNK_SAMPLES) {
+            size_t n = (size_t)std::min<uint64_t>(CHUNK_SAMPLES, layout.fragmentEnd(f) - k);
+            if (!readSamples(fp, layout, k, n, chunk.data())) {
+                return "Failed to read the samples.";
+            }
+
+            size_t nBuckets = (n + baseSize - 1) / baseSize;
+            int16_t *out = level.data() + 2 * bucket;
+            pool.parallelFor(nBuckets, 1024, [&](size_t begin, size_t end) {
+                for (size_t b = begin; b < end; b++) {
+                    const int16_t *s = chunk.data() + b * baseSize;
+                    const int16_t *sEnd = chunk.data() + std::min(n, (b + 1) * baseSize);
+                    std::pair<const int16_t*, const int16_t*> mm = std::minmax_element(s, sEnd);
+                    out[2*b] = *mm.first;
+                    out[2*b + 1] = *mm.second;
+                }
+            });
+            bucket += nBuckets;
+        }
+    }
+
+    std::string tempPath = std::string(cachePath) + ".tmp";
+    FILE *cache = fopen(tempPath.c_str(), "wb");
+    if (cache == NULL) {
+        return "Failed to create the envelope cache.";
+    }
+    bool isWritten = fwrite(&header, sizeof(EnvelopeHeader), 1, cache) == 1;
+
+    // Each coarser level from pairs of buckets of the one below, without
+    // pairing across fragments.
+    for (uint32_t l = 0; l < header.nLevels && isWritten; l++) {
+        isWritten = level.empty() || fwrite(level.data(), 2, level.size(), cache) == level.size();
+        if (l + 1 == header.nLevels) {
+            break;
+        }
+
+        uint32_t shift = BASE_SHIFT + l;
+        std::vector<int16_t> next(2 * levelBuckets(layout, shift + 1));
+        size_t in = 0;
+        size_t out = 0;
+        for (size_t f = 0; f < layout.numFragments(); f++) {
+            size_t nIn = (size_t)EnvelopeIndex::numBuckets(layout, f, shift);
+            size_t nOut = (size_t)EnvelopeIndex::numBuckets(layout, f, shift + 1);
+            const int16_t *src = level.data() + 2 * in;
+            int16_t *dst = next.data() + 2 * out;
+            pool.parallelFor(nOut, 4096, [&](size_t begin, size_t end) {
+                for (size_t b = begin; b < end; b++) {
+                    int16_t lo = src[4*b];
+                    int16_t hi = src[4*b + 1];
+                    if (2*b + 1 < nIn) {
+                        lo = std::min(lo, src[4*b + 2]);
+                        hi = std::max(hi, src[4*b + 3]);
+                    }
+                    dst[2*b] = lo;
+                    dst[2*b + 1] = hi;
+                }
+            });
+            in += nIn;
+            out += nOut;
+        }
+        level.swap(next);
+    }
+
+    isWritten = fclose(cache) == 0 && isWritten;
+    if (!isWritten) {
+        remove(tempPath.c_str());
+        return "Failed to write the envelope cache.";
+    }
+
+    remove(cachePath);
+    if (rename(tempPath.c_str(), cachePath) != 0) {
+        remove(tempPath.c_str());
+        return "Failed to replace the envelope cache.";
+    }
+
+    return NULL;
+}
+
+
+FILE *openEnvelope(const char *cachePath, const ContinuousLayout &layout, int64_t fileSize,
+                   EnvelopeIndex &index)
+{
+    FILE *cache = fopen(cachePath, "rb");
+    if (cache == NULL) {
+        return NULL;
+    }
+
+    EnvelopeHeader header;
+    if (fread(&header, sizeof(EnvelopeHeader), 1, cache) != 1 ||
+        memcmp(header.magic, ENVELOPE_MAGIC, 8) != 0 || header.fileSize != fileSize ||
+        header.dataOffset != layout.dataOffset || header.nSamples != layout.nSamples ||
+        header.nFragments != layout.numFragments() || header.nLevels == 0 ||
+        header.baseShift + header.nLevels > 63) {
+        fclose(cache);
+        return NULL;
+    }
+
+    index.baseShift = header.baseShift;
+    index.nLevels = header.nLevels;
+    setLevelOffsets(layout, index);
+
+    return cache;
+}
+
+
+const char *queryEnvelope(FILE *fp, const ContinuousLayout &layout, FILE *cache,
+                          const EnvelopeIndex &index, double startTime, double endTime,
+                          size_t nPixels, EnvelopeQuery &result)
+{
+    result.times.clear();
+    result.minimum.clear();
+    result.maximum.clear();
+
+    // The samples of each fragment inside the span.
+    size_t nFragments = layout.numFragments();
+    std::vector<uint64_t> first(nFragments), last(nFragments);
+    uint64_t nSpan = 0;
+    for (size_t f = 0; f < nFragments; f++) {
+        uint64_t start = layout.fragmentStarts[f];
+        uint64_t end = layout.fragmentEnd(f);
+        // Allow for span edges that are meant to land on a sample.
+        double t0 = std::ceil((startTime - layout.fragmentTimes[f]) * layout.sampleFrequency - 1e-6);
+        double t1 = std::ceil((endTime - layout.fragmentTimes[f]) * layout.sampleFrequency - 1e-6);
+        first[f] = start + (uint64_t)std::min(std::max(t0, 0.0), (double)(end - start));
+        last[f] = start + (uint64_t)std::min(std::max(t1, 0.0), (double)(end - start));
+        last[f] = std::max(first[f], last[f]);
+        nSpan += last[f] - first[f];
+    }
+
+    double samplesPerPixel = (double)nSpan / (double)std::max<size_t>(nPixels, 1);
+    int level = -1;
+    while (level + 1 < (int)index.nLevels &&
+           (double)((uint64_t)1 << (index.baseShift + level + 1)) <= samplesPerPixel) {
+        level++;
+    }
+
+    if (level < 0) {
+        result.samplesPerPoint = 1;
+        std::vector<int16_t> samples;
+        for (size_t f = 0; f < nFragments; f++) {
+            size_t n = (size_t)(last[f] - first[f]);
+            samples.resize(n);
+            if (!readSamples(fp, layout, first[f], n, samples.data())) {
+                return "Failed to read the samples.";
+            }
+            for (size_t k = 0; k < n; k++) {
+                double v = (double)samples[k] * layout.adToMV;
+                result.times.push_back(layout.sampleTime(f, first[f] + k));
+                result.minimum.push_back(v);
+                result.maximum.push_back(v);
+            }
+        }
+        return NULL;
+    }
+
+    uint32_t shift = index.baseShift + (uint32_t)level;
+    result.samplesPerPoint = (uint64_t)1 << shift;
+    std::vector<int16_t> buckets;
+    uint64_t fragmentBucket = 0;
+    for (size_t f = 0; f < nFragments; f++) {
+        uint64_t start = layout.fragmentStarts[f];
+        uint64_t nBuckets = EnvelopeIndex::numBuckets(layout, f, shift);
+
+        if (last[f] > first[f]) {
+            uint64_t b0 = (first[f] - start) >> shift;
+            uint64_t b1 = ((last[f] - start - 1) >> shift) + 1;
+            size_t n = (size_t)(b1 - b0);
+            buckets.resize(2 * n);
+            if (!seekFile(cache, index.levelOffsets[level] + 4 * (int64_t)(fragmentBucket + b0)) ||
+                fread(buckets.data(), 4, n, cache) != n) {
+                return "Failed to read the envelope cache.";
+            }
+            for (size_t b = 0; b < n; b++) {
+                result.times.push_back(layout.sampleTime(f, start + ((b0 + b) << shift)));
+                result.minimum.push_back((double)buckets[2*b] * layout.adToMV);
+                result.maximum.push_back((double)buckets[2*b + 1] * layout.adToMV);
+            }
+        }
+
+        fragmentBucket += nBuckets;
+    }
+
+    return NULL;
+}
@@ -0,0 +1,118 @@
+#ifndef ENVELOPE_H
+#define ENVELOPE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+#include "continuousfile.h"
+#include "threadpool.h"
+
+// Layout of the envelope pyramid of one continuous variable.  Level l holds
+// the min and max of every run of 2^(baseShift + l) samples, with runs
+// restarting at each fragment so no bucket straddles a gap in the
+// recording.  Levels are stored back to back in the cache file, the
+// buckets of each level in fragment order as int16 (min, max) pairs.
+struct EnvelopeIndex
+{
+    uint32_t baseShift;
+    uint32_t nLevels;
+
+    // File offset of each level's first bucket.
+    std::vector<int64_t> levelOffsets;
+
+    // Number of buckets of fragment f at level l.
+    static uint64_t numBuckets(const ContinuousLayout &layout, size_t f, uint32_t shift)
+    {
+        uint64_t n = layout.fragmentEnd(f) - layout.fragmentStarts[f];
+        return (n + ((uint64_t)1 << shift) - 1) >> shift;
+    }
+};
+
+// Result of queryEnvelope.  Each point covers samplesPerPoint samples, or
+// is a single sample if samplesPerPoint is 1.
+struct EnvelopeQuery
+{
+    std::vector<double> times;
+    std::vector<double> minimum;
+    std::vector<double> maximum;
+    uint64_t samplesPerPoint;
+};
+
+
+/*******************************************************************************
+ buildEnvelope - Builds and caches the envelope pyramid of a variable.
+
+ Syntax:
+ const char *buildEnvelope(FILE *fp, const ContinuousLayout &layout, int64_t fileSize,
+                           const char *cachePath, ThreadPool &pool)
+
+ Description:
+ The samples are streamed from the NEX file a chunk at a time, so a
+ recording far larger than memory only needs its finest envelope level in
+ memory, a 2^baseShift fraction of the samples.  Each coarser level is
+ made from pairs of buckets of the one below.  The cache is written to a
+ temporary file that replaces cachePath once it is complete, so a failed
+ build never leaves a partial cache behind.
+
+ Input:
+ fp - Open NEX file.
+ layout - The variable's layout from readContinuousLayout.
+ fileSize - Size of the NEX file, stored so a changed file is noticed.
+ cachePath - File to write the pyramid to.
+ pool - Thread pool for the min/max passes.
+
+ Output:
+ const char * - NULL on success, otherwise a description of the problem.
+*******************************************************************************/
+const char *buildEnvelope(FILE *fp, const ContinuousLayout &layout, int64_t fileSize,
+                          const char *cachePath, ThreadPool &pool);
+
+
+/*******************************************************************************
+ openEnvelope - Opens a cached pyramid if it matches the variable.
+
+ Syntax:
+ FILE *openEnvelope(const char *cachePath, const ContinuousLayout &layout,
+                    int64_t fileSize, EnvelopeIndex &index)
+
+ Output:
+ FILE * - The open cache file, or NULL if there is no cache or it was
+     built from different data.
+ index - The pyramid's layout.
+*******************************************************************************/
+FILE *openEnvelope(const char *cachePath, const ContinuousLayout &layout, int64_t fileSize,
+                   EnvelopeIndex &index);
+
+
+/*******************************************************************************
+ queryEnvelope - Gets the envelope of a time span for display.
+
+ Syntax:
+ const char *queryEnvelope(FILE *fp, const ContinuousLayout &layout, FILE *cache,
+                           const EnvelopeIndex &index, double startTime, double endTime,
+                           size_t nPixels, EnvelopeQuery &result)
+
+ Description:
+ Picks the coarsest level that still gives at least one bucket per pixel
+ and reads only the buckets inside the span from the cache, so the cost
+ depends on the pixel width rather than the span.  Spans short enough to
+ need less than 2^baseShift samples per pixel are read straight from the
+ NEX file as raw samples.
+
+ Input:
+ fp - Open NEX file.
+ layout - The variable's layout.
+ cache, index - The pyramid from openEnvelope.
+ startTime, endTime - Time span to show. (s)
+ nPixels - Width of the display.
+
+ Output:
+ const char * - NULL on success, otherwise a description of the problem.
+ result - The envelope, in mV.
+*******************************************************************************/
+const char *queryEnvelope(FILE *fp, const ContinuousLayout &layout, FILE *cache,
+                          const EnvelopeIndex &index, double startTime, double endTime,
+                          size_t nPixels, EnvelopeQuery &result);
+
+#endif
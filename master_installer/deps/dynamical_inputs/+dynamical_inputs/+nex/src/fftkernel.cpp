@@ -0,0 +1,206 @@
+#include "fftkernel.h"
+
+#include <cmath>
+
+typedef std::complex<double> Complex;
+
+static const double FFT_PI = 3.14159265358979323846;
+
+
+FFTPlan::FFTPlan(size_t n)
+    : m_Size(n)
+{
+    m_Twiddles.resize(n);
+    for (size_t k = 0; k < n; k++) {
+        double phase = -2.0 * FFT_PI * (double)k / (double)n;
+        m_Twiddles[k] = Complex(std::cos(phase), std::sin(phase));
+    }
+
+    // Radix 4 first, then 2, then odd factors.  Anything left once the
+    // trial factor passes sqrt(n) is prime.
+    size_t p = 4;
+    size_t remaining = n;
+    while (remaining > 1) {
+        while (remaining % p != 0) {
+            p = p == 4 ? 2 : (p == 2 ? 3 : p + 2);
+            if (p * p > remaining) {
+                p = remaining;
+            }
+        }
+        remaining /= p;
+        m_Factors.push_back(p);
+        m_Factors.push_back(remaining);
+    }
+}
+
+
+void FFTPlan::transform(const Complex *in, Complex *out) const
+{
+    if (m_Size == 0) {
+        return;
+    }
+    if (m_Size == 1) {
+        out[0] = in[0];
+        return;
+    }
+    work(out, in, 1, 0);
+}
+
+
+// One stage: the p sub-transforms of length m are done first, each of every
+// p-th input, into consecutive blocks of out, then combined by the stage's
+// butterflies.
+void FFTPlan::work(Complex *out, const Complex *in, size_t stride, size_t factor) const
+{
+    size_t p = m_Factors[factor];
+    size_t m = m_Factors[factor + 1];
+
+    if (m == 1) {
+        for (size_t q = 0; q < p; q++) {
+            out[q] = in[q * stride];
+        }
+    }
+    else {
+        for (size_t q = 0; q < p; q++) {
+            work(out + q * m, in + q * stride, stride * p, factor + 2);
+        }
+    }
+
+    switch (p) {
+        case 2: butterfly2(out, stride, m); break;
+        case 3: butterfly3(out, stride, m); break;
+        case 4: butterfly4(out, stride, m); break;
+        default: butterflyGeneric(out, stride, m, p); break;
+    }
+}
+
+
+void FFTPlan::butterfly2(Complex *out, size_t stride, size_t m) const
+{
+    Complex *out2 = out + m;
+    for (size_t k = 0; k < m; k++) {
+        Complex t = out2[k] * m_Twiddles[k * stride];
+        out2[k] = out[k] - t;
+        out[k] += t;
+    }
+}
+
+
+void FFTPlan::butterfly3(Complex *out, size_t stride, size_t m) const
+{
+    // sin(-2 pi / 3)
+    double sin3 = m_Twiddles[stride * m].imag();
+
+    for (size_t k = 0; k < m; k++) {
+        Complex s1 = out[k + m] * m_Twiddles[k * stride];
+        Complex s2 = out[k + 2 * m] * m_Twiddles[2 * k * stride];
+        Complex sum = s1 + s2;
+        Complex diff = (s1 - s2) * sin3;
+
+        Complex mid = out[k] - sum * 0.5;
+        out[k] += sum;
+        out[k + m] = Complex(mid.real() - diff.imag(), mid.imag() + diff.real());
+        out[k + 2 * m] = Complex(mid.real() + diff.imag(), mid.imag() - diff.real());
+    }
+}
+
+
+void FFTPlan::butterfly4(Complex *out, size_t stride, size_t m) const
+{
+    for (size_t k = 0; k < m; k++) {
+        Complex s0 = out[k + m] * m_Twiddles[k * stride];
+        Complex s1 = out[k + 2 * m] * m_Twiddles[2 * k * stride];
+        Complex s2 = out[k + 3 * m] * m_Twiddles[3 * k * stride];
+
+        Complex s5 = out[k] - s1;
+        Complex s4 = out[k] + s1;
+        Complex s3 = s0 + s2;
+        Complex s6 = s0 - s2;
+
+        out[k] = s4 + s3;
+        out[k + 2 * m] = s4 - s3;
+
+        // s5 -/+ i s6
+        out[k + m] = Complex(s5.real() + s6.imag(), s5.imag() - s6.real());
+        out[k + 3 * m] = Complex(s5.real() - s6.imag(), s5.imag() + s6.real());
+    }
+}
+
+
+void FFTPlan::butterflyGeneric(Complex *out, size_t stride, size_t m, size_t p) const
+{
+    std::vector<Complex> scratch(p);
+
+    for (size_t u = 0; u < m; u++) {
+        for (size_t q = 0; q < p; q++) {
+            scratch[q] = out[u + q * m];
+        }
+
+        for (size_t q = 0; q < p; q++) {
+            size_t k = u + q * m;
+            size_t step = stride * k % m_Size;
+            size_t index = 0;
+            Complex sum = scratch[0];
+            for (size_t j = 1; j < p; j++) {
+                index += step;
+                if (index >= m_Size) {
+                    index -= m_Size;
+                }
+                sum += scratch[j] * m_Twiddles[index];
+            }
+            out[k] = sum;
+        }
+    }
+}
+
+
+RealFFT::RealFFT(size_t n)
+    : m_Size(n), m_Plan(n % 2 == 0 ? n / 2 : n)
+{
+    if (n % 2 == 0) {
+        m_Split.resize(n / 2 + 1);
+        for (size_t k = 0; k <= n / 2; k++) {
+            double phase = -2.0 * FFT_PI * (double)k / (double)n;
+            m_Split[k] = Complex(std::cos(phase), std::sin(phase));
+        }
+    }
+}
+
+
+void RealFFT::transform(const double *x, Complex *X, std::vector<Complex> &work) const
+{
+    size_t n = m_Size;
+    if (n == 0) {
+        return;
+    }
+
+    if (n % 2 != 0) {
+        work.resize(2 * n);
+        for (size_t j = 0; j < n; j++) {
+            work[j] = Complex(x[j], 0.0);
+        }
+        m_Plan.transform(&work[0], &work[n]);
+        for (size_t k = 0; k < numBins(); k++) {
+            X[k] = work[n + k];
+        }
+        return;
+    }
+
+    size_t half = n / 2;
+    work.resize(2 * half);
+    for (size_t j = 0; j < half; j++) {
+        work[j] = Complex(x[2 * j], x[2 * j + 1]);
+    }
+    Complex *Z = &work[half];
+    m_Plan.transform(&work[0], Z);
+
+    // Z[k] = E[k] + i O[k], where E and O are the spectra of the even and
+    // odd samples, and X[k] = E[k] + exp(-2 pi i k / n) O[k].
+    for (size_t k = 0; k <= half; k++) {
+        Complex a = Z[k % half];
+        Complex b = std::conj(Z[(half - k) % half]);
+        Complex even = (a + b) * 0.5;
+        Complex odd = (a - b) * Complex(0.0, -0.5);
+        X[k] = even + m_Split[k] * odd;
+    }
+}
@@ -0,0 +1,95 @@
+#ifndef FFTKERNEL_H
+#define FFTKERNEL_H
+
+#include <complex>
+#include <cstddef>
+#include <vector>
+
+/*******************************************************************************
+ FFTPlan - Forward discrete Fourier transform of one length.
+
+ Description:
+ A mixed radix, decimation in time FFT that works for any length.  The
+ length is split into factors of 4, then 2, 3 and any larger primes, each
+ with its own butterfly, so powers of 2 and lengths with small factors run
+ in O(n log n).  Lengths with a large prime factor still work, but that
+ factor costs O(p) per output.
+
+ The twiddle factors are worked out once when the plan is made.  A plan is
+ never changed by transform(), so one plan can be shared by any number of
+ threads.
+
+ Usage:
+ FFTPlan plan(n);
+ plan.transform(in, out);    // out[k] = sum(in[j] * exp(-2 pi i j k / n))
+*******************************************************************************/
+class FFTPlan
+{
+public:
+    explicit FFTPlan(size_t n);
+
+    size_t size() const { return m_Size; }
+
+    // Transforms n values of in into out, which must not overlap in.
+    void transform(const std::complex<double> *in, std::complex<double> *out) const;
+
+private:
+    void work(std::complex<double> *out, const std::complex<double> *in, size_t stride,
+              size_t factor) const;
+
+    void butterfly2(std::complex<double> *out, size_t stride, size_t m) const;
+    void butterfly3(std::complex<double> *out, size_t stride, size_t m) const;
+    void butterfly4(std::complex<double> *out, size_t stride, size_t m) const;
+    void butterflyGeneric(std::complex<double> *out, size_t stride, size_t m, size_t p) const;
+
+    size_t m_Size;
+
+    // exp(-2 pi i k / n) for k = 0..n-1.
+    std::vector<std::complex<double> > m_Twiddles;
+
+    // Pairs of (radix, remaining length) from the first stage to the last.
+    std::vector<size_t> m_Factors;
+};
+
+
+/*******************************************************************************
+ RealFFT - Forward DFT of real values.
+
+ Description:
+ Returns the n / 2 + 1 non-negative frequency bins, the rest being their
+ complex conjugates.  Even lengths are done as a complex FFT of half the
+ length, with the even samples as the real part and the odd ones as the
+ imaginary part, and the two interleaved spectra separated afterwards.
+ Odd lengths fall back to a complex FFT of the full length.
+
+ As with FFTPlan, one RealFFT can be shared by threads as long as each
+ passes its own work buffer.
+
+ Usage:
+ RealFFT fft(n);
+ std::vector<std::complex<double> > work, X(n / 2 + 1);
+ fft.transform(x, X.data(), work);
+*******************************************************************************/
+class RealFFT
+{
+public:
+    explicit RealFFT(size_t n);
+
+    size_t size() const { return m_Size; }
+    size_t numBins() const { return m_Size / 2 + 1; }
+
+    // Transforms n real values into numBins() bins.  work is resized as
+    // needed and can be reused between calls.
+    void transform(const double *x, std::complex<double> *X,
+                   std::vector<std::complex<double> > &work) const;
+
+private:
+    size_t m_Size;
+    FFTPlan m_Plan;
+
+    // exp(-2 pi i k / n) for k = 0..n/2, to separate the half length
+    // spectra.  Empty for odd lengths.
+    std::vector<std::complex<double> > m_Split;
+};
+
+#endif
@@ -0,0 +1,207 @@
+#include "intervalset.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include "NexFile.h"
+#include "continuousfile.h"
+
+
+// Adds [start, end] to the end of a result if it has any length, joining it
+// to the last interval if they touch.
+static inline void appendInterval(std::vector<Interval> &result, double start, double end)
+{
+    if (!(end > start)) {
+        return;
+    }
+    if (!result.empty() && start <= result.back().end) {
+        result.back().end = std::max(result.back().end, end);
+        return;
+    }
+    Interval interval = {start, end};
+    result.push_back(interval);
+}
+
+
+void unionIntervals(const std::vector<Interval> &a, const std::vector<Interval> &b,
+                    std::vector<Interval> &result)
+{
+    result.clear();
+    result.reserve(a.size() + b.size());
+
+    // Take whichever interval starts first; appendInterval joins overlaps.
+    size_t i = 0, j = 0;
+    while (i < a.size() || j < b.size()) {
+        const Interval &next = (j == b.size() || (i < a.size() && a[i].start <= b[j].start)) ? a[i++] : b[j++];
+        appendInterval(result, next.start, next.end);
+    }
+}
+
+
+void intersectIntervals(const std::vector<Interval> &a, const std::vector<Interval> &b,
+                        std::vector<Interval> &result)
+{
+    result.clear();
+
+    size_t i = 0, j = 0;
+    while (i < a.size() && j < b.size()) {
+        appendInterval(result, std::max(a[i].start, b[j].start), std::min(a[i].end, b[j].end));
+
+        // Whichever ends first can't overlap anything further on.
+        if (a[i].end < b[j].end) {
+            i++;
+        }
+        else {
+            j++;
+        }
+    }
+}
+
+
+void subtractIntervals(const std::vector<Interval> &a, const std::vector<Interval> &b,
+                       std::vector<Interval> &result)
+{
+    result.clear();
+
+    size_t j = 0;
+    for (size_t i = 0; i < a.size(); i++) {
+        double start = a[i].start;
+        double end = a[i].end;
+
+        // Skip what ends before this interval.  b[j] may still overlap the
+        // next interval of a, so it isn't passed over.
+        while (j < b.size() && b[j].end <= start) {
+            j++;
+        }
+        size_t k = j;
+        while (k < b.size() && b[k].start < end) {
+            appendInterval(result, start, b[k].start);
+            start = std::max(start, b[k].end);
+            k++;
+        }
+        appendInterval(result, start, end);
+    }
+}
+
+
+void complementIntervals(const std::vector<Interval> &a, double spanStart, double spanEnd,
+                         std::vector<Interval> &result)
+{
+    result.clear();
+
+    double start = spanStart;
+    for (size_t i = 0; i < a.size() && a[i].start < spanEnd; i++) {
+        appendInterval(result, start, std::min(a[i].start, spanEnd));
+        start = std::max(start, a[i].end);
+    }
+    appendInterval(result, start, spanEnd);
+}
+
+
+void removeShortIntervals(std::vector<Interval> &intervals, double minDuration)
+{
+    intervals.erase(std::remove_if(intervals.begin(), intervals.end(),
+                                   [minDuration](const Interval &x) {
+                                       return !(x.end > x.start) || x.end - x.start < minDuration;
+                                   }),
+                    intervals.end());
+}
+
+
+void mergeIntervalGaps(std::vector<Interval> &intervals, double maxGap)
+{
+    size_t nMerged = 0;
+    for (size_t i = 0; i < intervals.size(); i++) {
+        if (!(intervals[i].end > intervals[i].start)) {
+            continue;
+        }
+        if (nMerged > 0 && intervals[i].start - intervals[nMerged-1].end <= maxGap) {
+            intervals[nMerged-1].end = std::max(intervals[nMerged-1].end, intervals[i].end);
+        }
+        else {
+            intervals[nMerged++] = intervals[i];
+        }
+    }
+    intervals.resize(nMerged);
+}
+
+
+static bool namesMatch(const std::string &name, const char *varName, size_t length, bool isCaseSensitive)
+{
+    if (name.size() != length) {
+        return false;
+    }
+    for (size_t k = 0; k < length; k++) {
+        char a = name[k], b = varName[k];
+        if (!isCaseSensitive) {
+            a = (char)std::toupper((unsigned char)a);
+            b = (char)std::toupper((unsigned char)b);
+        }
+        if (a != b) {
+            return false;
+        }
+    }
+    return true;
+}
+
+
+const char *readIntervalVariables(FILE *fp, const std::vector<std::string> &names,
+                                  bool isCaseSensitive, std::vector<std::vector<Interval> > &sets,
+                                  double &fileStart, double &fileEnd)
+{
+    NexFileHeader fileHeader;
+    std::vector<NexVarHeader> allHeaders;
+
+    if (!seekFile(fp, 0) || fread(&fileHeader, sizeof(NexFileHeader), 1, fp) != 1) {
+        return "Failed to read the file header.";
+    }
+    if (fileHeader.NumVars < 0 || !(fileHeader.Frequency > 0)) {
+        return "Invalid file header.";
+    }
+    allHeaders.resize(fileHeader.NumVars);
+    if (fileHeader.NumVars > 0 &&
+        fread(&allHeaders[0], sizeof(NexVarHeader) * fileHeader.NumVars, 1, fp) != 1) {
+        return "Failed to read the variable headers.";
+    }
+    fileStart = (double)fileHeader.Beg / fileHeader.Frequency;
+    fileEnd = (double)fileHeader.End / fileHeader.Frequency;
+
+    sets.assign(names.size(), std::vector<Interval>());
+    std::vector<int> ticks;
+    for (size_t n = 0; n < names.size(); n++) {
+        const NexVarHeader *header = NULL;
+        for (size_t i = 0; i < allHeaders.size(); i++) {
+            const NexVarHeader &candidate = allHeaders[i];
+            if (candidate.Type == NEX_VARIABLE_TYPE_INTERVAL &&
+                namesMatch(names[n], candidate.Name, strnlen(candidate.Name, sizeof(candidate.Name)),
+                           isCaseSensitive)) {
+                if (header != NULL) {
+                    return "More than one interval variable has that name.";
+                }
+                header = &candidate;
+            }
+        }
+        if (header == NULL) {
+            return "No interval variable has that name.";
+        }
+
+        // The start ticks of all the intervals, then their end ticks.
+        size_t count = header->Count > 0 ? (size_t)header->Count : 0;
+        ticks.resize(2 * count);
+        if (count > 0 &&
+            (!seekFile(fp, (int64_t)(unsigned int)header->DataOffset) ||
+             fread(&ticks[0], 2 * count * 4, 1, fp) != 1)) {
+            return "Failed to read the interval times.";
+        }
+
+        std::vector<Interval> &set = sets[n];
+        set.resize(count);
+        for (size_t k = 0; k < count; k++) {
+            set[k].start = (double)ticks[k] / fileHeader.Frequency;
+            set[k].end = (double)ticks[count + k] / fileHeader.Frequency;
+        }
+        mergeIntervals(set);
+    }
+
+    return NULL;
+}
@@ -0,0 +1,92 @@
+#ifndef INTERVALSET_H
+#define INTERVALSET_H
+
+#include <cstdio>
+#include <string>
+#include <vector>
+#include "spiketrains.h"
+
+// Interval sets are sorted, disjoint lists of Intervals, as made by
+// mergeIntervals, so every result below can be passed straight to the
+// selection and window kernels.  The set operations treat a set as the time
+// it covers and ignore the endpoints, so their results never hold an
+// interval of zero length: two intervals that only touch don't intersect,
+// and taking an interval away leaves nothing of it, not its endpoints.
+// The clean up functions drop zero length intervals for the same reason.
+// Each operation is a single linear merge of its inputs.
+
+// The operations of the IntervalAlgebra command.
+enum IntervalOperation
+{
+    IntervalUnion = 0,
+    IntervalIntersection,
+    IntervalDifference,
+    IntervalComplement,
+    IntervalMinDuration,
+    IntervalMergeGaps
+};
+
+
+/*******************************************************************************
+ unionIntervals - Time covered by either of two interval sets.
+*******************************************************************************/
+void unionIntervals(const std::vector<Interval> &a, const std::vector<Interval> &b,
+                    std::vector<Interval> &result);
+
+/*******************************************************************************
+ intersectIntervals - Time covered by both of two interval sets.
+*******************************************************************************/
+void intersectIntervals(const std::vector<Interval> &a, const std::vector<Interval> &b,
+                        std::vector<Interval> &result);
+
+/*******************************************************************************
+ subtractIntervals - Time covered by a but not by b.
+*******************************************************************************/
+void subtractIntervals(const std::vector<Interval> &a, const std::vector<Interval> &b,
+                       std::vector<Interval> &result);
+
+/*******************************************************************************
+ complementIntervals - Time in [spanStart, spanEnd) not covered by a set.
+*******************************************************************************/
+void complementIntervals(const std::vector<Interval> &a, double spanStart, double spanEnd,
+                         std::vector<Interval> &result);
+
+/*******************************************************************************
+ removeShortIntervals - Drops the intervals shorter than minDuration. (s)
+*******************************************************************************/
+void removeShortIntervals(std::vector<Interval> &intervals, double minDuration);
+
+/*******************************************************************************
+ mergeIntervalGaps - Joins intervals separated by gaps of at most maxGap. (s)
+*******************************************************************************/
+void mergeIntervalGaps(std::vector<Interval> &intervals, double maxGap);
+
+
+/*******************************************************************************
+ readIntervalVariables - Reads interval variables of a NEX file by name.
+
+ Syntax:
+ const char *readIntervalVariables(FILE *fp, const std::vector<std::string> &names,
+                                   bool isCaseSensitive,
+                                   std::vector<std::vector<Interval> > &sets,
+                                   double &fileStart, double &fileEnd)
+
+ Description:
+ Converts each variable's start and end ticks to seconds and merges them
+ into an interval set.  Every name must match exactly one variable.
+
+ Input:
+ fp - Open NEX file.
+ names - Names of the interval variables to read.
+ isCaseSensitive - Whether the names must match case.
+
+ Output:
+ const char * - NULL on success, otherwise a description of the problem.
+ sets - One interval set per name.
+ fileStart, fileEnd - The file's recording span, tbeg and tend. (s)
+*******************************************************************************/
+const char *readIntervalVariables(FILE *fp, const std::vector<std::string> &names,
+                                  bool isCaseSensitive, std::vector<std::vector<Interval> > &sets,
+                                  double &fileStart, double &fileEnd);
+
+#endif
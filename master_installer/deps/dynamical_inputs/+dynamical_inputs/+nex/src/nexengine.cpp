@@ -7,7 +7,24 @@ char **g_fileHeaderFields,
      **g_markerFields,
      **g_markerValueFields,
      **g_continuousFields,
-     **g_varHeaderFields;
+     **g_varHeaderFields,
+     **g_amdStatsFields;
+
+// Open AMD streams, by handle.  Handles are never reused.
+std::map<unsigned int, StreamingAMD*> g_streams;
+unsigned int g_nextStreamHandle = 1;
+
+// Open continuous readers, by handle.  Handles are never reused.
+std::map<unsigned int, ContinuousReader*> g_readers;
+unsigned int g_nextReaderHandle = 1;
+
+// Open AMD result files, by handle.  Handles are never reused.
+std::map<unsigned int, ResultStoreReader*> g_resultStores;
+unsigned int g_nextResultStoreHandle = 1;
+
+// CDFs being built a matrix at a time, by handle.  Handles are never reused.
+std::map<unsigned int, ECDFAccumulator*> g_ecdfs;
+unsigned int g_nextECDFHandle = 1;
 
 
 void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
@@ -15,7 +32,6 @@ void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
     unsigned int opCode;
     FILE *fp;
     char fileName[256];
-    int variableType = -1;
     static bool isInit = false;
 
     // Do any initialization if we haven't done so yet.
@@ -35,147 +51,2071 @@ void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
         barf("Usage: nexengine(opCode, args)");
     }
 
-    // Grab the opcode.
-    opCode = (unsigned int)mxGetScalar(prhs[0]);
+    // Grab the opcode.
+    opCode = (unsigned int)mxGetScalar(prhs[0]);
+
+    switch (opCode) {
+        // Read the continuous data.
+        case GetContinuous:
+        {
+            NexFileHeader fileHeader;
+
+            CHECKARGCOUNT(1);
+
+            // Make sure the file argument is a string.
+            bool isChar = mxIsChar(prhs[1]);
+            if (!isChar) {
+                barf("NEXENGINE:GetContinous:File name must be a string.");
+            }
+
+            // Extract the filename.
+            if (mxGetString(prhs[1], fileName, 256)) {
+                barf("NEXENGINE:GetContinous:Failed to extract the file name.");
+            }
+
+            // Open up the nex file.
+            fp = fopen(fileName, "rb");
+            if (fp == NULL) {
+                barf("NEXENGINE:GetContinous:Failed to open file.");
+            }
+
+            // Read the file header.
+            fread(&fileHeader, sizeof(NexFileHeader), 1, fp);
+
+            plhs[0] = readVariableData(fp, &fileHeader, NEX_VARIABLE_TYPE_CONTINUOUS);
+
+            // Close the NEX file.
+            fclose(fp);
+
+            break;
+        }
+
+        // Read the markers.
+        case GetMarkers:
+        {
+            NexFileHeader fileHeader;
+
+            CHECKARGCOUNT(1);
+
+            // Make sure the file argument is a string.
+            bool isChar = mxIsChar(prhs[1]);
+            if (!isChar) {
+                barf("NEXENGINE:GetMarkers:File name must be a string.");
+            }
+
+            // Extract the filename.
+            if (mxGetString(prhs[1], fileName, 256)) {
+                barf("NEXENGINE:GetMarkers:Failed to extract the file name.");
+            }
+
+            // Open up the nex file.
+            fp = fopen(fileName, "rb");
+            if (fp == NULL) {
+                barf("NEXENGINE:GetMarkers:Failed to open file.");
+            }
+
+            // Read the file header.
+            fread(&fileHeader, sizeof(NexFileHeader), 1, fp);
+
+            plhs[0] = readVariableData(fp, &fileHeader, NEX_VARIABLE_TYPE_MARKER);
+
+            // Close the NEX file.
+            fclose(fp);
+
+            break;
+        }
+
+        // Read the events.
+        case GetEvents:
+        {
+            NexFileHeader fileHeader;
+
+            CHECKARGCOUNT(1);
+
+            // Make sure the file argument is a string.
+            bool isChar = mxIsChar(prhs[1]);
+            if (!isChar) {
+                barf("NEXENGINE:GetEvents:File name must be a string.");
+            }
+
+            // Extract the filename.
+            if (mxGetString(prhs[1], fileName, 256)) {
+                barf("NEXENGINE:GetEvents:Failed to extract the file name.");
+            }
+
+            // Open up the nex file.
+            fp = fopen(fileName, "rb");
+            if (fp == NULL) {
+                barf("NEXENGINE:GetEvents:Failed to open file.");
+            }
+
+            // Read the file header.
+            fread(&fileHeader, sizeof(NexFileHeader), 1, fp);
+
+            plhs[0] = readVariableData(fp, &fileHeader, NEX_VARIABLE_TYPE_EVENT);
+
+            // Close the NEX file.
+            fclose(fp);
+
+            break;
+        }
+
+        // Read the file header.
+        case GetHeader:
+        {
+            NexFileHeader fileHeader;
+
+            CHECKARGCOUNT(1);
+
+            // Make sure the file argument is a string.
+            bool isChar = mxIsChar(prhs[1]);
+            if (!isChar) {
+                barf("NEXENGINE:GetHeader:File name must be a string.");
+            }
+
+            // Extract the filename.
+            if (mxGetString(prhs[1], fileName, 256)) {
+                barf("NEXENGINE:GetHeader:Failed to extract the file name.");
+            }
+
+            // Open up the nex file.
+            fp = fopen(fileName, "rb");
+            if (fp == NULL) {
+                barf("NEXENGINE:GetHeader:Failed to open file.");
+            }
+
+            // Read the header.
+            fread(&fileHeader, sizeof(NexFileHeader), 1, fp);
+
+            // Close the file.
+            fclose(fp);
+
+            plhs[0] = packFileHeaderData(&fileHeader);
+
+            break;
+        }
+
+        // Select the spikes of each neuron that fall within a set of windows
+        // and, optionally, a set of intervals.
+        case SelectSpikes:
+        {
+            CHECKARGCOUNT(3);
+
+            std::vector<SpikeTrain> trains = getSpikeTrains(prhs[1], "SelectSpikes");
+            std::vector<Interval> intervals = getIntervals(prhs[2], "SelectSpikes");
+
+            // The windows are passed as a Wx2 [start end] matrix.
+            if (!mxIsDouble(prhs[3]) || (!mxIsEmpty(prhs[3]) && mxGetN(prhs[3]) != 2)) {
+                barf("NEXENGINE:SelectSpikes:Windows must be a Wx2 double matrix.");
+            }
+            size_t nWindows = mxGetM(prhs[3]);
+            const double *windowStarts = mxGetPr(prhs[3]);
+            const double *windowEnds = windowStarts + nWindows;
+
+            size_t nTrains = trains.size();
+            plhs[0] = mxCreateDoubleMatrix(nTrains, nWindows, mxREAL);
+            double *counts = mxGetPr(plhs[0]);
+
+            if (nlhs < 2) {
+                // Only the spike counts were requested so we don't need to
+                // keep track of the selected ranges.
+                for (size_t w = 0; w < nWindows; w++) {
+                    for (size_t i = 0; i < nTrains; i++) {
+                        counts[i + w*nTrains] = (double)countSpikes(trains[i], intervals,
+                                                                    windowStarts[w], windowEnds[w]);
+                    }
+                }
+            }
+            else {
+                // Each cell holds an Rx2 [first last] matrix of 1 based,
+                // inclusive spike indices.
+                plhs[1] = mxCreateCellMatrix(nTrains, nWindows);
+                std::vector<IndexRange> ranges;
+
+                for (size_t w = 0; w < nWindows; w++) {
+                    for (size_t i = 0; i < nTrains; i++) {
+                        size_t k = i + w*nTrains;
+                        counts[k] = (double)selectSpikeRanges(trains[i], intervals,
+                                                              windowStarts[w], windowEnds[w], ranges);
+
+                        mxArray *r = mxCreateDoubleMatrix(ranges.size(), 2, mxREAL);
+                        double *rp = mxGetPr(r);
+                        for (size_t j = 0; j < ranges.size(); j++) {
+                            rp[j] = (double)ranges[j].first + 1;
+                            rp[j + ranges.size()] = (double)ranges[j].last;
+                        }
+                        mxSetCell(plhs[1], k, r);
+                    }
+                }
+            }
+
+            break;
+        }
+
+        // Calculate the AMD matrix, neuron stats and z-scores for one window.
+        case WindowAMD:
+        {
+            CHECKARGCOUNT(1);
+
+            std::vector<SpikeTrain> trains = getSpikeTrains(prhs[1], "WindowAMD");
+            size_t nTrains = trains.size();
+
+            WindowStats window;
+            std::vector<NeuronStats> stats;
+            computeWindowStats(trains, window, stats);
+
+            PackedTrains packed;
+            packTrains(trains, packed);
+
+            // The pair kernel runs on the thread pool and writes straight
+            // into the output matrices.
+            plhs[0] = mxCreateDoubleMatrix(nTrains, nTrains, mxREAL);
+            double *zscore = NULL;
+            if (nlhs > 2) {
+                plhs[2] = mxCreateDoubleMatrix(nTrains, nTrains, mxREAL);
+                zscore = mxGetPr(plhs[2]);
+            }
+            computeTiledAMD<double>(packed, stats, mxGetPr(plhs[0]), zscore, getThreadPool());
+
+            if (nlhs > 1) {
+                plhs[1] = packAMDStats(window, stats);
+            }
+
+            break;
+        }
+
+        // Calculate the AMD of a sequence of overlapping windows by sliding a
+        // single window across them.
+        case SlidingWindowAMD:
+        {
+            CHECKARGCOUNT(5);
+
+            std::vector<SpikeTrain> trains = getSpikeTrains(prhs[1], "SlidingWindowAMD");
+            std::vector<Interval> intervals = getIntervals(prhs[2], "SlidingWindowAMD");
+            size_t nTrains = trains.size();
+
+            if (!mxIsDouble(prhs[3]) || (!mxIsEmpty(prhs[3]) && mxGetN(prhs[3]) != 2)) {
+                barf("NEXENGINE:SlidingWindowAMD:Windows must be a Wx2 double matrix.");
+            }
+            size_t nWindows = mxGetM(prhs[3]);
+            const double *windowStarts = mxGetPr(prhs[3]);
+            const double *windowEnds = windowStarts + nWindows;
+
+            std::vector<std::vector<size_t> > windowNeurons =
+                getWindowNeurons(prhs[4], nTrains, nWindows, "SlidingWindowAMD");
+            bool isSingle = getPrecision(prhs[5], "SlidingWindowAMD");
+            mxClassID classID = isSingle ? mxSINGLE_CLASS : mxDOUBLE_CLASS;
+
+            plhs[0] = mxCreateCellMatrix(nWindows, 1);
+            if (nlhs > 1) {
+                plhs[1] = mxCreateCellMatrix(nWindows, 1);
+            }
+            if (nlhs > 2) {
+                plhs[2] = mxCreateCellMatrix(nWindows, 1);
+            }
+
+            ThreadPool &pool = getThreadPool();
+            SlidingAMD sliding(trains, intervals);
+            std::vector<NeuronStats> stats;
+            WindowStats window;
+
+            for (size_t w = 0; w < nWindows; w++) {
+                const std::vector<size_t> &neurons = windowNeurons[w];
+
+                sliding.advance(windowStarts[w], windowEnds[w], pool);
+
+                mxArray *amd = mxCreateNumericMatrix(neurons.size(), neurons.size(), classID, mxREAL);
+                mxArray *zscore = mxCreateNumericMatrix(neurons.size(), neurons.size(), classID, mxREAL);
+                if (isSingle) {
+                    sliding.emit(neurons, (float*)mxGetData(amd), (float*)mxGetData(zscore),
+                                 window, stats, pool);
+                }
+                else {
+                    sliding.emit(neurons, mxGetPr(amd), mxGetPr(zscore), window, stats, pool);
+                }
+
+                mxSetCell(plhs[0], w, amd);
+                if (nlhs > 1) {
+                    mxSetCell(plhs[1], w, zscore);
+                }
+                else {
+                    mxDestroyArray(zscore);
+                }
+                if (nlhs > 2) {
+                    mxSetCell(plhs[2], w, packAMDStats(window, stats));
+                }
+            }
+
+            break;
+        }
+
+        // Calculate the AMD of a window with a large number of neurons, either
+        // as dense single/double matrices or as the top k neighbors of each
+        // neuron.
+        case TiledWindowAMD:
+        {
+            CHECKARGCOUNT(3);
+
+            std::vector<SpikeTrain> trains = getSpikeTrains(prhs[1], "TiledWindowAMD");
+            size_t nTrains = trains.size();
+
+            bool isSingle = getPrecision(prhs[2], "TiledWindowAMD");
+            mxClassID classID = isSingle ? mxSINGLE_CLASS : mxDOUBLE_CLASS;
+
+            double topK = mxGetScalar(prhs[3]);
+            if (!(topK >= 0) || topK != std::floor(topK)) {
+                barf("NEXENGINE:TiledWindowAMD:Top k must be a non-negative integer.");
+            }
+            size_t k = (size_t)topK;
+
+            WindowStats window;
+            std::vector<NeuronStats> stats;
+            computeWindowStats(trains, window, stats);
+
+            PackedTrains packed;
+            packTrains(trains, packed);
+
+            ThreadPool &pool = getThreadPool();
+
+            if (k == 0) {
+                plhs[0] = mxCreateNumericMatrix(nTrains, nTrains, classID, mxREAL);
+                mxArray *zscore = NULL;
+                if (nlhs > 2) {
+                    zscore = plhs[2] = mxCreateNumericMatrix(nTrains, nTrains, classID, mxREAL);
+                }
+
+                if (isSingle) {
+                    computeTiledAMD<float>(packed, stats, (float*)mxGetData(plhs[0]),
+                        zscore ? (float*)mxGetData(zscore) : NULL, pool);
+                }
+                else {
+                    computeTiledAMD<double>(packed, stats, mxGetPr(plhs[0]),
+                        zscore ? mxGetPr(zscore) : NULL, pool);
+                }
+
+                // There are no neighbor indices for the dense matrices.
+                if (nlhs > 3) {
+                    plhs[3] = mxCreateDoubleMatrix(0, 0, mxREAL);
+                }
+            }
+            else {
+                // The z-scores are needed to rank the neighbors, so they're
+                // always calculated.
+                plhs[0] = mxCreateNumericMatrix(nTrains, k, classID, mxREAL);
+                mxArray *zscore = mxCreateNumericMatrix(nTrains, k, classID, mxREAL);
+                mxArray *neighbors = mxCreateDoubleMatrix(nTrains, k, mxREAL);
+
+                if (isSingle) {
+                    computeTopKAMD<float>(packed, stats, k, (float*)mxGetData(plhs[0]),
+                        (float*)mxGetData(zscore), mxGetPr(neighbors), pool);
+                }
+                else {
+                    computeTopKAMD<double>(packed, stats, k, mxGetPr(plhs[0]),
+                        mxGetPr(zscore), mxGetPr(neighbors), pool);
+                }
+
+                if (nlhs > 2) {
+                    plhs[2] = zscore;
+                }
+                else {
+                    mxDestroyArray(zscore);
+                }
+                if (nlhs > 3) {
+                    plhs[3] = neighbors;
+                }
+                else {
+                    mxDestroyArray(neighbors);
+                }
+            }
+
+            if (nlhs > 1) {
+                plhs[1] = packAMDStats(window, stats);
+            }
+
+            break;
+        }
+
+        // Calculate the AMD of many windows at once, splitting the work into
+        // window x pair tile tasks.
+        case MultiWindowAMD:
+        {
+            CHECKARGCOUNT(5);
+
+            std::vector<SpikeTrain> trains = getSpikeTrains(prhs[1], "MultiWindowAMD");
+            std::vector<Interval> intervals = getIntervals(prhs[2], "MultiWindowAMD");
+            size_t nTrains = trains.size();
+
+            if (!mxIsDouble(prhs[3]) || (!mxIsEmpty(prhs[3]) && mxGetN(prhs[3]) != 2)) {
+                barf("NEXENGINE:MultiWindowAMD:Windows must be a Wx2 double matrix.");
+            }
+            size_t nWindows = mxGetM(prhs[3]);
+            const double *windowStarts = mxGetPr(prhs[3]);
+            const double *windowEnds = windowStarts + nWindows;
+
+            std::vector<std::vector<size_t> > windowNeurons =
+                getWindowNeurons(prhs[4], nTrains, nWindows, "MultiWindowAMD");
+            bool isSingle = getPrecision(prhs[5], "MultiWindowAMD");
+            mxClassID classID = isSingle ? mxSINGLE_CLASS : mxDOUBLE_CLASS;
+
+            ThreadPool &pool = getThreadPool();
+            std::vector<AMDWindowJob> jobs(nWindows);
+
+            // Pack the spikes of each window's neurons.
+            pool.parallelFor(nWindows, 1, [&](size_t wBegin, size_t wEnd) {
+                for (size_t w = wBegin; w < wEnd; w++) {
+                    packWindowTrains(trains, windowNeurons[w], intervals,
+                                     windowStarts[w], windowEnds[w], jobs[w].trains);
+                }
+            });
+
+            // All the output matrices have to be created here on the MATLAB
+            // thread before the workers can fill them in.
+            plhs[0] = mxCreateCellMatrix(nWindows, 1);
+            mxArray *zscores = mxCreateCellMatrix(nWindows, 1);
+            for (size_t w = 0; w < nWindows; w++) {
+                size_t k = windowNeurons[w].size();
+                mxArray *amd = mxCreateNumericMatrix(k, k, classID, mxREAL);
+                mxArray *zscore = mxCreateNumericMatrix(k, k, classID, mxREAL);
+                mxSetCell(plhs[0], w, amd);
+                mxSetCell(zscores, w, zscore);
+                if (isSingle) {
+                    jobs[w].amdSingle = (float*)mxGetData(amd);
+                    jobs[w].zscoreSingle = (float*)mxGetData(zscore);
+                }
+                else {
+                    jobs[w].amd = mxGetPr(amd);
+                    jobs[w].zscore = mxGetPr(zscore);
+                }
+            }
+
+            computeMultiWindowAMD(jobs, pool);
+
+            if (nlhs > 1) {
+                plhs[1] = zscores;
+            }
+            else {
+                mxDestroyArray(zscores);
+            }
+            if (nlhs > 2) {
+                plhs[2] = mxCreateCellMatrix(nWindows, 1);
+                for (size_t w = 0; w < nWindows; w++) {
+                    mxSetCell(plhs[2], w, packAMDStats(jobs[w].window, jobs[w].stats));
+                }
+            }
+
+            break;
+        }
+
+        // Calculate the stability between AMD windows from their z-scores.
+        case WindowStability:
+        {
+            CHECKARGCOUNT(3);
+
+            const mxArray *zscores = prhs[1];
+            const mxArray *ids = prhs[2];
+            if (!mxIsCell(zscores) || !mxIsCell(ids) ||
+                mxGetNumberOfElements(zscores) != mxGetNumberOfElements(ids)) {
+                barf("NEXENGINE:WindowStability:Z-scores and cell IDs must be cell arrays of the same size.");
+            }
+            size_t nWindows = mxGetNumberOfElements(zscores);
+
+            char method[16];
+            if (mxGetString(prhs[3], method, 16)) {
+                barf("NEXENGINE:WindowStability:Failed to read the stability method.");
+            }
+            bool isAll = strcmp(method, "all") == 0;
+            if (!isAll && strcmp(method, "neighbor") != 0) {
+                barf("NEXENGINE:WindowStability:Method must be 'neighbor' or 'all'.");
+            }
+
+            std::vector<ZScoreWindow> windows(nWindows);
+            std::vector<std::vector<double> > cellIDs(nWindows);
+            for (size_t w = 0; w < nWindows; w++) {
+                const mxArray *z = mxGetCell(zscores, w);
+                const mxArray *id = mxGetCell(ids, w);
+                if (z == NULL || !mxIsDouble(z) || mxGetM(z) != mxGetN(z)) {
+                    barf("NEXENGINE:WindowStability:Z-scores %d must be a square double matrix.", (int)w + 1);
+                }
+                if (id == NULL || !mxIsDouble(id) || mxGetNumberOfElements(id) != mxGetM(z)) {
+                    barf("NEXENGINE:WindowStability:Cell IDs %d must have one entry per z-score row.", (int)w + 1);
+                }
+
+                windows[w].z = mxGetPr(z);
+                windows[w].n = mxGetM(z);
+                cellIDs[w].assign(mxGetPr(id), mxGetPr(id) + mxGetNumberOfElements(id));
+            }
+
+            std::vector<double> globalIDs;
+            mapGlobalNeurons(cellIDs, windows, globalIDs);
+
+            ThreadPool &pool = getThreadPool();
+            if (isAll) {
+                plhs[0] = mxCreateDoubleMatrix(nWindows, nWindows, mxREAL);
+                allStability(windows, mxGetPr(plhs[0]), pool);
+            }
+            else {
+                plhs[0] = mxCreateDoubleMatrix(1, nWindows > 0 ? nWindows - 1 : 0, mxREAL);
+                neighborStability(windows, mxGetPr(plhs[0]), pool);
+            }
+
+            // The global neuron map, in case the caller wants to line up the
+            // windows' neurons.
+            if (nlhs > 1) {
+                plhs[1] = mxCreateDoubleMatrix(globalIDs.size(), 1, mxREAL);
+                std::copy(globalIDs.begin(), globalIDs.end(), mxGetPr(plhs[1]));
+            }
+
+            break;
+        }
+
+        // Calculate the neighbor stability of a set of windows straight from
+        // the spike trains without keeping every window's AMD around.
+        case StreamStability:
+        {
+            CHECKARGCOUNT(4);
+
+            std::vector<SpikeTrain> trains = getSpikeTrains(prhs[1], "StreamStability");
+            std::vector<Interval> intervals = getIntervals(prhs[2], "StreamStability");
+            size_t nTrains = trains.size();
+
+            if (!mxIsDouble(prhs[3]) || (!mxIsEmpty(prhs[3]) && mxGetN(prhs[3]) != 2)) {
+                barf("NEXENGINE:StreamStability:Windows must be a Wx2 double matrix.");
+            }
+            size_t nWindows = mxGetM(prhs[3]);
+            const double *windowStarts = mxGetPr(prhs[3]);
+            const double *windowEnds = windowStarts + nWindows;
+
+            std::vector<std::vector<size_t> > windowNeurons =
+                getWindowNeurons(prhs[4], nTrains, nWindows, "StreamStability");
+
+            plhs[0] = mxCreateDoubleMatrix(1, nWindows > 0 ? nWindows - 1 : 0, mxREAL);
+            streamNeighborStability(trains, intervals, windowStarts, windowEnds, windowNeurons,
+                                    mxGetPr(plhs[0]), getThreadPool());
+
+            break;
+        }
+
+        // Calculate the empirical CDF of the off diagonal values of a set of
+        // window matrices, either exactly or from a quantile sketch.
+        case WindowECDF:
+        {
+            CHECKARGCOUNT(2);
+
+            const mxArray *cells = prhs[1];
+            if (!mxIsCell(cells)) {
+                barf("NEXENGINE:WindowECDF:Matrices must be a cell array.");
+            }
+            size_t nMatrices = mxGetNumberOfElements(cells);
+
+            if (!mxIsDouble(prhs[2]) || mxGetNumberOfElements(prhs[2]) != 1 ||
+                !(mxGetScalar(prhs[2]) >= 0.0 && mxGetScalar(prhs[2]) < 1.0)) {
+                barf("NEXENGINE:WindowECDF:Epsilon must be a scalar in [0, 1).");
+            }
+            double epsilon = mxGetScalar(prhs[2]);
+
+            // The matrices are read in place, nothing is copied.
+            std::vector<SquareMatrix> matrices(nMatrices);
+            for (size_t w = 0; w < nMatrices; w++) {
+                const mxArray *m = mxGetCell(cells, w);
+                if (m == NULL || !mxIsDouble(m) || mxGetM(m) != mxGetN(m)) {
+                    barf("NEXENGINE:WindowECDF:Matrix %d must be a square double matrix.", (int)w + 1);
+                }
+                matrices[w].data = mxGetPr(m);
+                matrices[w].n = mxGetM(m);
+            }
+
+            ThreadPool &pool = getThreadPool();
+            double nIgnored;
+            double errorBound;
+            if (epsilon == 0.0) {
+                ExactECDF cdf(matrices, pool);
+                plhs[0] = mxCreateDoubleMatrix(cdf.numPoints(), 1, mxREAL);
+                plhs[1] = mxCreateDoubleMatrix(cdf.numPoints(), 1, mxREAL);
+                cdf.write(mxGetPr(plhs[0]), mxGetPr(plhs[1]));
+                nIgnored = (double)cdf.numIgnored();
+                errorBound = 0.0;
+            }
+            else {
+                QuantileSketch sketch = sketchECDF(matrices, epsilon, pool);
+                std::vector<double> F, X;
+                sketch.cdf(F, X);
+                plhs[0] = mxCreateDoubleMatrix(F.size(), 1, mxREAL);
+                plhs[1] = mxCreateDoubleMatrix(X.size(), 1, mxREAL);
+                std::copy(F.begin(), F.end(), mxGetPr(plhs[0]));
+                std::copy(X.begin(), X.end(), mxGetPr(plhs[1]));
+                nIgnored = (double)sketch.numIgnored();
+                errorBound = sketch.count() > 0 ? sketch.rankError() / (double)sketch.count() : 0.0;
+            }
+
+            if (nlhs > 2) {
+                plhs[2] = mxCreateDoubleScalar(nIgnored);
+            }
+            if (nlhs > 3) {
+                plhs[3] = mxCreateDoubleScalar(errorBound);
+            }
+
+            break;
+        }
+
+        // Compare the AMD of every neuron pair of a window against the AMDs
+        // of jittered or shuffled surrogates of its spike trains.
+        case SurrogateAMD:
+        {
+            CHECKARGCOUNT(7);
+
+            std::vector<SpikeTrain> trains = getSpikeTrains(prhs[1], "SurrogateAMD");
+            std::vector<Interval> intervals = getIntervals(prhs[2], "SurrogateAMD");
+            size_t nTrains = trains.size();
+
+            SurrogateOptions options;
+            char method[16];
+            if (mxGetString(prhs[3], method, 16)) {
+                barf("NEXENGINE:SurrogateAMD:Failed to read the surrogate method.");
+            }
+            if (strcmp(method, "jitter") == 0) {
+                options.method = SurrogateJitter;
+            }
+            else if (strcmp(method, "shuffle") == 0) {
+                options.method = SurrogateShuffle;
+            }
+            else {
+                barf("NEXENGINE:SurrogateAMD:Method must be 'jitter' or 'shuffle'.");
+            }
+
+            double nSurrogates = mxGetScalar(prhs[4]);
+            if (!(nSurrogates >= 1) || nSurrogates != std::floor(nSurrogates)) {
+                barf("NEXENGINE:SurrogateAMD:Number of surrogates must be a positive integer.");
+            }
+            options.nSurrogates = (size_t)nSurrogates;
+
+            options.jitterWidth = mxGetScalar(prhs[5]);
+            if (!(options.jitterWidth >= 0)) {
+                barf("NEXENGINE:SurrogateAMD:Jitter width must be non-negative.");
+            }
+
+            double seed = mxGetScalar(prhs[6]);
+            double stream = mxGetScalar(prhs[7]);
+            if (!(seed >= 0 && seed < 4294967296.0) || seed != std::floor(seed) ||
+                !(stream >= 0 && stream < 4294967296.0) || stream != std::floor(stream)) {
+                barf("NEXENGINE:SurrogateAMD:Seed and stream must be 32-bit unsigned integers.");
+            }
+            options.seed = (uint32_t)seed;
+            options.stream = (uint32_t)stream;
+
+            WindowStats window;
+            std::vector<NeuronStats> stats;
+            computeWindowStats(trains, window, stats);
+
+            PackedTrains packed;
+            packTrains(trains, packed);
+
+            ThreadPool &pool = getThreadPool();
+
+            // The observed AMD the surrogates are compared against.
+            mxArray *amd = mxCreateDoubleMatrix(nTrains, nTrains, mxREAL);
+            computeTiledAMD<double>(packed, stats, mxGetPr(amd), NULL, pool);
+
+            plhs[0] = mxCreateDoubleMatrix(nTrains, nTrains, mxREAL);
+            mxArray *percentile = mxCreateDoubleMatrix(nTrains, nTrains, mxREAL);
+            computeSurrogateAMD(packed, window, intervals, mxGetPr(amd), options,
+                                mxGetPr(plhs[0]), mxGetPr(percentile), pool);
+
+            if (nlhs > 1) {
+                plhs[1] = percentile;
+            }
+            else {
+                mxDestroyArray(percentile);
+            }
+            if (nlhs > 2) {
+                plhs[2] = amd;
+            }
+            else {
+                mxDestroyArray(amd);
+            }
+
+            break;
+        }
+
+        // Start a stream of AMD windows calculated from live spike data.
+        case StreamOpen:
+        {
+            CHECKARGCOUNT(6);
+
+            double nNeurons = mxGetScalar(prhs[1]);
+            if (!(nNeurons >= 0) || nNeurons != std::floor(nNeurons)) {
+                barf("NEXENGINE:StreamOpen:Number of neurons must be a non-negative integer.");
+            }
+
+            StreamingAMDOptions options;
+            options.windowSize = mxGetScalar(prhs[2]);
+            options.windowStep = mxGetScalar(prhs[3]);
+            options.startTime = mxGetScalar(prhs[4]);
+            if (!(options.windowSize > 0) || !(options.windowStep > 0)) {
+                barf("NEXENGINE:StreamOpen:Window size and step must be positive.");
+            }
+
+            double minSpikeCount = mxGetScalar(prhs[5]);
+            double minValidNeurons = mxGetScalar(prhs[6]);
+            if (!(minSpikeCount >= 0) || !(minValidNeurons >= 0)) {
+                barf("NEXENGINE:StreamOpen:Minimum counts must be non-negative.");
+            }
+            options.minSpikeCount = (size_t)minSpikeCount;
+            options.minValidNeurons = (size_t)minValidNeurons;
+
+            unsigned int handle = g_nextStreamHandle++;
+            g_streams[handle] = new StreamingAMD((size_t)nNeurons, options);
+
+            plhs[0] = mxCreateDoubleScalar((double)handle);
+
+            break;
+        }
+
+        // Add a chunk of spikes to a stream and get back the windows it
+        // completed.
+        case StreamAppend:
+        {
+            CHECKARGCOUNT(3);
+
+            std::map<unsigned int, StreamingAMD*>::iterator it =
+                g_streams.find((unsigned int)mxGetScalar(prhs[1]));
+            if (it == g_streams.end()) {
+                barf("NEXENGINE:StreamAppend:Invalid stream handle.");
+            }
+            StreamingAMD &stream = *it->second;
+
+            std::vector<SpikeTrain> chunks = getSpikeTrains(prhs[2], "StreamAppend");
+            if (chunks.size() != stream.numNeurons()) {
+                barf("NEXENGINE:StreamAppend:Expected a chunk for each of the %d neurons.",
+                     (int)stream.numNeurons());
+            }
+
+            double completeTime = mxGetScalar(prhs[3]);
+            if (!std::isfinite(completeTime)) {
+                barf("NEXENGINE:StreamAppend:The complete time must be finite.");
+            }
+
+            // Check every chunk before adding any of them so a bad chunk
+            // leaves the stream as it was.
+            for (size_t i = 0; i < chunks.size(); i++) {
+                const char *error = stream.checkChunk(i, chunks[i].t, chunks[i].n);
+                if (error != NULL) {
+                    barf("NEXENGINE:StreamAppend:Neuron %d: %s", (int)i + 1, error);
+                }
+            }
+            for (size_t i = 0; i < chunks.size(); i++) {
+                stream.append(i, chunks[i].t, chunks[i].n);
+            }
+
+            std::vector<StreamedWindow> windows;
+            std::vector<StreamedStability> stability;
+            stream.advance(completeTime, windows, stability, getThreadPool());
+
+            const char *windowFields[] = {"WindowStart", "WindowEnd", "Neurons", "AMD", "ZScore", "Stats"};
+            plhs[0] = mxCreateStructMatrix(1, windows.size(), 6, windowFields);
+            for (size_t w = 0; w < windows.size(); w++) {
+                const StreamedWindow &window = windows[w];
+                size_t k = window.neurons.size();
+
+                mxArray *neurons = mxCreateDoubleMatrix(k, 1, mxREAL);
+                for (size_t i = 0; i < k; i++) {
+                    mxGetPr(neurons)[i] = (double)(window.neurons[i] + 1);
+                }
+                mxArray *amd = mxCreateDoubleMatrix(k, k, mxREAL);
+                std::copy(window.amd.begin(), window.amd.end(), mxGetPr(amd));
+                mxArray *zscore = mxCreateDoubleMatrix(k, k, mxREAL);
+                std::copy(window.zscore.begin(), window.zscore.end(), mxGetPr(zscore));
+
+                mxSetField(plhs[0], w, "WindowStart", mxCreateDoubleScalar(window.windowStart));
+                mxSetField(plhs[0], w, "WindowEnd", mxCreateDoubleScalar(window.windowEnd));
+                mxSetField(plhs[0], w, "Neurons", neurons);
+                mxSetField(plhs[0], w, "AMD", amd);
+                mxSetField(plhs[0], w, "ZScore", zscore);
+                mxSetField(plhs[0], w, "Stats", packAMDStats(window.window, window.stats));
+            }
+
+            if (nlhs > 1) {
+                const char *stabilityFields[] = {"data", "times"};
+                plhs[1] = mxCreateStructMatrix(1, 1, 2, stabilityFields);
+                mxArray *data = mxCreateDoubleMatrix(1, stability.size(), mxREAL);
+                mxArray *times = mxCreateDoubleMatrix(1, stability.size(), mxREAL);
+                for (size_t s = 0; s < stability.size(); s++) {
+                    mxGetPr(data)[s] = stability[s].value;
+                    mxGetPr(times)[s] = stability[s].time;
+                }
+                mxSetField(plhs[1], 0, "data", data);
+                mxSetField(plhs[1], 0, "times", times);
+            }
+
+            break;
+        }
+
+        // Release a stream.
+        case StreamClose:
+        {
+            CHECKARGCOUNT(1);
+
+            std::map<unsigned int, StreamingAMD*>::iterator it =
+                g_streams.find((unsigned int)mxGetScalar(prhs[1]));
+            if (it != g_streams.end()) {
+                delete it->second;
+                g_streams.erase(it);
+            }
+
+            break;
+        }
+
+        // Calculate a pair metric other than the AMD, or the plain AMD, for a
+        // set of time windows.
+        case PairMetric:
+        {
+            CHECKARGCOUNT(6);
+
+            std::vector<SpikeTrain> trains = getSpikeTrains(prhs[1], "PairMetric");
+            std::vector<Interval> intervals = getIntervals(prhs[2], "PairMetric");
+            size_t nTrains = trains.size();
+
+            if (!mxIsDouble(prhs[3]) || (!mxIsEmpty(prhs[3]) && mxGetN(prhs[3]) != 2)) {
+                barf("NEXENGINE:PairMetric:Windows must be a Wx2 double matrix.");
+            }
+            size_t nWindows = mxGetM(prhs[3]);
+            const double *windowStarts = mxGetPr(prhs[3]);
+            const double *windowEnds = windowStarts + nWindows;
+
+            std::vector<std::vector<size_t> > windowNeurons =
+                getWindowNeurons(prhs[4], nTrains, nWindows, "PairMetric");
+
+            char name[16];
+            if (mxGetString(prhs[5], name, 16)) {
+                barf("NEXENGINE:PairMetric:Failed to read the metric.");
+            }
+            PairMetricType type = MetricAMD;
+            if (strcmp(name, "sttc") == 0) {
+                type = MetricSTTC;
+            }
+            else if (strcmp(name, "isi") == 0) {
+                type = MetricISIDistance;
+            }
+            else if (strcmp(name, "spike") == 0) {
+                type = MetricSPIKEDistance;
+            }
+            else if (strcmp(name, "amd") != 0) {
+                barf("NEXENGINE:PairMetric:Metric must be 'amd', 'sttc', 'isi' or 'spike'.");
+            }
+
+            PairMetricOptions options;
+            options.sttcDt = mxGetScalar(prhs[6]);
+            if (type == MetricSTTC && !(options.sttcDt > 0)) {
+                barf("NEXENGINE:PairMetric:The STTC dt must be positive.");
+            }
+
+            ThreadPool &pool = getThreadPool();
+            std::vector<MetricWindowJob> jobs(nWindows);
+
+            pool.parallelFor(nWindows, 1, [&](size_t wBegin, size_t wEnd) {
+                for (size_t w = wBegin; w < wEnd; w++) {
+                    packWindowTrains(trains, windowNeurons[w], intervals,
+                                     windowStarts[w], windowEnds[w], jobs[w].trains);
+                    windowSpans(intervals, windowStarts[w], windowEnds[w], jobs[w].spans);
+                }
+            });
+
+            plhs[0] = mxCreateCellMatrix(nWindows, 1);
+            for (size_t w = 0; w < nWindows; w++) {
+                size_t k = windowNeurons[w].size();
+                mxArray *values = mxCreateDoubleMatrix(k, k, mxREAL);
+                mxSetCell(plhs[0], w, values);
+                jobs[w].values = mxGetPr(values);
+            }
+
+            computeMultiWindowPairMetric(type, options, jobs, pool);
+
+            break;
+        }
+
+        // Calculate the cross and auto-correlograms of every pair of neurons.
+        case Correlograms:
+        {
+            CHECKARGCOUNT(4);
+
+            std::vector<SpikeTrain> trains = getSpikeTrains(prhs[1], "Correlograms");
+            std::vector<Interval> intervals = getIntervals(prhs[2], "Correlograms");
+            size_t nTrains = trains.size();
+
+            double maxLag = mxGetScalar(prhs[3]);
+            CorrelogramOptions options;
+            options.binWidth = mxGetScalar(prhs[4]);
+            if (!(options.binWidth > 0) || !(maxLag >= options.binWidth)) {
+                barf("NEXENGINE:Correlograms:The bin width must be positive and no more than the maximum lag.");
+            }
+
+            // Round the lag range up to a whole number of bins, allowing for
+            // the lag being a multiple of the width that isn't exact in
+            // floating point.
+            options.halfBins = (size_t)std::ceil(maxLag / options.binWidth - 1e-9);
+            size_t nBins = options.numBins();
+
+            std::vector<size_t> neurons(nTrains);
+            for (size_t i = 0; i < nTrains; i++) {
+                neurons[i] = i;
+            }
+            PackedTrains packed;
+            packWindowTrains(trains, neurons, intervals, -mxGetInf(), mxGetInf(), packed);
+
+            mwSize dims[3] = {nBins, nTrains, nTrains};
+            plhs[0] = mxCreateNumericArray(3, dims, mxUINT32_CLASS, mxREAL);
+            computeCorrelograms(packed, options, (uint32_t*)mxGetData(plhs[0]), getThreadPool());
+
+            if (nlhs > 1) {
+                plhs[1] = mxCreateDoubleMatrix(nBins, 1, mxREAL);
+                double *lags = mxGetPr(plhs[1]);
+                for (size_t b = 0; b < nBins; b++) {
+                    lags[b] = ((double)b - (double)options.halfBins + 0.5) * options.binWidth;
+                }
+            }
+
+            break;
+        }
+
+        // Align spikes to a set of triggers, giving a raster of every trial
+        // and the PSTH of every neuron.
+        case PSTH:
+        {
+            CHECKARGCOUNT(4);
+
+            std::vector<SpikeTrain> trains = getSpikeTrains(prhs[1], "PSTH");
+            size_t nTrains = trains.size();
+
+            if (!mxIsDouble(prhs[2])) {
+                barf("NEXENGINE:PSTH:Triggers must be a double vector.");
+            }
+            size_t nTriggers = mxGetNumberOfElements(prhs[2]);
+            const double *triggers = mxGetPr(prhs[2]);
+            for (size_t k = 0; k < nTriggers; k++) {
+                if (!std::isfinite(triggers[k])) {
+                    barf("NEXENGINE:PSTH:Triggers must be finite.");
+                }
+            }
+
+            if (!mxIsDouble(prhs[3]) || mxGetNumberOfElements(prhs[3]) != 2) {
+                barf("NEXENGINE:PSTH:The trial window must be a [pre post] vector.");
+            }
+            PSTHOptions options;
+            options.preTime = mxGetPr(prhs[3])[0];
+            options.postTime = mxGetPr(prhs[3])[1];
+            options.binWidth = mxGetScalar(prhs[4]);
+            if (!(options.preTime + options.postTime > 0) || !(options.binWidth > 0)) {
+                barf("NEXENGINE:PSTH:The trial window and bin width must be positive.");
+            }
+            size_t nBins = options.numBins();
+
+            ThreadPool &pool = getThreadPool();
+
+            mxArray *offsets = mxCreateNumericMatrix(nTriggers * nTrains + 1, 1, mxUINT64_CLASS, mxREAL);
+            uint64_t *rowOffsets = (uint64_t*)mxGetData(offsets);
+            countTrialSpikes(trains, triggers, nTriggers, options, rowOffsets, pool);
+
+            mxArray *values = mxCreateDoubleMatrix(rowOffsets[nTriggers * nTrains], 1, mxREAL);
+            plhs[0] = mxCreateDoubleMatrix(nBins, nTrains, mxREAL);
+            fillTrialSpikes(trains, triggers, nTriggers, options, rowOffsets,
+                            mxGetPr(values), mxGetPr(plhs[0]), pool);
+
+            if (nlhs > 1) {
+                plhs[1] = offsets;
+            }
+            else {
+                mxDestroyArray(offsets);
+            }
+            if (nlhs > 2) {
+                plhs[2] = values;
+            }
+            else {
+                mxDestroyArray(values);
+            }
+
+            break;
+        }
+
+        // Bin the spikes of every neuron, either from a NEX file in ticks or
+        // from timestamps in seconds.
+        case BinCounts:
+        {
+            CHECKARGCOUNT(7);
+
+            std::vector<Interval> intervals = getIntervals(prhs[2], "BinCounts");
+
+            if (!mxIsDouble(prhs[3]) || mxGetNumberOfElements(prhs[3]) != 2) {
+                barf("NEXENGINE:BinCounts:The time range must be a [start end] vector.");
+            }
+            double startTime = mxGetPr(prhs[3])[0];
+            double endTime = mxGetPr(prhs[3])[1];
+            double binWidth = mxGetScalar(prhs[4]);
+            if (!(binWidth > 0) || !(endTime > startTime)) {
+                barf("NEXENGINE:BinCounts:The bin width and time range must be positive.");
+            }
+            double nBins = std::ceil((endTime - startTime) / binWidth - 1e-9);
+            if (nBins > 4294967295.0) {
+                barf("NEXENGINE:BinCounts:Too many bins.");
+            }
+
+            char format[16];
+            char precision[16];
+            if (mxGetString(prhs[5], format, 16) || mxGetString(prhs[6], precision, 16)) {
+                barf("NEXENGINE:BinCounts:Failed to read the format and precision.");
+            }
+            bool isCSR = strcmp(format, "csr") == 0;
+            bool isUint16 = strcmp(precision, "uint16") == 0;
+            if ((!isCSR && strcmp(format, "dense") != 0) ||
+                (!isUint16 && strcmp(precision, "uint32") != 0)) {
+                barf("NEXENGINE:BinCounts:Format must be 'dense' or 'csr' and precision 'uint16' or 'uint32'.");
+            }
+
+            if (mxIsChar(prhs[1])) {
+                // Straight from the file, in ticks.  The bin edges have to
+                // land on ticks for the integer binning to match seconds.
+                if (mxGetString(prhs[1], fileName, 256)) {
+                    barf("NEXENGINE:BinCounts:Failed to extract the file name.");
+                }
+                if (!mxIsDouble(prhs[7])) {
+                    barf("NEXENGINE:BinCounts:Neuron indices must be a double vector.");
+                }
+                std::vector<int> channels;
+                for (size_t k = 0; k < mxGetNumberOfElements(prhs[7]); k++) {
+                    channels.push_back((int)mxGetPr(prhs[7])[k] - 1);
+                }
+
+                fp = fopen(fileName, "rb");
+                if (fp == NULL) {
+                    barf("NEXENGINE:BinCounts:Failed to open file.");
+                }
+                NexFileHeader fileHeader;
+                fread(&fileHeader, sizeof(NexFileHeader), 1, fp);
+                std::vector<std::vector<int64_t> > ticks = readNeuronTicks(fp, &fileHeader, channels);
+                fclose(fp);
+
+                double frequency = fileHeader.Frequency;
+                double widthTicks = binWidth * frequency;
+                if (std::fabs(widthTicks - std::floor(widthTicks + 0.5)) > 1e-6 * widthTicks ||
+                    widthTicks < 0.5) {
+                    barf("NEXENGINE:BinCounts:The bin width must be a whole number of %g Hz ticks.", frequency);
+                }
+
+                BinGrid<int64_t> grid;
+                grid.start = (int64_t)std::floor(startTime * frequency + 0.5);
+                grid.width = (int64_t)std::floor(widthTicks + 0.5);
+                grid.nBins = (size_t)nBins;
+                grid.end = grid.start + (int64_t)grid.nBins * grid.width;
+                int64_t endTick = (int64_t)std::ceil(endTime * frequency - 1e-6);
+                if (endTick < grid.end) {
+                    grid.end = endTick;
+                }
+
+                std::vector<TimedTrain<int64_t> > trains(ticks.size());
+                for (size_t i = 0; i < ticks.size(); i++) {
+                    trains[i].t = ticks[i].data();
+                    trains[i].n = ticks[i].size();
+                }
+                std::vector<TimeSpan<int64_t> > spans(intervals.size());
+                for (size_t k = 0; k < intervals.size(); k++) {
+                    spans[k].start = (int64_t)std::ceil(intervals[k].start * frequency - 1e-6);
+                    spans[k].end = (int64_t)std::floor(intervals[k].end * frequency + 1e-6);
+                }
+
+                packBinCounts(trains, spans, grid, isCSR, isUint16, nlhs, plhs);
+            }
+            else {
+                std::vector<SpikeTrain> secondTrains = getSpikeTrains(prhs[1], "BinCounts");
+
+                BinGrid<double> grid;
+                grid.start = startTime;
+                grid.width = binWidth;
+                grid.nBins = (size_t)nBins;
+                grid.end = endTime;
+
+                std::vector<TimedTrain<double> > trains(secondTrains.size());
+                for (size_t i = 0; i < secondTrains.size(); i++) {
+                    trains[i].t = secondTrains[i].t;
+                    trains[i].n = secondTrains[i].n;
+                }
+                std::vector<TimeSpan<double> > spans(intervals.size());
+                for (size_t k = 0; k < intervals.size(); k++) {
+                    spans[k].start = intervals[k].start;
+                    spans[k].end = intervals[k].end;
+                }
+
+                packBinCounts(trains, spans, grid, isCSR, isUint16, nlhs, plhs);
+            }
+
+            break;
+        }
+
+        // Build the min/max envelope pyramid of a continuous variable, or get
+        // the envelope of a time span for display, building the pyramid
+        // first if its cache is missing or out of date.
+        case BuildEnvelope:
+        case QueryEnvelope:
+        {
+            bool isQuery = opCode == QueryEnvelope;
+            CHECKARGCOUNT((isQuery ? 5 : 3));
+
+            char cachePath[1024];
+            if (!mxIsChar(prhs[1]) || mxGetString(prhs[1], fileName, 256) ||
+                !mxIsChar(prhs[3]) || mxGetString(prhs[3], cachePath, 1024)) {
+                barf("NEXENGINE:Envelope:File and cache names must be strings.");
+            }
+            int channel = (int)mxGetScalar(prhs[2]) - 1;
+
+            fp = fopen(fileName, "rb");
+            if (fp == NULL) {
+                barf("NEXENGINE:Envelope:Failed to open file.");
+            }
+
+            ContinuousLayout layout;
+            const char *error = readContinuousLayout(fp, channel, layout);
+            int64_t fileSize = getFileSize(fp);
+
+            EnvelopeIndex index;
+            FILE *cache = NULL;
+            if (error == NULL && isQuery) {
+                cache = openEnvelope(cachePath, layout, fileSize, index);
+            }
+            if (error == NULL && cache == NULL) {
+                error = buildEnvelope(fp, layout, fileSize, cachePath, getThreadPool());
+                if (error == NULL && isQuery) {
+                    cache = openEnvelope(cachePath, layout, fileSize, index);
+                    if (cache == NULL) {
+                        error = "Failed to open the envelope cache.";
+                    }
+                }
+            }
+
+            EnvelopeQuery result;
+            if (error == NULL && isQuery) {
+                if (!mxIsDouble(prhs[4]) || mxGetNumberOfElements(prhs[4]) != 2) {
+                    error = "The time span must be a [start end] vector.";
+                }
+                else {
+                    const double *span = mxGetPr(prhs[4]);
+                    double nPixels = mxGetScalar(prhs[5]);
+                    error = queryEnvelope(fp, layout, cache, index, span[0], span[1],
+                                          nPixels < 1 ? 1 : (size_t)nPixels, result);
+                }
+            }
+
+            if (cache != NULL) {
+                fclose(cache);
+            }
+            fclose(fp);
+
+            if (error != NULL) {
+                barf("NEXENGINE:Envelope:%s", error);
+            }
+
+            if (isQuery) {
+                size_t n = result.times.size();
+                const std::vector<double> *columns[3] = {&result.times, &result.minimum, &result.maximum};
+                for (int k = 0; k < 3 && (k == 0 || k < nlhs); k++) {
+                    plhs[k] = mxCreateDoubleMatrix(n, 1, mxREAL);
+                    std::copy(columns[k]->begin(), columns[k]->end(), mxGetPr(plhs[k]));
+                }
+                if (nlhs > 3) {
+                    plhs[3] = mxCreateDoubleScalar((double)result.samplesPerPoint);
+                }
+            }
+
+            break;
+        }
+
+        // Open a continuous variable for reading a chunk at a time.
+        case ContinuousOpen:
+        {
+            CHECKARGCOUNT(3);
+
+            if (!mxIsChar(prhs[1]) || mxGetString(prhs[1], fileName, 256)) {
+                barf("NEXENGINE:ContinuousOpen:File name must be a string.");
+            }
+            int channel = (int)mxGetScalar(prhs[2]) - 1;
+            double chunkSize = mxGetScalar(prhs[3]);
+            if (!(chunkSize >= 1)) {
+                barf("NEXENGINE:ContinuousOpen:Chunk size must be positive.");
+            }
+
+            ContinuousReader *reader = new ContinuousReader();
+            const char *error = reader->open(fileName, channel, (size_t)chunkSize);
+            if (error != NULL) {
+                delete reader;
+                barf("NEXENGINE:ContinuousOpen:%s", error);
+            }
+
+            unsigned int handle = g_nextReaderHandle++;
+            g_readers[handle] = reader;
+            plhs[0] = mxCreateDoubleScalar((double)handle);
+
+            if (nlhs > 1) {
+                const ContinuousLayout &layout = reader->layout();
+                size_t nFragments = layout.numFragments();
+                const char *layoutFields[] = {"SampleFrequency", "ADtoMV", "NumSamples",
+                                              "FragmentStarts", "FragmentTimes"};
+                plhs[1] = mxCreateStructMatrix(1, 1, 5, layoutFields);
+
+                mxArray *starts = mxCreateDoubleMatrix(nFragments, 1, mxREAL);
+                mxArray *times = mxCreateDoubleMatrix(nFragments, 1, mxREAL);
+                for (size_t f = 0; f < nFragments; f++) {
+                    mxGetPr(starts)[f] = (double)(layout.fragmentStarts[f] + 1);
+                    mxGetPr(times)[f] = layout.fragmentTimes[f];
+                }
+
+                mxSetField(plhs[1], 0, "SampleFrequency", mxCreateDoubleScalar(layout.sampleFrequency));
+                mxSetField(plhs[1], 0, "ADtoMV", mxCreateDoubleScalar(layout.adToMV));
+                mxSetField(plhs[1], 0, "NumSamples", mxCreateDoubleScalar((double)layout.nSamples));
+                mxSetField(plhs[1], 0, "FragmentStarts", starts);
+                mxSetField(plhs[1], 0, "FragmentTimes", times);
+            }
+
+            break;
+        }
+
+        // Get the next chunk of a continuous reader.  An empty chunk means
+        // the end of the data.
+        case ContinuousNext:
+        {
+            CHECKARGCOUNT(1);
+
+            std::map<unsigned int, ContinuousReader*>::iterator it =
+                g_readers.find((unsigned int)mxGetScalar(prhs[1]));
+            if (it == g_readers.end()) {
+                barf("NEXENGINE:ContinuousNext:Invalid reader handle.");
+            }
+
+            ContinuousChunk chunk;
+            bool isChunk = it->second->next(chunk);
+            if (!isChunk && it->second->error() != NULL) {
+                barf("NEXENGINE:ContinuousNext:%s", it->second->error());
+            }
+
+            size_t n = isChunk ? chunk.samples.size() : 0;
+            plhs[0] = mxCreateNumericMatrix(n, 1, mxINT16_CLASS, mxREAL);
+            if (n > 0) {
+                std::copy(chunk.samples.begin(), chunk.samples.end(), (int16_t*)mxGetData(plhs[0]));
+            }
+            if (nlhs > 1) {
+                plhs[1] = mxCreateDoubleScalar(isChunk ? chunk.startTime : mxGetNaN());
+            }
+            if (nlhs > 2) {
+                plhs[2] = mxCreateDoubleScalar(isChunk ? (double)(chunk.fragment + 1) : mxGetNaN());
+            }
+            if (nlhs > 3) {
+                plhs[3] = mxCreateDoubleScalar(isChunk ? (double)(chunk.firstSample + 1) : mxGetNaN());
+            }
+
+            break;
+        }
+
+        // Release a continuous reader.
+        case ContinuousClose:
+        {
+            CHECKARGCOUNT(1);
+
+            std::map<unsigned int, ContinuousReader*>::iterator it =
+                g_readers.find((unsigned int)mxGetScalar(prhs[1]));
+            if (it != g_readers.end()) {
+                delete it->second;
+                g_readers.erase(it);
+            }
+
+            break;
+        }
+
+        // Filter and decimate continuous variables while reading them.
+        case FilterContinuous:
+        {
+            CHECKARGCOUNT(6);
+
+            if (!mxIsChar(prhs[1]) || mxGetString(prhs[1], fileName, 256)) {
+                barf("NEXENGINE:FilterContinuous:File name must be a string.");
+            }
+            if (!mxIsDouble(prhs[2]) || !mxIsDouble(prhs[3])) {
+                barf("NEXENGINE:FilterContinuous:Indices and taps must be doubles.");
+            }
+
+            std::vector<int> channels;
+            for (size_t i = 0; i < mxGetNumberOfElements(prhs[2]); i++) {
+                channels.push_back((int)mxGetPr(prhs[2])[i] - 1);
+            }
+
+            ContinuousFilterOptions options;
+            options.taps.assign(mxGetPr(prhs[3]), mxGetPr(prhs[3]) + mxGetNumberOfElements(prhs[3]));
+            double decimation = mxGetScalar(prhs[4]);
+            if (!(decimation >= 1) || decimation != std::floor(decimation)) {
+                barf("NEXENGINE:FilterContinuous:Decimation factor must be a positive integer.");
+            }
+            options.decimation = (size_t)decimation;
+            options.zeroPhase = mxGetScalar(prhs[6]) != 0;
+
+            options.sections = getSections(prhs[5], "FilterContinuous");
+
+            std::vector<FilteredChannel> results;
+            const char *error = filterContinuous(fileName, channels, options, results, getThreadPool());
+            if (error != NULL) {
+                barf("NEXENGINE:FilterContinuous:%s", error);
+            }
+
+            const char *resultFields[] = {"ADFrequency", "timestamps", "fragmentStarts", "data"};
+            plhs[0] = mxCreateStructMatrix(1, results.size(), 4, resultFields);
+            for (size_t i = 0; i < results.size(); i++) {
+                const FilteredChannel &result = results[i];
+                size_t nFragments = result.fragmentStarts.size();
+
+                mxArray *times = mxCreateDoubleMatrix(nFragments, 1, mxREAL);
+                mxArray *starts = mxCreateDoubleMatrix(nFragments, 1, mxREAL);
+                for (size_t f = 0; f < nFragments; f++) {
+                    mxGetPr(times)[f] = result.fragmentTimes[f];
+                    mxGetPr(starts)[f] = (double)(result.fragmentStarts[f] + 1);
+                }
+                mxArray *data = mxCreateDoubleMatrix(result.data.size(), 1, mxREAL);
+                std::copy(result.data.begin(), result.data.end(), mxGetPr(data));
+
+                mxSetField(plhs[0], i, "ADFrequency", mxCreateDoubleScalar(result.sampleFrequency));
+                mxSetField(plhs[0], i, "timestamps", times);
+                mxSetField(plhs[0], i, "fragmentStarts", starts);
+                mxSetField(plhs[0], i, "data", data);
+            }
+
+            break;
+        }
+
+        // Find spikes on continuous variables by thresholding them.
+        case DetectSpikes:
+        {
+            CHECKARGCOUNT(8);
+
+            char outputPath[1024];
+            if (!mxIsChar(prhs[1]) || mxGetString(prhs[1], fileName, 256) ||
+                !mxIsChar(prhs[8]) || mxGetString(prhs[8], outputPath, 1024)) {
+                barf("NEXENGINE:DetectSpikes:File names must be strings.");
+            }
+            if (!mxIsDouble(prhs[2]) || !mxIsDouble(prhs[7]) || mxGetNumberOfElements(prhs[7]) != 2) {
+                barf("NEXENGINE:DetectSpikes:Indices must be doubles and the snippet a [pre post] vector.");
+            }
+
+            std::vector<int> channels;
+            for (size_t i = 0; i < mxGetNumberOfElements(prhs[2]); i++) {
+                channels.push_back((int)mxGetPr(prhs[2])[i] - 1);
+            }
+
+            SpikeDetectOptions options;
+            options.sections = getSections(prhs[3], "DetectSpikes");
+            options.thresholdFactor = mxGetScalar(prhs[4]);
+            double polarity = mxGetScalar(prhs[5]);
+            options.polarity = polarity < 0 ? NegativeSpikes : (polarity > 0 ? PositiveSpikes : BothSpikes);
+            options.refractory = mxGetScalar(prhs[6]);
+            const double *snippet = mxGetPr(prhs[7]);
+            if (!(snippet[0] >= 0) || !(snippet[1] >= 0) || !(options.refractory >= 0)) {
+                barf("NEXENGINE:DetectSpikes:Snippet lengths and refractory period must be non-negative.");
+            }
+            options.preSamples = (size_t)snippet[0];
+            options.postSamples = (size_t)snippet[1];
+
+            std::vector<DetectedSpikes> results;
+            const char *error = detectSpikes(fileName, channels, options, results, getThreadPool());
+            if (error != NULL) {
+                barf("NEXENGINE:DetectSpikes:%s", error);
+            }
+
+            if (outputPath[0] != '\0' &&
+                !saveDetectedSpikes(outputPath, results, options.preSamples, options.postSamples)) {
+                barf("NEXENGINE:DetectSpikes:Failed to write %s.", outputPath);
+            }
+
+            size_t nPoints = options.preSamples + options.postSamples;
+            const char *spikeFields[] = {"name", "timestamps", "threshold", "waveforms"};
+            plhs[0] = mxCreateStructMatrix(1, results.size(), 4, spikeFields);
+            for (size_t i = 0; i < results.size(); i++) {
+                const DetectedSpikes &result = results[i];
+                size_t nSpikes = result.times.size();
+
+                mxArray *times = mxCreateDoubleMatrix(nSpikes, 1, mxREAL);
+                std::copy(result.times.begin(), result.times.end(), mxGetPr(times));
+
+                // Snippets are stored spike after spike, MATLAB wants a
+                // row per spike.
+                mxArray *waveforms = mxCreateDoubleMatrix(nSpikes, nPoints, mxREAL);
+                double *w = mxGetPr(waveforms);
+                for (size_t k = 0; k < nSpikes; k++) {
+                    for (size_t p = 0; p < nPoints; p++) {
+                        w[k + p*nSpikes] = result.snippets[k*nPoints + p];
+                    }
+                }
+
+                mxSetField(plhs[0], i, "name", mxCreateString(result.name.c_str()));
+                mxSetField(plhs[0], i, "timestamps", times);
+                mxSetField(plhs[0], i, "threshold", mxCreateDoubleScalar(result.threshold));
+                mxSetField(plhs[0], i, "waveforms", waveforms);
+            }
+
+            break;
+        }
+
+        // Features and principal component scores of the waveforms of a
+        // waveform variable.
+        case WaveformFeatures:
+        {
+            CHECKARGCOUNT(3);
+
+            if (!mxIsChar(prhs[1]) || mxGetString(prhs[1], fileName, 256)) {
+                barf("NEXENGINE:WaveformFeatures:File name must be a string.");
+            }
+            int index = (int)mxGetScalar(prhs[2]) - 1;
+            double nComponents = mxGetScalar(prhs[3]);
+            if (!(nComponents >= 0)) {
+                barf("NEXENGINE:WaveformFeatures:Number of components must be non-negative.");
+            }
+
+            fp = fopen(fileName, "rb");
+            if (fp == NULL) {
+                barf("NEXENGINE:WaveformFeatures:Failed to open file.");
+            }
+
+            WaveformLayout layout;
+            WaveformFeatureSet features;
+            const char *error = readWaveformLayout(fp, index, layout);
+            if (error == NULL) {
+                error = computeWaveformFeatures(fp, layout, (size_t)nComponents, features, getThreadPool());
+            }
+            fclose(fp);
+
+            if (error != NULL) {
+                barf("NEXENGINE:WaveformFeatures:%s", error);
+            }
+
+            size_t count = features.timestamps.size();
+            size_t d = layout.nPoints;
+            size_t k = features.nComponents;
+            const char *featureFields[] = {"name", "timestamps", "peak", "trough", "width", "energy",
+                                           "scores", "mean", "components", "explained"};
+            plhs[0] = mxCreateStructMatrix(1, 1, 10, featureFields);
+
+            struct { const char *field; const std::vector<double> *values; size_t m, n; } columns[] = {
+                {"timestamps", &features.timestamps, count, 1},
+                {"peak", &features.peak, count, 1},
+                {"trough", &features.trough, count, 1},
+                {"width", &features.width, count, 1},
+                {"energy", &features.energy, count, 1},
+                {"scores", &features.scores, count, k},
+                {"mean", &features.mean, d, 1},
+                {"components", &features.components, d, k},
+                {"explained", &features.explained, k, 1}
+            };
+            for (size_t c = 0; c < sizeof(columns) / sizeof(columns[0]); c++) {
+                mxArray *array = mxCreateDoubleMatrix(columns[c].m, columns[c].n, mxREAL);
+                std::copy(columns[c].values->begin(), columns[c].values->end(), mxGetPr(array));
+                mxSetField(plhs[0], 0, columns[c].field, array);
+            }
+            mxSetField(plhs[0], 0, "name", mxCreateString(layout.name.c_str()));
+
+            break;
+        }
+
+        // Average continuous variables around the spikes of neurons.
+        case SpikeTriggeredAverage:
+        {
+            CHECKARGCOUNT(4);
+
+            if (!mxIsChar(prhs[1]) || mxGetString(prhs[1], fileName, 256)) {
+                barf("NEXENGINE:SpikeTriggeredAverage:File name must be a string.");
+            }
+            if (!mxIsDouble(prhs[2]) || !mxIsDouble(prhs[3]) ||
+                !mxIsDouble(prhs[4]) || mxGetNumberOfElements(prhs[4]) != 2) {
+                barf("NEXENGINE:SpikeTriggeredAverage:Indices must be doubles and the window a [pre post] vector.");
+            }
+
+            std::vector<int> neurons;
+            for (size_t k = 0; k < mxGetNumberOfElements(prhs[2]); k++) {
+                neurons.push_back((int)mxGetPr(prhs[2])[k] - 1);
+            }
+            std::vector<int> channels;
+            for (size_t k = 0; k < mxGetNumberOfElements(prhs[3]); k++) {
+                channels.push_back((int)mxGetPr(prhs[3])[k] - 1);
+            }
+            const double *window = mxGetPr(prhs[4]);
+
+            fp = fopen(fileName, "rb");
+            if (fp == NULL) {
+                barf("NEXENGINE:SpikeTriggeredAverage:Failed to open file.");
+            }
+            NexFileHeader fileHeader;
+            fread(&fileHeader, sizeof(NexFileHeader), 1, fp);
+            std::vector<std::vector<int64_t> > ticks = readNeuronTicks(fp, &fileHeader, neurons);
+            fclose(fp);
+
+            std::vector<std::vector<double> > times(ticks.size());
+            std::vector<SpikeTrain> trains(ticks.size());
+            for (size_t i = 0; i < ticks.size(); i++) {
+                times[i].resize(ticks[i].size());
+                for (size_t s = 0; s < ticks[i].size(); s++) {
+                    times[i][s] = (double)ticks[i][s] / fileHeader.Frequency;
+                }
+                trains[i].t = times[i].empty() ? NULL : &times[i][0];
+                trains[i].n = times[i].size();
+            }
+
+            std::vector<STAResult> results;
+            const char *error = spikeTriggeredAverage(fileName, channels, trains, window[0], window[1],
+                                                      results, getThreadPool());
+            if (error != NULL) {
+                barf("NEXENGINE:SpikeTriggeredAverage:%s", error);
+            }
+
+            const char *staFields[] = {"name", "lags", "mean", "sd", "count"};
+            plhs[0] = mxCreateStructMatrix(1, results.size(), 5, staFields);
+            for (size_t c = 0; c < results.size(); c++) {
+                const STAResult &result = results[c];
+                size_t nLags = result.nLags;
+
+                mxArray *lags = mxCreateDoubleMatrix(nLags, 1, mxREAL);
+                for (size_t l = 0; l < nLags; l++) {
+                    mxGetPr(lags)[l] = (double)(result.firstLag + (int64_t)l) / result.sampleFrequency;
+                }
+                mxArray *mean = mxCreateDoubleMatrix(nLags, trains.size(), mxREAL);
+                std::copy(result.mean.begin(), result.mean.end(), mxGetPr(mean));
+                mxArray *sd = mxCreateDoubleMatrix(nLags, trains.size(), mxREAL);
+                std::copy(result.sd.begin(), result.sd.end(), mxGetPr(sd));
+                mxArray *count = mxCreateDoubleMatrix(nLags, trains.size(), mxREAL);
+                std::copy(result.count.begin(), result.count.end(), mxGetPr(count));
+
+                mxSetField(plhs[0], c, "name", mxCreateString(result.name.c_str()));
+                mxSetField(plhs[0], c, "lags", lags);
+                mxSetField(plhs[0], c, "mean", mean);
+                mxSetField(plhs[0], c, "sd", sd);
+                mxSetField(plhs[0], c, "count", count);
+            }
+
+            break;
+        }
+
+        // Welch power spectral densities or spectrograms of continuous
+        // variables.
+        case WelchPSD:
+        case Spectrogram:
+        {
+            CHECKARGCOUNT(5);
+
+            const char *caller = opCode == WelchPSD ? "WelchPSD" : "Spectrogram";
+            if (!mxIsChar(prhs[1]) || mxGetString(prhs[1], fileName, 256)) {
+                barf("NEXENGINE:%s:File name must be a string.", caller);
+            }
+            if (!mxIsDouble(prhs[2]) || !mxIsDouble(prhs[3]) || mxGetNumberOfElements(prhs[3]) == 0) {
+                barf("NEXENGINE:%s:Indices and window must be doubles.", caller);
+            }
+            double overlap = mxGetScalar(prhs[4]);
+            double nfft = mxGetScalar(prhs[5]);
+            if (!(overlap >= 0) || !(nfft >= 1)) {
+                barf("NEXENGINE:%s:Overlap and FFT length must be non-negative.", caller);
+            }
+
+            std::vector<int> channels;
+            for (size_t k = 0; k < mxGetNumberOfElements(prhs[2]); k++) {
+                channels.push_back((int)mxGetPr(prhs[2])[k] - 1);
+            }
+
+            SpectralOptions options;
+            options.window.assign(mxGetPr(prhs[3]), mxGetPr(prhs[3]) + mxGetNumberOfElements(prhs[3]));
+            options.overlap = (size_t)overlap;
+            options.nfft = (size_t)nfft;
+            options.isSpectrogram = opCode == Spectrogram;
+
+            std::vector<ChannelSpectrum> results;
+            const char *error = computeSpectra(fileName, channels, options, results, getThreadPool());
+            if (error != NULL) {
+                barf("NEXENGINE:%s:%s", caller, error);
+            }
+
+            const char *spectrumFields[] = {"name", "frequencies", "power", "times", "nSegments"};
+            plhs[0] = mxCreateStructMatrix(1, results.size(), 5, spectrumFields);
+            for (size_t c = 0; c < results.size(); c++) {
+                ChannelSpectrum &result = results[c];
+                size_t nFrequencies = result.nFrequencies;
+                size_t nColumns = options.isSpectrogram ? result.nSegments : 1;
+
+                mxArray *frequencies = mxCreateDoubleMatrix(nFrequencies, 1, mxREAL);
+                for (size_t k = 0; k < nFrequencies; k++) {
+                    mxGetPr(frequencies)[k] = (double)k * result.sampleFrequency / (double)options.nfft;
+                }
+                mxArray *power = mxCreateNumericMatrix(nFrequencies, nColumns, mxSINGLE_CLASS, mxREAL);
+                std::copy(result.power.begin(), result.power.end(), (float*)mxGetData(power));
+                std::vector<float>().swap(result.power);
+                mxArray *times = mxCreateDoubleMatrix(result.times.size(), 1, mxREAL);
+                std::copy(result.times.begin(), result.times.end(), mxGetPr(times));
+
+                mxSetField(plhs[0], c, "name", mxCreateString(result.name.c_str()));
+                mxSetField(plhs[0], c, "frequencies", frequencies);
+                mxSetField(plhs[0], c, "power", power);
+                mxSetField(plhs[0], c, "times", times);
+                mxSetField(plhs[0], c, "nSegments", mxCreateDoubleScalar((double)result.nSegments));
+            }
+
+            break;
+        }
+
+        // Read NEX interval variables by name as interval sets.
+        case ReadIntervals:
+        {
+            CHECKARGCOUNT(3);
+
+            if (!mxIsChar(prhs[1]) || mxGetString(prhs[1], fileName, 256)) {
+                barf("NEXENGINE:ReadIntervals:File name must be a string.");
+            }
+            if (!mxIsCell(prhs[2])) {
+                barf("NEXENGINE:ReadIntervals:Names must be a cell array of strings.");
+            }
+            std::vector<std::string> names;
+            for (size_t k = 0; k < mxGetNumberOfElements(prhs[2]); k++) {
+                const mxArray *name = mxGetCell(prhs[2], k);
+                char buffer[64];
+                if (name == NULL || !mxIsChar(name) || mxGetString(name, buffer, sizeof(buffer))) {
+                    barf("NEXENGINE:ReadIntervals:Names must be a cell array of strings.");
+                }
+                names.push_back(buffer);
+            }
+            bool isCaseSensitive = mxGetScalar(prhs[3]) != 0;
+
+            fp = fopen(fileName, "rb");
+            if (fp == NULL) {
+                barf("NEXENGINE:ReadIntervals:Failed to open file.");
+            }
+            std::vector<std::vector<Interval> > sets;
+            double fileStart, fileEnd;
+            const char *error = readIntervalVariables(fp, names, isCaseSensitive, sets, fileStart, fileEnd);
+            fclose(fp);
+
+            if (error != NULL) {
+                barf("NEXENGINE:ReadIntervals:%s", error);
+            }
+
+            plhs[0] = mxCreateCellMatrix(1, sets.size());
+            for (size_t k = 0; k < sets.size(); k++) {
+                mxSetCell(plhs[0], k, packIntervals(sets[k]));
+            }
+            if (nlhs > 1) {
+                plhs[1] = mxCreateDoubleMatrix(1, 2, mxREAL);
+                mxGetPr(plhs[1])[0] = fileStart;
+                mxGetPr(plhs[1])[1] = fileEnd;
+            }
+
+            break;
+        }
+
+        // Set operations and clean up of interval sets.
+        case IntervalAlgebra:
+        {
+            CHECKARGCOUNT(4);
+
+            int operation = (int)mxGetScalar(prhs[1]);
+            std::vector<Interval> a = getIntervals(prhs[2], "IntervalAlgebra");
+            std::vector<Interval> b = getIntervals(prhs[3], "IntervalAlgebra");
+            size_t nParameters = mxGetNumberOfElements(prhs[4]);
+            if (!mxIsDouble(prhs[4]) || nParameters == 0) {
+                barf("NEXENGINE:IntervalAlgebra:The parameter must be a double.");
+            }
+            const double *parameter = mxGetPr(prhs[4]);
+
+            std::vector<Interval> result;
+            switch (operation) {
+                case IntervalUnion:
+                    unionIntervals(a, b, result);
+                    break;
+                case IntervalIntersection:
+                    intersectIntervals(a, b, result);
+                    break;
+                case IntervalDifference:
+                    subtractIntervals(a, b, result);
+                    break;
+                case IntervalComplement:
+                    if (nParameters != 2) {
+                        barf("NEXENGINE:IntervalAlgebra:The complement needs a [tbeg tend] span.");
+                    }
+                    complementIntervals(a, parameter[0], parameter[1], result);
+                    break;
+                case IntervalMinDuration:
+                    result.swap(a);
+                    removeShortIntervals(result, parameter[0]);
+                    break;
+                case IntervalMergeGaps:
+                    result.swap(a);
+                    mergeIntervalGaps(result, parameter[0]);
+                    break;
+                default:
+                    barf("NEXENGINE:IntervalAlgebra:Unknown operation %d.", operation);
+            }
+
+            plhs[0] = packIntervals(result);
+
+            break;
+        }
+
+        // Average the runs of equally spaced samples of a time series.
+        case SequentialBouts:
+        {
+            CHECKARGCOUNT(3);
+
+            if (!mxIsDouble(prhs[1]) || !mxIsDouble(prhs[2]) ||
+                mxGetNumberOfElements(prhs[1]) != mxGetNumberOfElements(prhs[2])) {
+                barf("NEXENGINE:SequentialBouts:Time and data must be double vectors of the same length.");
+            }
+            double boutLength = mxGetScalar(prhs[3]);
+            if (!(boutLength > 0)) {
+                barf("NEXENGINE:SequentialBouts:Bout length must be positive.");
+            }
+
+            BoutAverages bouts;
+            averageSequentialBouts(mxGetPr(prhs[1]), mxGetPr(prhs[2]), mxGetNumberOfElements(prhs[1]),
+                                   boutLength, bouts);
 
-    switch (opCode) {
-        // Read the continuous data.
-        case GetContinuous:
-            variableType = NEX_VARIABLE_TYPE_CONTINUOUS;
+            const std::vector<double> *columns[] = {&bouts.starts, &bouts.stops, &bouts.averages};
+            for (int k = 0; k < 3 && k < max(nlhs, 1); k++) {
+                plhs[k] = mxCreateDoubleMatrix(columns[k]->size(), 1, mxREAL);
+                std::copy(columns[k]->begin(), columns[k]->end(), mxGetPr(plhs[k]));
+            }
 
-            NexFileHeader fileHeader;
+            break;
+        }
 
-            CHECKARGCOUNT(1);
+        // Write AMD windows to a result file.
+        case ResultStoreWrite:
+        {
+            CHECKARGCOUNT(8);
 
-            // Make sure the file argument is a string.
-            bool isChar = mxIsChar(prhs[1]);
-            if (!isChar) {
-                barf("NEXENGINE:GetContinous:File name must be a string.");
+            if (!mxIsChar(prhs[1]) || mxGetString(prhs[1], fileName, 256)) {
+                barf("NEXENGINE:ResultStoreWrite:File name must be a string.");
+            }
+            uint32_t valueBytes = (uint32_t)mxGetScalar(prhs[2]);
+            const mxArray *namesArray = prhs[3];
+            const mxArray *cellIDsArray = prhs[4];
+            const mxArray *meta = prhs[5];
+            const mxArray *neuronsArray = prhs[6];
+            const mxArray *statsArray = prhs[7];
+            const mxArray *matricesArray = prhs[8];
+
+            size_t nNeurons = mxGetNumberOfElements(namesArray);
+            size_t nWindows = mxGetM(meta);
+            if (!mxIsCell(namesArray) || !mxIsDouble(cellIDsArray) ||
+                mxGetNumberOfElements(cellIDsArray) != nNeurons) {
+                barf("NEXENGINE:ResultStoreWrite:Names must be a cell array with a cell ID each.");
+            }
+            if (!mxIsDouble(meta) || mxGetN(meta) != 6 || !mxIsCell(neuronsArray) || !mxIsCell(statsArray) ||
+                !mxIsCell(matricesArray) || mxGetNumberOfElements(neuronsArray) != nWindows ||
+                mxGetNumberOfElements(statsArray) != nWindows || mxGetM(matricesArray) != nWindows ||
+                mxGetN(matricesArray) != NUM_RESULT_MATRICES) {
+                barf("NEXENGINE:ResultStoreWrite:Window data must be a row of each per window.");
             }
 
-            // Extract the filename.
-            if (mxGetString(prhs[1], fileName, 256)) {
-                barf("NEXENGINE:GetContinous:Failed to extract the file name.");
+            std::vector<std::string> names(nNeurons);
+            std::vector<uint32_t> cellIDs(nNeurons);
+            for (size_t i = 0; i < nNeurons; i++) {
+                const mxArray *name = mxGetCell(namesArray, i);
+                char *buffer = name != NULL && mxIsChar(name) ? mxArrayToString(name) : NULL;
+                if (buffer == NULL) {
+                    barf("NEXENGINE:ResultStoreWrite:Names must be strings.");
+                }
+                names[i] = buffer;
+                mxFree(buffer);
+                cellIDs[i] = (uint32_t)mxGetPr(cellIDsArray)[i];
             }
 
-            // Open up the nex file.
-            fp = fopen(fileName, "rb");
-            if (fp == NULL) {
-                barf("NEXENGINE:GetContinous:Failed to open file.");
+            ResultStoreWriter writer;
+            const char *error = writer.open(fileName, valueBytes);
+            if (error != NULL) {
+                barf("NEXENGINE:ResultStoreWrite:%s", error);
             }
 
-            // Read the file header.
-            fread(&fileHeader, sizeof(NexFileHeader), 1, fp);
+            std::vector<uint32_t> neurons;
+            for (size_t w = 0; w < nWindows && error == NULL; w++) {
+                const mxArray *windowNeurons = mxGetCell(neuronsArray, w);
+                const mxArray *windowStats = mxGetCell(statsArray, w);
+                size_t n = windowNeurons == NULL ? 0 : mxGetNumberOfElements(windowNeurons);
+                if (n > 0 && !mxIsDouble(windowNeurons)) {
+                    error = "Neuron indices must be doubles.";
+                    break;
+                }
+                if (n > 0 && (windowStats == NULL || !mxIsDouble(windowStats) ||
+                              mxGetM(windowStats) != n || mxGetN(windowStats) != 4)) {
+                    error = "Stats must be an nNeurons x 4 double matrix.";
+                    break;
+                }
 
-            plhs[0] = readVariableData(fp, &fileHeader, NEX_VARIABLE_TYPE_CONTINUOUS);
+                neurons.resize(n);
+                for (size_t k = 0; k < n; k++) {
+                    double index = mxGetPr(windowNeurons)[k];
+                    if (!(index >= 1 && index <= (double)nNeurons)) {
+                        error = "Neuron index out of range.";
+                        break;
+                    }
+                    neurons[k] = (uint32_t)index - 1;
+                }
 
-            // Close the NEX file.
-            fclose(fp);
+                ResultWindowEntry entry;
+                memset(&entry, 0, sizeof(entry));
+                const double *row = mxGetPr(meta);
+                entry.windowStart = row[w];
+                entry.windowEnd = row[w + nWindows];
+                entry.timeMin = row[w + 2 * nWindows];
+                entry.timeMax = row[w + 3 * nWindows];
+                entry.timeDiff = row[w + 4 * nWindows];
+                entry.minSpikeCount = row[w + 5 * nWindows];
+                entry.nNeurons = (uint32_t)n;
+
+                ResultMatrixData matrices[NUM_RESULT_MATRICES];
+                for (int m = 0; m < NUM_RESULT_MATRICES && error == NULL; m++) {
+                    const mxArray *matrix = mxGetCell(matricesArray, w + m * nWindows);
+                    matrices[m].values = NULL;
+                    matrices[m].isSingle = false;
+                    if (matrix == NULL || mxIsEmpty(matrix)) {
+                        continue;
+                    }
+                    if ((!mxIsDouble(matrix) && !mxIsSingle(matrix)) ||
+                        mxGetM(matrix) != n || mxGetN(matrix) != n) {
+                        error = "Matrices must be nNeurons x nNeurons single or double.";
+                        break;
+                    }
+                    matrices[m].values = mxGetData(matrix);
+                    matrices[m].isSingle = mxIsSingle(matrix);
+                    entry.matrixFlags |= 1u << m;
+                }
+
+                if (error == NULL) {
+                    error = writer.addWindow(entry, neurons.data(), n > 0 ? mxGetPr(windowStats) : NULL,
+                                             matrices);
+                }
+            }
+
+            if (error == NULL) {
+                error = writer.close(names, cellIDs);
+            }
+            if (error != NULL) {
+                barf("NEXENGINE:ResultStoreWrite:%s", error);
+            }
 
             break;
         }
 
-        // Read the markers.
-        case GetMarkers:
+        // Open an AMD result file for reading a window at a time.
+        case ResultStoreOpen:
         {
-            NexFileHeader fileHeader;
-
             CHECKARGCOUNT(1);
 
-            // Make sure the file argument is a string.
-            bool isChar = mxIsChar(prhs[1]);
-            if (!isChar) {
-                barf("NEXENGINE:GetMarkers:File name must be a string.");
+            if (!mxIsChar(prhs[1]) || mxGetString(prhs[1], fileName, 256)) {
+                barf("NEXENGINE:ResultStoreOpen:File name must be a string.");
             }
 
-            // Extract the filename.
-            if (mxGetString(prhs[1], fileName, 256)) {
-                barf("NEXENGINE:GetMarkers:Failed to extract the file name.");
+            ResultStoreReader *reader = new ResultStoreReader();
+            const char *error = reader->open(fileName);
+            if (error != NULL) {
+                delete reader;
+                barf("NEXENGINE:ResultStoreOpen:%s", error);
             }
 
-            // Open up the nex file.
-            fp = fopen(fileName, "rb");
-            if (fp == NULL) {
-                barf("NEXENGINE:GetMarkers:Failed to open file.");
+            unsigned int handle = g_nextResultStoreHandle++;
+            g_resultStores[handle] = reader;
+            plhs[0] = mxCreateDoubleScalar((double)handle);
+
+            if (nlhs > 1) {
+                size_t nNeurons = reader->names().size();
+                size_t nWindows = reader->numWindows();
+                const char *infoFields[] = {"Precision", "NeuronNames", "CellIDs", "Windows", "NumNeurons"};
+                plhs[1] = mxCreateStructMatrix(1, 1, 5, infoFields);
+
+                mxArray *names = mxCreateCellMatrix(nNeurons, 1);
+                mxArray *cellIDs = mxCreateDoubleMatrix(nNeurons, 1, mxREAL);
+                for (size_t i = 0; i < nNeurons; i++) {
+                    mxSetCell(names, i, mxCreateString(reader->names()[i].c_str()));
+                    mxGetPr(cellIDs)[i] = (double)reader->cellIDs()[i];
+                }
+
+                // The window times come from the index, so none of the
+                // windows are read.
+                mxArray *windows = mxCreateDoubleMatrix(nWindows, 6, mxREAL);
+                mxArray *counts = mxCreateDoubleMatrix(nWindows, 1, mxREAL);
+                double *w = mxGetPr(windows);
+                for (size_t i = 0; i < nWindows; i++) {
+                    const ResultWindowEntry &entry = reader->window(i);
+                    w[i] = entry.windowStart;
+                    w[i + nWindows] = entry.windowEnd;
+                    w[i + 2 * nWindows] = entry.timeMin;
+                    w[i + 3 * nWindows] = entry.timeMax;
+                    w[i + 4 * nWindows] = entry.timeDiff;
+                    w[i + 5 * nWindows] = entry.minSpikeCount;
+                    mxGetPr(counts)[i] = (double)entry.nNeurons;
+                }
+
+                bool isSingle = reader->header().valueBytes == 4;
+                mxSetField(plhs[1], 0, "Precision", mxCreateString(isSingle ? "single" : "double"));
+                mxSetField(plhs[1], 0, "NeuronNames", names);
+                mxSetField(plhs[1], 0, "CellIDs", cellIDs);
+                mxSetField(plhs[1], 0, "Windows", windows);
+                mxSetField(plhs[1], 0, "NumNeurons", counts);
             }
 
-            // Read the file header.
-            fread(&fileHeader, sizeof(NexFileHeader), 1, fp);
+            break;
+        }
 
-            plhs[0] = readVariableData(fp, &fileHeader, NEX_VARIABLE_TYPE_MARKER);
+        // Read windows of an AMD result file.
+        case ResultStoreRead:
+        {
+            CHECKARGCOUNT(2);
 
-            // Close the NEX file.
-            fclose(fp);
+            std::map<unsigned int, ResultStoreReader*>::iterator it =
+                g_resultStores.find((unsigned int)mxGetScalar(prhs[1]));
+            if (it == g_resultStores.end()) {
+                barf("NEXENGINE:ResultStoreRead:Invalid result file handle.");
+            }
+            const ResultStoreReader &reader = *it->second;
+            if (!mxIsDouble(prhs[2])) {
+                barf("NEXENGINE:ResultStoreRead:Window indices must be doubles.");
+            }
+
+            size_t nRead = mxGetNumberOfElements(prhs[2]);
+            bool isSingle = reader.header().valueBytes == 4;
+            const char *windowFields[] = {"Neurons", "Stats", "AMD", "ZScore", "PValue", "Percentile"};
+            plhs[0] = mxCreateStructMatrix(nRead, 1, 6, windowFields);
+
+            for (size_t r = 0; r < nRead; r++) {
+                double index = mxGetPr(prhs[2])[r];
+                if (!(index >= 1 && index <= (double)reader.numWindows())) {
+                    barf("NEXENGINE:ResultStoreRead:Window index %g is out of range.", index);
+                }
+                size_t i = (size_t)index - 1;
+                size_t n = reader.window(i).nNeurons;
+
+                mxArray *neurons = mxCreateDoubleMatrix(n, 1, mxREAL);
+                const uint32_t *ids = reader.neurons(i);
+                for (size_t k = 0; k < n; k++) {
+                    if (ids[k] >= reader.names().size()) {
+                        barf("NEXENGINE:ResultStoreRead:Window %d refers to a neuron not in the dictionary.",
+                             (int)i + 1);
+                    }
+                    mxGetPr(neurons)[k] = (double)ids[k] + 1;
+                }
+                mxArray *stats = mxCreateDoubleMatrix(n, 4, mxREAL);
+                memcpy(mxGetPr(stats), reader.stats(i), 32 * n);
+
+                mxSetField(plhs[0], r, "Neurons", neurons);
+                mxSetField(plhs[0], r, "Stats", stats);
+                for (int m = 0; m < NUM_RESULT_MATRICES; m++) {
+                    const void *values = reader.matrix(i, (ResultMatrix)m);
+                    mxArray *matrix;
+                    if (values == NULL) {
+                        matrix = mxCreateDoubleMatrix(0, 0, mxREAL);
+                    }
+                    else {
+                        matrix = mxCreateNumericMatrix(n, n, isSingle ? mxSINGLE_CLASS : mxDOUBLE_CLASS, mxREAL);
+                        memcpy(mxGetData(matrix), values, n * n * reader.header().valueBytes);
+                    }
+                    mxSetField(plhs[0], r, windowFields[2 + m], matrix);
+                }
+            }
 
             break;
         }
 
-        // Read the events.
-        case GetEvents:
+        // Release an AMD result file.
+        case ResultStoreClose:
         {
-            NexFileHeader fileHeader;
-
             CHECKARGCOUNT(1);
 
-            // Make sure the file argument is a string.
-            bool isChar = mxIsChar(prhs[1]);
-            if (!isChar) {
-                barf("NEXENGINE:GetEvents:File name must be a string.");
+            std::map<unsigned int, ResultStoreReader*>::iterator it =
+                g_resultStores.find((unsigned int)mxGetScalar(prhs[1]));
+            if (it != g_resultStores.end()) {
+                delete it->second;
+                g_resultStores.erase(it);
             }
 
-            // Extract the filename.
-            if (mxGetString(prhs[1], fileName, 256)) {
-                barf("NEXENGINE:GetEvents:Failed to extract the file name.");
-            }
+            break;
+        }
 
-            // Open up the nex file.
-            fp = fopen(fileName, "rb");
-            if (fp == NULL) {
-                barf("NEXENGINE:GetEvents:Failed to open file.");
-            }
+        // Start a CDF that's built from one window matrix at a time.
+        case ECDFOpen:
+        {
+            CHECKARGCOUNT(2);
 
-            // Read the file header.
-            fread(&fileHeader, sizeof(NexFileHeader), 1, fp);
+            if (!mxIsDouble(prhs[1]) || mxGetNumberOfElements(prhs[1]) != 1 ||
+                !(mxGetScalar(prhs[1]) >= 0.0 && mxGetScalar(prhs[1]) < 1.0)) {
+                barf("NEXENGINE:ECDFOpen:Epsilon must be a scalar in [0, 1).");
+            }
+            double nValues = mxGetScalar(prhs[2]);
+            if (!(nValues >= 0) || nValues != std::floor(nValues)) {
+                barf("NEXENGINE:ECDFOpen:Number of values must be a non-negative integer.");
+            }
 
-            plhs[0] = readVariableData(fp, &fileHeader, NEX_VARIABLE_TYPE_EVENT);
+            unsigned int handle = g_nextECDFHandle++;
+            g_ecdfs[handle] = new ECDFAccumulator(mxGetScalar(prhs[1]), (size_t)nValues);
 
-            // Close the NEX file.
-            fclose(fp);
+            plhs[0] = mxCreateDoubleScalar((double)handle);
 
             break;
         }
 
-        // Read the file header.
-        case GetHeader:
+        // Add the off diagonal values of a window matrix to a CDF.
+        case ECDFAppend:
         {
-            NexFileHeader fileHeader;
-
-            CHECKARGCOUNT(1);
+            CHECKARGCOUNT(2);
 
-            // Make sure the file argument is a string.
-            bool isChar = mxIsChar(prhs[1]);
-            if (!isChar) {
-                barf("NEXENGINE:GetHeader:File name must be a string.");
+            std::map<unsigned int, ECDFAccumulator*>::iterator it =
+                g_ecdfs.find((unsigned int)mxGetScalar(prhs[1]));
+            if (it == g_ecdfs.end()) {
+                barf("NEXENGINE:ECDFAppend:Invalid CDF handle.");
             }
 
-            // Extract the filename.
-            if (mxGetString(prhs[1], fileName, 256)) {
-                barf("NEXENGINE:GetHeader:Failed to extract the file name.");
+            const mxArray *m = prhs[2];
+            if ((!mxIsDouble(m) && !mxIsSingle(m)) || mxGetM(m) != mxGetN(m)) {
+                barf("NEXENGINE:ECDFAppend:Matrix must be a square single or double matrix.");
             }
 
-            // Open up the nex file.
-            fp = fopen(fileName, "rb");
-            if (fp == NULL) {
-                barf("NEXENGINE:GetHeader:Failed to open file.");
+            // The matrix is read in place, in its own precision.
+            ThreadPool &pool = getThreadPool();
+            if (mxIsSingle(m)) {
+                it->second->add((const float*)mxGetData(m), mxGetM(m), pool);
+            }
+            else {
+                it->second->add(mxGetPr(m), mxGetM(m), pool);
             }
 
-            // Read the header.
-            fread(&fileHeader, sizeof(NexFileHeader), 1, fp);
+            break;
+        }
 
-            // Close the file.
-            fclose(fp);
+        // Finish a CDF and release it.
+        case ECDFClose:
+        {
+            CHECKARGCOUNT(1);
 
-            plhs[0] = packFileHeaderData(&fileHeader);
+            std::map<unsigned int, ECDFAccumulator*>::iterator it =
+                g_ecdfs.find((unsigned int)mxGetScalar(prhs[1]));
+            if (it == g_ecdfs.end()) {
+                if (nlhs > 0) {
+                    barf("NEXENGINE:ECDFClose:Invalid CDF handle.");
+                }
+                break;
+            }
+
+            std::vector<double> F, X;
+            size_t nIgnored = 0;
+            double errorBound = 0.0;
+            if (nlhs > 0) {
+                it->second->finish(F, X, nIgnored, errorBound, getThreadPool());
+            }
+            delete it->second;
+            g_ecdfs.erase(it);
+
+            plhs[0] = mxCreateDoubleMatrix(F.size(), 1, mxREAL);
+            std::copy(F.begin(), F.end(), mxGetPr(plhs[0]));
+            if (nlhs > 1) {
+                plhs[1] = mxCreateDoubleMatrix(X.size(), 1, mxREAL);
+                std::copy(X.begin(), X.end(), mxGetPr(plhs[1]));
+            }
+            if (nlhs > 2) {
+                plhs[2] = mxCreateDoubleScalar((double)nIgnored);
+            }
+            if (nlhs > 3) {
+                plhs[3] = mxCreateDoubleScalar(errorBound);
+            }
 
             break;
         }
@@ -281,6 +2221,21 @@ void initGlobalStructFields(void)
         sprintf(g_varHeaderFields[16], "MVOffset");
         sprintf(g_varHeaderFields[17], "prethresholdTimeInSeconds");
         
+        // Create the AMD window stats field strings.
+        g_amdStatsFields = (char**)mxMalloc(sizeof(char*) * NUM_AMD_STATS_FIELDS);
+        mexMakeMemoryPersistent(g_amdStatsFields);
+        for (int i = 0; i < NUM_AMD_STATS_FIELDS; i++) {
+            g_amdStatsFields[i] = (char*)mxMalloc(sizeof(char) * 32);
+            mexMakeMemoryPersistent(g_amdStatsFields[i]);
+        }
+        sprintf(g_amdStatsFields[0], "nSpikes");
+        sprintf(g_amdStatsFields[1], "ISImean");
+        sprintf(g_amdStatsFields[2], "ISIstd");
+        sprintf(g_amdStatsFields[3], "Poisson");
+        sprintf(g_amdStatsFields[4], "TimeMin");
+        sprintf(g_amdStatsFields[5], "TimeMax");
+        sprintf(g_amdStatsFields[6], "TimeDiff");
+
         // Indicate that init was run so that the next time this function is called
         // it won't run the string initialization.
         isInit = true;
@@ -536,6 +2491,11 @@ mxArray* readVariableData(FILE *fp, NexFileHeader *fileHeader, unsigned int vari
         }
     }
 
+    // Return an empty matrix if nothing was found.
+    if (varIndices.empty()) {
+        return mxCreateDoubleMatrix(0, 0, mxREAL);
+    }
+
     // If the channels weren't specified, we'll construct a list of all
     // channels, i.e. get all the data.
     if (channels.empty()) {
@@ -550,10 +2510,10 @@ mxArray* readVariableData(FILE *fp, NexFileHeader *fileHeader, unsigned int vari
     // Loop over all the "channels" we want to extract from this variable.  What
     // I'm calling a channel is the data associated with a specific variable
     // header entry.
-    for (size_t i = 0; i < nIndices; i++) {
+    for (size_t i = 0; i < channels.size(); i++) {
         // Extract the variable header index corresponding with our "channel"
         // index.
-        size_t iHeader = varIndices[indices[i]];
+        size_t iHeader = varIndices[channels[i]];
 
         switch (allHeaders[iHeader].Type) {
             case NEX_VARIABLE_TYPE_CONTINUOUS:
@@ -573,45 +2533,278 @@ mxArray* readVariableData(FILE *fp, NexFileHeader *fileHeader, unsigned int vari
         }
     }
 
-    if (!varIndices.empty()) {
+    return data;
+}
 
 
-        // Create a cell array to hold the makers.
-        data = mxCreateCellMatrix(nData, 1);
+std::vector<std::vector<int64_t> > readNeuronTicks(FILE *fp, NexFileHeader *fileHeader,
+                                                   const std::vector<int> &channels)
+{
+    std::vector<NexVarHeader> allHeaders;
+    std::vector<size_t> neuronHeaders;
+    std::vector<std::vector<int64_t> > ticks;
 
-        // We'll use this counter as an index into the mex cell matrix.  Data we
-        // want to read and store will be put into the cell matrix at the index
-        // value.
-        size_t counter = 0;
+    allHeaders.resize(fileHeader->NumVars);
+    if (fileHeader->NumVars > 0) {
+        fread(&allHeaders[0], sizeof(NexVarHeader) * fileHeader->NumVars, 1, fp);
+    }
+    for (size_t i = 0; i < allHeaders.size(); i++) {
+        if (allHeaders[i].Type == NEX_VARIABLE_TYPE_NEURON) {
+            neuronHeaders.push_back(i);
+        }
+    }
 
-        // Loop over all the variables and extract only the specified variables.
-        for (size_t i = 0; i < varHeaders.size(); i++) {
-            if (varHeaders[i].Type == variableType) {
-                switch (varHeaders[i].Type) {
-                    case NEX_VARIABLE_TYPE_CONTINUOUS:
-                        mxSetCell(data, counter++, readContinuousVariable(fp, &varHeaders[i], fileHeader));
-                        break;
+    std::vector<size_t> selected;
+    if (channels.empty()) {
+        selected = neuronHeaders;
+    }
+    for (size_t k = 0; k < channels.size(); k++) {
+        if (channels[k] < 0 || (size_t)channels[k] >= neuronHeaders.size()) {
+            fclose(fp);
+            barf("NEXENGINE:readNeuronTicks:Neuron index %d is out of range.", channels[k] + 1);
+        }
+        selected.push_back(neuronHeaders[channels[k]]);
+    }
 
-                    case NEX_VARIABLE_TYPE_MARKER:
-                        mxSetCell(data, counter++, readMarkerVariable(fp, &varHeaders[i], fileHeader));
-                        break;
+    std::vector<int> buffer;
+    ticks.resize(selected.size());
+    for (size_t k = 0; k < selected.size(); k++) {
+        NexVarHeader &header = allHeaders[selected[k]];
 
-                    case NEX_VARIABLE_TYPE_EVENT:
-                        mxSetCell(data, counter++, 	(fp, &varHeaders[i], fileHeader));
-                        break;
+        // The timestamps are stored as 4 byte ticks.
+        buffer.resize(header.Count);
+        fseek(fp, header.DataOffset, SEEK_SET);
+        if (header.Count > 0) {
+            fread(&buffer[0], header.Count * 4, 1, fp);
+        }
+        ticks[k].assign(buffer.begin(), buffer.end());
+    }
 
-                    default:
-                        barf("NEXENGINE:readData:Invalid variable type.");
-                }
-            }
+    return ticks;
+}
+
+
+template <typename T>
+void packBinCounts(const std::vector<TimedTrain<T> > &trains,
+                   const std::vector<TimeSpan<T> > &intervals, const BinGrid<T> &grid,
+                   bool isCSR, bool isUint16, int nlhs, mxArray *plhs[])
+{
+    ThreadPool &pool = getThreadPool();
+    size_t nNeurons = trains.size();
+    mxClassID classID = isUint16 ? mxUINT16_CLASS : mxUINT32_CLASS;
+
+    if (!isCSR) {
+        plhs[0] = mxCreateNumericMatrix(nNeurons, grid.nBins, classID, mxREAL);
+        if (isUint16) {
+            binCountsDense(trains, intervals, grid, (uint16_t*)mxGetData(plhs[0]), pool);
+        }
+        else {
+            binCountsDense(trains, intervals, grid, (uint32_t*)mxGetData(plhs[0]), pool);
         }
+        return;
+    }
+
+    mxArray *offsets = mxCreateNumericMatrix(nNeurons + 1, 1, mxUINT64_CLASS, mxREAL);
+    uint64_t *rowOffsets = (uint64_t*)mxGetData(offsets);
+    countNonzeroBins(trains, intervals, grid, rowOffsets, pool);
+
+    size_t nNonzero = rowOffsets[nNeurons];
+    mxArray *columns = mxCreateNumericMatrix(nNonzero, 1, mxUINT32_CLASS, mxREAL);
+    mxArray *values = mxCreateNumericMatrix(nNonzero, 1, classID, mxREAL);
+    if (isUint16) {
+        binCountsCSR(trains, intervals, grid, rowOffsets, (uint32_t*)mxGetData(columns),
+                     (uint16_t*)mxGetData(values), pool);
     }
     else {
-        // Return an empty matrix if nothing was found.
-        data = mxCreateDoubleMatrix(0, 0, mxREAL);
+        binCountsCSR(trains, intervals, grid, rowOffsets, (uint32_t*)mxGetData(columns),
+                     (uint32_t*)mxGetData(values), pool);
     }
 
-    return data;
+    plhs[0] = offsets;
+    mxArray *rest[2] = {columns, values};
+    for (int k = 0; k < 2; k++) {
+        if (nlhs > k + 1) {
+            plhs[k + 1] = rest[k];
+        }
+        else {
+            mxDestroyArray(rest[k]);
+        }
+    }
+}
+
+
+mxArray * packAMDStats(const WindowStats &window, const std::vector<NeuronStats> &stats)
+{
+    size_t n = stats.size();
+
+    mxArray *statsStruct = mxCreateStructMatrix(1, 1, NUM_AMD_STATS_FIELDS, (const char**)g_amdStatsFields);
+
+    mxArray *nSpikes = mxCreateDoubleMatrix(n, 1, mxREAL);
+    mxArray *isiMean = mxCreateDoubleMatrix(n, 1, mxREAL);
+    mxArray *isiStd = mxCreateDoubleMatrix(n, 1, mxREAL);
+    mxArray *poisson = mxCreateDoubleMatrix(n, 1, mxREAL);
+    for (size_t i = 0; i < n; i++) {
+        mxGetPr(nSpikes)[i] = stats[i].nSpikes;
+        mxGetPr(isiMean)[i] = stats[i].isiMean;
+        mxGetPr(isiStd)[i] = stats[i].isiStd;
+        mxGetPr(poisson)[i] = stats[i].poisson;
+    }
+
+    mxSetField(statsStruct, 0, "nSpikes", nSpikes);
+    mxSetField(statsStruct, 0, "ISImean", isiMean);
+    mxSetField(statsStruct, 0, "ISIstd", isiStd);
+    mxSetField(statsStruct, 0, "Poisson", poisson);
+    mxSetField(statsStruct, 0, "TimeMin", mxCreateDoubleScalar(window.timeMin));
+    mxSetField(statsStruct, 0, "TimeMax", mxCreateDoubleScalar(window.timeMax));
+    mxSetField(statsStruct, 0, "TimeDiff", mxCreateDoubleScalar(window.timeDiff));
+
+    return statsStruct;
+}
+
+
+std::vector<SpikeTrain> getSpikeTrains(const mxArray *trains, const char *caller)
+{
+    if (!mxIsCell(trains)) {
+        barf("NEXENGINE:%s:Spike trains must be a cell array of timestamp vectors.", caller);
+    }
+
+    size_t nTrains = mxGetNumberOfElements(trains);
+    std::vector<SpikeTrain> views(nTrains);
+
+    for (size_t i = 0; i < nTrains; i++) {
+        const mxArray *c = mxGetCell(trains, i);
+
+        // Empty cells are allowed and treated as neurons without spikes.
+        if (c == NULL || mxIsEmpty(c)) {
+            views[i].t = NULL;
+            views[i].n = 0;
+            continue;
+        }
+
+        if (!mxIsDouble(c)) {
+            barf("NEXENGINE:%s:Spike train %d must be of type double.", caller, (int)i + 1);
+        }
+
+        views[i].t = mxGetPr(c);
+        views[i].n = mxGetNumberOfElements(c);
+
+        // All the kernels rely on sorted timestamps.
+        if (!std::is_sorted(views[i].t, views[i].t + views[i].n)) {
+            barf("NEXENGINE:%s:Spike train %d is not sorted.", caller, (int)i + 1);
+        }
+    }
+
+    return views;
+}
+
+
+std::vector<Interval> getIntervals(const mxArray *intervals, const char *caller)
+{
+    std::vector<Interval> list;
+
+    if (mxIsEmpty(intervals)) {
+        return list;
+    }
+
+    if (!mxIsDouble(intervals) || mxGetN(intervals) != 2) {
+        barf("NEXENGINE:%s:Intervals must be an Nx2 double matrix.", caller);
+    }
+
+    size_t n = mxGetM(intervals);
+    const double *p = mxGetPr(intervals);
+    list.resize(n);
+    for (size_t i = 0; i < n; i++) {
+        list[i].start = p[i];
+        list[i].end = p[i + n];
+    }
+
+    mergeIntervals(list);
+
+    return list;
+}
+
+
+mxArray * packIntervals(const std::vector<Interval> &intervals)
+{
+    size_t n = intervals.size();
+    mxArray *packed = mxCreateDoubleMatrix(n, 2, mxREAL);
+    double *p = mxGetPr(packed);
+    for (size_t i = 0; i < n; i++) {
+        p[i] = intervals[i].start;
+        p[i + n] = intervals[i].end;
+    }
+
+    return packed;
+}
+
+
+std::vector<Biquad> getSections(const mxArray *sos, const char *caller)
+{
+    std::vector<Biquad> sections;
+
+    if (mxIsEmpty(sos)) {
+        return sections;
+    }
+
+    if (!mxIsDouble(sos) || mxGetN(sos) != 6) {
+        barf("NEXENGINE:%s:Sections must be a Kx6 double matrix.", caller);
+    }
+
+    size_t n = mxGetM(sos);
+    const double *p = mxGetPr(sos);
+    for (size_t k = 0; k < n; k++) {
+        double a0 = p[k + 3*n];
+        if (a0 == 0) {
+            barf("NEXENGINE:%s:Section %d has a0 = 0.", caller, (int)k + 1);
+        }
+        Biquad q;
+        q.b0 = p[k] / a0;
+        q.b1 = p[k + n] / a0;
+        q.b2 = p[k + 2*n] / a0;
+        q.a1 = p[k + 4*n] / a0;
+        q.a2 = p[k + 5*n] / a0;
+        sections.push_back(q);
+    }
+
+    return sections;
+}
+
+
+bool getPrecision(const mxArray *precision, const char *caller)
+{
+    char buffer[16];
+    if (!mxIsChar(precision) || mxGetString(precision, buffer, 16)) {
+        barf("NEXENGINE:%s:Failed to read the precision.", caller);
+    }
+    bool isSingle = strcmp(buffer, "single") == 0;
+    if (!isSingle && strcmp(buffer, "double") != 0) {
+        barf("NEXENGINE:%s:Precision must be 'single' or 'double'.", caller);
+    }
+
+    return isSingle;
+}
+
+
+std::vector<std::vector<size_t> > getWindowNeurons(const mxArray *mask, size_t nTrains,
+                                                    size_t nWindows, const char *caller)
+{
+    if (!(mxIsLogical(mask) || mxIsDouble(mask)) || mxGetM(mask) != nTrains || mxGetN(mask) != nWindows) {
+        barf("NEXENGINE:%s:Neuron mask must be a %d x %d logical matrix.",
+             caller, (int)nTrains, (int)nWindows);
+    }
+
+    std::vector<std::vector<size_t> > neurons(nWindows);
+    for (size_t w = 0; w < nWindows; w++) {
+        for (size_t i = 0; i < nTrains; i++) {
+            size_t k = i + w*nTrains;
+            bool isSet = mxIsLogical(mask) ? mxGetLogicals(mask)[k] != 0 : mxGetPr(mask)[k] != 0;
+            if (isSet) {
+                neurons[w].push_back(i);
+            }
+        }
+    }
+
+    return neurons;
 }
 
 
@@ -650,6 +2843,37 @@ static void cleanup()
         mxFree(g_continuousFields[i]);
     }
     mxFree(g_continuousFields);
+
+    // Delete the memory allocated for the AMD stats fields.
+    for (i = 0; i < NUM_AMD_STATS_FIELDS; i++) {
+        mxFree(g_amdStatsFields[i]);
+    }
+    mxFree(g_amdStatsFields);
+
+    // Release any streams that were never closed.
+    for (std::map<unsigned int, StreamingAMD*>::iterator it = g_streams.begin(); it != g_streams.end(); ++it) {
+        delete it->second;
+    }
+    g_streams.clear();
+
+    for (std::map<unsigned int, ContinuousReader*>::iterator it = g_readers.begin(); it != g_readers.end(); ++it) {
+        delete it->second;
+    }
+    g_readers.clear();
+
+    for (std::map<unsigned int, ResultStoreReader*>::iterator it = g_resultStores.begin();
+         it != g_resultStores.end(); ++it) {
+        delete it->second;
+    }
+    g_resultStores.clear();
+
+    for (std::map<unsigned int, ECDFAccumulator*>::iterator it = g_ecdfs.begin(); it != g_ecdfs.end(); ++it) {
+        delete it->second;
+    }
+    g_ecdfs.clear();
+
+    // Stop the worker threads.
+    shutdownThreadPool();
 }
 
 
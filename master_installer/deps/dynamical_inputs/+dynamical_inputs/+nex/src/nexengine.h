@@ -1,9 +1,35 @@
 #ifndef NEXENGINE_H
 #define NEXENGINE_H
 
+#include <algorithm>
+#include <map>
 #include <mex.h>
 #include "NexFile.h"
 #include "NexFileVariables.h"
+#include "spiketrains.h"
+#include "amdkernel.h"
+#include "slidingamd.h"
+#include "tiledamd.h"
+#include "stabilitykernel.h"
+#include "streamstability.h"
+#include "ecdfkernel.h"
+#include "surrogateamd.h"
+#include "streamingamd.h"
+#include "pairmetrics.h"
+#include "correlogram.h"
+#include "psthkernel.h"
+#include "bincounts.h"
+#include "envelope.h"
+#include "continuousreader.h"
+#include "continuousfilter.h"
+#include "spikedetect.h"
+#include "waveformfeatures.h"
+#include "stakernel.h"
+#include "spectralkernel.h"
+#include "intervalset.h"
+#include "sequentialbouts.h"
+#include "resultstore.h"
+#include "threadpool.h"
 
 // Macro to check that the right number of arguments were passed to a command.
 #define CHECKARGCOUNT(x) if (nrhs != (x+1)) {barf("NEXENGINE:%d command requires %d arguments.", opCode, x);}
@@ -14,6 +40,7 @@
 #define NUM_MARKER_VALUE_FIELDS 2
 #define NUM_CONTINUOUS_FIELDS 8
 #define NUM_VAR_HEADER_FIELDS 18
+#define NUM_AMD_STATS_FIELDS 7
 
 #ifndef max
 #define max(a,b)            (((a) > (b)) ? (a) : (b))
@@ -30,7 +57,44 @@ typedef enum {
     GetEvents,
     GetMarkers,
     GetContinuous,
-    GetVariableHeaders
+    GetVariableHeaders,
+    SelectSpikes,
+    WindowAMD,
+    SlidingWindowAMD,
+    TiledWindowAMD,
+    MultiWindowAMD,
+    WindowStability,
+    StreamStability,
+    WindowECDF,
+    SurrogateAMD,
+    StreamOpen,
+    StreamAppend,
+    StreamClose,
+    PairMetric,
+    Correlograms,
+    PSTH,
+    BinCounts,
+    BuildEnvelope,
+    QueryEnvelope,
+    ContinuousOpen,
+    ContinuousNext,
+    ContinuousClose,
+    FilterContinuous,
+    DetectSpikes,
+    WaveformFeatures,
+    SpikeTriggeredAverage,
+    WelchPSD,
+    Spectrogram,
+    ReadIntervals,
+    IntervalAlgebra,
+    SequentialBouts,
+    ResultStoreWrite,
+    ResultStoreOpen,
+    ResultStoreRead,
+    ResultStoreClose,
+    ECDFOpen,
+    ECDFAppend,
+    ECDFClose
 } EngineFunctions;
 
 
@@ -128,6 +192,166 @@ mxArray * readMarkerVariable(FILE *fp, NexVarHeader *markerHeader, NexFileHeader
 *******************************************************************************/
 mxArray * readContinuousVariable(FILE *fp, NexVarHeader *continuousHeader, NexFileHeader *fileHeader);
 
+/*******************************************************************************
+ readNeuronTicks - Reads the timestamps of neuron variables in ticks.
+
+ Syntax:
+ std::vector<std::vector<int64_t> > readNeuronTicks(FILE *fp, NexFileHeader *fileHeader,
+                                                    const std::vector<int> &channels)
+
+ Description:
+ Unlike the other readers, the timestamps are left as the integer ticks
+ stored in the file rather than converted to seconds in an mxArray, for the
+ kernels that can work on ticks directly.  fp must be just past the file
+ header.
+
+ Input:
+ channels - 0 based indices among the neuron variables to read, or empty
+     for all of them.
+
+ Output:
+ std::vector<std::vector<int64_t> > - The timestamps of each neuron.
+*******************************************************************************/
+std::vector<std::vector<int64_t> > readNeuronTicks(FILE *fp, NexFileHeader *fileHeader,
+                                                   const std::vector<int> &channels);
+
+/*******************************************************************************
+ packBinCounts - Bins spike trains and returns the counts to MATLAB.
+
+ Syntax:
+ packBinCounts(const std::vector<TimedTrain<T> > &trains,
+               const std::vector<TimeSpan<T> > &intervals, const BinGrid<T> &grid,
+               bool isCSR, bool isUint16, int nlhs, mxArray *plhs[])
+
+ Description:
+ Shared by the seconds and ticks versions of the BinCounts command.  Dense
+ counts go in plhs[0] as an nNeurons x nBins matrix.  CSR counts go in
+ plhs[0..2] as the uint64 row offsets, uint32 zero based bin indices and
+ the counts.
+*******************************************************************************/
+template <typename T>
+void packBinCounts(const std::vector<TimedTrain<T> > &trains,
+                   const std::vector<TimeSpan<T> > &intervals, const BinGrid<T> &grid,
+                   bool isCSR, bool isUint16, int nlhs, mxArray *plhs[]);
+
+/*******************************************************************************
+ packAMDStats - Creates an mxArray struct containing AMD window statistics.
+
+ Syntax:
+ mxArray * packAMDStats(const WindowStats &window, const std::vector<NeuronStats> &stats)
+
+ Description:
+ Packs the per neuron statistics into column vectors (nSpikes, ISImean,
+ ISIstd, Poisson) and the window time span into scalars (TimeMin, TimeMax,
+ TimeDiff) of a 1x1 mxSTRUCT_CLASS mxArray.  The field names match the
+ names used by dynamical.math.AMDWindow.
+
+ Output:
+ mxArray * - mxSTRUCT_CLASS mxArray containing the statistics.
+*******************************************************************************/
+mxArray * packAMDStats(const WindowStats &window, const std::vector<NeuronStats> &stats);
+
+/*******************************************************************************
+ getSpikeTrains - Wraps a cell array of spike timestamps as spike train views.
+
+ Syntax:
+ std::vector<SpikeTrain> getSpikeTrains(const mxArray *trains, const char *caller)
+
+ Description:
+ Validates that the mxArray is a cell array of real double vectors sorted in
+ ascending order, i.e. the timestamps column of a neuron table, and returns a
+ view of each one.  No timestamps are copied, so the views are only valid for
+ as long as the mxArray is.
+
+ Input:
+ trains - Cell array of spike timestamp vectors. (s)
+ caller - Name of the calling command, used in error messages.
+
+ Output:
+ std::vector<SpikeTrain> - One view per cell.
+*******************************************************************************/
+std::vector<SpikeTrain> getSpikeTrains(const mxArray *trains, const char *caller);
+
+/*******************************************************************************
+ getIntervals - Converts an Nx2 [start end] matrix into a merged interval list.
+
+ Syntax:
+ std::vector<Interval> getIntervals(const mxArray *intervals, const char *caller)
+
+ Description:
+ Reads an Nx2 double matrix of interval start/end times and returns them
+ sorted and merged via mergeIntervals.  An empty matrix produces an empty
+ list, which the selection kernels treat as "no interval filtering".
+
+ Input:
+ intervals - Nx2 matrix of interval start and end times. (s)
+ caller - Name of the calling command, used in error messages.
+
+ Output:
+ std::vector<Interval> - The sorted, disjoint intervals.
+*******************************************************************************/
+std::vector<Interval> getIntervals(const mxArray *intervals, const char *caller);
+
+/*******************************************************************************
+ packIntervals - Creates an Nx2 [start end] matrix from an interval list.
+
+ Syntax:
+ mxArray * packIntervals(const std::vector<Interval> &intervals)
+
+ Description:
+ The inverse of getIntervals, so the result can be passed back to any
+ command that takes intervals.
+*******************************************************************************/
+mxArray * packIntervals(const std::vector<Interval> &intervals);
+
+/*******************************************************************************
+ getSections - Converts a MATLAB second order section matrix into biquads.
+
+ Syntax:
+ std::vector<Biquad> getSections(const mxArray *sos, const char *caller)
+
+ Input:
+ sos - Kx6 double matrix of [b0 b1 b2 a0 a1 a2] rows, the layout of
+     MATLAB's zp2sos.  Empty for no sections.
+ caller - Name of the calling command, used in error messages.
+
+ Output:
+ std::vector<Biquad> - The sections, normalized so a0 is 1.
+*******************************************************************************/
+std::vector<Biquad> getSections(const mxArray *sos, const char *caller);
+
+/*******************************************************************************
+ getPrecision - Reads a 'single' or 'double' precision option.
+
+ Syntax:
+ bool getPrecision(const mxArray *precision, const char *caller)
+
+ Output:
+ bool - True for 'single', false for 'double'.
+*******************************************************************************/
+bool getPrecision(const mxArray *precision, const char *caller);
+
+/*******************************************************************************
+ getWindowNeurons - Converts a neuron x window mask into per window index lists.
+
+ Syntax:
+ std::vector<std::vector<size_t> > getWindowNeurons(const mxArray *mask, size_t nTrains,
+                                                    size_t nWindows, const char *caller)
+
+ Input:
+ mask - nTrains x nWindows logical (or double) matrix of the neurons that
+     take part in each window.
+ nTrains - Expected number of rows.
+ nWindows - Expected number of columns.
+ caller - Name of the calling command, used in error messages.
+
+ Output:
+ std::vector<std::vector<size_t> > - The 0 based neuron indices of each
+     window, in ascending order.
+*******************************************************************************/
+std::vector<std::vector<size_t> > getWindowNeurons(const mxArray *mask, size_t nTrains,
+                                                    size_t nWindows, const char *caller);
+
 /*******************************************************************************
 *******************************************************************************/
 static void cleanup();
@@ -0,0 +1,374 @@
+#include "pairmetrics.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include "amdkernel.h"
+#include "tiledamd.h"
+
+
+void windowSpans(const std::vector<Interval> &intervals, double windowStart,
+                 double windowEnd, std::vector<Interval> &spans)
+{
+    spans.clear();
+
+    if (intervals.empty()) {
+        if (windowEnd > windowStart) {
+            Interval span = {windowStart, windowEnd};
+            spans.push_back(span);
+        }
+        return;
+    }
+
+    for (size_t k = 0; k < intervals.size() && intervals[k].start < windowEnd; k++) {
+        Interval span = {std::max(intervals[k].start, windowStart),
+                         std::min(intervals[k].end, windowEnd)};
+        if (span.end > span.start) {
+            spans.push_back(span);
+        }
+    }
+}
+
+
+double spanMeasure(const std::vector<Interval> &spans)
+{
+    double measure = 0.0;
+    for (size_t k = 0; k < spans.size(); k++) {
+        measure += spans[k].end - spans[k].start;
+    }
+    return measure;
+}
+
+
+// The spikes of s within a span.
+static SpikeTrain spanTrain(SpikeTrain s, const Interval &span)
+{
+    const double *first = std::lower_bound(s.t, s.t + s.n, span.start);
+    const double *last = std::upper_bound(first, s.t + s.n, span.end);
+    SpikeTrain sub = {first, (size_t)(last - first)};
+    return sub;
+}
+
+
+void AMDMetric::pair(SpikeTrain a, SpikeTrain b, double *ab, double *ba) const
+{
+    pairAMD(a, b, ab, ba);
+}
+
+
+// Fraction of the spans within dt of a spike of s.
+static double tiledFraction(SpikeTrain s, double dt, const std::vector<Interval> &spans,
+                            double measure)
+{
+    double covered = 0.0;
+    size_t k = 0;
+    size_t i = 0;
+
+    while (i < s.n) {
+        // The next run of overlapping tiles, as one stretch [lo, hi].
+        double lo = s.t[i] - dt;
+        double hi = s.t[i] + dt;
+        for (i++; i < s.n && s.t[i] - dt <= hi; i++) {
+            hi = s.t[i] + dt;
+        }
+
+        // Its overlap with the spans.  The stretches only move forward, so
+        // spans that end before this one starts are done with.
+        while (k < spans.size() && spans[k].end <= lo) {
+            k++;
+        }
+        for (size_t m = k; m < spans.size() && spans[m].start < hi; m++) {
+            covered += std::min(hi, spans[m].end) - std::max(lo, spans[m].start);
+        }
+    }
+
+    return covered / measure;
+}
+
+
+// Fraction of the spikes of a within dt of a spike of b.
+static double coincidentFraction(SpikeTrain a, SpikeTrain b, double dt)
+{
+    size_t nCoincident = 0;
+    size_t j = 0;
+
+    for (size_t i = 0; i < a.n; i++) {
+        while (j < b.n && b.t[j] < a.t[i] - dt) {
+            j++;
+        }
+        if (j < b.n && b.t[j] <= a.t[i] + dt) {
+            nCoincident++;
+        }
+    }
+
+    return (double)nCoincident / (double)a.n;
+}
+
+
+// One half of the STTC.  Both fractions being 1 leaves nothing to compare,
+// which counts as no correlation.
+static double sttcTerm(double p, double t)
+{
+    double d = 1.0 - p * t;
+    return d > 0.0 ? (p - t) / d : 0.0;
+}
+
+
+double STTCMetric::diagonal(SpikeTrain a) const
+{
+    return a.n == 0 || !(measure > 0) ? std::numeric_limits<double>::quiet_NaN() : 1.0;
+}
+
+
+void STTCMetric::pair(SpikeTrain a, SpikeTrain b, double *ab, double *ba) const
+{
+    if (a.n == 0 || b.n == 0 || !(measure > 0)) {
+        *ab = *ba = std::numeric_limits<double>::quiet_NaN();
+        return;
+    }
+
+    double tA = tiledFraction(a, dt, spans, measure);
+    double tB = tiledFraction(b, dt, spans, measure);
+    double pA = coincidentFraction(a, b, dt);
+    double pB = coincidentFraction(b, a, dt);
+
+    *ab = *ba = 0.5 * (sttcTerm(pA, tB) + sttcTerm(pB, tA));
+}
+
+
+// A spike train with the window edges added as spikes, so spike k of the
+// edged train is start for k = 0, t[k-1] for 1 <= k <= n and end for
+// k = n + 1.
+struct EdgedTrain
+{
+    SpikeTrain s;
+    double start;
+    double end;
+
+    size_t size() const { return s.n + 2; }
+
+    double operator[](size_t k) const
+    {
+        return k == 0 ? start : (k <= s.n ? s.t[k-1] : end);
+    }
+};
+
+
+// Distance from each spike of a to the nearest spike of b, edges included.
+static void nearestDistances(const EdgedTrain &a, const EdgedTrain &b, std::vector<double> &d)
+{
+    size_t na = a.size();
+    size_t nb = b.size();
+    size_t j = 0;
+
+    d.resize(na);
+    for (size_t i = 0; i < na; i++) {
+        double t = a[i];
+        while (j + 1 < nb && b[j + 1] <= t) {
+            j++;
+        }
+        double dist = std::fabs(t - b[j]);
+        if (j + 1 < nb) {
+            dist = std::min(dist, b[j + 1] - t);
+        }
+        d[i] = dist;
+    }
+}
+
+
+// Walks the intervals between the merged spikes of both edged trains, from
+// start to end, calling body(t0, t1, ia, ib) where [a[ia], a[ia+1]] and
+// [b[ib], b[ib+1]] are the ISIs of each train that contain (t0, t1).
+template <typename Body>
+static void sweepISIs(const EdgedTrain &a, const EdgedTrain &b, Body body)
+{
+    size_t ia = 0;
+    size_t ib = 0;
+    size_t lastA = a.size() - 1;
+    size_t lastB = b.size() - 1;
+    double t = a.start;
+
+    while (ia < lastA && ib < lastB) {
+        double nextA = a[ia + 1];
+        double nextB = b[ib + 1];
+        double tNext = std::min(nextA, nextB);
+
+        if (tNext > t) {
+            body(t, tNext, ia, ib);
+            t = tNext;
+        }
+        if (nextA <= tNext) {
+            ia++;
+        }
+        if (nextB <= tNext) {
+            ib++;
+        }
+    }
+}
+
+
+// Integral of the ISI-distance's relative ISI difference over one span.
+static double isiIntegral(const EdgedTrain &ea, const EdgedTrain &eb)
+{
+    double integral = 0.0;
+
+    sweepISIs(ea, eb, [&](double t0, double t1, size_t ia, size_t ib) {
+        double isiA = ea[ia + 1] - ea[ia];
+        double isiB = eb[ib + 1] - eb[ib];
+        integral += std::fabs(isiA - isiB) / std::max(isiA, isiB) * (t1 - t0);
+    });
+
+    return integral;
+}
+
+
+double ISIDistanceMetric::diagonal(SpikeTrain a) const
+{
+    return a.n == 0 || !(measure > 0) ? std::numeric_limits<double>::quiet_NaN() : 0.0;
+}
+
+
+void ISIDistanceMetric::pair(SpikeTrain a, SpikeTrain b, double *ab, double *ba) const
+{
+    if (a.n == 0 || b.n == 0 || !(measure > 0)) {
+        *ab = *ba = std::numeric_limits<double>::quiet_NaN();
+        return;
+    }
+
+    double integral = 0.0;
+    for (size_t k = 0; k < spans.size(); k++) {
+        EdgedTrain ea = {spanTrain(a, spans[k]), spans[k].start, spans[k].end};
+        EdgedTrain eb = {spanTrain(b, spans[k]), spans[k].start, spans[k].end};
+        integral += isiIntegral(ea, eb);
+    }
+
+    *ab = *ba = integral / measure;
+}
+
+
+// Integral of the SPIKE-distance's dissimilarity profile over one span.
+static double spikeIntegral(const EdgedTrain &ea, const EdgedTrain &eb,
+                            std::vector<double> &dA, std::vector<double> &dB)
+{
+    nearestDistances(ea, eb, dA);
+    nearestDistances(eb, ea, dB);
+
+    double integral = 0.0;
+
+    // Within an interval both ISIs are fixed and each train's spike time
+    // difference is linear in t, so S(t) is linear as well and the
+    // trapezoid rule is exact.
+    sweepISIs(ea, eb, [&](double t0, double t1, size_t ia, size_t ib) {
+        double pA = ea[ia], fA = ea[ia + 1];
+        double pB = eb[ib], fB = eb[ib + 1];
+        double isiA = fA - pA;
+        double isiB = fB - pB;
+        double scale = 0.5 * (isiA + isiB) * (isiA + isiB);
+
+        double s[2];
+        double ts[2] = {t0, t1};
+        for (int e = 0; e < 2; e++) {
+            double t = ts[e];
+            double sA = (dA[ia] * (fA - t) + dA[ia + 1] * (t - pA)) / isiA;
+            double sB = (dB[ib] * (fB - t) + dB[ib + 1] * (t - pB)) / isiB;
+            s[e] = (sA * isiB + sB * isiA) / scale;
+        }
+
+        integral += 0.5 * (s[0] + s[1]) * (t1 - t0);
+    });
+
+    return integral;
+}
+
+
+double SPIKEDistanceMetric::diagonal(SpikeTrain a) const
+{
+    return a.n == 0 || !(measure > 0) ? std::numeric_limits<double>::quiet_NaN() : 0.0;
+}
+
+
+void SPIKEDistanceMetric::pair(SpikeTrain a, SpikeTrain b, double *ab, double *ba) const
+{
+    if (a.n == 0 || b.n == 0 || !(measure > 0)) {
+        *ab = *ba = std::numeric_limits<double>::quiet_NaN();
+        return;
+    }
+
+    std::vector<double> dA, dB;
+    double integral = 0.0;
+    for (size_t k = 0; k < spans.size(); k++) {
+        EdgedTrain ea = {spanTrain(a, spans[k]), spans[k].start, spans[k].end};
+        EdgedTrain eb = {spanTrain(b, spans[k]), spans[k].start, spans[k].end};
+        integral += spikeIntegral(ea, eb, dA, dB);
+    }
+
+    *ab = *ba = integral / measure;
+}
+
+
+// Fills in the pairs of the tile with rows [i0, i0 + tileSize) and columns
+// [j0, j0 + tileSize), plus their mirror images below the diagonal.
+template <typename Metric>
+static void computeMetricTile(const PackedTrains &trains, const Metric &metric,
+                              size_t i0, size_t j0, size_t tileSize, double *values)
+{
+    size_t n = trains.size();
+    size_t i1 = std::min(i0 + tileSize, n);
+    size_t j1 = std::min(j0 + tileSize, n);
+
+    for (size_t i = i0; i < i1; i++) {
+        SpikeTrain a = trains[i];
+
+        if (i0 == j0) {
+            values[i + i*n] = metric.diagonal(a);
+        }
+
+        for (size_t j = (i0 == j0) ? i + 1 : j0; j < j1; j++) {
+            double ij, ji;
+            metric.pair(a, trains[j], &ij, &ji);
+            values[i + j*n] = ij;
+            values[j + i*n] = Metric::isSymmetric ? ij : ji;
+        }
+    }
+}
+
+
+template <typename Metric>
+static void runMetricJobs(const PairMetricOptions &options, std::vector<MetricWindowJob> &jobs,
+                          ThreadPool &pool)
+{
+    std::vector<Metric> metrics;
+    metrics.reserve(jobs.size());
+    for (size_t w = 0; w < jobs.size(); w++) {
+        metrics.push_back(Metric(options, jobs[w].spans));
+        jobs[w].tileSize = chooseTileSize(jobs[w].trains);
+    }
+
+    runWindowTiles(jobs, pool, [&](MetricWindowJob &job, const WindowTileTask &task) {
+        computeMetricTile(job.trains, metrics[task.window], task.i0, task.j0, job.tileSize,
+                          job.values);
+    });
+}
+
+
+void computeMultiWindowPairMetric(PairMetricType type, const PairMetricOptions &options,
+                                  std::vector<MetricWindowJob> &jobs, ThreadPool &pool)
+{
+    switch (type) {
+        case MetricAMD:
+            runMetricJobs<AMDMetric>(options, jobs, pool);
+            break;
+
+        case MetricSTTC:
+            runMetricJobs<STTCMetric>(options, jobs, pool);
+            break;
+
+        case MetricISIDistance:
+            runMetricJobs<ISIDistanceMetric>(options, jobs, pool);
+            break;
+
+        case MetricSPIKEDistance:
+            runMetricJobs<SPIKEDistanceMetric>(options, jobs, pool);
+            break;
+    }
+}
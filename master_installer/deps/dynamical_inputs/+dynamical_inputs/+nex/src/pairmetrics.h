@@ -0,0 +1,190 @@
+#ifndef PAIRMETRICS_H
+#define PAIRMETRICS_H
+
+#include <cstddef>
+#include <vector>
+#include "spiketrains.h"
+#include "threadpool.h"
+
+// The pair metrics the engine knows about.
+typedef enum
+{
+    MetricAMD,
+    MetricSTTC,
+    MetricISIDistance,
+    MetricSPIKEDistance
+} PairMetricType;
+
+// Parameters shared by all metrics.  Each metric only looks at the ones it
+// needs.
+struct PairMetricOptions
+{
+    // Coincidence window of the spike time tiling coefficient. (s)
+    double sttcDt;
+};
+
+
+/*******************************************************************************
+ Pair metrics
+
+ Description:
+ Each metric is a small struct that is made for one window and has:
+
+     static const bool isSymmetric;
+     double diagonal(SpikeTrain a) const;
+     void pair(SpikeTrain a, SpikeTrain b, double *ab, double *ba) const;
+
+ pair() gives the metric from a to b and from b to a.  For symmetric metrics
+ both are the same value.  diagonal() gives the metric from a train to
+ itself.  The drivers below are templated on the metric, so every metric
+ gets its own copy of the tile loop with its merge loop inlined into it and
+ nothing is looked up per pair or per spike.
+
+ The metrics that integrate over time are given the spans of the window
+ the spikes were selected from, see windowSpans, and only integrate over
+ those.  Time the intervals leave out of the window doesn't count.
+
+ Adding a metric means adding a struct here, its pair() in pairmetrics.cpp,
+ a PairMetricType and a case in computeMultiWindowPairMetric.
+*******************************************************************************/
+
+/*******************************************************************************
+ windowSpans - Lists the parts of a window covered by a set of intervals.
+
+ Syntax:
+ windowSpans(const std::vector<Interval> &intervals, double windowStart,
+             double windowEnd, std::vector<Interval> &spans)
+
+ Description:
+ Intersects the window with the intervals, giving the sorted, disjoint
+ spans the spikes of the window can be selected from.  With no intervals
+ the span is the whole window.  Spans of no length are left out.
+
+ Input:
+ intervals - Sorted, disjoint intervals as produced by mergeIntervals.
+ windowStart, windowEnd - The window. (s)
+
+ Output:
+ spans - Cleared and filled with the covered spans.
+*******************************************************************************/
+void windowSpans(const std::vector<Interval> &intervals, double windowStart,
+                 double windowEnd, std::vector<Interval> &spans);
+
+// Total length of a set of spans from windowSpans. (s)
+double spanMeasure(const std::vector<Interval> &spans);
+
+
+// Average minimum distance, the same as pairAMD.  The diagonal is zero, as
+// in the AMD matrices of the AMD kernels.
+struct AMDMetric
+{
+    static const bool isSymmetric = false;
+
+    AMDMetric(const PairMetricOptions &, const std::vector<Interval> &) {}
+
+    double diagonal(SpikeTrain) const { return 0.0; }
+    void pair(SpikeTrain a, SpikeTrain b, double *ab, double *ba) const;
+};
+
+// Spike time tiling coefficient (Cutts and Eglen, 2014).  Ranges from -1 to
+// 1, with 1 for trains whose spikes all fall within dt of each other.
+struct STTCMetric
+{
+    static const bool isSymmetric = true;
+
+    STTCMetric(const PairMetricOptions &options, const std::vector<Interval> &timeSpans)
+        : dt(options.sttcDt), spans(timeSpans), measure(spanMeasure(timeSpans)) {}
+
+    double diagonal(SpikeTrain a) const;
+    void pair(SpikeTrain a, SpikeTrain b, double *ab, double *ba) const;
+
+    double dt;
+    const std::vector<Interval> &spans;
+    double measure;
+};
+
+// ISI-distance (Kreuz et al., 2007).  The time average of the relative
+// difference of the two trains' current ISIs, from 0 to 1.
+struct ISIDistanceMetric
+{
+    static const bool isSymmetric = true;
+
+    ISIDistanceMetric(const PairMetricOptions &, const std::vector<Interval> &timeSpans)
+        : spans(timeSpans), measure(spanMeasure(timeSpans)) {}
+
+    double diagonal(SpikeTrain a) const;
+    void pair(SpikeTrain a, SpikeTrain b, double *ab, double *ba) const;
+
+    const std::vector<Interval> &spans;
+    double measure;
+};
+
+// SPIKE-distance (Kreuz et al., 2013).  The time average of the spike time
+// differences around each instant, weighted by the local firing rates, from
+// 0 to 1.
+struct SPIKEDistanceMetric
+{
+    static const bool isSymmetric = true;
+
+    SPIKEDistanceMetric(const PairMetricOptions &, const std::vector<Interval> &timeSpans)
+        : spans(timeSpans), measure(spanMeasure(timeSpans)) {}
+
+    double diagonal(SpikeTrain a) const;
+    void pair(SpikeTrain a, SpikeTrain b, double *ab, double *ba) const;
+
+    const std::vector<Interval> &spans;
+    double measure;
+};
+
+
+// Input and output of a single window for computeMultiWindowPairMetric.
+struct MetricWindowJob
+{
+    // Set by the caller.  values points to a preallocated k x k matrix,
+    // where k is the number of trains.  spans are the parts of the window
+    // the trains were selected from, as given by windowSpans.
+    PackedTrains trains;
+    std::vector<Interval> spans;
+    double *values;
+
+    // Filled in by computeMultiWindowPairMetric.
+    size_t tileSize;
+};
+
+
+/*******************************************************************************
+ computeMultiWindowPairMetric - Computes a pair metric for many windows.
+
+ Syntax:
+ computeMultiWindowPairMetric(PairMetricType type, const PairMetricOptions &options,
+                              std::vector<MetricWindowJob> &jobs, ThreadPool &pool)
+
+ Description:
+ Runs on the same tile scheduler as the AMD kernels, runWindowTiles: every
+ window's pair matrix is split into cache sized tiles of packed trains and
+ all the tiles of all the windows run as one set of tasks with work
+ stealing.  The metric type is switched on once, then the templated tile
+ loop for that metric runs.
+
+ The STTC tiles only the window's spans and takes its time fractions of
+ their total length.  ISI-distance and SPIKE-distance are integrated over
+ each span separately, treating the span's edges as spikes of both trains
+ as the original papers do for the edges of a recording, and averaged over
+ the total length.
+
+ Input:
+ type - Which metric to calculate.
+ options - Metric parameters.
+ jobs - One entry per window, see MetricWindowJob.
+ pool - Thread pool to run the tiles on.
+
+ Output:
+ jobs - The value matrices are filled in, column major, with [i + j*k]
+     the metric from train i to train j.  Pairs with an empty train are NaN,
+     including an empty train with itself, except for the AMD whose
+     diagonal is always zero.
+*******************************************************************************/
+void computeMultiWindowPairMetric(PairMetricType type, const PairMetricOptions &options,
+                                  std::vector<MetricWindowJob> &jobs, ThreadPool &pool);
+
+#endif
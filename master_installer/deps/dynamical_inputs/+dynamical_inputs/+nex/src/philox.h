@@ -0,0 +1,112 @@
+#ifndef PHILOX_H
+#define PHILOX_H
+
+#include <cstdint>
+
+/*******************************************************************************
+ PhiloxRNG - Counter based random number generator (Philox4x32-10).
+
+ Description:
+ Philox, from Salmon et al., "Parallel Random Numbers: As Easy as 1, 2, 3",
+ turns a 128-bit counter and a 64-bit key into 128 random bits with a fixed
+ number of multiply/xor rounds.  There's no state to carry from one number
+ to the next, so the numbers for any (key, counter) can be generated on any
+ thread in any order and always come out the same.  That is what makes the
+ engine's randomized results independent of the number of threads and of
+ how the work stealing happened to split up the tasks.
+
+ The key picks an independent stream, typically a user seed and a window.
+ The upper three words of the counter are set by the caller, typically to
+ the indices of the thing being randomized, and the lowest word counts the
+ blocks of numbers drawn from it.
+
+ Usage:
+ PhiloxRNG rng(seed, stream, neuron, surrogate);
+ double u = rng.uniform();
+*******************************************************************************/
+class PhiloxRNG
+{
+public:
+    PhiloxRNG(uint32_t key0, uint32_t key1, uint32_t c1, uint32_t c2 = 0, uint32_t c3 = 0)
+        : m_Next(4)
+    {
+        m_Key[0] = key0;
+        m_Key[1] = key1;
+        m_Counter[0] = 0;
+        m_Counter[1] = c1;
+        m_Counter[2] = c2;
+        m_Counter[3] = c3;
+    }
+
+    // Next 32 random bits.
+    uint32_t next()
+    {
+        if (m_Next == 4) {
+            generate();
+            m_Next = 0;
+        }
+        return m_Block[m_Next++];
+    }
+
+    // Uniform double in [0, 1) with 53 random bits.
+    double uniform()
+    {
+        uint64_t hi = next() >> 5;
+        uint64_t lo = next() >> 6;
+        return (double)(hi * 67108864 + lo) * (1.0 / 9007199254740992.0);
+    }
+
+    // Uniform integer in [0, n), n > 0.
+    uint32_t below(uint32_t n)
+    {
+        // Lemire's multiply and shift, rejecting the few values that would
+        // make the result biased.
+        uint64_t m = (uint64_t)next() * n;
+        uint32_t low = (uint32_t)m;
+        if (low < n) {
+            uint32_t threshold = (uint32_t)(-n) % n;
+            while (low < threshold) {
+                m = (uint64_t)next() * n;
+                low = (uint32_t)m;
+            }
+        }
+        return (uint32_t)(m >> 32);
+    }
+
+private:
+    void generate()
+    {
+        uint32_t c[4] = {m_Counter[0], m_Counter[1], m_Counter[2], m_Counter[3]};
+        uint32_t k[2] = {m_Key[0], m_Key[1]};
+
+        for (int round = 0; round < 10; round++) {
+            uint64_t p0 = (uint64_t)0xD2511F53 * c[0];
+            uint64_t p1 = (uint64_t)0xCD9E8D57 * c[2];
+            uint32_t next[4] = {
+                (uint32_t)(p1 >> 32) ^ c[1] ^ k[0],
+                (uint32_t)p1,
+                (uint32_t)(p0 >> 32) ^ c[3] ^ k[1],
+                (uint32_t)p0
+            };
+            c[0] = next[0];
+            c[1] = next[1];
+            c[2] = next[2];
+            c[3] = next[3];
+            k[0] += 0x9E3779B9;
+            k[1] += 0xBB67AE85;
+        }
+
+        m_Block[0] = c[0];
+        m_Block[1] = c[1];
+        m_Block[2] = c[2];
+        m_Block[3] = c[3];
+        m_Counter[0]++;
+    }
+
+    uint32_t m_Key[2];
+    uint32_t m_Counter[4];
+    uint32_t m_Block[4];
+    int m_Next;
+};
+
+#endif
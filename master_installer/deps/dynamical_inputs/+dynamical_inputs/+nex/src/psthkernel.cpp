@@ -0,0 +1,77 @@
+#include "psthkernel.h"
+
+#include <algorithm>
+#include <cmath>
+
+
+size_t PSTHOptions::numBins() const
+{
+    // Allow for the trial length being a multiple of the width that isn't
+    // exact in floating point.
+    return (size_t)std::ceil((preTime + postTime) / binWidth - 1e-9);
+}
+
+
+// Index range of the spikes of a train in one trial.
+static IndexRange trialRange(SpikeTrain train, double trigger, const PSTHOptions &options)
+{
+    IndexRange r;
+    r.first = std::lower_bound(train.t, train.t + train.n, trigger - options.preTime) - train.t;
+    r.last = std::lower_bound(train.t + r.first, train.t + train.n, trigger + options.postTime) - train.t;
+    return r;
+}
+
+
+void countTrialSpikes(const std::vector<SpikeTrain> &trains, const double *triggers,
+                      size_t nTriggers, const PSTHOptions &options, uint64_t *offsets,
+                      ThreadPool &pool)
+{
+    size_t nNeurons = trains.size();
+
+    offsets[0] = 0;
+    pool.parallelFor(nNeurons, 1, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) {
+            for (size_t k = 0; k < nTriggers; k++) {
+                IndexRange r = trialRange(trains[i], triggers[k], options);
+                offsets[k + nTriggers*i + 1] = r.last - r.first;
+            }
+        }
+    });
+
+    for (size_t r = 1; r <= nTriggers * nNeurons; r++) {
+        offsets[r] += offsets[r - 1];
+    }
+}
+
+
+void fillTrialSpikes(const std::vector<SpikeTrain> &trains, const double *triggers,
+                     size_t nTriggers, const PSTHOptions &options, const uint64_t *offsets,
+                     double *values, double *counts, ThreadPool &pool)
+{
+    size_t nNeurons = trains.size();
+    size_t nBins = options.numBins();
+
+    pool.parallelFor(nNeurons, 1, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) {
+            SpikeTrain train = trains[i];
+            double *psth = counts + nBins*i;
+            std::fill(psth, psth + nBins, 0.0);
+
+            for (size_t k = 0; k < nTriggers; k++) {
+                size_t row = k + nTriggers*i;
+                double *out = values + offsets[row];
+                IndexRange r = trialRange(train, triggers[k], options);
+
+                for (size_t m = r.first; m < r.last; m++) {
+                    double t = train.t[m] - triggers[k];
+                    out[m - r.first] = t;
+
+                    // Rounding can put a spike at the very start of the
+                    // trial just below zero.
+                    size_t bin = (size_t)std::max(0.0, (t + options.preTime) / options.binWidth);
+                    psth[std::min(bin, nBins - 1)] += 1.0;
+                }
+            }
+        }
+    });
+}
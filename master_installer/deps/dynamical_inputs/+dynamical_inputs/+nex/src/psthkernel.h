@@ -0,0 +1,72 @@
+#ifndef PSTHKERNEL_H
+#define PSTHKERNEL_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "spiketrains.h"
+#include "threadpool.h"
+
+struct PSTHOptions
+{
+    // Each trial covers trigger - preTime <= s < trigger + postTime. (s)
+    double preTime;
+    double postTime;
+
+    // Width of the PSTH bins, starting at -preTime.  The last bin is cut
+    // short if the trial length isn't a multiple of it. (s)
+    double binWidth;
+
+    size_t numBins() const;
+};
+
+
+/*******************************************************************************
+ countTrialSpikes - Counts the spikes of every neuron in every trial.
+
+ Syntax:
+ countTrialSpikes(const std::vector<SpikeTrain> &trains, const double *triggers,
+                  size_t nTriggers, const PSTHOptions &options, uint64_t *offsets,
+                  ThreadPool &pool)
+
+ Description:
+ First of the two passes that build the raster in compressed sparse row
+ form.  Row r = trial + nTriggers*neuron holds the spikes of one neuron in
+ one trial.  Each row is found with two binary searches, so the triggers
+ don't have to be sorted, and the neurons are spread over the thread pool.
+
+ Input:
+ trains - Sorted spike trains.
+ triggers - Trigger times, one per trial. (s)
+ options - Trial window.
+
+ Output:
+ offsets - Preallocated nTriggers*nNeurons + 1 row offsets.  The spikes of
+     row r are values[offsets[r]] to values[offsets[r+1] - 1].
+*******************************************************************************/
+void countTrialSpikes(const std::vector<SpikeTrain> &trains, const double *triggers,
+                      size_t nTriggers, const PSTHOptions &options, uint64_t *offsets,
+                      ThreadPool &pool);
+
+
+/*******************************************************************************
+ fillTrialSpikes - Fills in the raster and the PSTH of every neuron.
+
+ Syntax:
+ fillTrialSpikes(const std::vector<SpikeTrain> &trains, const double *triggers,
+                 size_t nTriggers, const PSTHOptions &options, const uint64_t *offsets,
+                 double *values, double *counts, ThreadPool &pool)
+
+ Description:
+ Second pass, once the caller has allocated values to the size given by
+ the offsets from countTrialSpikes.
+
+ Output:
+ values - Spike times relative to each row's trigger, in row order. (s)
+ counts - Preallocated nBins x nNeurons spike counts, summed over trials.
+*******************************************************************************/
+void fillTrialSpikes(const std::vector<SpikeTrain> &trains, const double *triggers,
+                     size_t nTriggers, const PSTHOptions &options, const uint64_t *offsets,
+                     double *values, double *counts, ThreadPool &pool);
+
+#endif
@@ -0,0 +1,375 @@
+#include "resultstore.h"
+
+#include <cstring>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static const char RESULT_STORE_MAGIC[8] = {'N', 'E', 'X', 'A', 'M', 'D', 'R', '\0'};
+static const uint32_t RESULT_STORE_VERSION = 1;
+
+
+static inline uint64_t roundUp8(uint64_t n)
+{
+    return (n + 7) & ~(uint64_t)7;
+}
+
+
+// Offsets within a window's block of its stats and of each of its
+// matrices, and the size of the whole block.
+struct BlockLayout
+{
+    uint64_t stats;
+    uint64_t matrices[NUM_RESULT_MATRICES];
+    uint64_t size;
+};
+
+static BlockLayout blockLayout(uint64_t n, uint32_t valueBytes, uint32_t flags)
+{
+    BlockLayout layout;
+    layout.stats = roundUp8(4 * n);
+    uint64_t offset = layout.stats + 32 * n;
+    for (int m = 0; m < NUM_RESULT_MATRICES; m++) {
+        layout.matrices[m] = offset;
+        if (flags & (1u << m)) {
+            offset += roundUp8(n * n * valueBytes);
+        }
+    }
+    layout.size = offset;
+    return layout;
+}
+
+
+ResultStoreWriter::ResultStoreWriter()
+    : m_File(NULL), m_Offset(0)
+{
+    std::memset(&m_Header, 0, sizeof(m_Header));
+}
+
+
+ResultStoreWriter::~ResultStoreWriter()
+{
+    if (m_File != NULL) {
+        fclose(m_File);
+    }
+}
+
+
+bool ResultStoreWriter::write(const void *data, size_t nBytes)
+{
+    if (nBytes > 0 && fwrite(data, 1, nBytes, m_File) != nBytes) {
+        return false;
+    }
+    m_Offset += nBytes;
+    return true;
+}
+
+
+bool ResultStoreWriter::pad()
+{
+    static const char zeros[8] = {0};
+    return write(zeros, (size_t)(roundUp8(m_Offset) - m_Offset));
+}
+
+
+const char *ResultStoreWriter::open(const char *fileName, uint32_t valueBytes)
+{
+    if (valueBytes != 4 && valueBytes != 8) {
+        return "Values must be 4 or 8 bytes.";
+    }
+
+    m_File = fopen(fileName, "wb");
+    if (m_File == NULL) {
+        return "Failed to create the file.";
+    }
+
+    std::memcpy(m_Header.magic, RESULT_STORE_MAGIC, sizeof(m_Header.magic));
+    m_Header.version = RESULT_STORE_VERSION;
+    m_Header.valueBytes = valueBytes;
+    m_Offset = 0;
+    m_Index.clear();
+
+    // Written again with the offsets filled in by close().
+    if (!write(&m_Header, sizeof(m_Header))) {
+        return "Failed to write the header.";
+    }
+
+    return NULL;
+}
+
+
+const char *ResultStoreWriter::addWindow(ResultWindowEntry entry, const uint32_t *neurons,
+                                         const double *stats, const ResultMatrixData *matrices)
+{
+    if (m_File == NULL) {
+        return "The file isn't open.";
+    }
+
+    size_t n = entry.nNeurons;
+    entry.dataOffset = m_Offset;
+
+    if (!write(neurons, 4 * n) || !pad() || !write(stats, 32 * n)) {
+        return "Failed to write the window.";
+    }
+
+    size_t nValues = n * n;
+    for (int m = 0; m < NUM_RESULT_MATRICES; m++) {
+        if (!(entry.matrixFlags & (1u << m))) {
+            continue;
+        }
+
+        const ResultMatrixData &matrix = matrices[m];
+        bool isSame = matrix.isSingle == (m_Header.valueBytes == 4);
+        const void *values = matrix.values;
+        if (!isSame) {
+            m_Buffer.resize(nValues * m_Header.valueBytes);
+            if (matrix.isSingle) {
+                const float *from = (const float*)matrix.values;
+                double *to = (double*)m_Buffer.data();
+                for (size_t k = 0; k < nValues; k++) {
+                    to[k] = (double)from[k];
+                }
+            }
+            else {
+                const double *from = (const double*)matrix.values;
+                float *to = (float*)m_Buffer.data();
+                for (size_t k = 0; k < nValues; k++) {
+                    to[k] = (float)from[k];
+                }
+            }
+            values = m_Buffer.data();
+        }
+
+        if (!write(values, nValues * m_Header.valueBytes) || !pad()) {
+            return "Failed to write the window.";
+        }
+    }
+
+    m_Index.push_back(entry);
+
+    return NULL;
+}
+
+
+const char *ResultStoreWriter::close(const std::vector<std::string> &names,
+                                     const std::vector<uint32_t> &cellIDs)
+{
+    if (m_File == NULL) {
+        return "The file isn't open.";
+    }
+    if (names.size() != cellIDs.size()) {
+        return "There must be a cell ID per neuron name.";
+    }
+
+    size_t nNeurons = names.size();
+    std::vector<uint64_t> nameOffsets(nNeurons + 1, 0);
+    for (size_t i = 0; i < nNeurons; i++) {
+        nameOffsets[i + 1] = nameOffsets[i] + names[i].size();
+    }
+
+    bool isWritten = true;
+    m_Header.dictionaryOffset = m_Offset;
+    isWritten = isWritten && write(cellIDs.data(), 4 * nNeurons) && pad();
+    isWritten = isWritten && write(nameOffsets.data(), 8 * (nNeurons + 1));
+    for (size_t i = 0; i < nNeurons && isWritten; i++) {
+        isWritten = write(names[i].data(), names[i].size());
+    }
+    isWritten = isWritten && pad();
+
+    m_Header.indexOffset = m_Offset;
+    isWritten = isWritten && write(m_Index.data(), sizeof(ResultWindowEntry) * m_Index.size());
+
+    m_Header.nNeurons = nNeurons;
+    m_Header.nWindows = m_Index.size();
+    isWritten = isWritten && fseek(m_File, 0, SEEK_SET) == 0 &&
+                fwrite(&m_Header, sizeof(m_Header), 1, m_File) == 1;
+
+    isWritten = !ferror(m_File) && isWritten;
+    isWritten = fclose(m_File) == 0 && isWritten;
+    m_File = NULL;
+
+    return isWritten ? NULL : "Failed to write the index.";
+}
+
+
+ResultStoreReader::ResultStoreReader()
+    : m_Data(NULL), m_Size(0),
+#ifdef _WIN32
+      m_File(INVALID_HANDLE_VALUE), m_Mapping(NULL)
+#else
+      m_File(-1)
+#endif
+{
+    std::memset(&m_Header, 0, sizeof(m_Header));
+}
+
+
+ResultStoreReader::~ResultStoreReader()
+{
+    close();
+}
+
+
+void ResultStoreReader::close()
+{
+#ifdef _WIN32
+    if (m_Data != NULL) {
+        UnmapViewOfFile(m_Data);
+    }
+    if (m_Mapping != NULL) {
+        CloseHandle(m_Mapping);
+    }
+    if (m_File != INVALID_HANDLE_VALUE) {
+        CloseHandle(m_File);
+    }
+    m_Mapping = NULL;
+    m_File = INVALID_HANDLE_VALUE;
+#else
+    if (m_Data != NULL) {
+        munmap((void*)m_Data, (size_t)m_Size);
+    }
+    if (m_File >= 0) {
+        ::close(m_File);
+    }
+    m_File = -1;
+#endif
+    m_Data = NULL;
+    m_Size = 0;
+}
+
+
+const char *ResultStoreReader::open(const char *fileName)
+{
+    close();
+
+#ifdef _WIN32
+    m_File = CreateFileA(fileName, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+                         FILE_ATTRIBUTE_NORMAL, NULL);
+    if (m_File == INVALID_HANDLE_VALUE) {
+        return "Failed to open file.";
+    }
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(m_File, &size)) {
+        close();
+        return "Failed to open file.";
+    }
+    m_Size = (uint64_t)size.QuadPart;
+    if (m_Size >= sizeof(ResultStoreHeader)) {
+        m_Mapping = CreateFileMappingA(m_File, NULL, PAGE_READONLY, 0, 0, NULL);
+        m_Data = m_Mapping == NULL ? NULL :
+                 (const unsigned char*)MapViewOfFile(m_Mapping, FILE_MAP_READ, 0, 0, 0);
+        if (m_Data == NULL) {
+            close();
+            return "Failed to map the file.";
+        }
+    }
+#else
+    m_File = ::open(fileName, O_RDONLY);
+    if (m_File < 0) {
+        return "Failed to open file.";
+    }
+    struct stat info;
+    if (fstat(m_File, &info) != 0) {
+        close();
+        return "Failed to open file.";
+    }
+    m_Size = (uint64_t)info.st_size;
+    if (m_Size >= sizeof(ResultStoreHeader)) {
+        void *data = mmap(NULL, (size_t)m_Size, PROT_READ, MAP_SHARED, m_File, 0);
+        if (data == MAP_FAILED) {
+            m_Size = 0;
+            close();
+            return "Failed to map the file.";
+        }
+        m_Data = (const unsigned char*)data;
+    }
+#endif
+
+    if (m_Size < sizeof(ResultStoreHeader)) {
+        close();
+        return "Not an AMD result file.";
+    }
+    std::memcpy(&m_Header, m_Data, sizeof(m_Header));
+    if (std::memcmp(m_Header.magic, RESULT_STORE_MAGIC, sizeof(m_Header.magic)) != 0) {
+        close();
+        return "Not an AMD result file.";
+    }
+    if (m_Header.version != RESULT_STORE_VERSION ||
+        (m_Header.valueBytes != 4 && m_Header.valueBytes != 8)) {
+        close();
+        return "Unsupported AMD result file version.";
+    }
+
+    // The dictionary and index have to fit in the file, and so does every
+    // window they point to, so the accessors never need to check.
+    uint64_t nNeurons = m_Header.nNeurons;
+    uint64_t nWindows = m_Header.nWindows;
+    uint64_t namesOffset = m_Header.dictionaryOffset + roundUp8(4 * nNeurons);
+    if (nNeurons > m_Size || nWindows > m_Size ||
+        m_Header.dictionaryOffset > m_Size || namesOffset + 8 * (nNeurons + 1) > m_Size ||
+        m_Header.indexOffset > m_Size ||
+        m_Size - m_Header.indexOffset < nWindows * sizeof(ResultWindowEntry)) {
+        close();
+        return "The AMD result file is truncated.";
+    }
+
+    const uint32_t *cellIDs = (const uint32_t*)(m_Data + m_Header.dictionaryOffset);
+    const uint64_t *nameOffsets = (const uint64_t*)(m_Data + namesOffset);
+    const char *characters = (const char*)(m_Data + namesOffset + 8 * (nNeurons + 1));
+    uint64_t nCharacters = m_Size - (namesOffset + 8 * (nNeurons + 1));
+    m_CellIDs.assign(cellIDs, cellIDs + nNeurons);
+    m_Names.resize((size_t)nNeurons);
+    for (size_t i = 0; i < nNeurons; i++) {
+        if (nameOffsets[i] > nameOffsets[i + 1] || nameOffsets[i + 1] > nCharacters) {
+            close();
+            return "The AMD result file is truncated.";
+        }
+        m_Names[i].assign(characters + nameOffsets[i], (size_t)(nameOffsets[i + 1] - nameOffsets[i]));
+    }
+
+    const ResultWindowEntry *index = (const ResultWindowEntry*)(m_Data + m_Header.indexOffset);
+    m_Index.assign(index, index + nWindows);
+    for (size_t i = 0; i < m_Index.size(); i++) {
+        const ResultWindowEntry &entry = m_Index[i];
+        BlockLayout layout = blockLayout(entry.nNeurons, m_Header.valueBytes, entry.matrixFlags);
+        if (entry.dataOffset % 8 != 0 || entry.dataOffset > m_Size ||
+            m_Size - entry.dataOffset < layout.size) {
+            close();
+            return "The AMD result file is truncated.";
+        }
+    }
+
+    return NULL;
+}
+
+
+const uint32_t *ResultStoreReader::neurons(size_t i) const
+{
+    return (const uint32_t*)(m_Data + m_Index[i].dataOffset);
+}
+
+
+const double *ResultStoreReader::stats(size_t i) const
+{
+    const ResultWindowEntry &entry = m_Index[i];
+    BlockLayout layout = blockLayout(entry.nNeurons, m_Header.valueBytes, entry.matrixFlags);
+    return (const double*)(m_Data + entry.dataOffset + layout.stats);
+}
+
+
+const void *ResultStoreReader::matrix(size_t i, ResultMatrix m) const
+{
+    const ResultWindowEntry &entry = m_Index[i];
+    if (!(entry.matrixFlags & (1u << m))) {
+        return NULL;
+    }
+    BlockLayout layout = blockLayout(entry.nNeurons, m_Header.valueBytes, entry.matrixFlags);
+    return m_Data + entry.dataOffset + layout.matrices[m];
+}
@@ -0,0 +1,186 @@
+#ifndef RESULTSTORE_H
+#define RESULTSTORE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// AMD result files hold the windows of an AMD run in a form that can be read
+// a window at a time without parsing the rest of the file.  Everything is
+// little endian:
+//
+//   ResultStoreHeader
+//   one block per window, 8 byte aligned:
+//       uint32 neuron indices into the dictionary, padded to 8 bytes
+//       n x 4 double stats: nSpikes, ISImean, ISIstd, Poisson, column major
+//       n x n matrices, float or double, for each bit set in the window's
+//           matrix flags, in ResultMatrix order
+//   the neuron dictionary:
+//       uint32 cell IDs, then nNeurons + 1 uint64 name offsets, then the
+//       name characters
+//   ResultWindowEntry index, one per window
+//
+// The dictionary and index go at the end so the windows can be written as
+// they're made, with only the header patched once they're all written.
+
+// The matrices a window can hold, as bits of ResultWindowEntry::matrixFlags.
+enum ResultMatrix
+{
+    ResultAMD = 0,
+    ResultZScore,
+    ResultPValue,
+    ResultPercentile,
+    NUM_RESULT_MATRICES
+};
+
+struct ResultStoreHeader
+{
+    char magic[8];
+    uint32_t version;
+
+    // 4 if the matrices are stored as float, 8 for double.
+    uint32_t valueBytes;
+
+    uint64_t nNeurons;
+    uint64_t nWindows;
+    uint64_t dictionaryOffset;
+    uint64_t indexOffset;
+};
+
+struct ResultWindowEntry
+{
+    // Same as the AMDWindow properties. (s)
+    double windowStart;
+    double windowEnd;
+    double timeMin;
+    double timeMax;
+    double timeDiff;
+    double minSpikeCount;
+
+    // Where the window's block starts.
+    uint64_t dataOffset;
+
+    uint32_t nNeurons;
+    uint32_t matrixFlags;
+};
+
+// A matrix passed to the writer, in either precision.
+struct ResultMatrixData
+{
+    const void *values;
+    bool isSingle;
+};
+
+
+/*******************************************************************************
+ ResultStoreWriter - Writes an AMD result file a window at a time.
+
+ Usage:
+ ResultStoreWriter writer;
+ writer.open(fileName, 4);
+ for each window: writer.addWindow(entry, neurons, stats, matrices);
+ writer.close(names, cellIDs);
+
+ Matrices are converted to the file's precision as they're written.  A
+ file that was never closed has no index and won't open for reading.
+*******************************************************************************/
+class ResultStoreWriter
+{
+public:
+    ResultStoreWriter();
+    ~ResultStoreWriter();
+
+    // valueBytes is 4 to store the matrices as float or 8 for double.
+    const char *open(const char *fileName, uint32_t valueBytes);
+
+    // Adds a window.  entry's nNeurons and matrixFlags say what's passed;
+    // its data offset is filled in.  neurons are 0 based dictionary
+    // indices, stats is nNeurons x 4 and matrices[m] is only read if bit m
+    // of the flags is set.
+    const char *addWindow(ResultWindowEntry entry, const uint32_t *neurons, const double *stats,
+                          const ResultMatrixData *matrices);
+
+    // Writes the neuron dictionary and the window index and closes the file.
+    const char *close(const std::vector<std::string> &names, const std::vector<uint32_t> &cellIDs);
+
+private:
+    ResultStoreWriter(const ResultStoreWriter &);
+    ResultStoreWriter &operator=(const ResultStoreWriter &);
+
+    bool write(const void *data, size_t nBytes);
+    bool pad();
+
+    FILE *m_File;
+    uint64_t m_Offset;
+    ResultStoreHeader m_Header;
+    std::vector<ResultWindowEntry> m_Index;
+    std::vector<char> m_Buffer;
+};
+
+
+/*******************************************************************************
+ ResultStoreReader - Memory maps an AMD result file for random access.
+
+ Description:
+ open() maps the file and checks the header, dictionary and index, but
+ reads none of the windows; their pages are only read from disk when a
+ window is asked for, so loading a few windows of a large run costs about
+ what those windows take up.  The pointers handed out point straight into
+ the mapping and are valid until the reader is closed.
+
+ Usage:
+ ResultStoreReader reader;
+ if (reader.open(fileName) == NULL) {
+     const ResultWindowEntry &entry = reader.window(i);
+     const uint32_t *neurons = reader.neurons(i);
+     const void *amd = reader.matrix(i, ResultAMD);
+ }
+*******************************************************************************/
+class ResultStoreReader
+{
+public:
+    ResultStoreReader();
+    ~ResultStoreReader();
+
+    const char *open(const char *fileName);
+
+    const ResultStoreHeader &header() const { return m_Header; }
+    size_t numWindows() const { return m_Index.size(); }
+    const ResultWindowEntry &window(size_t i) const { return m_Index[i]; }
+    const std::vector<std::string> &names() const { return m_Names; }
+    const std::vector<uint32_t> &cellIDs() const { return m_CellIDs; }
+
+    // The dictionary indices of the neurons of window i.  They're only
+    // checked against the dictionary when used, so that opening a file
+    // doesn't touch the windows.
+    const uint32_t *neurons(size_t i) const;
+    const double *stats(size_t i) const;
+
+    // The n x n matrix m of window i, or NULL if the window doesn't have it.
+    // Its elements are float or double as header().valueBytes says.
+    const void *matrix(size_t i, ResultMatrix m) const;
+
+private:
+    ResultStoreReader(const ResultStoreReader &);
+    ResultStoreReader &operator=(const ResultStoreReader &);
+
+    void close();
+
+    const unsigned char *m_Data;
+    uint64_t m_Size;
+#ifdef _WIN32
+    void *m_File;
+    void *m_Mapping;
+#else
+    int m_File;
+#endif
+
+    ResultStoreHeader m_Header;
+    std::vector<ResultWindowEntry> m_Index;
+    std::vector<std::string> m_Names;
+    std::vector<uint32_t> m_CellIDs;
+};
+
+#endif
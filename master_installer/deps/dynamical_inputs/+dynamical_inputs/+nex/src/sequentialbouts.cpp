@@ -0,0 +1,66 @@
+#include "sequentialbouts.h"
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+// Exponent bits of a double.
+static const uint64_t EXPONENT_MASK = 0x7ff0000000000000ULL;
+
+// 2^-52, eps(1).
+static const double EPS_SCALE = 2.220446049250313e-16;
+
+
+// MATLAB's eps(x) of a finite, normal, non-negative x: the power of 2 at or
+// below x, scaled by eps(1).  Inf and NaN give Inf and NaN, which make the
+// comparisons below fail as they should.
+static inline double epsOf(double x)
+{
+    uint64_t bits;
+    std::memcpy(&bits, &x, sizeof(bits));
+    bits &= EXPONENT_MASK;
+    double power;
+    std::memcpy(&power, &bits, sizeof(power));
+    return power * EPS_SCALE;
+}
+
+
+void averageSequentialBouts(const double *time, const double *data, size_t n, double boutLength,
+                            BoutAverages &bouts)
+{
+    bouts.starts.clear();
+    bouts.stops.clear();
+    bouts.averages.clear();
+    if (n == 0) {
+        return;
+    }
+
+    // isBreak[i] is 1 if sample i starts a new run.  Kept as bytes so the
+    // loop stays branch free.
+    std::vector<uint8_t> isBreak(n);
+    isBreak[0] = 1;
+    double absBoutLength = std::fabs(boutLength);
+    for (size_t i = 1; i < n; i++) {
+        double step = time[i] - time[i - 1];
+        double largest = std::fabs(step) > absBoutLength ? std::fabs(step) : absBoutLength;
+        isBreak[i] = !(std::fabs(step - boutLength) <= epsOf(largest));
+    }
+
+    // The run label of sample i is the prefix sum of isBreak, so each run
+    // is reduced as the label ticks over.
+    size_t first = 0;
+    double sum = 0.0;
+    for (size_t i = 0; i <= n; i++) {
+        if (i == n || (i > 0 && isBreak[i])) {
+            bouts.starts.push_back(time[first]);
+            bouts.stops.push_back(time[i - 1]);
+            bouts.averages.push_back(sum / (double)(i - first));
+            if (i == n) {
+                break;
+            }
+            first = i;
+            sum = 0.0;
+        }
+        sum += data[i];
+    }
+}
@@ -0,0 +1,47 @@
+#ifndef SEQUENTIALBOUTS_H
+#define SEQUENTIALBOUTS_H
+
+#include <cstddef>
+#include <vector>
+
+// Runs of equally spaced samples of a time series and their averages, one
+// entry per run.
+struct BoutAverages
+{
+    std::vector<double> starts;
+    std::vector<double> stops;
+    std::vector<double> averages;
+};
+
+
+/*******************************************************************************
+ averageSequentialBouts - Averages the runs of a time series sampled at a
+                          fixed step.
+
+ Syntax:
+ void averageSequentialBouts(const double *time, const double *data, size_t n,
+                             double boutLength, BoutAverages &bouts)
+
+ Description:
+ A sample continues the run of the one before it if the time between them
+ equals boutLength to within eps of the larger of the two, the same test
+ as dynamical.util.averagesequentialbouts.  The test is made on all the
+ samples at once in a branch free loop the compiler can vectorize, with
+ eps worked out from the exponent bits rather than by calling nextafter,
+ leaving a flag per sample.  The running sum of the flags labels the runs,
+ and a second pass sums each run as its label ticks over, so the whole
+ thing is O(n) however long the runs are.
+
+ Input:
+ time - n ascending sample times.
+ data - n values.
+ boutLength - Step between the samples of a run.
+
+ Output:
+ bouts - Overwritten with the first and last time and the mean value of
+     each run, in time order.
+*******************************************************************************/
+void averageSequentialBouts(const double *time, const double *data, size_t n, double boutLength,
+                            BoutAverages &bouts);
+
+#endif
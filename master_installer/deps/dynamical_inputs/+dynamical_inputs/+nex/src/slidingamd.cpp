@@ -0,0 +1,263 @@
+#include "slidingamd.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+
+/*******************************************************************************
+ diffRanges - Applies the difference between two index ranges.
+
+ Description:
+ Calls update(k, -1) for every index in [a0, b0) that isn't in [a1, b1) and
+ update(k, 1) for every index in [a1, b1) that isn't in [a0, b0).  If the
+ ranges don't overlap, reset() is called instead of removing the old range
+ one index at a time, then the new range is added.
+*******************************************************************************/
+template <typename Update, typename Reset>
+static void diffRanges(size_t a0, size_t b0, size_t a1, size_t b1, Update update, Reset reset)
+{
+    if (a0 >= b0 || a1 >= b1 || a1 >= b0 || b1 <= a0) {
+        reset();
+        for (size_t k = a1; k < b1; k++) {
+            update(k, 1.0);
+        }
+        return;
+    }
+
+    // Front of the window.
+    for (size_t k = a0; k < a1; k++) {
+        update(k, -1.0);
+    }
+    for (size_t k = a1; k < a0; k++) {
+        update(k, 1.0);
+    }
+
+    // Back of the window.
+    for (size_t k = b1; k < b0; k++) {
+        update(k, -1.0);
+    }
+    for (size_t k = b0; k < b1; k++) {
+        update(k, 1.0);
+    }
+}
+
+
+// The ISIs of the spikes [a, b) are the ISIs [a+1, b), where ISI k is
+// t[k] - t[k-1].
+static void isiRange(size_t a, size_t b, size_t &isiA, size_t &isiB)
+{
+    if (b > a + 1) {
+        isiA = a + 1;
+        isiB = b;
+    }
+    else {
+        isiA = isiB = 0;
+    }
+}
+
+
+SlidingAMD::SlidingAMD(const std::vector<SpikeTrain> &trains, const std::vector<Interval> &intervals)
+{
+    size_t n = trains.size();
+    const double inf = std::numeric_limits<double>::infinity();
+
+    // Apply the intervals once.  From here on every window is a contiguous
+    // range of each masked train.
+    m_Trains.resize(n);
+    std::vector<IndexRange> ranges;
+    for (size_t i = 0; i < n; i++) {
+        selectSpikeRanges(trains[i], intervals, -inf, inf, ranges);
+        for (size_t r = 0; r < ranges.size(); r++) {
+            m_Trains[i].insert(m_Trains[i].end(), trains[i].t + ranges[r].first, trains[i].t + ranges[r].last);
+        }
+    }
+
+    m_First.assign(n, 0);
+    m_Last.assign(n, 0);
+    m_PairSums.resize(n * n);
+    m_ISI2.resize(n);
+    m_ISI3.resize(n);
+}
+
+
+double SlidingAMD::nearestDistance(double t, size_t j) const
+{
+    const std::vector<double> &s = m_Trains[j];
+
+    std::vector<double>::const_iterator next = std::lower_bound(s.begin(), s.end(), t);
+
+    double d = std::numeric_limits<double>::infinity();
+    if (next != s.end()) {
+        d = *next - t;
+    }
+    if (next != s.begin()) {
+        d = std::min(d, t - *(next - 1));
+    }
+
+    return d;
+}
+
+
+void SlidingAMD::updatePairSums(size_t i, size_t k, double sign)
+{
+    size_t n = m_Trains.size();
+    double t = m_Trains[i][k];
+
+    for (size_t j = 0; j < n; j++) {
+        // Neurons without any spikes never produce a valid AMD, so there's
+        // nothing to keep track of.
+        if (j == i || m_Trains[j].empty()) {
+            continue;
+        }
+        m_PairSums[i*n + j].add(sign * nearestDistance(t, j));
+    }
+}
+
+
+void SlidingAMD::updateISISums(size_t i, size_t k, double sign)
+{
+    const std::vector<double> &s = m_Trains[i];
+    double d = s[k] - s[k-1];
+    double d2 = d * d;
+
+    m_ISI2[i].add(sign * d2);
+    m_ISI3[i].add(sign * d2 * d);
+}
+
+
+void SlidingAMD::advance(double windowStart, double windowEnd, ThreadPool &pool)
+{
+    size_t n = m_Trains.size();
+
+    // Each neuron only touches its own row of pair sums and its own ISI sums,
+    // so the neurons can be updated in parallel.
+    pool.parallelFor(n, 1, [&](size_t iBegin, size_t iEnd) {
+        for (size_t i = iBegin; i < iEnd; i++) {
+            const std::vector<double> &s = m_Trains[i];
+            size_t a1 = std::lower_bound(s.begin(), s.end(), windowStart) - s.begin();
+            size_t b1 = std::lower_bound(s.begin() + a1, s.end(), windowEnd) - s.begin();
+            size_t a0 = m_First[i];
+            size_t b0 = m_Last[i];
+
+            diffRanges(a0, b0, a1, b1,
+                [&](size_t k, double sign) { updatePairSums(i, k, sign); },
+                [&]() {
+                    for (size_t j = 0; j < n; j++) {
+                        m_PairSums[i*n + j].reset();
+                    }
+                });
+
+            size_t isiA0, isiB0, isiA1, isiB1;
+            isiRange(a0, b0, isiA0, isiB0);
+            isiRange(a1, b1, isiA1, isiB1);
+            diffRanges(isiA0, isiB0, isiA1, isiB1,
+                [&](size_t k, double sign) { updateISISums(i, k, sign); },
+                [&]() {
+                    m_ISI2[i].reset();
+                    m_ISI3[i].reset();
+                });
+
+            m_First[i] = a1;
+            m_Last[i] = b1;
+        }
+    });
+}
+
+
+template <typename T>
+void SlidingAMD::emit(const std::vector<size_t> &neurons, T *amd, T *zscore,
+                      WindowStats &window, std::vector<NeuronStats> &stats, ThreadPool &pool) const
+{
+    const double nan = std::numeric_limits<double>::quiet_NaN();
+    size_t n = m_Trains.size();
+    size_t k = neurons.size();
+
+    // Time span of the emitted neurons.
+    window.timeMin = nan;
+    window.timeMax = nan;
+    for (size_t p = 0; p < k; p++) {
+        size_t i = neurons[p];
+        if (m_Last[i] <= m_First[i]) {
+            continue;
+        }
+        double first = m_Trains[i][m_First[i]];
+        double last = m_Trains[i][m_Last[i] - 1];
+        if (!(first >= window.timeMin)) {
+            window.timeMin = first;
+        }
+        if (!(last <= window.timeMax)) {
+            window.timeMax = last;
+        }
+    }
+    window.timeDiff = window.timeMax - window.timeMin;
+
+    // Neuron stats from the running ISI sums.
+    stats.resize(k);
+    for (size_t p = 0; p < k; p++) {
+        size_t i = neurons[p];
+        size_t nSpikes = m_Last[i] - m_First[i];
+
+        if (nSpikes == 0) {
+            finishNeuronStats(0, 0.0, 0.0, 0.0, 0.0, window.timeDiff, stats[p]);
+            continue;
+        }
+
+        double c1 = m_Trains[i][m_First[i]] - window.timeMin;
+        double c2 = window.timeMax - m_Trains[i][m_Last[i] - 1];
+        finishNeuronStats(nSpikes, c1, c2, m_ISI2[i].value(), m_ISI3[i].value(),
+                          window.timeDiff, stats[p]);
+    }
+
+    // AMD and z-scores, one output row per task.
+    pool.parallelFor(k, 1, [&](size_t pBegin, size_t pEnd) {
+        for (size_t p = pBegin; p < pEnd; p++) {
+            size_t i = neurons[p];
+            const std::vector<double> &si = m_Trains[i];
+            size_t ai = m_First[i];
+            size_t bi = m_Last[i];
+
+            for (size_t q = 0; q < k; q++) {
+                size_t j = neurons[q];
+                const std::vector<double> &sj = m_Trains[j];
+                size_t aj = m_First[j];
+                size_t bj = m_Last[j];
+                double value;
+
+                if (p == q) {
+                    value = 0.0;
+                }
+                else if (ai >= bi || aj >= bj) {
+                    value = nan;
+                }
+                else {
+                    double sum = m_PairSums[i*n + j].value();
+                    double firstJ = sj[aj];
+                    double lastJ = sj[bj - 1];
+
+                    // Spikes before the first spike of j in the window have
+                    // that spike as their nearest neighbour, even if there's
+                    // a closer one of j just outside the window.  Likewise
+                    // for spikes after the last spike of j.
+                    for (size_t m = ai; m < bi && si[m] < firstJ; m++) {
+                        sum += (firstJ - si[m]) - nearestDistance(si[m], j);
+                    }
+                    for (size_t m = bi; m > ai && si[m-1] > lastJ; m--) {
+                        sum += (si[m-1] - lastJ) - nearestDistance(si[m-1], j);
+                    }
+
+                    value = sum / (double)(bi - ai);
+                }
+
+                amd[p + q*k] = (T)value;
+                zscore[p + q*k] = (T)computeZScore(value, stats[p], stats[q]);
+            }
+        }
+    });
+}
+
+
+template void SlidingAMD::emit<double>(const std::vector<size_t> &, double *, double *,
+                                       WindowStats &, std::vector<NeuronStats> &, ThreadPool &) const;
+template void SlidingAMD::emit<float>(const std::vector<size_t> &, float *, float *,
+                                      WindowStats &, std::vector<NeuronStats> &, ThreadPool &) const;
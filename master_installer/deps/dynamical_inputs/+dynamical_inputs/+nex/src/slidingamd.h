@@ -0,0 +1,134 @@
+#ifndef SLIDINGAMD_H
+#define SLIDINGAMD_H
+
+#include <vector>
+#include "spiketrains.h"
+#include "amdkernel.h"
+#include "threadpool.h"
+
+// Running sum that keeps track of the rounding error lost at each step
+// (Neumaier's variant of Kahan summation).  The sliding window adds and
+// removes the same values thousands of times, so a plain double would slowly
+// drift away from the value a full recalculation gives.
+struct CompensatedSum
+{
+    double sum;
+    double c;
+
+    CompensatedSum() : sum(0.0), c(0.0) {}
+
+    void add(double x)
+    {
+        double t = sum + x;
+        if ((sum >= 0 ? sum : -sum) >= (x >= 0 ? x : -x)) {
+            c += (sum - t) + x;
+        }
+        else {
+            c += (x - t) + sum;
+        }
+        sum = t;
+    }
+
+    double value() const { return sum + c; }
+
+    void reset() { sum = 0.0; c = 0.0; }
+};
+
+
+/*******************************************************************************
+ SlidingAMD - Incrementally updated AMD for overlapping time windows.
+
+ Description:
+ When consecutive windows overlap, most of the spikes in a window were also
+ in the previous one.  Rather than recalculating every window, SlidingAMD
+ keeps running sums that are updated only by the spikes entering and leaving
+ the window as it moves.
+
+ The intervals are applied to the spike trains once up front, so the spikes
+ of a neuron inside any window are a contiguous range of its masked train.
+ For a spike s of neuron i, let D_ij(s) be the distance from s to the nearest
+ spike of the whole masked train of neuron j.  The running sum R_ij of D_ij
+ over the spikes of i in the window only changes when spikes of i enter or
+ leave.  D_ij(s) is also the distance to the nearest spike of j inside the
+ window, except for the spikes of i that come before the first (or after the
+ last) spike of j in the window.  Those are corrected for when a window is
+ emitted, which only touches the few spikes at the window edges.
+
+ The ISI moments are kept as running sums of the squared and cubed ISIs of
+ each neuron.
+
+ Usage:
+ SlidingAMD s(trains, intervals);
+ for each window, in order of start time:
+     s.advance(windowStart, windowEnd, pool);
+     s.emit(neurons, amd, zscore, window, stats, pool);
+*******************************************************************************/
+class SlidingAMD
+{
+public:
+    SlidingAMD(const std::vector<SpikeTrain> &trains, const std::vector<Interval> &intervals);
+
+    size_t numNeurons() const { return m_Trains.size(); }
+
+    /***************************************************************************
+     advance - Moves the window to [windowStart, windowEnd).
+
+     Description:
+     Only the spikes that enter or leave the window are visited.  Windows
+     will usually be advanced in order of start time, but any window is
+     allowed.  If the new window doesn't overlap the old one, the sums are
+     simply rebuilt from the spikes of the new window.
+    ***************************************************************************/
+    void advance(double windowStart, double windowEnd, ThreadPool &pool);
+
+    /***************************************************************************
+     emit - Writes out the results of the current window.
+
+     Description:
+     Calculates the AMD, z-scores, neuron stats and window time span for a
+     subset of the neurons.  The time span only takes into account the
+     neurons in the subset, matching what a full calculation over just those
+     neurons would give.
+
+     Input:
+     neurons - Indices of the neurons to emit, in output order.
+     pool - Thread pool to run on.
+
+     Output:
+     amd, zscore - Preallocated column major k x k matrices, where k is the
+         number of neurons emitted.  T is double or float, the values are
+         only rounded when written out.
+     window - Time span of the emitted neurons' spikes.
+     stats - Resized to k and filled in.
+    ***************************************************************************/
+    template <typename T>
+    void emit(const std::vector<size_t> &neurons, T *amd, T *zscore,
+              WindowStats &window, std::vector<NeuronStats> &stats, ThreadPool &pool) const;
+
+private:
+    // Distance from t to the nearest spike of neuron j's masked train.
+    double nearestDistance(double t, size_t j) const;
+
+    // Adds (sign = 1) or removes (sign = -1) spike k of neuron i from the
+    // running pair sums of row i.
+    void updatePairSums(size_t i, size_t k, double sign);
+
+    // Adds or removes ISI k (t[k] - t[k-1]) of neuron i.
+    void updateISISums(size_t i, size_t k, double sign);
+
+    // Masked spike trains.
+    std::vector<std::vector<double> > m_Trains;
+
+    // Current window as a range [m_First[i], m_Last[i]) of each masked train.
+    std::vector<size_t> m_First;
+    std::vector<size_t> m_Last;
+
+    // Running sums of D_ij, stored row major (i*n + j).
+    std::vector<CompensatedSum> m_PairSums;
+
+    // Running sums of the squared and cubed ISIs of each neuron.
+    std::vector<CompensatedSum> m_ISI2;
+    std::vector<CompensatedSum> m_ISI3;
+};
+
+#endif
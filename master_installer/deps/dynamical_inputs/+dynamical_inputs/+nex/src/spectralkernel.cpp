@@ -0,0 +1,189 @@
+#include "spectralkernel.h"
+
+#include <complex>
+#include "continuousreader.h"
+#include "fftkernel.h"
+
+// Samples per read, at the least.  Longer windows read a window at a time.
+static const size_t SPECTRAL_CHUNK_SAMPLES = 1 << 16;
+
+
+// Cuts the fragments of a variable into segments and adds up or keeps their
+// periodograms.
+class SegmentSpectra
+{
+public:
+    SegmentSpectra(const SpectralOptions &options, const RealFFT &fft, const ContinuousLayout &layout,
+                   ChannelSpectrum &result)
+        : m_Options(options), m_FFT(fft), m_Layout(layout), m_Result(result),
+          m_Segment(options.nfft, 0.0), m_Bins(fft.numBins()), m_Sum(fft.numBins(), 0.0),
+          m_BufferStart(0), m_Fragment(layout.numFragments())
+    {
+        double windowPower = 0.0;
+        for (size_t k = 0; k < options.window.size(); k++) {
+            windowPower += options.window[k] * options.window[k];
+        }
+        m_Scale = windowPower > 0.0 ? 1.0 / (layout.sampleFrequency * windowPower) : 0.0;
+        m_Hop = options.window.size() - options.overlap;
+
+        // Spectrogram columns are known up front, so they're allocated once
+        // rather than grown.
+        if (options.isSpectrogram) {
+            size_t nSegments = 0;
+            for (size_t f = 0; f < layout.numFragments(); f++) {
+                uint64_t length = layout.fragmentEnd(f) - layout.fragmentStarts[f];
+                if (length >= options.window.size()) {
+                    nSegments += (size_t)((length - options.window.size()) / m_Hop) + 1;
+                }
+            }
+            result.power.reserve(nSegments * m_Bins.size());
+            result.times.reserve(nSegments);
+        }
+    }
+
+    void push(const ContinuousChunk &chunk)
+    {
+        if (chunk.fragment != m_Fragment) {
+            m_Fragment = chunk.fragment;
+            m_Buffer.clear();
+            m_BufferStart = chunk.firstSample;
+        }
+        m_Buffer.insert(m_Buffer.end(), chunk.samples.begin(), chunk.samples.end());
+
+        size_t length = m_Options.window.size();
+        size_t position = 0;
+        while (position + length <= m_Buffer.size()) {
+            addSegment(&m_Buffer[position], m_BufferStart + position);
+            position += m_Hop;
+        }
+
+        // Keep the samples the next segment starts at.
+        position = position < m_Buffer.size() ? position : m_Buffer.size();
+        m_Buffer.erase(m_Buffer.begin(), m_Buffer.begin() + position);
+        m_BufferStart += position;
+    }
+
+    void finish()
+    {
+        if (!m_Options.isSpectrogram) {
+            m_Result.power.resize(m_Sum.size());
+            double n = m_Result.nSegments > 0 ? (double)m_Result.nSegments : 1.0;
+            for (size_t k = 0; k < m_Sum.size(); k++) {
+                m_Result.power[k] = (float)(m_Sum[k] / n);
+            }
+        }
+    }
+
+private:
+    void addSegment(const int16_t *x, uint64_t first)
+    {
+        const std::vector<double> &window = m_Options.window;
+        double adToMV = m_Layout.adToMV;
+        for (size_t k = 0; k < window.size(); k++) {
+            m_Segment[k] = (double)x[k] * adToMV * window[k];
+        }
+        m_FFT.transform(m_Segment.data(), m_Bins.data(), m_Work);
+
+        size_t nBins = m_Bins.size();
+        size_t nfft = m_Options.nfft;
+        size_t offset = m_Result.power.size();
+        if (m_Options.isSpectrogram) {
+            m_Result.power.resize(offset + nBins);
+            m_Result.times.push_back(m_Layout.sampleTime(m_Fragment, first) +
+                                     0.5 * (double)window.size() / m_Layout.sampleFrequency);
+        }
+
+        for (size_t k = 0; k < nBins; k++) {
+            // Every bin but 0 and Nyquist stands for its negative frequency
+            // too.
+            bool isEdge = k == 0 || 2 * k == nfft;
+            double p = std::norm(m_Bins[k]) * m_Scale * (isEdge ? 1.0 : 2.0);
+            if (m_Options.isSpectrogram) {
+                m_Result.power[offset + k] = (float)p;
+            }
+            else {
+                m_Sum[k] += p;
+            }
+        }
+        m_Result.nSegments++;
+    }
+
+    const SpectralOptions &m_Options;
+    const RealFFT &m_FFT;
+    const ContinuousLayout &m_Layout;
+    ChannelSpectrum &m_Result;
+
+    double m_Scale;
+    size_t m_Hop;
+
+    // Windowed, zero padded segment, its spectrum and the FFT's work space.
+    std::vector<double> m_Segment;
+    std::vector<std::complex<double> > m_Bins;
+    std::vector<std::complex<double> > m_Work;
+
+    // Welch sum of the periodograms.
+    std::vector<double> m_Sum;
+
+    // Samples of the current fragment not yet cut into all their segments,
+    // and the index of the first.
+    std::vector<int16_t> m_Buffer;
+    uint64_t m_BufferStart;
+    size_t m_Fragment;
+};
+
+
+static const char *channelSpectrum(const char *fileName, int channel, const SpectralOptions &options,
+                                   const RealFFT &fft, ChannelSpectrum &result)
+{
+    ContinuousReader reader;
+    size_t chunkSize = options.window.size() > SPECTRAL_CHUNK_SAMPLES ?
+                       options.window.size() : SPECTRAL_CHUNK_SAMPLES;
+    const char *error = reader.open(fileName, channel, chunkSize);
+    if (error != NULL) {
+        return error;
+    }
+    const ContinuousLayout &layout = reader.layout();
+
+    result.name = layout.name;
+    result.sampleFrequency = layout.sampleFrequency;
+    result.nFrequencies = fft.numBins();
+    result.nSegments = 0;
+
+    SegmentSpectra spectra(options, fft, layout, result);
+    ContinuousChunk chunk;
+    while (reader.next(chunk)) {
+        spectra.push(chunk);
+    }
+    spectra.finish();
+
+    return reader.error();
+}
+
+
+const char *computeSpectra(const char *fileName, const std::vector<int> &channels,
+                           const SpectralOptions &options, std::vector<ChannelSpectrum> &results,
+                           ThreadPool &pool)
+{
+    if (options.window.empty() || options.overlap >= options.window.size()) {
+        return "The overlap must be less than the window length.";
+    }
+    if (options.nfft < options.window.size()) {
+        return "The FFT length must be at least the window length.";
+    }
+
+    RealFFT fft(options.nfft);
+    results.assign(channels.size(), ChannelSpectrum());
+    std::vector<const char*> errors(channels.size(), NULL);
+
+    pool.runTasks(channels.size(), [&](size_t c) {
+        errors[c] = channelSpectrum(fileName, channels[c], options, fft, results[c]);
+    });
+
+    for (size_t c = 0; c < channels.size(); c++) {
+        if (errors[c] != NULL) {
+            return errors[c];
+        }
+    }
+
+    return NULL;
+}
@@ -0,0 +1,85 @@
+#ifndef SPECTRALKERNEL_H
+#define SPECTRALKERNEL_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+#include "threadpool.h"
+
+struct SpectralOptions
+{
+    // Window applied to each segment; its length is the segment length.
+    std::vector<double> window;
+
+    // Samples shared by consecutive segments, less than the window length.
+    size_t overlap;
+
+    // FFT length, at least the window length.  Segments are zero padded
+    // up to it.
+    size_t nfft;
+
+    // Keep the spectrum of every segment rather than their average.
+    bool isSpectrogram;
+};
+
+// The spectrum of one continuous variable.
+struct ChannelSpectrum
+{
+    std::string name;
+    double sampleFrequency;
+
+    // nfft / 2 + 1 frequencies, from 0 to the Nyquist frequency.
+    size_t nFrequencies;
+
+    // Number of segments the spectrum is over.
+    size_t nSegments;
+
+    // One sided power spectral density. (mV^2/Hz)  For the Welch average
+    // this is nFrequencies values.  For a spectrogram it is nFrequencies x
+    // nSegments, column major.
+    std::vector<float> power;
+
+    // Time of the centre of each segment of a spectrogram. (s)
+    std::vector<double> times;
+};
+
+
+/*******************************************************************************
+ computeSpectra - Welch power spectral densities or spectrograms of continuous
+                  variables.
+
+ Syntax:
+ const char *computeSpectra(const char *fileName, const std::vector<int> &channels,
+                            const SpectralOptions &options,
+                            std::vector<ChannelSpectrum> &results, ThreadPool &pool)
+
+ Description:
+ Streams each variable through a ContinuousReader, cutting it into
+ windowed segments that step by the window length less the overlap, and
+ takes the periodogram of each with a RealFFT shared by all the channels.
+ Segments never span a gap between fragments: each fragment is cut from
+ its own first sample, and what's left at its end that doesn't fill a
+ segment is dropped, as is any fragment shorter than a segment.
+
+ The scaling matches MATLAB's pwelch and spectrogram with a sample rate:
+ |X|^2 / (fs * sum(window.^2)), doubled at every frequency but 0 and
+ Nyquist.  The Welch average is summed in double and only stored as float
+ at the end; spectrogram columns are stored as float as they're made, so a
+ day long spectrogram takes half the memory it would as double.
+
+ Channels are spread over the pool.
+
+ Input:
+ fileName - NEX file to read.
+ channels - 0 based indices among the file's continuous variables.
+ options - Segmenting and output options.
+
+ Output:
+ const char * - NULL on success, otherwise a description of the problem.
+ results - One entry per channel.
+*******************************************************************************/
+const char *computeSpectra(const char *fileName, const std::vector<int> &channels,
+                           const SpectralOptions &options, std::vector<ChannelSpectrum> &results,
+                           ThreadPool &pool);
+
+#endif
@@ -0,0 +1,361 @@
+#include "spikedetect.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include "NexFile.h"
+#include "NexFileVariables.h"
+#include "continuousreader.h"
+
+// Samples per read.
+static const size_t DETECT_CHUNK_SAMPLES = 1 << 16;
+
+// Most samples the noise is estimated from.
+static const size_t NOISE_SAMPLES = 1 << 20;
+
+// median(|x|) of Gaussian noise in standard deviations (Quiroga et al.,
+// 2004).
+static const double MAD_TO_SD = 0.6745;
+
+
+// Reads a continuous variable through the filter, calling
+// body(chunk, values, isNewFragment) with each chunk's filtered values in
+// mV.  The filter starts each fragment settled on its first sample, so the
+// recording's offset doesn't ring through it.
+template <typename Body>
+static const char *streamFiltered(const char *fileName, int channel,
+                                  const std::vector<Biquad> &sections, ContinuousLayout &layout,
+                                  Body body)
+{
+    ContinuousReader reader;
+    const char *error = reader.open(fileName, channel, DETECT_CHUNK_SAMPLES);
+    if (error != NULL) {
+        return error;
+    }
+    layout = reader.layout();
+
+    BiquadCascade cascade(sections, 1);
+    ContinuousChunk chunk;
+    std::vector<double> x;
+    size_t fragment = layout.numFragments();
+
+    while (reader.next(chunk)) {
+        size_t n = chunk.samples.size();
+        x.resize(n);
+        for (size_t k = 0; k < n; k++) {
+            x[k] = (double)chunk.samples[k] * layout.adToMV;
+        }
+
+        bool isNewFragment = chunk.fragment != fragment;
+        if (isNewFragment) {
+            fragment = chunk.fragment;
+            cascade.settle(x.data());
+        }
+        cascade.run(x.data(), n);
+
+        body(chunk, x, isNewFragment);
+    }
+
+    return reader.error();
+}
+
+
+// Threshold detection over the filtered samples of one variable, a
+// fragment at a time.  Indices are relative to the fragment start.
+class ThresholdDetector
+{
+public:
+    ThresholdDetector(const SpikeDetectOptions &options, const ContinuousLayout &layout,
+                      DetectedSpikes &result)
+        : m_Options(options), m_Layout(layout), m_Result(result),
+          m_Fragment(0), m_Count(0), m_NextAllowed(0), m_IsInExcursion(false),
+          m_ExcursionStart(0), m_Peak(0), m_PeakValue(0.0), m_BufferStart(0)
+    {
+        double refractory = std::ceil(options.refractory * layout.sampleFrequency - 1e-9);
+        m_Refractory = refractory > 1.0 ? (int64_t)refractory : 1;
+        m_HasSnippets = options.preSamples + options.postSamples > 0;
+    }
+
+    void startFragment(size_t fragment)
+    {
+        m_Fragment = fragment;
+        m_Count = 0;
+        m_NextAllowed = 0;
+        m_IsInExcursion = false;
+        m_Buffer.clear();
+        m_BufferStart = 0;
+    }
+
+    void push(const double *x, size_t n)
+    {
+        double threshold = m_Result.threshold;
+
+        if (m_HasSnippets) {
+            m_Buffer.insert(m_Buffer.end(), x, x + n);
+        }
+
+        for (size_t k = 0; k < n; k++) {
+            int64_t i = m_Count + (int64_t)k;
+            double v = polarized(x[k]);
+
+            if (!m_IsInExcursion) {
+                if (v > threshold && i >= m_NextAllowed) {
+                    m_IsInExcursion = true;
+                    m_ExcursionStart = i;
+                    m_Peak = i;
+                    m_PeakValue = v;
+                }
+            }
+            else if (v <= threshold) {
+                emit();
+                continue;
+            }
+            else if (v > m_PeakValue) {
+                m_Peak = i;
+                m_PeakValue = v;
+            }
+
+            if (m_IsInExcursion && i - m_ExcursionStart + 1 >= m_Refractory) {
+                emit();
+            }
+        }
+        m_Count += (int64_t)n;
+
+        if (m_HasSnippets) {
+            fillSnippets(false);
+
+            // Keep what the pending snippets and any spike still to come
+            // could need.
+            int64_t keepFrom = (m_IsInExcursion ? m_ExcursionStart : m_Count) - (int64_t)m_Options.preSamples;
+            if (!m_Pending.empty()) {
+                keepFrom = std::min(keepFrom, m_Pending.front() - (int64_t)m_Options.preSamples);
+            }
+            if (keepFrom > m_BufferStart) {
+                m_Buffer.erase(m_Buffer.begin(), m_Buffer.begin() + (size_t)(keepFrom - m_BufferStart));
+                m_BufferStart = keepFrom;
+            }
+        }
+    }
+
+    void finishFragment()
+    {
+        if (m_IsInExcursion) {
+            emit();
+        }
+        if (m_HasSnippets) {
+            fillSnippets(true);
+        }
+    }
+
+private:
+    double polarized(double x) const
+    {
+        switch (m_Options.polarity) {
+            case NegativeSpikes:
+                return -x;
+            case PositiveSpikes:
+                return x;
+            default:
+                return std::fabs(x);
+        }
+    }
+
+    void emit()
+    {
+        m_Result.times.push_back(m_Layout.sampleTime(m_Fragment,
+            m_Layout.fragmentStarts[m_Fragment] + (uint64_t)m_Peak));
+        if (m_HasSnippets) {
+            m_Pending.push_back(m_Peak);
+        }
+        m_NextAllowed = m_Peak + m_Refractory;
+        m_IsInExcursion = false;
+    }
+
+    // Copies out the snippets whose samples are all in, or all of them at
+    // the end of the fragment, with the end samples standing in for those
+    // past the fragment's ends.
+    void fillSnippets(bool isFinished)
+    {
+        int64_t pre = (int64_t)m_Options.preSamples;
+        int64_t post = (int64_t)m_Options.postSamples;
+
+        while (!m_Pending.empty() && (isFinished || m_Pending.front() + post <= m_Count)) {
+            int64_t peak = m_Pending.front();
+            for (int64_t j = peak - pre; j < peak + post; j++) {
+                int64_t i = std::min(std::max(j, (int64_t)0), m_Count - 1);
+                m_Result.snippets.push_back(m_Buffer[(size_t)(i - m_BufferStart)]);
+            }
+            m_Pending.pop_front();
+        }
+    }
+
+    const SpikeDetectOptions &m_Options;
+    const ContinuousLayout &m_Layout;
+    DetectedSpikes &m_Result;
+    int64_t m_Refractory;
+    bool m_HasSnippets;
+
+    size_t m_Fragment;
+    int64_t m_Count;
+
+    // First sample a new excursion may start on.
+    int64_t m_NextAllowed;
+
+    bool m_IsInExcursion;
+    int64_t m_ExcursionStart;
+    int64_t m_Peak;
+    double m_PeakValue;
+
+    // Recent samples from m_BufferStart on, and the peaks of the spikes
+    // waiting on samples for their snippets.
+    std::vector<double> m_Buffer;
+    int64_t m_BufferStart;
+    std::deque<int64_t> m_Pending;
+};
+
+
+static const char *detectChannel(const char *fileName, int channel,
+                                 const SpikeDetectOptions &options, DetectedSpikes &result)
+{
+    ContinuousLayout layout;
+
+    // Estimate the noise from every stride'th sample.
+    std::vector<double> magnitudes;
+    uint64_t stride = 0;
+    const char *error = streamFiltered(fileName, channel, options.sections, layout,
+        [&](const ContinuousChunk &chunk, const std::vector<double> &x, bool) {
+            if (stride == 0) {
+                stride = std::max<uint64_t>(layout.nSamples / NOISE_SAMPLES, 1);
+                magnitudes.reserve((size_t)(layout.nSamples / stride + 1));
+            }
+            uint64_t k = (stride - chunk.firstSample % stride) % stride;
+            for (; k < x.size(); k += stride) {
+                magnitudes.push_back(std::fabs(x[k]));
+            }
+        });
+    if (error != NULL) {
+        return error;
+    }
+
+    result.name = layout.name;
+    result.timestampFrequency = layout.timestampFrequency;
+    result.sampleFrequency = layout.sampleFrequency;
+    result.threshold = 0.0;
+    if (!magnitudes.empty()) {
+        std::vector<double>::iterator median = magnitudes.begin() + magnitudes.size() / 2;
+        std::nth_element(magnitudes.begin(), median, magnitudes.end());
+        result.threshold = options.thresholdFactor * *median / MAD_TO_SD;
+    }
+    std::vector<double>().swap(magnitudes);
+
+    ThresholdDetector detector(options, layout, result);
+    bool isStarted = false;
+    error = streamFiltered(fileName, channel, options.sections, layout,
+        [&](const ContinuousChunk &chunk, const std::vector<double> &x, bool isNewFragment) {
+            if (isNewFragment) {
+                if (isStarted) {
+                    detector.finishFragment();
+                }
+                detector.startFragment(chunk.fragment);
+                isStarted = true;
+            }
+            detector.push(x.data(), x.size());
+        });
+    if (isStarted) {
+        detector.finishFragment();
+    }
+
+    return error;
+}
+
+
+const char *detectSpikes(const char *fileName, const std::vector<int> &channels,
+                         const SpikeDetectOptions &options,
+                         std::vector<DetectedSpikes> &results, ThreadPool &pool)
+{
+    results.assign(channels.size(), DetectedSpikes());
+    std::vector<const char*> errors(channels.size(), NULL);
+
+    pool.runTasks(channels.size(), [&](size_t i) {
+        errors[i] = detectChannel(fileName, channels[i], options, results[i]);
+    });
+
+    for (size_t i = 0; i < channels.size(); i++) {
+        if (errors[i] != NULL) {
+            return errors[i];
+        }
+    }
+
+    return NULL;
+}
+
+
+// A variable name with a suffix, cut to fit the NEX name field.
+static std::string variableName(const std::string &name, const char *suffix)
+{
+    std::string full = name + suffix;
+    return full.substr(0, sizeof(((NexVarHeader*)0)->Name) - 1);
+}
+
+
+bool saveDetectedSpikes(const char *fileName, const std::vector<DetectedSpikes> &spikes,
+                        size_t preSamples, size_t postSamples)
+{
+    if (spikes.empty()) {
+        return false;
+    }
+
+    double frequency = spikes[0].timestampFrequency;
+    int nPoints = (int)(preSamples + postSamples);
+    std::vector<std::unique_ptr<NexFileVariable> > variables;
+    int endTicks = 0;
+
+    for (size_t c = 0; c < spikes.size(); c++) {
+        const DetectedSpikes &channel = spikes[c];
+        std::string name = variableName(channel.name, "_spk");
+
+        Neuron *neuron = new Neuron(name.c_str(), frequency);
+        variables.push_back(std::unique_ptr<NexFileVariable>(neuron));
+
+        Waveform *waveform = NULL;
+        double adToMV = 1.0;
+        if (nPoints > 0) {
+            double maxAbs = 0.0;
+            for (size_t k = 0; k < channel.snippets.size(); k++) {
+                maxAbs = std::max(maxAbs, std::fabs(channel.snippets[k]));
+            }
+            if (maxAbs > 0.0) {
+                adToMV = maxAbs / 32767.0;
+            }
+            waveform = new Waveform(variableName(name, "_wf").c_str(), frequency,
+                                    channel.sampleFrequency, nPoints, adToMV,
+                                    (double)preSamples / channel.sampleFrequency);
+            variables.push_back(std::unique_ptr<NexFileVariable>(waveform));
+        }
+
+        std::vector<short> values(nPoints);
+        for (size_t s = 0; s < channel.times.size(); s++) {
+            int ticks = (int)std::floor(channel.times[s] * frequency + 0.5);
+            neuron->AddTimestamp(ticks);
+            endTicks = std::max(endTicks, ticks);
+
+            if (waveform != NULL) {
+                const double *snippet = &channel.snippets[s * nPoints];
+                for (int p = 0; p < nPoints; p++) {
+                    values[p] = (short)std::floor(snippet[p] / adToMV + 0.5);
+                }
+                waveform->AddWaveform(ticks, values.data());
+            }
+        }
+    }
+
+    std::vector<NexFileVariable*> fileVariables;
+    for (size_t i = 0; i < variables.size(); i++) {
+        fileVariables.push_back(variables[i].get());
+    }
+
+    return SaveNexFile(fileName, frequency, endTicks + 1, fileVariables);
+}
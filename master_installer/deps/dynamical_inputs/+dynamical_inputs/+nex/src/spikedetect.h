@@ -0,0 +1,116 @@
+#ifndef SPIKEDETECT_H
+#define SPIKEDETECT_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+#include "continuousfilter.h"
+#include "threadpool.h"
+
+enum SpikePolarity
+{
+    NegativeSpikes = -1,
+    BothSpikes = 0,
+    PositiveSpikes = 1
+};
+
+struct SpikeDetectOptions
+{
+    // Causal filter run before detecting, normally a high pass to remove
+    // the LFP.  Empty for none.
+    std::vector<Biquad> sections;
+
+    // The threshold is thresholdFactor noise standard deviations, with
+    // the noise estimated as median(|x|) / 0.6745.
+    double thresholdFactor;
+
+    // Which way spikes cross the threshold.
+    SpikePolarity polarity;
+
+    // Shortest time from one spike's peak to the next. (s)
+    double refractory;
+
+    // Samples kept before and after each peak as its snippet.  Both 0 for
+    // no snippets.
+    size_t preSamples;
+    size_t postSamples;
+};
+
+// The spikes found on one continuous variable.
+struct DetectedSpikes
+{
+    // Name of the variable, timestamp rate of its file (Hz) and sampling
+    // rate. (Hz)
+    std::string name;
+    double timestampFrequency;
+    double sampleFrequency;
+
+    // Threshold used, in the filtered signal. (mV)
+    double threshold;
+
+    // Time of each spike's peak. (s)
+    std::vector<double> times;
+
+    // preSamples + postSamples filtered values per spike, spike after
+    // spike. (mV)
+    std::vector<double> snippets;
+};
+
+
+/*******************************************************************************
+ detectSpikes - Finds threshold crossings on continuous variables.
+
+ Syntax:
+ const char *detectSpikes(const char *fileName, const std::vector<int> &channels,
+                          const SpikeDetectOptions &options,
+                          std::vector<DetectedSpikes> &results, ThreadPool &pool)
+
+ Description:
+ Streams each variable through ContinuousReader twice, so any length of
+ recording runs in constant memory.  The first pass estimates the noise
+ from an evenly spaced subsample of the filtered signal.  The second
+ marks a spike at the peak of each excursion past the threshold, with no
+ new excursion starting until the refractory period after the last peak
+ has passed.  An excursion that lasts a whole refractory period ends
+ there.  Fragments are filtered and searched separately, and snippets
+ that run past a fragment's ends repeat its end samples.
+
+ Channels run in parallel on the pool.
+
+ Input:
+ fileName - NEX file to read.
+ channels - 0 based indices among the file's continuous variables.
+ options - How to detect.
+
+ Output:
+ const char * - NULL on success, otherwise a description of the problem.
+ results - One entry per channel.
+*******************************************************************************/
+const char *detectSpikes(const char *fileName, const std::vector<int> &channels,
+                         const SpikeDetectOptions &options,
+                         std::vector<DetectedSpikes> &results, ThreadPool &pool);
+
+
+/*******************************************************************************
+ saveDetectedSpikes - Writes detected spikes to a NEX file.
+
+ Syntax:
+ bool saveDetectedSpikes(const char *fileName, const std::vector<DetectedSpikes> &spikes,
+                         size_t preSamples, size_t postSamples)
+
+ Description:
+ Writes a neuron variable named after each source variable with "_spk"
+ added, and if there are snippets, a waveform variable with "_wf" added
+ after that.  Snippets are stored as int16 scaled to the largest value of
+ each channel.  Timestamps are rounded to the file's tick rate.
+
+ Input:
+ preSamples, postSamples - The snippet layout the spikes were found with.
+
+ Output:
+ bool - false if the file couldn't be written.
+*******************************************************************************/
+bool saveDetectedSpikes(const char *fileName, const std::vector<DetectedSpikes> &spikes,
+                        size_t preSamples, size_t postSamples);
+
+#endif
@@ -0,0 +1,154 @@
+#include "spiketrains.h"
+
+#include <algorithm>
+
+
+void mergeIntervals(std::vector<Interval> &intervals)
+{
+    // Throw out any malformed intervals before sorting.
+    intervals.erase(std::remove_if(intervals.begin(), intervals.end(),
+                                   [](const Interval &x) { return x.end < x.start; }),
+                    intervals.end());
+
+    std::sort(intervals.begin(), intervals.end(),
+              [](const Interval &a, const Interval &b) { return a.start < b.start; });
+
+    // Collapse overlapping intervals.  The intervals are closed, so two
+    // intervals that touch are also merged.
+    size_t nMerged = 0;
+    for (size_t i = 0; i < intervals.size(); i++) {
+        if (nMerged > 0 && intervals[i].start <= intervals[nMerged-1].end) {
+            intervals[nMerged-1].end = std::max(intervals[nMerged-1].end, intervals[i].end);
+        }
+        else {
+            intervals[nMerged++] = intervals[i];
+        }
+    }
+    intervals.resize(nMerged);
+}
+
+
+size_t selectSpikeRanges(SpikeTrain train, const std::vector<Interval> &intervals,
+                         double windowStart, double windowEnd,
+                         std::vector<IndexRange> &ranges)
+{
+    const double *begin = train.t;
+    const double *end = train.t + train.n;
+    size_t nSelected = 0;
+
+    ranges.clear();
+
+    // Jump straight to the first spike inside the window.
+    const double *s = std::lower_bound(begin, end, windowStart);
+
+    if (intervals.empty()) {
+        const double *e = std::lower_bound(s, end, windowEnd);
+        if (e > s) {
+            IndexRange r = {(size_t)(s - begin), (size_t)(e - begin)};
+            ranges.push_back(r);
+            nSelected = e - s;
+        }
+        return nSelected;
+    }
+
+    // Skip any intervals that end before the window starts.
+    std::vector<Interval>::const_iterator iv = std::lower_bound(intervals.begin(), intervals.end(), windowStart,
+        [](const Interval &x, double t) { return x.end < t; });
+
+    // Walk the spikes and intervals together.  Each step either moves the
+    // spike pointer past the current interval or moves to the next interval,
+    // so every spike and interval is looked at once.
+    for (; iv != intervals.end() && iv->start < windowEnd && s != end; ++iv) {
+        // Move up to the first spike in the interval.
+        while (s != end && *s < iv->start) {
+            ++s;
+        }
+
+        // Collect every spike that is in both the interval and the window.
+        const double *first = s;
+        while (s != end && *s <= iv->end && *s < windowEnd) {
+            ++s;
+        }
+
+        if (s > first) {
+            IndexRange r = {(size_t)(first - begin), (size_t)(s - begin)};
+            ranges.push_back(r);
+            nSelected += s - first;
+        }
+    }
+
+    return nSelected;
+}
+
+
+size_t countSpikes(SpikeTrain train, const std::vector<Interval> &intervals,
+                   double windowStart, double windowEnd)
+{
+    const double *begin = train.t;
+    const double *end = train.t + train.n;
+
+    const double *s = std::lower_bound(begin, end, windowStart);
+
+    if (intervals.empty()) {
+        return std::lower_bound(s, end, windowEnd) - s;
+    }
+
+    std::vector<Interval>::const_iterator iv = std::lower_bound(intervals.begin(), intervals.end(), windowStart,
+        [](const Interval &x, double t) { return x.end < t; });
+
+    size_t nSelected = 0;
+    for (; iv != intervals.end() && iv->start < windowEnd && s != end; ++iv) {
+        while (s != end && *s < iv->start) {
+            ++s;
+        }
+
+        const double *first = s;
+        while (s != end && *s <= iv->end && *s < windowEnd) {
+            ++s;
+        }
+        nSelected += s - first;
+    }
+
+    return nSelected;
+}
+
+
+void packTrains(const std::vector<SpikeTrain> &trains, PackedTrains &packed)
+{
+    size_t nTotal = 0;
+    for (size_t i = 0; i < trains.size(); i++) {
+        nTotal += trains[i].n;
+    }
+
+    packed.times.clear();
+    packed.times.reserve(nTotal);
+    packed.offsets.resize(trains.size() + 1);
+
+    for (size_t i = 0; i < trains.size(); i++) {
+        packed.offsets[i] = packed.times.size();
+        packed.times.insert(packed.times.end(), trains[i].t, trains[i].t + trains[i].n);
+    }
+    packed.offsets[trains.size()] = packed.times.size();
+}
+
+
+void packWindowTrains(const std::vector<SpikeTrain> &trains, const std::vector<size_t> &neurons,
+                      const std::vector<Interval> &intervals, double windowStart,
+                      double windowEnd, PackedTrains &packed)
+{
+    std::vector<IndexRange> ranges;
+
+    packed.times.clear();
+    packed.offsets.resize(neurons.size() + 1);
+
+    for (size_t k = 0; k < neurons.size(); k++) {
+        const SpikeTrain &s = trains[neurons[k]];
+
+        packed.offsets[k] = packed.times.size();
+        selectSpikeRanges(s, intervals, windowStart, windowEnd, ranges);
+        for (size_t r = 0; r < ranges.size(); r++) {
+            packed.times.insert(packed.times.end(), s.t + ranges[r].first, s.t + ranges[r].last);
+        }
+    }
+    packed.offsets[neurons.size()] = packed.times.size();
+}
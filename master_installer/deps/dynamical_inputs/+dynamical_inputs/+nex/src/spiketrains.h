@@ -0,0 +1,153 @@
+#ifndef SPIKETRAINS_H
+#define SPIKETRAINS_H
+
+#include <cstddef>
+#include <vector>
+
+// A read only view of a sorted spike train.  The timestamps aren't owned by
+// the view, they typically point straight into the data of an mxArray.
+struct SpikeTrain
+{
+    const double *t;
+    size_t n;
+};
+
+// A closed time interval [start, end]. (s)
+struct Interval
+{
+    double start;
+    double end;
+};
+
+// A half open range of spike indices [first, last).
+struct IndexRange
+{
+    size_t first;
+    size_t last;
+};
+
+// A set of spike trains packed back to back into a single buffer.  Train i
+// is times[offsets[i]] to times[offsets[i+1] - 1].  Keeping the trains of a
+// window in one contiguous block means neighbouring neurons share cache lines
+// and pages rather than being scattered across separately allocated arrays.
+struct PackedTrains
+{
+    std::vector<double> times;
+    std::vector<size_t> offsets;
+
+    size_t size() const { return offsets.empty() ? 0 : offsets.size() - 1; }
+
+    SpikeTrain operator[](size_t i) const
+    {
+        SpikeTrain s = {times.data() + offsets[i], offsets[i+1] - offsets[i]};
+        return s;
+    }
+};
+
+
+/*******************************************************************************
+ mergeIntervals - Sorts and merges a set of intervals.
+
+ Syntax:
+ mergeIntervals(std::vector<Interval> &intervals)
+
+ Description:
+ Sorts the intervals by their start time and collapses any overlapping or
+ touching intervals into a single interval.  The result is a sorted list of
+ disjoint intervals, which is what the selection kernels below expect.
+ Intervals with an end time before their start time are dropped.
+
+ Input:
+ intervals - The intervals to merge.  Modified in place.
+*******************************************************************************/
+void mergeIntervals(std::vector<Interval> &intervals);
+
+
+/*******************************************************************************
+ selectSpikeRanges - Finds the spikes inside a window and a set of intervals.
+
+ Syntax:
+ size_t selectSpikeRanges(SpikeTrain train, const std::vector<Interval> &intervals,
+                          double windowStart, double windowEnd,
+                          std::vector<IndexRange> &ranges)
+
+ Description:
+ Selects the spikes s with windowStart <= s < windowEnd that also fall
+ within one of the (closed) intervals.  If the interval list is empty, only
+ the window bounds are applied.  The spike train and the intervals are walked
+ together in a single linear merge, so the cost is O(spikes + intervals)
+ rather than one full pass over the spikes per interval.
+
+ Input:
+ train - Sorted spike train to select from.
+ intervals - Sorted, disjoint intervals as produced by mergeIntervals.
+ windowStart - Start of the time window, inclusive. (s)
+ windowEnd - End of the time window, exclusive. (s)
+ ranges - Cleared and filled with the selected index ranges.  Ranges are in
+     ascending order and never empty.
+
+ Output:
+ size_t - Total number of spikes selected.
+*******************************************************************************/
+size_t selectSpikeRanges(SpikeTrain train, const std::vector<Interval> &intervals,
+                         double windowStart, double windowEnd,
+                         std::vector<IndexRange> &ranges);
+
+
+/*******************************************************************************
+ packTrains - Copies a set of spike trains into a single packed buffer.
+
+ Syntax:
+ packTrains(const std::vector<SpikeTrain> &trains, PackedTrains &packed)
+
+ Input:
+ trains - The spike trains to pack.
+
+ Output:
+ packed - Overwritten with a copy of the trains.
+*******************************************************************************/
+void packTrains(const std::vector<SpikeTrain> &trains, PackedTrains &packed);
+
+
+/*******************************************************************************
+ packWindowTrains - Packs the selected spikes of a set of neurons.
+
+ Syntax:
+ packWindowTrains(const std::vector<SpikeTrain> &trains, const std::vector<size_t> &neurons,
+                  const std::vector<Interval> &intervals, double windowStart,
+                  double windowEnd, PackedTrains &packed)
+
+ Description:
+ Runs selectSpikeRanges on each of the listed neurons and packs the spikes
+ it selects, in the order the neurons are listed.
+
+ Input:
+ trains - All the spike trains.
+ neurons - Indices into trains of the neurons to pack.
+ intervals - Sorted, disjoint intervals as produced by mergeIntervals.
+ windowStart - Start of the time window, inclusive. (s)
+ windowEnd - End of the time window, exclusive. (s)
+
+ Output:
+ packed - Overwritten with one train per listed neuron.
+*******************************************************************************/
+void packWindowTrains(const std::vector<SpikeTrain> &trains, const std::vector<size_t> &neurons,
+                      const std::vector<Interval> &intervals, double windowStart,
+                      double windowEnd, PackedTrains &packed);
+
+
+/*******************************************************************************
+ countSpikes - Counts the spikes inside a window and a set of intervals.
+
+ Syntax:
+ size_t countSpikes(SpikeTrain train, const std::vector<Interval> &intervals,
+                    double windowStart, double windowEnd)
+
+ Description:
+ Same selection rules as selectSpikeRanges, but only the number of selected
+ spikes is returned so no ranges need to be stored.
+*******************************************************************************/
+size_t countSpikes(SpikeTrain train, const std::vector<Interval> &intervals,
+                   double windowStart, double windowEnd);
+
+#endif
@@ -0,0 +1,143 @@
+#include "stabilitykernel.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+// Number of windows per side of a block of window pairs.
+static const size_t WINDOW_BLOCK_SIZE = 16;
+
+
+void mapGlobalNeurons(const std::vector<std::vector<double> > &cellIDs,
+                      std::vector<ZScoreWindow> &windows, std::vector<double> &globalIDs)
+{
+    globalIDs.clear();
+    for (size_t w = 0; w < cellIDs.size(); w++) {
+        globalIDs.insert(globalIDs.end(), cellIDs[w].begin(), cellIDs[w].end());
+    }
+    std::sort(globalIDs.begin(), globalIDs.end());
+    globalIDs.erase(std::unique(globalIDs.begin(), globalIDs.end()), globalIDs.end());
+
+    std::vector<size_t> globalIndex;
+    for (size_t w = 0; w < windows.size(); w++) {
+        const std::vector<double> &ids = cellIDs[w];
+
+        globalIndex.resize(ids.size());
+        for (size_t i = 0; i < ids.size(); i++) {
+            globalIndex[i] = std::lower_bound(globalIDs.begin(), globalIDs.end(), ids[i]) - globalIDs.begin();
+        }
+
+        setWindowNeurons(windows[w], globalIndex);
+    }
+}
+
+
+void setWindowNeurons(ZScoreWindow &window, const std::vector<size_t> &globalIndex)
+{
+    std::vector<std::pair<size_t, size_t> > neurons(globalIndex.size());
+    for (size_t i = 0; i < globalIndex.size(); i++) {
+        neurons[i] = std::make_pair(globalIndex[i], i);
+    }
+    std::sort(neurons.begin(), neurons.end());
+
+    window.globalIndex.resize(neurons.size());
+    window.position.resize(neurons.size());
+    for (size_t i = 0; i < neurons.size(); i++) {
+        window.globalIndex[i] = neurons[i].first;
+        window.position[i] = neurons[i].second;
+    }
+
+    double sum = 0.0;
+    for (size_t j = 0; j < window.n; j++) {
+        for (size_t i = 0; i < window.n; i++) {
+            if (i != j) {
+                double z = window.z[i + j*window.n];
+                sum += z * z;
+            }
+        }
+    }
+    window.sumSquares = sum;
+}
+
+
+double windowSimilarity(const ZScoreWindow &a, const ZScoreWindow &b)
+{
+    // Positions of the shared neurons in each matrix.
+    std::vector<size_t> pa;
+    std::vector<size_t> pb;
+    size_t ia = 0;
+    size_t ib = 0;
+    while (ia < a.globalIndex.size() && ib < b.globalIndex.size()) {
+        if (a.globalIndex[ia] < b.globalIndex[ib]) {
+            ia++;
+        }
+        else if (b.globalIndex[ib] < a.globalIndex[ia]) {
+            ib++;
+        }
+        else {
+            pa.push_back(a.position[ia++]);
+            pb.push_back(b.position[ib++]);
+        }
+    }
+
+    double dot = 0.0;
+    for (size_t y = 0; y < pa.size(); y++) {
+        const double *za = a.z + pa[y]*a.n;
+        const double *zb = b.z + pb[y]*b.n;
+        for (size_t x = 0; x < pa.size(); x++) {
+            if (x != y) {
+                dot += za[pa[x]] * zb[pb[x]];
+            }
+        }
+    }
+
+    return dot / std::sqrt(a.sumSquares * b.sumSquares);
+}
+
+
+void neighborStability(const std::vector<ZScoreWindow> &windows, double *stability,
+                       ThreadPool &pool)
+{
+    if (windows.size() < 2) {
+        return;
+    }
+
+    pool.parallelFor(windows.size() - 1, 1, [&](size_t wBegin, size_t wEnd) {
+        for (size_t w = wBegin; w < wEnd; w++) {
+            stability[w] = windowSimilarity(windows[w], windows[w+1]);
+        }
+    });
+}
+
+
+void allStability(const std::vector<ZScoreWindow> &windows, double *stability,
+                  ThreadPool &pool)
+{
+    size_t n = windows.size();
+    size_t nBlocks = (n + WINDOW_BLOCK_SIZE - 1) / WINDOW_BLOCK_SIZE;
+
+    std::vector<std::pair<size_t, size_t> > blocks;
+    for (size_t bi = 0; bi < nBlocks; bi++) {
+        for (size_t bj = bi; bj < nBlocks; bj++) {
+            blocks.push_back(std::make_pair(bi * WINDOW_BLOCK_SIZE, bj * WINDOW_BLOCK_SIZE));
+        }
+    }
+
+    pool.runTasks(blocks.size(), [&](size_t t) {
+        size_t a0 = blocks[t].first;
+        size_t a1 = std::min(a0 + WINDOW_BLOCK_SIZE, n);
+        size_t b0 = blocks[t].second;
+        size_t b1 = std::min(b0 + WINDOW_BLOCK_SIZE, n);
+
+        for (size_t a = a0; a < a1; a++) {
+            if (a0 == b0) {
+                stability[a + a*n] = 0.0;
+            }
+            for (size_t b = (a0 == b0) ? a + 1 : b0; b < b1; b++) {
+                double s = windowSimilarity(windows[a], windows[b]);
+                stability[a + b*n] = s;
+                stability[b + a*n] = s;
+            }
+        }
+    });
+}
@@ -0,0 +1,124 @@
+#ifndef STABILITYKERNEL_H
+#define STABILITYKERNEL_H
+
+#include <cstddef>
+#include <vector>
+#include "threadpool.h"
+
+// The z-score matrix of one AMD window, mapped into the global neuron index
+// space shared by all the windows being compared.
+struct ZScoreWindow
+{
+    // Column major n x n z-score matrix.  Not owned.
+    const double *z;
+    size_t n;
+
+    // Global indices of the window's neurons in ascending order, and for
+    // each of them the row/column of the neuron in z.
+    std::vector<size_t> globalIndex;
+    std::vector<size_t> position;
+
+    // Sum of the squared off diagonal z-scores.
+    double sumSquares;
+};
+
+
+/*******************************************************************************
+ mapGlobalNeurons - Maps every window's neurons into one global index space.
+
+ Syntax:
+ mapGlobalNeurons(const std::vector<std::vector<double> > &cellIDs,
+                  std::vector<ZScoreWindow> &windows, std::vector<double> &globalIDs)
+
+ Description:
+ Collects the cell IDs of all the windows into one sorted list, then gives
+ each window the global index of each of its neurons, sorted, along with
+ where to find the neuron in the window's z-score matrix.  This is done once
+ so that comparing two windows is a simple merge of two sorted index lists.
+ Also fills in each window's sum of squares.
+
+ Input:
+ cellIDs - The cell IDs of each window's neurons, in z-score matrix order.
+ windows - One entry per window with z and n already set.
+
+ Output:
+ windows - globalIndex, position and sumSquares are filled in.
+ globalIDs - Sorted list of every cell ID found.
+*******************************************************************************/
+void mapGlobalNeurons(const std::vector<std::vector<double> > &cellIDs,
+                      std::vector<ZScoreWindow> &windows, std::vector<double> &globalIDs);
+
+
+/*******************************************************************************
+ setWindowNeurons - Sets the global indices of a window's neurons.
+
+ Syntax:
+ setWindowNeurons(ZScoreWindow &window, const std::vector<size_t> &globalIndex)
+
+ Description:
+ Used by mapGlobalNeurons, and directly when the windows' neurons already
+ share an index space, e.g. indices into one list of spike trains.
+
+ Input:
+ window - Window with z and n already set.
+ globalIndex - Global index of each row of the window's z-score matrix.
+
+ Output:
+ window - globalIndex, position and sumSquares are filled in.
+*******************************************************************************/
+void setWindowNeurons(ZScoreWindow &window, const std::vector<size_t> &globalIndex);
+
+
+/*******************************************************************************
+ windowSimilarity - Cosine similarity of two windows' z-scores.
+
+ Syntax:
+ double windowSimilarity(const ZScoreWindow &a, const ZScoreWindow &b)
+
+ Description:
+ Same value as dynamical.math.similarity.  Both z-score matrices are placed
+ in the union of the two windows' neurons, with zeros for the neurons a
+ window doesn't have, and the cosine of their off diagonal elements is
+ taken.  Only the neurons the windows have in common contribute to the dot
+ product, so only that block of each matrix is visited.  A NaN anywhere in
+ either matrix gives NaN, as it does in MATLAB.
+*******************************************************************************/
+double windowSimilarity(const ZScoreWindow &a, const ZScoreWindow &b);
+
+
+/*******************************************************************************
+ neighborStability - Similarity of each window with the next one.
+
+ Syntax:
+ neighborStability(const std::vector<ZScoreWindow> &windows, double *stability,
+                   ThreadPool &pool)
+
+ Output:
+ stability - Preallocated array of nWindows - 1 values.
+*******************************************************************************/
+void neighborStability(const std::vector<ZScoreWindow> &windows, double *stability,
+                       ThreadPool &pool);
+
+
+/*******************************************************************************
+ allStability - Similarity of every pair of windows.
+
+ Syntax:
+ allStability(const std::vector<ZScoreWindow> &windows, double *stability,
+              ThreadPool &pool)
+
+ Description:
+ The nWindows x nWindows similarity (Gram) matrix is split into square
+ blocks of window pairs.  Each block on or above the diagonal is one task,
+ so the z-scores of a block's windows stay in cache while all of its pairs
+ are compared, and the blocks are balanced across the threads with work
+ stealing.
+
+ Output:
+ stability - Preallocated column major nWindows x nWindows matrix.  It's
+     symmetric and the diagonal is set to zero.
+*******************************************************************************/
+void allStability(const std::vector<ZScoreWindow> &windows, double *stability,
+                  ThreadPool &pool);
+
+#endif
@@ -0,0 +1,195 @@
+#include "stakernel.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <limits>
+#include "continuousfile.h"
+
+// Windows closer than this many samples are read together.
+static const int64_t STA_GAP_SAMPLES = 4096;
+
+// Longest run of samples read at once.
+static const int64_t STA_MAX_RUN = 1 << 20;
+
+
+// A spike placed on a sample of a fragment.
+struct STAEvent
+{
+    int64_t sample;
+    uint32_t neuron;
+    uint32_t fragment;
+
+    bool operator<(const STAEvent &other) const { return sample < other.sample; }
+};
+
+
+// Puts the spikes on samples of the layout, dropping those in gaps.
+static void placeSpikes(const ContinuousLayout &layout, const std::vector<SpikeTrain> &trains,
+                        std::vector<STAEvent> &events)
+{
+    for (size_t i = 0; i < trains.size(); i++) {
+        for (size_t s = 0; s < trains[i].n; s++) {
+            double t = trains[i].t[s];
+
+            // Last fragment starting at or before the spike.
+            size_t f = std::upper_bound(layout.fragmentTimes.begin(), layout.fragmentTimes.end(), t) -
+                       layout.fragmentTimes.begin();
+            if (f == 0) {
+                continue;
+            }
+            f--;
+
+            double k = std::floor((t - layout.fragmentTimes[f]) * layout.sampleFrequency + 0.5);
+            uint64_t length = layout.fragmentEnd(f) - layout.fragmentStarts[f];
+            if (k >= (double)length) {
+                continue;
+            }
+
+            STAEvent event = {(int64_t)(layout.fragmentStarts[f] + (uint64_t)k), (uint32_t)i, (uint32_t)f};
+            events.push_back(event);
+        }
+    }
+
+    std::stable_sort(events.begin(), events.end());
+}
+
+
+// Adds the samples of one window to the sums of its neuron.
+static inline void accumulate(const int16_t *x, size_t n, int64_t *sum, int64_t *sumSq, uint64_t *count)
+{
+    for (size_t l = 0; l < n; l++) {
+        int32_t v = x[l];
+        sum[l] += v;
+        sumSq[l] += v * v;
+        count[l]++;
+    }
+}
+
+
+static const char *averageChannel(const char *fileName, int channel, const std::vector<SpikeTrain> &trains,
+                                  double preTime, double postTime, STAResult &result)
+{
+    FILE *fp = fopen(fileName, "rb");
+    if (fp == NULL) {
+        return "Failed to open file.";
+    }
+
+    ContinuousLayout layout;
+    const char *error = readContinuousLayout(fp, channel, layout);
+    if (error != NULL) {
+        fclose(fp);
+        return error;
+    }
+
+    double fs = layout.sampleFrequency;
+    int64_t firstLag = -(int64_t)std::floor(preTime * fs + 0.5);
+    int64_t lastLag = (int64_t)std::floor(postTime * fs + 0.5);
+    size_t nLags = lastLag >= firstLag ? (size_t)(lastLag - firstLag + 1) : 0;
+    size_t nNeurons = trains.size();
+
+    result.name = layout.name;
+    result.sampleFrequency = fs;
+    result.firstLag = firstLag;
+    result.nLags = nLags;
+
+    std::vector<int64_t> sum(nLags * nNeurons, 0);
+    std::vector<int64_t> sumSq(nLags * nNeurons, 0);
+    result.count.assign(nLags * nNeurons, 0);
+
+    std::vector<STAEvent> events;
+    if (nLags > 0) {
+        placeSpikes(layout, trains, events);
+    }
+
+    // The samples of spike e's window that lie in its fragment.
+    auto windowOf = [&](const STAEvent &e, int64_t &lo, int64_t &hi) {
+        lo = std::max(e.sample + firstLag, (int64_t)layout.fragmentStarts[e.fragment]);
+        hi = std::min(e.sample + lastLag + 1, (int64_t)layout.fragmentEnd(e.fragment));
+    };
+
+    std::vector<int16_t> samples;
+    size_t e = 0;
+    while (e < events.size() && error == NULL) {
+        // A window that starts after the spike or ends before it can lie
+        // wholly outside the fragment, and then there's nothing to read.
+        int64_t runStart, runEnd;
+        windowOf(events[e], runStart, runEnd);
+        if (runEnd <= runStart) {
+            e++;
+            continue;
+        }
+
+        size_t eEnd = e + 1;
+        while (eEnd < events.size() && events[eEnd].fragment == events[e].fragment) {
+            int64_t lo, hi;
+            windowOf(events[eEnd], lo, hi);
+            if (hi <= lo) {
+                eEnd++;
+                continue;
+            }
+            if (lo > runEnd + STA_GAP_SAMPLES || hi - runStart > STA_MAX_RUN) {
+                break;
+            }
+            runEnd = std::max(runEnd, hi);
+            eEnd++;
+        }
+
+        samples.resize((size_t)(runEnd - runStart));
+        if (!readSamples(fp, layout, (uint64_t)runStart, samples.size(), samples.data())) {
+            error = "Failed to read the samples.";
+            break;
+        }
+
+        for (; e < eEnd; e++) {
+            int64_t lo, hi;
+            windowOf(events[e], lo, hi);
+            if (hi <= lo) {
+                continue;
+            }
+            size_t offset = events[e].neuron * nLags + (size_t)(lo - (events[e].sample + firstLag));
+            accumulate(&samples[(size_t)(lo - runStart)], (size_t)(hi - lo),
+                       &sum[offset], &sumSq[offset], &result.count[offset]);
+        }
+    }
+    fclose(fp);
+
+    double scale = layout.adToMV;
+    double nan = std::numeric_limits<double>::quiet_NaN();
+    result.mean.assign(nLags * nNeurons, nan);
+    result.sd.assign(nLags * nNeurons, nan);
+    for (size_t k = 0; k < nLags * nNeurons; k++) {
+        double n = (double)result.count[k];
+        if (n > 0) {
+            result.mean[k] = (double)sum[k] / n * scale;
+        }
+        if (n > 1) {
+            long double ss = (long double)sumSq[k] - (long double)sum[k] * sum[k] / n;
+            result.sd[k] = std::sqrt(std::max((double)ss, 0.0) / (n - 1)) * scale;
+        }
+    }
+
+    return error;
+}
+
+
+const char *spikeTriggeredAverage(const char *fileName, const std::vector<int> &channels,
+                                  const std::vector<SpikeTrain> &trains, double preTime,
+                                  double postTime, std::vector<STAResult> &results,
+                                  ThreadPool &pool)
+{
+    results.assign(channels.size(), STAResult());
+    std::vector<const char*> errors(channels.size(), NULL);
+
+    pool.runTasks(channels.size(), [&](size_t c) {
+        errors[c] = averageChannel(fileName, channels[c], trains, preTime, postTime, results[c]);
+    });
+
+    for (size_t c = 0; c < channels.size(); c++) {
+        if (errors[c] != NULL) {
+            return errors[c];
+        }
+    }
+
+    return NULL;
+}
@@ -0,0 +1,67 @@
+#ifndef STAKERNEL_H
+#define STAKERNEL_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "spiketrains.h"
+#include "threadpool.h"
+
+// Spike triggered average of one continuous variable for each of a set of
+// neurons.  Lags are in samples of the variable, firstLag to
+// firstLag + nLags - 1, and the matrices are nLags x nNeurons, column major.
+struct STAResult
+{
+    std::string name;
+    double sampleFrequency;
+    int64_t firstLag;
+    size_t nLags;
+
+    // Mean and standard deviation (mV) at each lag, and the number of
+    // spikes they're over.  Spikes near the ends of a fragment only count
+    // at the lags that stay inside it.
+    std::vector<double> mean;
+    std::vector<double> sd;
+    std::vector<uint64_t> count;
+};
+
+
+/*******************************************************************************
+ spikeTriggeredAverage - Averages continuous variables around spikes.
+
+ Syntax:
+ const char *spikeTriggeredAverage(const char *fileName, const std::vector<int> &channels,
+                                   const std::vector<SpikeTrain> &trains, double preTime,
+                                   double postTime, std::vector<STAResult> &results,
+                                   ThreadPool &pool)
+
+ Description:
+ Each spike is put on the nearest sample of the fragment it falls in, and
+ spikes that fall in a gap between fragments are skipped.  The spikes of
+ all the neurons are sorted by sample, and runs of them whose windows
+ overlap or nearly touch are read from the file in one go, so dense spikes
+ read the variable about once and sparse ones read little more than their
+ windows.  Sums and sums of squares are kept as 64 bit integers of the raw
+ int16 samples, in a loop over the lags that vectorizes, and are only
+ scaled to mV at the end.
+
+ Channels are spread over the pool, each with its own file handle.
+
+ Input:
+ fileName - NEX file to read.
+ channels - 0 based indices among the file's continuous variables.
+ trains - Spike times of each neuron. (s)
+ preTime, postTime - The window, from preTime before each spike to
+     postTime after it, rounded to whole samples. (s)
+
+ Output:
+ const char * - NULL on success, otherwise a description of the problem.
+ results - One entry per channel.
+*******************************************************************************/
+const char *spikeTriggeredAverage(const char *fileName, const std::vector<int> &channels,
+                                  const std::vector<SpikeTrain> &trains, double preTime,
+                                  double postTime, std::vector<STAResult> &results,
+                                  ThreadPool &pool);
+
+#endif
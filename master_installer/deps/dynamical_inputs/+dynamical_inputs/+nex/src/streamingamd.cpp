@@ -0,0 +1,228 @@
+#include "streamingamd.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include "tiledamd.h"
+
+
+void SpikeRing::push(const double *t, size_t n)
+{
+    if (m_Size + n > m_Buffer.size()) {
+        size_t capacity = std::max<size_t>(m_Buffer.size(), 64);
+        while (capacity < m_Size + n) {
+            capacity *= 2;
+        }
+
+        // Unwrap into the new buffer.
+        std::vector<double> buffer(capacity);
+        for (size_t i = 0; i < m_Size; i++) {
+            buffer[i] = (*this)[i];
+        }
+        m_Buffer.swap(buffer);
+        m_Head = 0;
+    }
+
+    size_t mask = m_Buffer.size() - 1;
+    for (size_t i = 0; i < n; i++) {
+        m_Buffer[(m_Head + m_Size + i) & mask] = t[i];
+    }
+    m_Size += n;
+}
+
+
+void SpikeRing::popFront(size_t n)
+{
+    n = std::min(n, m_Size);
+    if (n == 0) {
+        return;
+    }
+    m_Head = (m_Head + n) & (m_Buffer.size() - 1);
+    m_Size -= n;
+}
+
+
+size_t SpikeRing::lowerBound(double t) const
+{
+    size_t lo = 0;
+    size_t hi = m_Size;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if ((*this)[mid] < t) {
+            lo = mid + 1;
+        }
+        else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+
+StreamingAMD::StreamingAMD(size_t nNeurons, const StreamingAMDOptions &options)
+    : m_Options(options), m_Spikes(nNeurons), m_NextWindow(0),
+      m_CompleteTime(-std::numeric_limits<double>::infinity()), m_HasPrevious(false),
+      m_PreviousEnd(0.0)
+{
+}
+
+
+const char *StreamingAMD::checkChunk(size_t neuron, const double *t, size_t n) const
+{
+    if (neuron >= m_Spikes.size()) {
+        return "Neuron index out of range.";
+    }
+    if (n == 0) {
+        return NULL;
+    }
+
+    for (size_t k = 0; k < n; k++) {
+        if (!std::isfinite(t[k])) {
+            return "Spike times must be finite.";
+        }
+    }
+
+    const SpikeRing &ring = m_Spikes[neuron];
+    if (t[0] < m_CompleteTime || (ring.size() > 0 && t[0] < ring.back())) {
+        return "Spikes must come after the neuron's previous spikes and the last complete time.";
+    }
+    for (size_t k = 1; k < n; k++) {
+        if (!(t[k] >= t[k-1])) {
+            return "Spikes must be sorted.";
+        }
+    }
+
+    return NULL;
+}
+
+
+void StreamingAMD::append(size_t neuron, const double *t, size_t n)
+{
+    m_Spikes[neuron].push(t, n);
+}
+
+
+void StreamingAMD::advance(double completeTime, std::vector<StreamedWindow> &windows,
+                           std::vector<StreamedStability> &stability, ThreadPool &pool)
+{
+    m_CompleteTime = std::max(m_CompleteTime, completeTime);
+    windows.clear();
+    stability.clear();
+
+    size_t nNeurons = m_Spikes.size();
+    std::vector<AMDWindowJob> jobs;
+
+    // Whether a window without any spikes is still emitted, which only
+    // happens when neither minimum excludes anything.
+    bool isEmptyEmitted = (m_Options.minSpikeCount == 0 ? nNeurons : 0) >= m_Options.minValidNeurons;
+
+    // Every window that's complete, in order.  The neurons and spikes of
+    // each one are picked out here since the rings can't be touched from
+    // the workers while they're being trimmed.
+    for (;;) {
+        double windowStart = m_Options.startTime + (double)m_NextWindow * m_Options.windowStep;
+        double windowEnd = windowStart + m_Options.windowSize;
+        if (windowEnd > m_CompleteTime) {
+            break;
+        }
+        m_NextWindow++;
+
+        std::vector<size_t> neurons;
+        std::vector<std::pair<size_t, size_t> > ranges;
+        bool isEmpty = true;
+        double nextSpike = m_CompleteTime;
+        for (size_t i = 0; i < nNeurons; i++) {
+            size_t first = m_Spikes[i].lowerBound(windowStart);
+            size_t last = m_Spikes[i].lowerBound(windowEnd);
+            if (last - first >= m_Options.minSpikeCount) {
+                neurons.push_back(i);
+                ranges.push_back(std::make_pair(first, last));
+            }
+            if (last > first) {
+                isEmpty = false;
+            }
+            if (last < m_Spikes[i].size()) {
+                nextSpike = std::min(nextSpike, m_Spikes[i][last]);
+            }
+        }
+
+        // Skip straight over a gap in the spikes rather than stepping
+        // through every empty window in it.  Spikes still to be appended
+        // come at or after the complete time, so that bounds the gap too.
+        // The jump stops a window short to be safe from rounding.
+        if (isEmpty && !isEmptyEmitted) {
+            double next = std::floor((nextSpike - m_Options.startTime - m_Options.windowSize) /
+                                     m_Options.windowStep);
+            if (next > (double)m_NextWindow) {
+                m_NextWindow = (size_t)next;
+            }
+            continue;
+        }
+        if (neurons.size() < m_Options.minValidNeurons) {
+            continue;
+        }
+
+        windows.push_back(StreamedWindow());
+        StreamedWindow &w = windows.back();
+        w.windowStart = windowStart;
+        w.windowEnd = windowEnd;
+        w.neurons.swap(neurons);
+
+        jobs.push_back(AMDWindowJob());
+        PackedTrains &packed = jobs.back().trains;
+        packed.offsets.resize(w.neurons.size() + 1);
+        for (size_t k = 0; k < w.neurons.size(); k++) {
+            const SpikeRing &ring = m_Spikes[w.neurons[k]];
+            packed.offsets[k] = packed.times.size();
+            for (size_t m = ranges[k].first; m < ranges[k].second; m++) {
+                packed.times.push_back(ring[m]);
+            }
+        }
+        packed.offsets[w.neurons.size()] = packed.times.size();
+    }
+
+    // Spikes before the next window can't be in any future window.
+    double nextStart = m_Options.startTime + (double)m_NextWindow * m_Options.windowStep;
+    for (size_t i = 0; i < nNeurons; i++) {
+        m_Spikes[i].popFront(m_Spikes[i].lowerBound(nextStart));
+    }
+
+    if (windows.empty()) {
+        return;
+    }
+
+    for (size_t w = 0; w < windows.size(); w++) {
+        size_t k = windows[w].neurons.size();
+        windows[w].amd.resize(k * k);
+        windows[w].zscore.resize(k * k);
+        jobs[w].amd = windows[w].amd.data();
+        jobs[w].zscore = windows[w].zscore.data();
+    }
+
+    computeMultiWindowAMD(jobs, pool);
+
+    // Neighbor stability, carrying the last window over to the next call.
+    for (size_t w = 0; w < windows.size(); w++) {
+        StreamedWindow &current = windows[w];
+        current.window = jobs[w].window;
+        current.stats.swap(jobs[w].stats);
+
+        ZScoreWindow z;
+        z.z = current.zscore.data();
+        z.n = current.neurons.size();
+        setWindowNeurons(z, current.neurons);
+
+        if (m_HasPrevious) {
+            StreamedStability s;
+            s.value = windowSimilarity(m_Previous, z);
+            s.time = 0.5 * (m_PreviousEnd + current.windowStart);
+            stability.push_back(s);
+        }
+
+        m_PreviousZScore = current.zscore;
+        m_Previous = z;
+        m_Previous.z = m_PreviousZScore.data();
+        m_PreviousEnd = current.windowEnd;
+        m_HasPrevious = true;
+    }
+}
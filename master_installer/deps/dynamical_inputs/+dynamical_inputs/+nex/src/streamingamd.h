@@ -0,0 +1,150 @@
+#ifndef STREAMINGAMD_H
+#define STREAMINGAMD_H
+
+#include <cstddef>
+#include <vector>
+#include "spiketrains.h"
+#include "amdkernel.h"
+#include "stabilitykernel.h"
+#include "threadpool.h"
+
+// Growable ring buffer of the spike times of one neuron.  The capacity is
+// kept at a power of two so the wrap around is a mask.
+class SpikeRing
+{
+public:
+    SpikeRing() : m_Head(0), m_Size(0) {}
+
+    size_t size() const { return m_Size; }
+
+    double operator[](size_t i) const { return m_Buffer[(m_Head + i) & (m_Buffer.size() - 1)]; }
+
+    double back() const { return (*this)[m_Size - 1]; }
+
+    void push(const double *t, size_t n);
+
+    // Drops the first n spikes.
+    void popFront(size_t n);
+
+    // Index of the first spike at or after t.
+    size_t lowerBound(double t) const;
+
+private:
+    std::vector<double> m_Buffer;
+    size_t m_Head;
+    size_t m_Size;
+};
+
+
+struct StreamingAMDOptions
+{
+    // Window layout, the size and step must be positive. (s)
+    double windowSize;
+    double windowStep;
+    double startTime;
+
+    // Same as the amd.m options.
+    size_t minSpikeCount;
+    size_t minValidNeurons;
+};
+
+// A window emitted by StreamingAMD.
+struct StreamedWindow
+{
+    double windowStart;
+    double windowEnd;
+
+    // Indices of the window's neurons and their k x k results.
+    std::vector<size_t> neurons;
+    std::vector<double> amd;
+    std::vector<double> zscore;
+    WindowStats window;
+    std::vector<NeuronStats> stats;
+};
+
+// Neighbor stability between an emitted window and the one before it.
+struct StreamedStability
+{
+    double value;
+    double time;
+};
+
+
+/*******************************************************************************
+ StreamingAMD - AMD windows and neighbor stability of live spike data.
+
+ Description:
+ Takes the spikes of a recording in chunks, as they are recorded, rather
+ than needing the whole file up front.  Each neuron's spikes go into a ring
+ buffer.  Every time the data is known to be complete up to some time, all
+ the windows that end by then are calculated at once with the tiled multi
+ window kernel and handed back, along with the neighbor stability of each
+ new window and the one emitted before it.  Spikes that no future window
+ can contain are dropped, so the memory used only depends on the window
+ size and the firing rates, not on the length of the recording.
+
+ A neuron is included in a window if it has at least minSpikeCount spikes
+ in it, and a window is only emitted if it has at least minValidNeurons
+ neurons, the same as amd.m.  amd.m's MinPersistence needs the whole
+ recording, so it isn't available here.
+
+ Usage:
+ StreamingAMD stream(nNeurons, options);
+ while recording:
+     stream.checkChunk(neuron, spikes, n) for each neuron with new spikes
+     stream.append(neuron, spikes, n) for each of them
+     stream.advance(completeTime, windows, stability, pool);
+*******************************************************************************/
+class StreamingAMD
+{
+public:
+    StreamingAMD(size_t nNeurons, const StreamingAMDOptions &options);
+
+    size_t numNeurons() const { return m_Spikes.size(); }
+
+    /***************************************************************************
+     checkChunk - Checks that a chunk of spikes can be appended.
+
+     Description:
+     The spikes must be finite and sorted, come after the neuron's previous
+     spikes and not before the last complete time passed to advance.
+     Returns NULL if they do, otherwise a description of the problem.
+    ***************************************************************************/
+    const char *checkChunk(size_t neuron, const double *t, size_t n) const;
+
+    // Adds a chunk of spikes of one neuron that passed checkChunk.
+    void append(size_t neuron, const double *t, size_t n);
+
+    /***************************************************************************
+     advance - Emits every window that ends at or before completeTime.
+
+     Input:
+     completeTime - Time up to which all spikes have been appended. (s)
+     pool - Thread pool to run on.
+
+     Output:
+     windows - The newly completed windows, replacing the contents.
+     stability - Neighbor stability of each window in windows with the
+         window emitted before it, replacing the contents.  The first
+         window ever emitted has nothing to be compared with.
+    ***************************************************************************/
+    void advance(double completeTime, std::vector<StreamedWindow> &windows,
+                 std::vector<StreamedStability> &stability, ThreadPool &pool);
+
+private:
+    StreamingAMDOptions m_Options;
+    std::vector<SpikeRing> m_Spikes;
+
+    // Index of the next window to emit and the time the data is complete
+    // up to.
+    size_t m_NextWindow;
+    double m_CompleteTime;
+
+    // The last window emitted, kept for the next stability value.
+    bool m_HasPrevious;
+    double m_PreviousEnd;
+    std::vector<double> m_PreviousZScore;
+    ZScoreWindow m_Previous;
+};
+
+#endif
@@ -0,0 +1,172 @@
+#include "streamstability.h"
+
+#include <algorithm>
+#include <utility>
+#include "amdkernel.h"
+#include "slidingamd.h"
+#include "stabilitykernel.h"
+#include "tiledamd.h"
+
+// Number of windows produced per batch, per thread.  Enough to keep every
+// thread busy without holding on to many windows.
+static const size_t WINDOWS_PER_THREAD = 2;
+
+// A window whose AMD has been calculated but that hasn't been compared with
+// the next window yet.
+struct StreamWindow
+{
+    size_t index;
+    std::vector<double> amd;
+    std::vector<double> zscore;
+    ZScoreWindow z;
+};
+
+
+// Gives a window its output buffers, sized for its neurons.
+static void allocateStreamWindow(StreamWindow &window, size_t index, size_t nNeurons)
+{
+    window.index = index;
+    window.amd.assign(nNeurons * nNeurons, 0.0);
+    window.zscore.assign(nNeurons * nNeurons, 0.0);
+    window.z.z = window.zscore.data();
+    window.z.n = nNeurons;
+}
+
+
+// Overlapping windows have to be produced one after the other by sliding a
+// single window across them.  Only the current and previous window are
+// kept.
+static void streamSlidingWindows(const std::vector<SpikeTrain> &trains,
+                                 const std::vector<Interval> &intervals,
+                                 const double *windowStarts, const double *windowEnds,
+                                 const std::vector<std::vector<size_t> > &windowNeurons,
+                                 double *stability, ThreadPool &pool)
+{
+    SlidingAMD sliding(trains, intervals);
+    StreamWindow previous;
+    StreamWindow current;
+    WindowStats window;
+    std::vector<NeuronStats> stats;
+
+    for (size_t w = 0; w < windowNeurons.size(); w++) {
+        const std::vector<size_t> &neurons = windowNeurons[w];
+
+        allocateStreamWindow(current, w, neurons.size());
+        sliding.advance(windowStarts[w], windowEnds[w], pool);
+        sliding.emit(neurons, current.amd.data(), current.zscore.data(), window, stats, pool);
+        setWindowNeurons(current.z, neurons);
+
+        if (w > 0) {
+            stability[w - 1] = windowSimilarity(previous.z, current.z);
+        }
+
+        std::swap(previous, current);
+    }
+}
+
+
+// Windows that don't overlap are independent, so a whole batch of them is
+// produced at once.  The comparisons of the previous batch run as extra
+// tasks next to the tiles of the current one.
+static void streamWindowBatches(const std::vector<SpikeTrain> &trains,
+                                const std::vector<Interval> &intervals,
+                                const double *windowStarts, const double *windowEnds,
+                                const std::vector<std::vector<size_t> > &windowNeurons,
+                                double *stability, ThreadPool &pool)
+{
+    size_t nWindows = windowNeurons.size();
+    size_t batchSize = std::max<size_t>(2, WINDOWS_PER_THREAD * pool.size());
+
+    // The last window of the batch before the previous one, which still
+    // has to be compared with the first window of the previous batch.
+    StreamWindow carry;
+    bool hasCarry = false;
+
+    std::vector<StreamWindow> previous;
+    std::vector<StreamWindow> batch;
+    std::vector<AMDWindowJob> jobs;
+    std::vector<WindowTileTask> tiles;
+    std::vector<std::pair<const StreamWindow *, const StreamWindow *> > comparisons;
+
+    for (size_t b0 = 0; b0 < nWindows || !previous.empty(); b0 += batchSize) {
+        size_t nBatch = (b0 < nWindows) ? std::min(batchSize, nWindows - b0) : 0;
+
+        batch.clear();
+        batch.resize(nBatch);
+        jobs.clear();
+        jobs.resize(nBatch);
+
+        pool.parallelFor(nBatch, 1, [&](size_t iBegin, size_t iEnd) {
+            for (size_t i = iBegin; i < iEnd; i++) {
+                size_t w = b0 + i;
+                allocateStreamWindow(batch[i], w, windowNeurons[w].size());
+                packWindowTrains(trains, windowNeurons[w], intervals,
+                                 windowStarts[w], windowEnds[w], jobs[i].trains);
+                jobs[i].amd = batch[i].amd.data();
+                jobs[i].zscore = batch[i].zscore.data();
+            }
+        });
+
+        prepareWindowJobs(jobs, pool);
+        listWindowTileTasks(jobs, tiles);
+
+        comparisons.clear();
+        for (size_t i = 0; i < previous.size(); i++) {
+            if (i == 0 && hasCarry) {
+                comparisons.push_back(std::make_pair(&carry, &previous[0]));
+            }
+            if (i + 1 < previous.size()) {
+                comparisons.push_back(std::make_pair(&previous[i], &previous[i+1]));
+            }
+        }
+
+        pool.runTasks(tiles.size() + comparisons.size(), [&](size_t t) {
+            if (t < tiles.size()) {
+                computeWindowTile(jobs[tiles[t].window], tiles[t]);
+            }
+            else {
+                const StreamWindow &a = *comparisons[t - tiles.size()].first;
+                const StreamWindow &b = *comparisons[t - tiles.size()].second;
+                stability[a.index] = windowSimilarity(a.z, b.z);
+            }
+        });
+
+        pool.parallelFor(nBatch, 1, [&](size_t iBegin, size_t iEnd) {
+            for (size_t i = iBegin; i < iEnd; i++) {
+                setWindowNeurons(batch[i].z, windowNeurons[b0 + i]);
+            }
+        });
+
+        // Everything in the previous batch but its last window is done with.
+        if (!previous.empty()) {
+            std::swap(carry, previous.back());
+            hasCarry = true;
+        }
+        previous.swap(batch);
+    }
+}
+
+
+void streamNeighborStability(const std::vector<SpikeTrain> &trains,
+                             const std::vector<Interval> &intervals,
+                             const double *windowStarts, const double *windowEnds,
+                             const std::vector<std::vector<size_t> > &windowNeurons,
+                             double *stability, ThreadPool &pool)
+{
+    bool isOverlapping = false;
+    for (size_t w = 1; w < windowNeurons.size(); w++) {
+        if (windowStarts[w] < windowEnds[w - 1]) {
+            isOverlapping = true;
+            break;
+        }
+    }
+
+    if (isOverlapping) {
+        streamSlidingWindows(trains, intervals, windowStarts, windowEnds, windowNeurons,
+                             stability, pool);
+    }
+    else {
+        streamWindowBatches(trains, intervals, windowStarts, windowEnds, windowNeurons,
+                            stability, pool);
+    }
+}
@@ -0,0 +1,51 @@
+#ifndef STREAMSTABILITY_H
+#define STREAMSTABILITY_H
+
+#include <cstddef>
+#include <vector>
+#include "spiketrains.h"
+#include "threadpool.h"
+
+
+/*******************************************************************************
+ streamNeighborStability - Computes neighbor stability straight from spikes.
+
+ Syntax:
+ streamNeighborStability(const std::vector<SpikeTrain> &trains,
+                         const std::vector<Interval> &intervals,
+                         const double *windowStarts, const double *windowEnds,
+                         const std::vector<std::vector<size_t> > &windowNeurons,
+                         double *stability, ThreadPool &pool)
+
+ Description:
+ Neighbor stability only ever compares window w with window w+1, so there's
+ no need to hold on to the AMD results of every window.  The windows are
+ produced in order and each one is dropped as soon as it's been compared
+ with the next, so only a few windows are in memory at any time no matter
+ how long the recording is.
+
+ Windows that don't overlap are processed in batches.  The tiles of one
+ batch run as tasks alongside the comparisons of the previous batch, so
+ computing the AMD and the stability overlap.  Overlapping windows are
+ produced one at a time with SlidingAMD.
+
+ The stability values are the same as running the windows through
+ computeMultiWindowAMD and neighborStability.
+
+ Input:
+ trains - All the spike trains.
+ intervals - Sorted, disjoint intervals as produced by mergeIntervals.
+ windowStarts, windowEnds - Bounds of each window, sorted by start time.
+ windowNeurons - Indices into trains of each window's neurons, ascending.
+ pool - Thread pool to run on.
+
+ Output:
+ stability - Preallocated array of nWindows - 1 values.
+*******************************************************************************/
+void streamNeighborStability(const std::vector<SpikeTrain> &trains,
+                             const std::vector<Interval> &intervals,
+                             const double *windowStarts, const double *windowEnds,
+                             const std::vector<std::vector<size_t> > &windowNeurons,
+                             double *stability, ThreadPool &pool);
+
+#endif
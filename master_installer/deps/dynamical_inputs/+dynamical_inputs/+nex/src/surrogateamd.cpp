@@ -0,0 +1,236 @@
+#include "surrogateamd.h"
+
+#include <algorithm>
+#include <limits>
+#include <mutex>
+#include <utility>
+#include "philox.h"
+#include "tiledamd.h"
+
+// Tasks per thread to aim for, so the work stealing has something to even
+// out.
+static const size_t TASKS_PER_THREAD = 4;
+
+
+void surrogateSpans(const WindowStats &window, const std::vector<Interval> &intervals,
+                    std::vector<Interval> &spans)
+{
+    spans.clear();
+
+    if (intervals.empty()) {
+        Interval span = {window.timeMin, window.timeMax};
+        spans.push_back(span);
+        return;
+    }
+
+    for (size_t k = 0; k < intervals.size() && intervals[k].start <= window.timeMax; k++) {
+        Interval span = {std::max(intervals[k].start, window.timeMin),
+                         std::min(intervals[k].end, window.timeMax)};
+        if (span.end >= span.start) {
+            spans.push_back(span);
+        }
+    }
+}
+
+
+// Jitters the spikes [first, last) of a train, all of which lie in span.
+static void jitterSpan(const double *first, const double *last, const Interval &span,
+                       double width, PhiloxRNG &rng, double *out)
+{
+    double lo = span.start;
+    double hi = span.end;
+    for (const double *s = first; s < last; s++) {
+        double t = *s + (2.0 * rng.uniform() - 1.0) * width;
+        if (t < lo) {
+            t = 2.0 * lo - t;
+        }
+        if (t > hi) {
+            t = 2.0 * hi - t;
+        }
+        *out++ = std::min(std::max(t, lo), hi);
+    }
+}
+
+
+// Shuffles the ISIs of the spikes [first, last) of a train, keeping the
+// first spike where it is.  isi is scratch space.
+static void shuffleSpan(const double *first, const double *last, PhiloxRNG &rng,
+                        std::vector<double> &isi, double *out)
+{
+    size_t n = last - first;
+    if (n == 0) {
+        return;
+    }
+
+    // Fisher-Yates shuffle of the ISIs, then add them back up from the
+    // first spike.
+    isi.resize(n - 1);
+    for (size_t k = 1; k < n; k++) {
+        isi[k-1] = first[k] - first[k-1];
+    }
+    for (size_t k = isi.size(); k > 1; k--) {
+        std::swap(isi[k-1], isi[rng.below((uint32_t)k)]);
+    }
+    // The last spike is the same sum of ISIs in another order, so it only
+    // moves by rounding.  Capping at it keeps the train in the span.
+    out[0] = first[0];
+    for (size_t k = 1; k < n; k++) {
+        out[k] = std::min(out[k-1] + isi[k-1], first[n-1]);
+    }
+}
+
+
+void makeSurrogate(SpikeTrain train, size_t neuron, size_t surrogate,
+                   const SurrogateOptions &options, const std::vector<Interval> &spans,
+                   std::vector<double> &out)
+{
+    PhiloxRNG rng(options.seed, options.stream, (uint32_t)neuron, (uint32_t)surrogate);
+
+    out.assign(train.t, train.t + train.n);
+    if (train.n == 0) {
+        return;
+    }
+
+    // Each span's spikes are handled on their own, so none of them leave
+    // it.  Spikes between the spans stay as they are in out.
+    std::vector<double> isi;
+    const double *end = train.t + train.n;
+    const double *first = train.t;
+    for (size_t k = 0; k < spans.size() && first < end; k++) {
+        first = std::lower_bound(first, end, spans[k].start);
+        const double *last = std::upper_bound(first, end, spans[k].end);
+        double *o = out.data() + (first - train.t);
+
+        if (options.method == SurrogateJitter) {
+            jitterSpan(first, last, spans[k], options.jitterWidth, rng, o);
+        }
+        else {
+            shuffleSpan(first, last, rng, isi, o);
+        }
+        first = last;
+    }
+
+    if (options.method == SurrogateJitter) {
+        std::sort(out.begin(), out.end());
+    }
+}
+
+
+// Counts of surrogate AMDs below and equal to the observed AMD.
+struct NullCounts
+{
+    std::vector<uint32_t> below;
+    std::vector<uint32_t> ties;
+
+    void resize(size_t n)
+    {
+        below.assign(n, 0);
+        ties.assign(n, 0);
+    }
+
+    void count(double observed, double surrogate, size_t index)
+    {
+        if (surrogate < observed) {
+            below[index]++;
+        }
+        else if (surrogate == observed) {
+            ties[index]++;
+        }
+    }
+};
+
+
+void computeSurrogateAMD(const PackedTrains &trains, const WindowStats &window,
+                         const std::vector<Interval> &intervals, const double *amd,
+                         const SurrogateOptions &options, double *pValue,
+                         double *percentile, ThreadPool &pool)
+{
+    const double nan = std::numeric_limits<double>::quiet_NaN();
+    size_t n = trains.size();
+    size_t K = options.nSurrogates;
+
+    std::vector<Interval> spans;
+    surrogateSpans(window, intervals, spans);
+
+    size_t tileSize = chooseTileSize(trains);
+    std::vector<std::pair<size_t, size_t> > tiles;
+    listTiles(n, tileSize, tiles);
+
+    // Small windows have few tiles, so the surrogates are split up as well.
+    size_t nTiles = tiles.size();
+    size_t nGroups = 1;
+    if (nTiles > 0 && nTiles < pool.size() * TASKS_PER_THREAD) {
+        nGroups = std::min(std::max<size_t>(K, 1), (pool.size() * TASKS_PER_THREAD + nTiles - 1) / nTiles);
+    }
+
+    NullCounts totals;
+    totals.resize(n * n);
+    std::mutex totalsMutex;
+
+    pool.runTasks(nTiles * nGroups, [&](size_t task) {
+        size_t i0 = tiles[task / nGroups].first;
+        size_t j0 = tiles[task / nGroups].second;
+        size_t g = task % nGroups;
+        size_t i1 = std::min(i0 + tileSize, n);
+        size_t j1 = std::min(j0 + tileSize, n);
+        size_t ni = i1 - i0;
+        size_t nj = j1 - j0;
+        bool isDiagonal = i0 == j0;
+
+        // Counts for the tile, [i - i0 + (j - j0)*ni] for i -> j and
+        // [j - j0 + (i - i0)*nj] after the first ni*nj for j -> i.
+        NullCounts counts;
+        counts.resize(2 * ni * nj);
+
+        std::vector<std::vector<double> > rowSurrogates(ni);
+        std::vector<std::vector<double> > colSurrogates(isDiagonal ? 0 : nj);
+
+        for (size_t k = K * g / nGroups; k < K * (g + 1) / nGroups; k++) {
+            for (size_t i = i0; i < i1; i++) {
+                makeSurrogate(trains[i], i, k, options, spans, rowSurrogates[i - i0]);
+            }
+            for (size_t j = j0; j < j1 && !isDiagonal; j++) {
+                makeSurrogate(trains[j], j, k, options, spans, colSurrogates[j - j0]);
+            }
+            const std::vector<std::vector<double> > &cols = isDiagonal ? rowSurrogates : colSurrogates;
+
+            for (size_t i = i0; i < i1; i++) {
+                SpikeTrain a = {rowSurrogates[i - i0].data(), rowSurrogates[i - i0].size()};
+                for (size_t j = isDiagonal ? i + 1 : j0; j < j1; j++) {
+                    SpikeTrain b = {cols[j - j0].data(), cols[j - j0].size()};
+                    double ij, ji;
+                    pairAMD(a, b, &ij, &ji);
+                    counts.count(amd[i + j*n], ij, (i - i0) + (j - j0)*ni);
+                    counts.count(amd[j + i*n], ji, ni*nj + (j - j0) + (i - i0)*nj);
+                }
+            }
+        }
+
+        std::lock_guard<std::mutex> lock(totalsMutex);
+        for (size_t i = i0; i < i1; i++) {
+            for (size_t j = isDiagonal ? i + 1 : j0; j < j1; j++) {
+                size_t ij = (i - i0) + (j - j0)*ni;
+                size_t ji = ni*nj + (j - j0) + (i - i0)*nj;
+                totals.below[i + j*n] += counts.below[ij];
+                totals.ties[i + j*n] += counts.ties[ij];
+                totals.below[j + i*n] += counts.below[ji];
+                totals.ties[j + i*n] += counts.ties[ji];
+            }
+        }
+    });
+
+    for (size_t j = 0; j < n; j++) {
+        for (size_t i = 0; i < n; i++) {
+            size_t index = i + j*n;
+            if (i == j || amd[index] != amd[index] || K == 0) {
+                pValue[index] = nan;
+                percentile[index] = nan;
+                continue;
+            }
+            double below = (double)totals.below[index];
+            double ties = (double)totals.ties[index];
+            pValue[index] = (1.0 + below + ties) / (double)(K + 1);
+            percentile[index] = 100.0 * (below + 0.5 * ties) / (double)K;
+        }
+    }
+}
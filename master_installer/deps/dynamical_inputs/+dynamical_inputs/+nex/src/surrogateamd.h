@@ -0,0 +1,136 @@
+#ifndef SURROGATEAMD_H
+#define SURROGATEAMD_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "spiketrains.h"
+#include "amdkernel.h"
+#include "threadpool.h"
+
+// How the surrogate spike trains are made.
+typedef enum
+{
+    // Every spike is moved by a uniform amount in [-width, width].
+    SurrogateJitter,
+
+    // The ISIs of each train are put in a random order, keeping the first
+    // spike where it is.  With intervals the ISIs within each interval are
+    // shuffled separately.
+    SurrogateShuffle
+} SurrogateMethod;
+
+struct SurrogateOptions
+{
+    SurrogateMethod method;
+    size_t nSurrogates;
+
+    // Jitter half width. (s)
+    double jitterWidth;
+
+    // Random number stream.  The same seed and stream always give the same
+    // surrogates, regardless of the number of threads.
+    uint32_t seed;
+    uint32_t stream;
+};
+
+
+/*******************************************************************************
+ surrogateSpans - Lists the spans the surrogate spikes of a window may use.
+
+ Syntax:
+ surrogateSpans(const WindowStats &window, const std::vector<Interval> &intervals,
+                std::vector<Interval> &spans)
+
+ Description:
+ Intersects the time span of the window's spikes with the intervals the
+ spikes were selected from.  With no intervals the span is the window's
+ whole time span.  Intervals are closed, so spans of no length are kept,
+ since a spike can sit on one.
+
+ Input:
+ window - Time span of the window's spikes.
+ intervals - Sorted, disjoint intervals as produced by mergeIntervals, or
+     empty if the spikes weren't restricted.
+
+ Output:
+ spans - Cleared and filled with the spans.
+*******************************************************************************/
+void surrogateSpans(const WindowStats &window, const std::vector<Interval> &intervals,
+                    std::vector<Interval> &spans);
+
+
+/*******************************************************************************
+ makeSurrogate - Generates one surrogate of a spike train.
+
+ Syntax:
+ makeSurrogate(SpikeTrain train, size_t neuron, size_t surrogate,
+               const SurrogateOptions &options, const std::vector<Interval> &spans,
+               std::vector<double> &out)
+
+ Description:
+ The random numbers come from a counter based generator keyed by the seed
+ and stream, with the neuron and surrogate indices as the counter, so any
+ surrogate can be regenerated on its own.  Every surrogate spike stays
+ within the span of the original spike, so no spike lands in a gap between
+ intervals and the spike count of each interval doesn't change.  Jittered
+ spikes that leave their span are reflected back into it, and shuffled
+ ISIs are rebuilt from the first spike of each span.  Spikes outside all
+ the spans are left where they are.  The result is sorted.
+
+ Input:
+ train - The original spike train.
+ neuron, surrogate - Indices that pick the random numbers used.
+ options - Surrogate method and parameters.
+ spans - The window's spans, as returned by surrogateSpans.
+
+ Output:
+ out - The surrogate train.
+*******************************************************************************/
+void makeSurrogate(SpikeTrain train, size_t neuron, size_t surrogate,
+                   const SurrogateOptions &options, const std::vector<Interval> &spans,
+                   std::vector<double> &out);
+
+
+/*******************************************************************************
+ computeSurrogateAMD - Empirical null distribution of every pair's AMD.
+
+ Syntax:
+ computeSurrogateAMD(const PackedTrains &trains, const WindowStats &window,
+                     const std::vector<Interval> &intervals, const double *amd,
+                     const SurrogateOptions &options, double *pValue,
+                     double *percentile, ThreadPool &pool)
+
+ Description:
+ Compares the AMD of each ordered neuron pair against its AMD in K
+ surrogate versions of the window.  The pair matrix is split into tiles,
+ and the surrogates into groups when there aren't enough tiles to keep the
+ threads busy.  Each task regenerates the surrogates of its tile's neurons
+ on the fly, so no surrogate is ever stored beyond the task that uses it.
+ Each task counts how many of its surrogate AMDs fall below, or tie, the
+ observed AMD and adds its counts to the totals at the end.
+
+ A small AMD means the spikes of the pair are closer than chance, so the
+ p-value is one sided towards small AMDs: (1 + #{surrogate <= observed}) /
+ (K + 1).  The percentile is the mid rank of the observed AMD within the
+ surrogates, 100 * (#{surrogate < observed} + #{surrogate == observed}/2) / K.
+ The diagonal and pairs with a NaN AMD are NaN.
+
+ Input:
+ trains - The window's packed spike trains.
+ window - The window's time span, as returned by computeWindowStats.
+ intervals - The merged intervals the trains were selected from, or empty.
+     The surrogate spikes are kept within them.
+ amd - The observed n x n AMD matrix.
+ options - Surrogate method and parameters.
+ pool - Thread pool to run on.
+
+ Output:
+ pValue, percentile - Preallocated column major n x n output matrices.
+*******************************************************************************/
+void computeSurrogateAMD(const PackedTrains &trains, const WindowStats &window,
+                         const std::vector<Interval> &intervals, const double *amd,
+                         const SurrogateOptions &options, double *pValue,
+                         double *percentile, ThreadPool &pool);
+
+#endif
@@ -0,0 +1,273 @@
+#include "threadpool.h"
+
+#include <algorithm>
+
+// The engine wide pool.  Created on first use.
+static ThreadPool *g_threadPool = NULL;
+
+
+ThreadPool::ThreadPool(size_t nThreads)
+    : m_Body(NULL), m_TaskBody(NULL), m_Cancelled(false), m_N(0), m_GrainSize(1),
+      m_NextChunk(0), m_NumActive(0), m_JobID(0), m_Stop(false)
+{
+    // Default to one thread per core.  The calling thread counts as one of
+    // them, so we start one less worker.
+    if (nThreads == 0) {
+        nThreads = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    // One task queue per thread, slot 0 belongs to the calling thread.
+    for (size_t i = 0; i < nThreads; i++) {
+        m_Queues.push_back(std::unique_ptr<TaskQueue>(new TaskQueue));
+    }
+
+    for (size_t i = 1; i < nThreads; i++) {
+        m_Workers.push_back(std::thread(&ThreadPool::workerLoop, this, i));
+    }
+}
+
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        m_Stop = true;
+    }
+    m_WorkReady.notify_all();
+
+    for (size_t i = 0; i < m_Workers.size(); i++) {
+        m_Workers[i].join();
+    }
+}
+
+
+void ThreadPool::parallelFor(size_t n, size_t grainSize, const std::function<void(size_t, size_t)> &body)
+{
+    if (n == 0) {
+        return;
+    }
+
+    grainSize = std::max<size_t>(grainSize, 1);
+
+    // Don't bother waking up the workers if there's only one chunk of work.
+    if (m_Workers.empty() || n <= grainSize) {
+        body(0, n);
+        return;
+    }
+
+    // Publish the job and wake up the workers.
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        m_Body = &body;
+        m_N = n;
+        m_GrainSize = grainSize;
+        m_NextChunk = 0;
+        m_NumActive = m_Workers.size();
+        m_Error = std::exception_ptr();
+        m_JobID++;
+    }
+    m_WorkReady.notify_all();
+
+    // Pitch in on the calling thread, then wait for the stragglers.
+    runChunks();
+
+    std::exception_ptr error;
+    {
+        std::unique_lock<std::mutex> lock(m_Mutex);
+        m_WorkDone.wait(lock, [this] { return m_NumActive == 0; });
+        m_Body = NULL;
+        error = m_Error;
+        m_Error = std::exception_ptr();
+    }
+
+    if (error) {
+        std::rethrow_exception(error);
+    }
+}
+
+
+void ThreadPool::runTasks(size_t nTasks, const std::function<void(size_t)> &body)
+{
+    if (nTasks == 0) {
+        return;
+    }
+
+    if (m_Workers.empty() || nTasks == 1) {
+        for (size_t t = 0; t < nTasks; t++) {
+            body(t);
+        }
+        return;
+    }
+
+    // Deal out the tasks in contiguous blocks, one per thread.
+    size_t nThreads = m_Queues.size();
+    for (size_t slot = 0; slot < nThreads; slot++) {
+        size_t tBegin = nTasks * slot / nThreads;
+        size_t tEnd = nTasks * (slot + 1) / nThreads;
+        std::lock_guard<std::mutex> lock(m_Queues[slot]->mutex);
+        m_Queues[slot]->tasks.clear();
+        for (size_t t = tBegin; t < tEnd; t++) {
+            m_Queues[slot]->tasks.push_back(t);
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        m_TaskBody = &body;
+        m_Cancelled = false;
+        m_NumActive = m_Workers.size();
+        m_Error = std::exception_ptr();
+        m_JobID++;
+    }
+    m_WorkReady.notify_all();
+
+    runQueuedTasks(0);
+
+    std::exception_ptr error;
+    {
+        std::unique_lock<std::mutex> lock(m_Mutex);
+        m_WorkDone.wait(lock, [this] { return m_NumActive == 0; });
+        m_TaskBody = NULL;
+        error = m_Error;
+        m_Error = std::exception_ptr();
+    }
+
+    if (error) {
+        std::rethrow_exception(error);
+    }
+}
+
+
+void ThreadPool::workerLoop(size_t slot)
+{
+    unsigned long lastJob = 0;
+
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> lock(m_Mutex);
+            m_WorkReady.wait(lock, [&] { return m_Stop || m_JobID != lastJob; });
+            if (m_Stop) {
+                return;
+            }
+            lastJob = m_JobID;
+        }
+
+        runJob(slot);
+
+        {
+            std::lock_guard<std::mutex> lock(m_Mutex);
+            if (--m_NumActive == 0) {
+                m_WorkDone.notify_one();
+            }
+        }
+    }
+}
+
+
+void ThreadPool::runJob(size_t slot)
+{
+    if (m_TaskBody != NULL) {
+        runQueuedTasks(slot);
+    }
+    else {
+        runChunks();
+    }
+}
+
+
+void ThreadPool::recordError()
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    if (!m_Error) {
+        m_Error = std::current_exception();
+    }
+}
+
+
+void ThreadPool::runChunks()
+{
+    size_t nChunks = (m_N + m_GrainSize - 1) / m_GrainSize;
+
+    for (;;) {
+        size_t chunk = m_NextChunk.fetch_add(1);
+        if (chunk >= nChunks) {
+            break;
+        }
+
+        size_t iBegin = chunk * m_GrainSize;
+        size_t iEnd = std::min(iBegin + m_GrainSize, m_N);
+
+        try {
+            (*m_Body)(iBegin, iEnd);
+        }
+        catch (...) {
+            // Keep the first error and make everyone else stop pulling work.
+            recordError();
+            m_NextChunk = nChunks;
+        }
+    }
+}
+
+
+bool ThreadPool::takeTask(size_t slot, size_t &task)
+{
+    // Our own queue first, oldest task first.
+    {
+        TaskQueue &own = *m_Queues[slot];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.tasks.empty()) {
+            task = own.tasks.front();
+            own.tasks.pop_front();
+            return true;
+        }
+    }
+
+    // Then steal from the back of the other queues, starting with our
+    // neighbour so the thieves spread out over different victims.
+    size_t nThreads = m_Queues.size();
+    for (size_t k = 1; k < nThreads; k++) {
+        TaskQueue &victim = *m_Queues[(slot + k) % nThreads];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.tasks.empty()) {
+            task = victim.tasks.back();
+            victim.tasks.pop_back();
+            return true;
+        }
+    }
+
+    return false;
+}
+
+
+void ThreadPool::runQueuedTasks(size_t slot)
+{
+    // Tasks never create new tasks, so once every queue is empty there's
+    // nothing left to do.
+    size_t task;
+    while (!m_Cancelled && takeTask(slot, task)) {
+        try {
+            (*m_TaskBody)(task);
+        }
+        catch (...) {
+            recordError();
+            m_Cancelled = true;
+        }
+    }
+}
+
+
+ThreadPool &getThreadPool()
+{
+    if (g_threadPool == NULL) {
+        g_threadPool = new ThreadPool();
+    }
+
+    return *g_threadPool;
+}
+
+
+void shutdownThreadPool()
+{
+    delete g_threadPool;
+    g_threadPool = NULL;
+}
@@ -0,0 +1,121 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed size pool of worker threads used by the analysis kernels.
+//
+// Work handed to the pool must never call into the MATLAB API (mx* or mex*
+// functions), those are only safe on the MATLAB thread.  Allocate all the
+// mxArrays up front, hand raw pointers to the workers and pack the results
+// once parallelFor returns.
+class ThreadPool
+{
+public:
+    explicit ThreadPool(size_t nThreads = 0);
+    ~ThreadPool();
+
+    // Number of threads that run work, including the calling thread.
+    size_t size() const { return m_Workers.size() + 1; }
+
+    /***************************************************************************
+     parallelFor - Runs a loop body over [0, n) on all threads.
+
+     Syntax:
+     pool.parallelFor(size_t n, size_t grainSize, body)
+
+     Description:
+     Splits [0, n) into chunks of grainSize iterations and calls
+     body(iBegin, iEnd) once per chunk.  Threads pull the next chunk as soon
+     as they finish their last one, so uneven chunks balance out.  The
+     calling thread takes part in the work and the call blocks until every
+     chunk is done.  If a chunk throws, the remaining chunks are skipped and
+     the first exception is rethrown on the calling thread.
+    ***************************************************************************/
+    void parallelFor(size_t n, size_t grainSize, const std::function<void(size_t, size_t)> &body);
+
+    /***************************************************************************
+     runTasks - Runs a list of independent tasks with work stealing.
+
+     Syntax:
+     pool.runTasks(size_t nTasks, body)
+
+     Description:
+     Calls body(task) once for every task in [0, nTasks).  Each thread is
+     given its own contiguous block of tasks up front, so neighbouring tasks
+     (e.g. the tiles of one window) tend to run on the same thread and share
+     its cache.  A thread that runs out of work steals single tasks from the
+     far end of another thread's block, which keeps every thread busy when
+     the tasks take very different amounts of time.  Error handling is the
+     same as for parallelFor.
+    ***************************************************************************/
+    void runTasks(size_t nTasks, const std::function<void(size_t)> &body);
+
+private:
+    ThreadPool(const ThreadPool &);
+    ThreadPool &operator=(const ThreadPool &);
+
+    // A thread's queue of task indices for runTasks.  The owner takes tasks
+    // from the front, thieves take them from the back.
+    struct TaskQueue
+    {
+        std::mutex mutex;
+        std::deque<size_t> tasks;
+    };
+
+    void workerLoop(size_t slot);
+    void runJob(size_t slot);
+    void runChunks();
+    void runQueuedTasks(size_t slot);
+    bool takeTask(size_t slot, size_t &task);
+    void recordError();
+
+    std::vector<std::thread> m_Workers;
+    std::mutex m_Mutex;
+    std::condition_variable m_WorkReady;
+    std::condition_variable m_WorkDone;
+
+    // The job currently being run.  Either m_Body (parallelFor) or
+    // m_TaskBody (runTasks) is set.
+    const std::function<void(size_t, size_t)> *m_Body;
+    const std::function<void(size_t)> *m_TaskBody;
+    std::vector<std::unique_ptr<TaskQueue> > m_Queues;
+    std::atomic<bool> m_Cancelled;
+    size_t m_N;
+    size_t m_GrainSize;
+    std::atomic<size_t> m_NextChunk;
+    size_t m_NumActive;
+    unsigned long m_JobID;
+    bool m_Stop;
+    std::exception_ptr m_Error;
+};
+
+
+/*******************************************************************************
+ getThreadPool - Returns the engine wide thread pool.
+
+ Syntax:
+ ThreadPool &getThreadPool()
+
+ Description:
+ The pool is created the first time it's needed and lives until the mex file
+ is cleared, so threads aren't spun up on every call into the engine.
+*******************************************************************************/
+ThreadPool &getThreadPool();
+
+
+/*******************************************************************************
+ shutdownThreadPool - Joins and deletes the engine wide thread pool.
+*******************************************************************************/
+void shutdownThreadPool();
+
+#endif
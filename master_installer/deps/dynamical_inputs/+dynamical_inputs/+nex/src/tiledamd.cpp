@@ -0,0 +1,264 @@
+#include "tiledamd.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <utility>
+
+// Number of doubles that comfortably fit in a per core L2 cache (256 KB),
+// leaving some room for the output.
+static const size_t L2_CACHE_DOUBLES = 24 * 1024;
+
+static const size_t MIN_TILE_SIZE = 8;
+static const size_t MAX_TILE_SIZE = 256;
+
+
+size_t chooseTileSize(const PackedTrains &trains)
+{
+    size_t n = trains.size();
+    if (n == 0) {
+        return MIN_TILE_SIZE;
+    }
+
+    // A tile holds the trains of its rows and of its columns.
+    double meanSpikes = (double)trains.times.size() / (double)n;
+    double tileSize = (double)L2_CACHE_DOUBLES / (2.0 * std::max(meanSpikes, 1.0));
+
+    return std::min(MAX_TILE_SIZE, std::max(MIN_TILE_SIZE, (size_t)tileSize));
+}
+
+
+// Mean distance from the spikes of a to their nearest spike in b.  Same
+// merge as pairAMD, but only one direction is needed when a row is processed
+// on its own.
+static double directedAMD(SpikeTrain a, SpikeTrain b)
+{
+    if (a.n == 0 || b.n == 0) {
+        return std::numeric_limits<double>::quiet_NaN();
+    }
+
+    double sum = 0.0;
+    size_t j = 0;
+    for (size_t i = 0; i < a.n; i++) {
+        double t = a.t[i];
+        while (j < b.n && b.t[j] < t) {
+            j++;
+        }
+
+        double d = (j < b.n) ? b.t[j] - t : std::numeric_limits<double>::infinity();
+        if (j > 0) {
+            d = std::min(d, t - b.t[j-1]);
+        }
+        sum += d;
+    }
+
+    return sum / (double)a.n;
+}
+
+
+void listTiles(size_t n, size_t tileSize, std::vector<std::pair<size_t, size_t> > &tiles)
+{
+    size_t nBlocks = (n + tileSize - 1) / tileSize;
+
+    tiles.clear();
+    tiles.reserve(nBlocks * (nBlocks + 1) / 2);
+    for (size_t bi = 0; bi < nBlocks; bi++) {
+        for (size_t bj = bi; bj < nBlocks; bj++) {
+            tiles.push_back(std::make_pair(bi * tileSize, bj * tileSize));
+        }
+    }
+}
+
+
+// Fills in the pairs of the tile with rows [i0, i0 + tileSize) and columns
+// [j0, j0 + tileSize), plus their mirror images below the diagonal.
+template <typename T>
+static void computeAMDTile(const PackedTrains &trains, const std::vector<NeuronStats> &stats,
+                           size_t i0, size_t j0, size_t tileSize, T *amd, T *zscore)
+{
+    size_t n = trains.size();
+    size_t i1 = std::min(i0 + tileSize, n);
+    size_t j1 = std::min(j0 + tileSize, n);
+
+    for (size_t i = i0; i < i1; i++) {
+        SpikeTrain a = trains[i];
+
+        if (i0 == j0) {
+            amd[i + i*n] = 0;
+            if (zscore != NULL) {
+                zscore[i + i*n] = (T)computeZScore(0.0, stats[i], stats[i]);
+            }
+        }
+
+        for (size_t j = (i0 == j0) ? i + 1 : j0; j < j1; j++) {
+            double ij, ji;
+            pairAMD(a, trains[j], &ij, &ji);
+            amd[i + j*n] = (T)ij;
+            amd[j + i*n] = (T)ji;
+            if (zscore != NULL) {
+                zscore[i + j*n] = (T)computeZScore(ij, stats[i], stats[j]);
+                zscore[j + i*n] = (T)computeZScore(ji, stats[j], stats[i]);
+            }
+        }
+    }
+}
+
+
+// A window's trains borrowed from the caller, so a single window can go
+// through runWindowTiles without copying them into a job.
+struct BorrowedWindow
+{
+    const PackedTrains &trains;
+    size_t tileSize;
+};
+
+
+template <typename T>
+void computeTiledAMD(const PackedTrains &trains, const std::vector<NeuronStats> &stats,
+                     T *amd, T *zscore, ThreadPool &pool)
+{
+    BorrowedWindow window = {trains, chooseTileSize(trains)};
+    std::vector<BorrowedWindow> windows(1, window);
+
+    runWindowTiles(windows, pool, [&](BorrowedWindow &w, const WindowTileTask &task) {
+        computeAMDTile(w.trains, stats, task.i0, task.j0, w.tileSize, amd, zscore);
+    });
+}
+
+
+void prepareWindowJobs(std::vector<AMDWindowJob> &jobs, ThreadPool &pool)
+{
+    // One window per chunk, the stats are cheap compared to the pairs.
+    pool.parallelFor(jobs.size(), 1, [&](size_t wBegin, size_t wEnd) {
+        std::vector<SpikeTrain> views;
+        for (size_t w = wBegin; w < wEnd; w++) {
+            AMDWindowJob &job = jobs[w];
+            views.resize(job.trains.size());
+            for (size_t i = 0; i < views.size(); i++) {
+                views[i] = job.trains[i];
+            }
+            computeWindowStats(views, job.window, job.stats);
+            job.tileSize = chooseTileSize(job.trains);
+        }
+    });
+}
+
+
+void computeWindowTile(AMDWindowJob &job, const WindowTileTask &task)
+{
+    if (job.amdSingle != NULL) {
+        computeAMDTile(job.trains, job.stats, task.i0, task.j0, job.tileSize,
+                       job.amdSingle, job.zscoreSingle);
+    }
+    else {
+        computeAMDTile(job.trains, job.stats, task.i0, task.j0, job.tileSize, job.amd, job.zscore);
+    }
+}
+
+
+void computeMultiWindowAMD(std::vector<AMDWindowJob> &jobs, ThreadPool &pool)
+{
+    prepareWindowJobs(jobs, pool);
+    runWindowTiles(jobs, pool, computeWindowTile);
+}
+
+
+// A candidate neighbor of a neuron in the top k search.
+struct Neighbor
+{
+    double zscore;
+    double amd;
+    size_t index;
+};
+
+// Orders neighbors so that the least significant one sits at the top of a
+// std heap and is the first to be replaced.
+static bool moreSignificant(const Neighbor &a, const Neighbor &b)
+{
+    return a.zscore > b.zscore;
+}
+
+
+template <typename T>
+void computeTopKAMD(const PackedTrains &trains, const std::vector<NeuronStats> &stats,
+                    size_t k, T *amd, T *zscore, double *neighbors, ThreadPool &pool)
+{
+    const double nan = std::numeric_limits<double>::quiet_NaN();
+    size_t n = trains.size();
+    size_t tileSize = chooseTileSize(trains);
+    size_t nBlocks = (n + tileSize - 1) / tileSize;
+
+    if (k == 0) {
+        return;
+    }
+
+    pool.parallelFor(nBlocks, 1, [&](size_t bBegin, size_t bEnd) {
+        std::vector<std::vector<Neighbor> > heaps(tileSize);
+
+        for (size_t b = bBegin; b < bEnd; b++) {
+            size_t i0 = b * tileSize;
+            size_t i1 = std::min(i0 + tileSize, n);
+
+            for (size_t i = i0; i < i1; i++) {
+                heaps[i - i0].clear();
+            }
+
+            // Walk the columns a tile at a time so the column trains are
+            // reused by every row of the block while they're in cache.
+            for (size_t j0 = 0; j0 < n; j0 += tileSize) {
+                size_t j1 = std::min(j0 + tileSize, n);
+
+                for (size_t i = i0; i < i1; i++) {
+                    SpikeTrain a = trains[i];
+                    std::vector<Neighbor> &heap = heaps[i - i0];
+
+                    for (size_t j = j0; j < j1; j++) {
+                        if (j == i) {
+                            continue;
+                        }
+
+                        Neighbor c;
+                        c.amd = directedAMD(a, trains[j]);
+                        c.zscore = computeZScore(c.amd, stats[i], stats[j]);
+                        c.index = j;
+                        if (std::isnan(c.zscore)) {
+                            continue;
+                        }
+
+                        if (heap.size() < k) {
+                            heap.push_back(c);
+                            std::push_heap(heap.begin(), heap.end(), moreSignificant);
+                        }
+                        else if (c.zscore > heap.front().zscore) {
+                            std::pop_heap(heap.begin(), heap.end(), moreSignificant);
+                            heap.back() = c;
+                            std::push_heap(heap.begin(), heap.end(), moreSignificant);
+                        }
+                    }
+                }
+            }
+
+            for (size_t i = i0; i < i1; i++) {
+                std::vector<Neighbor> &heap = heaps[i - i0];
+                std::sort_heap(heap.begin(), heap.end(), moreSignificant);
+
+                for (size_t r = 0; r < k; r++) {
+                    bool isSet = r < heap.size();
+                    amd[i + r*n] = (T)(isSet ? heap[r].amd : nan);
+                    zscore[i + r*n] = (T)(isSet ? heap[r].zscore : nan);
+                    neighbors[i + r*n] = isSet ? (double)(heap[r].index + 1) : 0.0;
+                }
+            }
+        }
+    });
+}
+
+
+template void computeTiledAMD<double>(const PackedTrains &, const std::vector<NeuronStats> &,
+                                      double *, double *, ThreadPool &);
+template void computeTiledAMD<float>(const PackedTrains &, const std::vector<NeuronStats> &,
+                                     float *, float *, ThreadPool &);
+template void computeTopKAMD<double>(const PackedTrains &, const std::vector<NeuronStats> &,
+                                     size_t, double *, double *, double *, ThreadPool &);
+template void computeTopKAMD<float>(const PackedTrains &, const std::vector<NeuronStats> &,
+                                    size_t, float *, float *, double *, ThreadPool &);
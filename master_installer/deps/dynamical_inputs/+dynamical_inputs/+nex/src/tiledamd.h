@@ -0,0 +1,233 @@
+#ifndef TILEDAMD_H
+#define TILEDAMD_H
+
+#include <cstddef>
+#include <utility>
+#include <vector>
+#include "spiketrains.h"
+#include "amdkernel.h"
+#include "threadpool.h"
+
+
+/*******************************************************************************
+ chooseTileSize - Picks the number of neurons per side of a pair tile.
+
+ Syntax:
+ size_t chooseTileSize(const PackedTrains &trains)
+
+ Description:
+ A tile of the pair matrix touches the spike trains of its rows and its
+ columns.  The tile size is picked so that, for the window's average spike
+ count, both sets of trains fit in a typical per core L2 cache.
+*******************************************************************************/
+size_t chooseTileSize(const PackedTrains &trains);
+
+
+/*******************************************************************************
+ listTiles - Lists the tiles on and above the diagonal of an n x n pair
+             matrix.
+
+ Syntax:
+ listTiles(size_t n, size_t tileSize, std::vector<std::pair<size_t, size_t> > &tiles)
+
+ Description:
+ Each tile is given by its first row and column.  A tile covers both
+ directions of its pairs, so the tiles below the diagonal are filled in for
+ free.
+*******************************************************************************/
+void listTiles(size_t n, size_t tileSize, std::vector<std::pair<size_t, size_t> > &tiles);
+
+
+// One tile of one window's pair matrix.  window indexes the job list the
+// task was made from.
+struct WindowTileTask
+{
+    size_t window;
+    size_t i0;
+    size_t j0;
+};
+
+
+/*******************************************************************************
+ listWindowTileTasks - Lists the tiles of a set of windows.
+
+ Syntax:
+ listWindowTileTasks(const std::vector<Job> &jobs, std::vector<WindowTileTask> &tasks)
+
+ Description:
+ Each job must have its packed trains and tileSize set.  The tasks of one
+ window write to different parts of its output, so they can run in any
+ order on any thread.
+*******************************************************************************/
+template <typename Job>
+void listWindowTileTasks(const std::vector<Job> &jobs, std::vector<WindowTileTask> &tasks)
+{
+    std::vector<std::pair<size_t, size_t> > tiles;
+
+    tasks.clear();
+    for (size_t w = 0; w < jobs.size(); w++) {
+        listTiles(jobs[w].trains.size(), jobs[w].tileSize, tiles);
+        for (size_t t = 0; t < tiles.size(); t++) {
+            WindowTileTask task = {w, tiles[t].first, tiles[t].second};
+            tasks.push_back(task);
+        }
+    }
+}
+
+
+/*******************************************************************************
+ runWindowTiles - Runs the pair tiles of a set of windows.
+
+ Syntax:
+ runWindowTiles(std::vector<Job> &jobs, ThreadPool &pool, TileFn computeTile)
+
+ Description:
+ The tile scheduler shared by all the pair kernels.  Every window's tiles
+ are listed with listWindowTileTasks and all of them run as one set of
+ tasks with work stealing, calling computeTile(job, task) for each.
+ Windows with many neurons turn into many tasks, small windows into a
+ single one, so the threads end up with similar amounts of work regardless
+ of how the neurons are spread over the windows.  A single window is just
+ a list of one.
+*******************************************************************************/
+template <typename Job, typename TileFn>
+void runWindowTiles(std::vector<Job> &jobs, ThreadPool &pool, TileFn computeTile)
+{
+    std::vector<WindowTileTask> tasks;
+    listWindowTileTasks(jobs, tasks);
+
+    pool.runTasks(tasks.size(), [&](size_t t) {
+        computeTile(jobs[tasks[t].window], tasks[t]);
+    });
+}
+
+
+/*******************************************************************************
+ computeTiledAMD - Computes the AMD and z-scores of a large window tile by
+                   tile.
+
+ Syntax:
+ computeTiledAMD<T>(const PackedTrains &trains, const std::vector<NeuronStats> &stats,
+                    T *amd, T *zscore, ThreadPool &pool)
+
+ Description:
+ Rather than listing every neuron pair up front, the upper triangle of the
+ pair matrix is split into square tiles and each tile is handed to the
+ thread pool as one task by runWindowTiles.  Within a tile the row and
+ column trains stay in cache while all of the tile's pairs are merged.
+
+ T is either double or float.  Calculations are always done in double, the
+ results are only rounded when written out, which halves the output size
+ for float.
+
+ Input:
+ trains - The window's packed spike trains.
+ stats - The window's neuron stats, as returned by computeWindowStats.
+ pool - Thread pool to run the tiles on.
+
+ Output:
+ amd - Preallocated column major n x n output matrix.
+ zscore - Preallocated n x n output matrix, or NULL to skip the z-scores.
+*******************************************************************************/
+template <typename T>
+void computeTiledAMD(const PackedTrains &trains, const std::vector<NeuronStats> &stats,
+                     T *amd, T *zscore, ThreadPool &pool);
+
+
+// Input and output of a single window for computeMultiWindowAMD.
+struct AMDWindowJob
+{
+    // Set by the caller.  amd and zscore point to preallocated k x k
+    // matrices, where k is the number of trains.  zscore may be NULL.  For
+    // single precision output, amdSingle and zscoreSingle are set instead.
+    PackedTrains trains;
+    double *amd = NULL;
+    double *zscore = NULL;
+    float *amdSingle = NULL;
+    float *zscoreSingle = NULL;
+
+    // Filled in by computeMultiWindowAMD.
+    WindowStats window;
+    std::vector<NeuronStats> stats;
+    size_t tileSize;
+};
+
+
+/*******************************************************************************
+ prepareWindowJobs - Fills in the stats and tile size of a set of windows.
+
+ Syntax:
+ prepareWindowJobs(std::vector<AMDWindowJob> &jobs, ThreadPool &pool)
+
+ Description:
+ First step of computeMultiWindowAMD.  Must be run before the jobs' tiles
+ are listed and computed.
+*******************************************************************************/
+void prepareWindowJobs(std::vector<AMDWindowJob> &jobs, ThreadPool &pool);
+
+
+/*******************************************************************************
+ computeWindowTile - Computes a single tile of a prepared window, as listed
+                     by listWindowTileTasks.
+*******************************************************************************/
+void computeWindowTile(AMDWindowJob &job, const WindowTileTask &task);
+
+
+/*******************************************************************************
+ computeMultiWindowAMD - Computes the AMD of many windows at once.
+
+ Syntax:
+ computeMultiWindowAMD(std::vector<AMDWindowJob> &jobs, ThreadPool &pool)
+
+ Description:
+ Splits every window's pair matrix into tiles and runs all the tiles of all
+ the windows as one set of tasks with runWindowTiles.  This replaces running
+ one window per task, where a window with many active neurons takes far
+ longer than the others and leaves most threads idle while it finishes.
+ The spike data is shared between the threads, nothing is copied per task.
+
+ Input:
+ jobs - One entry per window, see AMDWindowJob.
+ pool - Thread pool to run the tiles on.
+
+ Output:
+ jobs - The AMD/z-score matrices, stats and window time spans are filled in.
+*******************************************************************************/
+void computeMultiWindowAMD(std::vector<AMDWindowJob> &jobs, ThreadPool &pool);
+
+
+/*******************************************************************************
+ computeTopKAMD - Keeps only the k most significant AMD values of each neuron.
+
+ Syntax:
+ computeTopKAMD<T>(const PackedTrains &trains, const std::vector<NeuronStats> &stats,
+                   size_t k, T *amd, T *zscore, double *neighbors, ThreadPool &pool)
+
+ Description:
+ For every neuron i, finds the k neurons j with the largest z-score of the
+ AMD from i to j, i.e. the neurons i fires most consistently close to.  The
+ output is n x k rather than n x n, which is what makes windows with
+ thousands of neurons fit in memory.  Rows are processed in blocks, one
+ block per task, and each block walks the columns a tile at a time.  Only a
+ k sized heap per row is ever held.
+
+ Pairs with an undefined z-score (e.g. empty trains) are never selected.
+ Rows with fewer than k candidates are padded with NaN and a neighbor index
+ of zero.
+
+ Input:
+ trains - The window's packed spike trains.
+ stats - The window's neuron stats, as returned by computeWindowStats.
+ k - Number of neighbors to keep per neuron.
+ pool - Thread pool to run the row blocks on.
+
+ Output:
+ amd, zscore - Preallocated column major n x k matrices.  Row i holds the
+     values of neuron i's neighbors in order of decreasing z-score.
+ neighbors - Preallocated n x k matrix of the 1 based neighbor indices.
+*******************************************************************************/
+template <typename T>
+void computeTopKAMD(const PackedTrains &trains, const std::vector<NeuronStats> &stats,
+                    size_t k, T *amd, T *zscore, double *neighbors, ThreadPool &pool);
+
+#endif
@@ -0,0 +1,312 @@
+#include "waveformfeatures.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include "NexFile.h"
+#include "continuousfile.h"
+
+// Waveforms per read.
+static const size_t WAVEFORM_BLOCK = 1 << 14;
+
+// Waveforms per task within a block.
+static const size_t WAVEFORM_SLICE = 512;
+
+// Most sweeps of Jacobi rotations.  Convergence is quadratic, so this is
+// never reached in practice.
+static const int JACOBI_SWEEPS = 50;
+
+
+const char *readWaveformLayout(FILE *fp, int index, WaveformLayout &layout)
+{
+    NexFileHeader fileHeader;
+    NexVarHeader header;
+
+    const char *error = readVariableHeader(fp, NEX_VARIABLE_TYPE_WAVEFORM, index, fileHeader, header);
+    if (error != NULL) {
+        return error;
+    }
+    if (header.Count < 0 || header.NPointsWave < 1 || !(header.WFrequency > 0)) {
+        return "Invalid waveform variable header.";
+    }
+
+    layout.name.assign(header.Name, strnlen(header.Name, sizeof(header.Name)));
+    layout.timestampFrequency = fileHeader.Frequency;
+    layout.waveformFrequency = header.WFrequency;
+    layout.adToMV = header.ADtoMV;
+    layout.nPoints = (size_t)header.NPointsWave;
+    layout.count = (uint64_t)header.Count;
+    layout.dataOffset = (int64_t)(unsigned int)header.DataOffset;
+
+    return NULL;
+}
+
+
+// Reads n waveforms starting at waveform first.
+static bool readWaveforms(FILE *fp, const WaveformLayout &layout, uint64_t first, size_t n,
+                          int16_t *values)
+{
+    int64_t offset = layout.dataOffset + 4 * (int64_t)layout.count +
+                     2 * (int64_t)(first * layout.nPoints);
+    size_t nValues = n * layout.nPoints;
+    return n == 0 || (seekFile(fp, offset) && fread(values, 2, nValues, fp) == nValues);
+}
+
+
+// Calls body(first, n, values) for each block of waveforms, with
+// values holding the n waveforms from waveform first on.
+template <typename Body>
+static const char *forEachBlock(FILE *fp, const WaveformLayout &layout, Body body)
+{
+    std::vector<int16_t> values;
+
+    for (uint64_t first = 0; first < layout.count; first += WAVEFORM_BLOCK) {
+        size_t n = (size_t)std::min<uint64_t>(WAVEFORM_BLOCK, layout.count - first);
+        values.resize(n * layout.nPoints);
+        if (!readWaveforms(fp, layout, first, n, values.data())) {
+            return "Failed to read the waveforms.";
+        }
+        body(first, n, values.data());
+    }
+
+    return NULL;
+}
+
+
+// Eigen decomposition of the symmetric n x n matrix a, which is destroyed,
+// by cyclic Jacobi rotations.  The columns of vectors are the eigenvectors.
+static void jacobiEigen(std::vector<double> &a, size_t n, std::vector<double> &values,
+                        std::vector<double> &vectors)
+{
+    vectors.assign(n*n, 0.0);
+    for (size_t i = 0; i < n; i++) {
+        vectors[i + i*n] = 1.0;
+    }
+
+    for (int sweep = 0; sweep < JACOBI_SWEEPS; sweep++) {
+        double diagonal = 0.0;
+        double off = 0.0;
+        for (size_t q = 0; q < n; q++) {
+            diagonal += a[q + q*n] * a[q + q*n];
+            for (size_t p = 0; p < q; p++) {
+                off += a[p + q*n] * a[p + q*n];
+            }
+        }
+        if (off <= 1e-30 * diagonal || off == 0.0) {
+            break;
+        }
+
+        for (size_t q = 1; q < n; q++) {
+            for (size_t p = 0; p < q; p++) {
+                double apq = a[p + q*n];
+                if (apq == 0.0) {
+                    continue;
+                }
+
+                double theta = (a[q + q*n] - a[p + p*n]) / (2.0 * apq);
+                double t = (theta >= 0.0 ? 1.0 : -1.0) / (std::fabs(theta) + std::sqrt(theta*theta + 1.0));
+                double c = 1.0 / std::sqrt(t*t + 1.0);
+                double s = t * c;
+
+                for (size_t k = 0; k < n; k++) {
+                    double akp = a[k + p*n];
+                    double akq = a[k + q*n];
+                    a[k + p*n] = c*akp - s*akq;
+                    a[k + q*n] = s*akp + c*akq;
+                }
+                for (size_t k = 0; k < n; k++) {
+                    double apk = a[p + k*n];
+                    double aqk = a[q + k*n];
+                    a[p + k*n] = c*apk - s*aqk;
+                    a[q + k*n] = s*apk + c*aqk;
+                }
+                for (size_t k = 0; k < n; k++) {
+                    double vkp = vectors[k + p*n];
+                    double vkq = vectors[k + q*n];
+                    vectors[k + p*n] = c*vkp - s*vkq;
+                    vectors[k + q*n] = s*vkp + c*vkq;
+                }
+            }
+        }
+    }
+
+    values.resize(n);
+    for (size_t i = 0; i < n; i++) {
+        values[i] = a[i + i*n];
+    }
+}
+
+
+// Integer sums of the values less a per-point offset and of the products
+// of each pair of those, upper triangle only.  The offset is the first
+// block's mean, so a DC offset in the waveforms doesn't make the products
+// so large that the covariance is lost when the squared mean is taken off.
+struct WaveformSums
+{
+    std::vector<int64_t> sum;
+    std::vector<int64_t> products;
+
+    explicit WaveformSums(size_t d) : sum(d, 0), products(d*(d + 1)/2, 0) {}
+
+    void add(const int16_t *w, const int32_t *offset, size_t d)
+    {
+        int64_t *p = products.data();
+        for (size_t j = 0; j < d; j++) {
+            int64_t wj = (int32_t)w[j] - offset[j];
+            sum[j] += wj;
+            for (size_t k = j; k < d; k++) {
+                *p++ += wj * ((int32_t)w[k] - offset[k]);
+            }
+        }
+    }
+
+    void merge(const WaveformSums &other)
+    {
+        for (size_t j = 0; j < sum.size(); j++) {
+            sum[j] += other.sum[j];
+        }
+        for (size_t j = 0; j < products.size(); j++) {
+            products[j] += other.products[j];
+        }
+    }
+};
+
+
+const char *computeWaveformFeatures(FILE *fp, const WaveformLayout &layout,
+                                    size_t nComponents, WaveformFeatureSet &features,
+                                    ThreadPool &pool)
+{
+    size_t d = layout.nPoints;
+    size_t count = (size_t)layout.count;
+    size_t k = std::min(nComponents, d);
+    double scale = layout.adToMV;
+
+    // First pass: the sums for the mean and covariance.
+    WaveformSums total(d);
+    std::vector<int32_t> offset(d, 0);
+    const char *error = forEachBlock(fp, layout, [&](uint64_t first, size_t n, const int16_t *values) {
+        if (first == 0 && n > 0) {
+            for (size_t j = 0; j < d; j++) {
+                int64_t blockSum = 0;
+                for (size_t i = 0; i < n; i++) {
+                    blockSum += values[j + i*d];
+                }
+                offset[j] = (int32_t)std::floor((double)blockSum / n + 0.5);
+            }
+        }
+        size_t nSlices = (n + WAVEFORM_SLICE - 1) / WAVEFORM_SLICE;
+        std::vector<WaveformSums> partial(nSlices, WaveformSums(d));
+        pool.runTasks(nSlices, [&](size_t s) {
+            size_t end = std::min((s + 1) * WAVEFORM_SLICE, n);
+            for (size_t i = s * WAVEFORM_SLICE; i < end; i++) {
+                partial[s].add(values + i*d, offset.data(), d);
+            }
+        });
+        for (size_t s = 0; s < nSlices; s++) {
+            total.merge(partial[s]);
+        }
+    });
+    if (error != NULL) {
+        return error;
+    }
+
+    features.mean.assign(d, 0.0);
+    std::vector<double> covariance(d*d, 0.0);
+    if (count > 0) {
+        long double n = (long double)count;
+        for (size_t j = 0; j < d; j++) {
+            features.mean[j] = (double)(offset[j] + (long double)total.sum[j] / n) * scale;
+        }
+        const int64_t *p = total.products.data();
+        for (size_t j = 0; j < d; j++) {
+            for (size_t m = j; m < d; m++, p++) {
+                if (count > 1) {
+                    long double c = ((long double)*p - (long double)total.sum[j] * total.sum[m] / n) / (n - 1);
+                    covariance[j + m*d] = covariance[m + j*d] = (double)c * scale * scale;
+                }
+            }
+        }
+    }
+
+    std::vector<double> values;
+    std::vector<double> vectors;
+    jacobiEigen(covariance, d, values, vectors);
+
+    std::vector<size_t> order(d);
+    for (size_t j = 0; j < d; j++) {
+        order[j] = j;
+    }
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return values[a] > values[b]; });
+
+    features.nComponents = k;
+    features.components.resize(d*k);
+    features.explained.resize(k);
+    for (size_t c = 0; c < k; c++) {
+        const double *v = &vectors[order[c]*d];
+        size_t largest = 0;
+        for (size_t j = 1; j < d; j++) {
+            if (std::fabs(v[j]) > std::fabs(v[largest])) {
+                largest = j;
+            }
+        }
+        double sign = v[largest] < 0.0 ? -1.0 : 1.0;
+        for (size_t j = 0; j < d; j++) {
+            features.components[j + c*d] = sign * v[j];
+        }
+        features.explained[c] = std::max(values[order[c]], 0.0);
+    }
+
+    // Second pass: the features and scores.
+    features.timestamps.resize(count);
+    features.peak.resize(count);
+    features.trough.resize(count);
+    features.width.resize(count);
+    features.energy.resize(count);
+    features.scores.resize(count*k);
+
+    std::vector<int> ticks(count);
+    if (count > 0 && (!seekFile(fp, layout.dataOffset) || fread(ticks.data(), 4, count, fp) != count)) {
+        return "Failed to read the timestamps.";
+    }
+    for (size_t i = 0; i < count; i++) {
+        features.timestamps[i] = (double)ticks[i] / layout.timestampFrequency;
+    }
+
+    return forEachBlock(fp, layout, [&](uint64_t first, size_t n, const int16_t *block) {
+        pool.parallelFor(n, WAVEFORM_SLICE, [&](size_t begin, size_t end) {
+            std::vector<double> centered(d);
+            for (size_t b = begin; b < end; b++) {
+                const int16_t *w = block + b*d;
+                size_t i = (size_t)first + b;
+
+                size_t iMin = 0;
+                size_t iMax = 0;
+                int64_t energy = 0;
+                for (size_t j = 0; j < d; j++) {
+                    iMin = w[j] < w[iMin] ? j : iMin;
+                    iMax = w[j] > w[iMax] ? j : iMax;
+                    energy += (int32_t)w[j] * (int32_t)w[j];
+                    centered[j] = (double)w[j] * scale - features.mean[j];
+                }
+                size_t iAfter = iMin;
+                for (size_t j = iMin + 1; j < d; j++) {
+                    iAfter = w[j] > w[iAfter] ? j : iAfter;
+                }
+
+                features.peak[i] = (double)w[iMax] * scale;
+                features.trough[i] = (double)w[iMin] * scale;
+                features.width[i] = (double)(iAfter - iMin) / layout.waveformFrequency;
+                features.energy[i] = (double)energy * scale * scale;
+
+                for (size_t c = 0; c < k; c++) {
+                    const double *v = &features.components[c*d];
+                    double score = 0.0;
+                    for (size_t j = 0; j < d; j++) {
+                        score += centered[j] * v[j];
+                    }
+                    features.scores[i + c*count] = score;
+                }
+            }
+        });
+    });
+}
@@ -0,0 +1,102 @@
+#ifndef WAVEFORMFEATURES_H
+#define WAVEFORMFEATURES_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include "threadpool.h"
+
+// Where the waveforms of a waveform variable are in a NEX file.  The data
+// is count int32 timestamps followed by count waveforms of nPoints int16
+// values each.
+struct WaveformLayout
+{
+    std::string name;
+
+    // The file's timestamp rate and the waveforms' sampling rate. (Hz)
+    double timestampFrequency;
+    double waveformFrequency;
+    double adToMV;
+
+    size_t nPoints;
+    uint64_t count;
+    int64_t dataOffset;
+};
+
+// Features of each waveform of a variable, and the principal components
+// they're projected onto.
+struct WaveformFeatureSet
+{
+    // Per waveform, in file order: timestamp (s), largest and smallest
+    // value (mV), time from the trough to the highest point after it (s)
+    // and sum of squares (mV^2).
+    std::vector<double> timestamps;
+    std::vector<double> peak;
+    std::vector<double> trough;
+    std::vector<double> width;
+    std::vector<double> energy;
+
+    // Mean waveform (mV), the nPoints x nComponents component matrix,
+    // column major, and the variance along each component. (mV^2)
+    size_t nComponents;
+    std::vector<double> mean;
+    std::vector<double> components;
+    std::vector<double> explained;
+
+    // count x nComponents projections of the mean subtracted waveforms,
+    // column major. (mV)
+    std::vector<double> scores;
+};
+
+
+/*******************************************************************************
+ readWaveformLayout - Reads the layout of a waveform variable.
+
+ Syntax:
+ const char *readWaveformLayout(FILE *fp, int index, WaveformLayout &layout)
+
+ Input:
+ fp - Open NEX file.
+ index - 0 based index among the file's waveform variables.
+
+ Output:
+ const char * - NULL on success, otherwise a description of the problem.
+*******************************************************************************/
+const char *readWaveformLayout(FILE *fp, int index, WaveformLayout &layout);
+
+
+/*******************************************************************************
+ computeWaveformFeatures - Per waveform features and PCA scores.
+
+ Syntax:
+ const char *computeWaveformFeatures(FILE *fp, const WaveformLayout &layout,
+                                     size_t nComponents, WaveformFeatureSet &features,
+                                     ThreadPool &pool)
+
+ Description:
+ Makes two passes over the waveforms, a block at a time, without ever
+ converting the int16 values to a double matrix.  The first sums the
+ values and their products in 64 bit integers, which is exact and so
+ doesn't depend on how the blocks are split among the threads.  The
+ covariance matrix that gives is only nPoints x nPoints, so its top
+ components are found exactly with Jacobi rotations.  The second pass
+ works out the features and projects each waveform onto them.
+
+ Each component's sign is set so that its largest element is positive.
+
+ Input:
+ fp - Open NEX file.
+ layout - The waveform variable to read.
+ nComponents - Number of components to keep, at most nPoints.
+
+ Output:
+ const char * - NULL on success, otherwise a description of the problem.
+ features - The features.
+*******************************************************************************/
+const char *computeWaveformFeatures(FILE *fp, const WaveformLayout &layout,
+                                    size_t nComponents, WaveformFeatureSet &features,
+                                    ThreadPool &pool);
+
+#endif
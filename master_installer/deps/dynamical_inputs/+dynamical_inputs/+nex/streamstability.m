@@ -0,0 +1,49 @@
+function stabilityValues = streamstability(timestamps, intervalTimes, windowTimes, neuronMask)
+% STREAMSTABILITY  Calculates the neighbor stability of a sequence of AMD
+% windows without keeping the windows around.
+%
+% Syntax:
+% stabilityValues = STREAMSTABILITY(timestamps, intervalTimes, windowTimes, neuronMask)
+%
+% Description:
+% Gives the same results as calculating the AMD z-scores of every window
+% and passing them to dynamical.math.stability with the 'neighbor' method,
+% but each window is compared with the next one as soon as both exist and
+% is then dropped.  Only a small batch of windows is held in memory at a
+% time, so long recordings don't need memory for every window.  The AMD of
+% a batch of windows is calculated while the previous batch is compared.
+% Overlapping windows are slid across like dynamical_inputs.nex.slidingamd.
+%
+% Input:
+% timestamps (cell) - Sorted spike timestamps for each neuron. (s)
+% intervalTimes (table|matrix) - Intervals to restrict the spikes to,
+%     either a table with 'Start' and 'End' variables or an Nx2
+%     [start end] matrix.  Leave empty to use all spikes.
+% windowTimes (matrix) - Wx2 [start end] matrix of time windows, sorted by
+%     start time.  Each window covers start <= s < end. (s)
+% neuronMask (logical) - nNeurons x W mask of the neurons to include in
+%     each window.
+%
+% Output:
+% stabilityValues (vector) - 1x(W-1) vector of the similarity between each
+%     window and the next one.
+%
+% See Also: dynamical.math.stability, dynamical_inputs.nex.windowstability
+
+narginchk(4, 4);
+
+validateattributes(timestamps, {'cell'}, {}, mfilename, 'timestamps', 1);
+validateattributes(windowTimes, {'numeric'}, {'2d'}, mfilename, 'windowTimes', 3);
+validateattributes(neuronMask, {'logical' 'numeric'}, ...
+    {'size', [numel(timestamps) size(windowTimes, 1)]}, mfilename, 'neuronMask', 4);
+
+if istable(intervalTimes)
+    intervalTimes = [intervalTimes.Start intervalTimes.End];
+elseif isempty(intervalTimes)
+    intervalTimes = [];
+end
+
+opcode = dynamical_inputs.nex.NexEngineOpcodes.StreamStability;
+
+stabilityValues = dynamical_inputs.nex.nexengine(opcode, ...
+    timestamps, double(intervalTimes), double(windowTimes), logical(neuronMask));
@@ -0,0 +1,92 @@
+function [pValues, percentiles, amdMatrix] = surrogateamd(trains, varargin)
+% SURROGATEAMD  Compares the AMD of a time window against surrogate data.
+%
+% Syntax:
+% pValues = SURROGATEAMD(trains)
+% [pValues, percentiles, amdMatrix] = SURROGATEAMD(trains)
+% ___ = SURROGATEAMD(___, options)
+%
+% Description:
+% Builds an empirical null distribution for the AMD of every neuron pair
+% of a window.  K surrogate versions of the window's spike trains are made,
+% either by jittering every spike or by shuffling the ISIs of each train,
+% and the AMD of each pair is calculated for every surrogate.  The
+% surrogates are generated inside the engine from a counter based random
+% number generator, so they never exist in MATLAB and the results only
+% depend on the seed and stream, not on the number of threads.
+%
+% When the trains were restricted to a set of intervals, pass them as
+% 'Intervals' so the surrogate spikes stay within them.  Every surrogate
+% spike stays in the interval of its original spike: jittered spikes are
+% reflected back into it, and the ISIs are shuffled within each interval.
+%
+% Input:
+% trains (cell) - The sorted spike timestamps of each neuron that fall
+%     within the window. (s)
+%
+% Options (key,value):
+% 'Intervals' (table|matrix) - Intervals the trains were restricted to,
+%     either a table with 'Start' and 'End' variables or an Nx2 [start end]
+%     matrix.  Default: [] (no intervals)
+% 'Method' (string) - 'jitter' to move every spike by a uniform amount of
+%     up to 'JitterWidth', or 'shuffle' to shuffle the ISIs of each train.
+%     Default: 'jitter'
+% 'JitterWidth' (scalar) - Largest amount a spike is moved by. (s)
+%     Default: 0.005
+% 'Surrogates' (scalar) - Number of surrogates K.  Default: 1000
+% 'Seed' (scalar) - Seed of the random numbers.  Default: 0
+% 'Stream' (scalar) - Random number stream, e.g. the index of the window,
+%     so that different windows get different surrogates with the same
+%     seed.  Default: 0
+%
+% Output:
+% pValues (matrix) - nNeurons x nNeurons one sided p-values of each AMD
+%     being smaller than chance, (1 + #{surrogate <= observed}) / (K + 1).
+%     The diagonal is NaN.
+% percentiles (matrix) - Percentile of each observed AMD within its
+%     surrogate AMDs.
+% amdMatrix (matrix) - The observed AMD matrix, as returned by windowamd.
+%
+% See Also: dynamical_inputs.nex.windowamd
+
+narginchk(1, Inf);
+
+p = inputParser;
+
+validator = @(x) validateattributes(x, {'cell'}, {});
+addRequired(p, 'trains', validator);
+
+validator = @(x) istable(x) || (isnumeric(x) && (isempty(x) || size(x, 2) == 2));
+addParameter(p, 'Intervals', [], validator);
+
+validator = @(x) any(validatestring(x, {'jitter' 'shuffle'}));
+addParameter(p, 'Method', 'jitter', validator);
+
+validator = @(x) validateattributes(x, {'numeric'}, {'scalar' 'nonempty' '>=' 0});
+addParameter(p, 'JitterWidth', 0.005, validator);
+
+validator = @(x) validateattributes(x, {'numeric'}, ...
+    {'scalar' 'nonempty' 'integer' '>=' 1});
+addParameter(p, 'Surrogates', 1000, validator);
+
+validator = @(x) validateattributes(x, {'numeric'}, ...
+    {'scalar' 'nonempty' 'integer' '>=' 0 '<' 2^32});
+addParameter(p, 'Seed', 0, validator);
+addParameter(p, 'Stream', 0, validator);
+
+parse(p, trains, varargin{:});
+
+method = validatestring(p.Results.Method, {'jitter' 'shuffle'});
+
+intervalTimes = p.Results.Intervals;
+if istable(intervalTimes)
+    intervalTimes = [intervalTimes.Start intervalTimes.End];
+elseif isempty(intervalTimes)
+    intervalTimes = [];
+end
+
+opcode = dynamical_inputs.nex.NexEngineOpcodes.SurrogateAMD;
+
+[pValues, percentiles, amdMatrix] = dynamical_inputs.nex.nexengine(opcode, ...
+    trains, double(intervalTimes), method, double(p.Results.Surrogates), ...
+    double(p.Results.JitterWidth), double(p.Results.Seed), double(p.Results.Stream));
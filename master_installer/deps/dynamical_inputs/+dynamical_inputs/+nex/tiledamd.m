@@ -0,0 +1,64 @@
+function [amdMatrix, stats, zScore, neighbors] = tiledamd(trains, varargin)
+% TILEDAMD  Calculates the AMD of a time window with a large number of neurons.
+%
+% Syntax:
+% [amdMatrix, stats, zScore] = TILEDAMD(trains)
+% [amdMatrix, stats, zScore, neighbors] = TILEDAMD(trains, 'TopK', k)
+% ___ = TILEDAMD(___, 'Precision', precision)
+%
+% Description:
+% Large window version of dynamical_inputs.nex.windowamd, meant for high
+% density recordings with hundreds to thousands of units.  The spike trains
+% are packed into a single buffer and the pair matrix is split into cache
+% sized tiles that are spread across the engine's thread pool.
+%
+% The results can be stored as single precision, which halves their size,
+% or only the k most significant neighbors of each neuron can be kept, in
+% which case the outputs are nNeurons x k rather than nNeurons x nNeurons.
+%
+% Input:
+% trains (cell) - The sorted spike timestamps of each neuron that fall
+%     within the window. (s)
+%
+% Options (key,value):
+% 'Precision' (string) - Class of the AMD and z-score outputs, either
+%     'double' or 'single'.  Calculations are always done in double.
+%     Default: 'double'
+% 'TopK' (scalar) - If non-zero, only the k neighbors with the largest
+%     z-score are kept for each neuron.  Default: 0
+%
+% Output:
+% amdMatrix (matrix) - nNeurons x nNeurons AMD matrix, as returned by
+%     windowamd.  With 'TopK', an nNeurons x k matrix where row i holds
+%     the AMD from neuron i to each of its neighbors.
+% stats (struct) - Neuron stats, as returned by windowamd.
+% zScore (matrix) - The z-scores matching amdMatrix.  With 'TopK', each
+%     row is sorted in decreasing order.
+% neighbors (matrix) - With 'TopK', the nNeurons x k matrix of neighbor
+%     indices into trains.  Rows with fewer than k valid neighbors are
+%     padded with 0 indices and NaN values.
+%
+% See Also: dynamical_inputs.nex.windowamd
+
+narginchk(1, Inf);
+
+p = inputParser;
+
+validator = @(x) validateattributes(x, {'cell'}, {});
+addRequired(p, 'trains', validator);
+
+validator = @(x) any(validatestring(x, {'double' 'single'}));
+addParameter(p, 'Precision', 'double', validator);
+
+validator = @(x) validateattributes(x, {'numeric'}, ...
+    {'scalar' 'nonempty' 'integer' '>=' 0});
+addParameter(p, 'TopK', 0, validator);
+
+parse(p, trains, varargin{:});
+
+precision = validatestring(p.Results.Precision, {'double' 'single'});
+
+opcode = dynamical_inputs.nex.NexEngineOpcodes.TiledWindowAMD;
+
+[amdMatrix, stats, zScore, neighbors] = dynamical_inputs.nex.nexengine(opcode, ...
+    trains, precision, double(p.Results.TopK));
@@ -0,0 +1,56 @@
+function [featureTable, pca] = waveformfeatures(nexFileName, index, varargin)
+% WAVEFORMFEATURES  Gets per spike features of a waveform variable.
+%
+% Syntax:
+% featureTable = WAVEFORMFEATURES(nexFileName, index)
+% [featureTable, pca] = WAVEFORMFEATURES(___, 'Components', k)
+%
+% Description:
+% Reads a waveform variable straight from the file in blocks, without
+% building a double matrix of the waveforms, and works out each spike's
+% peak, trough, trough to peak width, energy and its projection onto the
+% top k principal components of all the waveforms.  The covariance is
+% summed exactly in integers over the raw values across the engine's
+% threads, so the components are the same however many threads run.
+%
+% Input:
+% nexFileName (string) - The name of the NEX file to read.
+% index (integer) - Which waveform variable, counting only waveform
+%     variables in file order.
+%
+% Options:
+% Components (integer) - Number of principal components, at most the
+%     number of points per waveform. (default: 3)
+%
+% Output:
+% featureTable (table) - One row per spike with the variables Timestamp
+%     (s), Peak and Trough (largest and smallest value, mV), Width (time
+%     from the trough to the highest point after it, s), Energy (sum of
+%     squares, mV^2) and Scores (1 x k projections of the mean subtracted
+%     waveform, mV).
+% pca (struct) - Name of the variable, Mean waveform (mV), Components
+%     (nPoints x k, one unit vector per column) and Explained (variance
+%     along each component, mV^2).
+%
+% See Also: dynamical_inputs.nex.detectspikes
+
+narginchk(2, inf);
+
+validateattributes(index, {'numeric'}, {'scalar' 'integer' 'positive'}, mfilename, 'index', 2);
+
+p = inputParser;
+p.FunctionName = mfilename;
+addParameter(p, 'Components', 3, @(x) isscalar(x) && x >= 0 && x == round(x));
+parse(p, varargin{:});
+
+opcode = dynamical_inputs.nex.NexEngineOpcodes.WaveformFeatures;
+
+features = dynamical_inputs.nex.nexengine(opcode, char(nexFileName), double(index), ...
+    double(p.Results.Components));
+
+featureTable = table(features.timestamps, features.peak, features.trough, features.width, ...
+    features.energy, features.scores, 'VariableNames', ...
+    {'Timestamp' 'Peak' 'Trough' 'Width' 'Energy' 'Scores'});
+
+pca = struct('Name', features.name, 'Mean', features.mean, ...
+    'Components', features.components, 'Explained', features.explained);
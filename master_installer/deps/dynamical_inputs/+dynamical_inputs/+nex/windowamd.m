@@ -0,0 +1,48 @@
+function [amdMatrix, stats, zScore] = windowamd(trains)
+% WINDOWAMD  Calculates the AMD matrix and neuron stats for one time window.
+%
+% Syntax:
+% amdMatrix = WINDOWAMD(trains)
+% [amdMatrix, stats] = WINDOWAMD(trains)
+% [amdMatrix, stats, zScore] = WINDOWAMD(trains)
+%
+% Description:
+% Native version of the per window AMD calculations done in
+% dynamical.math.amd.  Every neuron pair is processed once: the two spike
+% trains are merged in a single pass that gives the nearest neighbour
+% distances in both directions.  The pairs are split across the engine's
+% thread pool.  If requested, the z-scores are calculated alongside the
+% AMD of each pair and written straight into their own matrix.
+%
+% Input:
+% trains (cell) - The sorted spike timestamps of each neuron that fall
+%     within the window. (s)
+%
+% Output:
+% amdMatrix (matrix) - nNeurons x nNeurons matrix where amdMatrix(i,j) is
+%     the average minimum distance from the spikes of neuron i to the
+%     spikes of neuron j.  The diagonal is zero.
+% stats (struct) - Struct with the fields:
+%     * nSpikes (vector) - Number of spikes of each neuron.
+%     * ISImean (vector) - ISI mean of each neuron.
+%     * ISIstd (vector) - ISI standard deviation of each neuron.
+%     * Poisson (vector) - Poisson expectation of each neuron.
+%     * TimeMin (scalar) - Smallest spike time in the window. (s)
+%     * TimeMax (scalar) - Largest spike time in the window. (s)
+%     * TimeDiff (scalar) - TimeMax - TimeMin. (s)
+% zScore (matrix) - nNeurons x nNeurons matrix where zScore(i,j) is the
+%     z-score of amdMatrix(i,j) against the ISI distribution of neuron j.
+
+narginchk(1, 1);
+
+validateattributes(trains, {'cell'}, {}, mfilename, 'trains', 1);
+
+opcode = dynamical_inputs.nex.NexEngineOpcodes.WindowAMD;
+
+if nargout > 2
+    [amdMatrix, stats, zScore] = dynamical_inputs.nex.nexengine(opcode, trains);
+elseif nargout > 1
+    [amdMatrix, stats] = dynamical_inputs.nex.nexengine(opcode, trains);
+else
+    amdMatrix = dynamical_inputs.nex.nexengine(opcode, trains);
+end
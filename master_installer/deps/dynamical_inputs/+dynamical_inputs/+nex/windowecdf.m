@@ -0,0 +1,59 @@
+function [F, X, nIgnored, errorBound] = windowecdf(matrices, varargin)
+% WINDOWECDF  Calculates the empirical CDF of the off diagonal values of a
+% set of window matrices.
+%
+% Syntax:
+% [F, X] = WINDOWECDF(matrices)
+% [F, X, nIgnored, errorBound] = WINDOWECDF(___)
+% [___] = WINDOWECDF(___, 'Epsilon', epsilon)
+%
+% Description:
+% Native version of flattening the off diagonal values of every matrix and
+% passing them to the 'ecdf' function.  The matrices are read in place,
+% with the diagonals skipped, straight into one buffer that is radix sorted
+% across the engine's thread pool.
+%
+% For very large sets of windows, a non-zero 'Epsilon' swaps the sort for a
+% mergeable quantile sketch that only keeps a small summary of the values.
+% The CDF is then approximate, but is guaranteed to be within errorBound
+% of the exact CDF at every point.
+%
+% Input:
+% matrices (cell) - Square matrix of each window, e.g. the AMD or ZScore
+%     tables of an AMDWindow array as numeric matrices.
+%
+% Options (key,value):
+% 'Epsilon' (scalar) - Target error of the approximate CDF, as a fraction
+%     of the number of values.  Set to 0 for the exact CDF.  An epsilon
+%     below about log2(n)/n keeps every value and is exact as well.
+%     Default: 0
+%
+% Output:
+% F (array) - The ECDF evaluated at the points in X.
+% X (array) - Smallest value, followed by the distinct values, in the same
+%     layout as returned by 'ecdf'.
+% nIgnored (scalar) - Number of NaN values left out.
+% errorBound (scalar) - Largest possible difference between F and the
+%     exact ECDF.  Always 0 for the exact CDF.
+%
+% See Also: dynamical.math.amdcdf, ecdf
+
+narginchk(1, Inf);
+
+p = inputParser;
+
+validator = @(x) validateattributes(x, {'cell'}, {});
+addRequired(p, 'matrices', validator);
+
+validator = @(x) validateattributes(x, {'numeric'}, ...
+    {'scalar' 'nonempty' 'real' '>=' 0 '<' 1});
+addParameter(p, 'Epsilon', 0, validator);
+
+parse(p, matrices, varargin{:});
+
+matrices = cellfun(@double, matrices, 'UniformOutput', false);
+
+opcode = dynamical_inputs.nex.NexEngineOpcodes.WindowECDF;
+
+[F, X, nIgnored, errorBound] = dynamical_inputs.nex.nexengine(opcode, ...
+    matrices, double(p.Results.Epsilon));
@@ -0,0 +1,44 @@
+function [stabilityValues, globalIDs] = windowstability(zScores, cellIDs, method)
+% WINDOWSTABILITY  Calculates the stability between AMD windows.
+%
+% Syntax:
+% stabilityValues = WINDOWSTABILITY(zScores, cellIDs, method)
+% [stabilityValues, globalIDs] = WINDOWSTABILITY(___)
+%
+% Description:
+% Native version of the window comparisons done in dynamical.math.stability.
+% The cell IDs of all windows are mapped into one global neuron index
+% space up front, after which each pair of windows is compared by walking
+% only the z-scores of the neurons they share.  The similarity is the
+% same cosine of the off diagonal z-scores calculated by
+% dynamical.math.similarity.  In 'all' mode the window pairs are split
+% into blocks that are balanced across the engine's thread pool.
+%
+% Input:
+% zScores (cell) - Square z-score matrix of each window, i.e. the ZScore
+%     tables of an AMDWindow array as numeric matrices.
+% cellIDs (cell) - The cell IDs of the rows of each z-score matrix.
+% method (string) - 'neighbor' to compare each window with the next one,
+%     or 'all' to compare every pair of windows.
+%
+% Output:
+% stabilityValues (matrix) - For 'neighbor', a 1 x (nWindows-1) vector.
+%     For 'all', a symmetric nWindows x nWindows matrix with a zero
+%     diagonal.
+% globalIDs (vector) - Sorted list of all the cell IDs found.
+%
+% See Also: dynamical.math.stability, dynamical.math.similarity
+
+narginchk(3, 3);
+
+validateattributes(zScores, {'cell'}, {}, mfilename, 'zScores', 1);
+validateattributes(cellIDs, {'cell'}, {'numel', numel(zScores)}, mfilename, 'cellIDs', 2);
+method = validatestring(method, {'neighbor' 'all'}, mfilename, 'method', 3);
+
+zScores = cellfun(@double, zScores, 'UniformOutput', false);
+cellIDs = cellfun(@double, cellIDs, 'UniformOutput', false);
+
+opcode = dynamical_inputs.nex.NexEngineOpcodes.WindowStability;
+
+[stabilityValues, globalIDs] = dynamical_inputs.nex.nexengine(opcode, ...
+    zScores, cellIDs, method);
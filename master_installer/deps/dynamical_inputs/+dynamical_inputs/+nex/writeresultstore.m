@@ -0,0 +1,41 @@
+function writeresultstore(fileName, neuronNames, cellIDs, windowInfo, neurons, stats, matrices, precision)
+% WRITERESULTSTORE  Writes AMD window results to a compact binary file.
+%
+% Syntax:
+% WRITERESULTSTORE(fileName, neuronNames, cellIDs, windowInfo, neurons, stats, matrices, precision)
+%
+% Description:
+% Writes the low level form of a set of AMD windows: a dictionary of all
+% the neurons, and for each window the dictionary indices of its neurons,
+% their stats and its matrices.  Names are stored once in the dictionary
+% rather than as the row and variable names of every window's tables, and
+% an index at the end of the file lets dynamical_inputs.nex.ResultStore
+% read any window without reading the others.
+% dynamical.math.AMDWindow.saveresults puts an AMDWindow array in this
+% form.
+%
+% Input:
+% fileName (string) - File to write, normally with a .amdr extension.
+% neuronNames (cell) - Name of each dictionary neuron.
+% cellIDs (vector) - Cell ID of each dictionary neuron.
+% windowInfo (matrix) - nWindows x 6 [WindowStart WindowEnd TimeMin
+%     TimeMax TimeDiff MinSpikeCount] of each window.
+% neurons (cell) - Dictionary indices of each window's neurons.
+% stats (cell) - nNeurons x 4 [nSpikes ISImean ISIstd Poisson] of each
+%     window.
+% matrices (cell) - nWindows x 4 cell of each window's AMD, ZScore, PValue
+%     and Percentile matrices, empty for those it doesn't have.
+% precision (string) - 'single' or 'double' storage for the matrices.
+%
+% See Also: dynamical_inputs.nex.ResultStore,
+%     dynamical.math.AMDWindow.saveresults
+
+narginchk(8, 8);
+
+precision = validatestring(precision, {'single' 'double'}, mfilename, 'precision', 8);
+valueBytes = 4 * (1 + strcmp(precision, 'double'));
+
+opcode = dynamical_inputs.nex.NexEngineOpcodes.ResultStoreWrite;
+
+dynamical_inputs.nex.nexengine(opcode, char(fileName), valueBytes, cellstr(neuronNames), ...
+    double(cellIDs(:)), double(windowInfo), neurons, stats, matrices);